@@ -27,6 +27,7 @@
 #include "netid.c"
 #include "nodeid.c"
 #include "dh.c"
+#include "resume.c"
 
 
 // Auth state definitions.
@@ -44,6 +45,23 @@
 #define auth_S5a 11
 
 
+// Resumption state definitions.
+#define auth_R0a 12
+#define auth_R0b 13
+#define auth_R1a 14
+#define auth_R1b 15
+#define auth_R2a 16
+
+
+// Fast handshake state definitions.
+#define auth_F0a 17
+#define auth_F0b 18
+#define auth_F1a 19
+#define auth_F1b 20
+#define auth_F2a 21
+#define auth_F2b 22
+
+
 // Size of HMAC tag.
 #define auth_HMACSIZE 32
 
@@ -62,12 +80,24 @@
 #define auth_NONCESIZE 32
 
 
+// Size of identity and connection parameter blocks.
+#define auth_IDENTITYSIZE (2 + nodekey_MAXSIZE + 2 + nodekey_MAXSIZE + auth_HMACSIZE)
+#define auth_PARAMSSIZE (auth_NONCESIZE + seq_SIZE + 4 + 8)
+
+
 // Maximum size of auth messages in bytes.
 #define auth_MAXMSGSIZE_S0 (4 + 2 + 8 + 4 + 4 + netid_SIZE)
 #define auth_MAXMSGSIZE_S1 (4 + 2 + 8 + 4 + auth_NONCESIZE + 2 + dh_MAXSIZE)
 #define auth_MAXMSGSIZE_S2 (4 + 2 + 2 + nodekey_MAXSIZE + 2 + nodekey_MAXSIZE + auth_HMACSIZE + auth_IDPIVSIZE + auth_IDPHMACSIZE + crypto_MAXIVSIZE)
 #define auth_MAXMSGSIZE_S3 (4 + 2 + auth_NONCESIZE + seq_SIZE + 4 + 8 + auth_CNEGIVSIZE + auth_CNEGHMACSIZE + crypto_MAXIVSIZE)
 #define auth_MAXMSGSIZE_S4 (4 + 2 + auth_NONCESIZE + auth_CNEGHMACSIZE)
+#define auth_MAXMSGSIZE_R1 (4 + 2 + resume_IDSIZE + 4 + auth_NONCESIZE + auth_HMACSIZE)
+#define auth_MAXMSGSIZE_R2 (4 + 2 + auth_NONCESIZE + 4 + 4 + seq_SIZE + 8 + auth_CNEGIVSIZE + auth_CNEGHMACSIZE + crypto_MAXIVSIZE)
+#define auth_MAXMSGSIZE_R3 (4 + 2 + 4 + seq_SIZE + 8 + auth_CNEGIVSIZE + auth_CNEGHMACSIZE + crypto_MAXIVSIZE)
+#define auth_MAXMSGSIZE_F1 (4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE + 2 + dh_MAXSIZE)
+#define auth_MAXMSGSIZE_F2 960 // nodes whose keys don't fit use the full handshake
+#define auth_MAXMSGSIZE_F3 960 // nodes whose keys don't fit use the full handshake
+#define auth_MAXMSGSIZE_F4 (4 + 2 + auth_PARAMSSIZE + auth_CNEGIVSIZE + auth_CNEGHMACSIZE + crypto_MAXIVSIZE)
 
 
 // Size of signature input buffer
@@ -80,7 +110,8 @@
 #define auth_CRYPTOCTX_CNEG 2
 #define auth_CRYPTOCTX_SESSION_A 3
 #define auth_CRYPTOCTX_SESSION_B 4
-#define auth_CRYPTOCTX_COUNT 5
+#define auth_CRYPTOCTX_RESUME 5
+#define auth_CRYPTOCTX_COUNT 6
 
 
 // Constraints.
@@ -105,6 +136,34 @@
 #undef auth_MAXMSGSIZE
 #define auth_MAXMSGSIZE auth_MAXMSGSIZE_S4
 #endif
+#if auth_MAXMSGSIZE < auth_MAXMSGSIZE_R1
+#undef auth_MAXMSGSIZE
+#define auth_MAXMSGSIZE auth_MAXMSGSIZE_R1
+#endif
+#if auth_MAXMSGSIZE < auth_MAXMSGSIZE_R2
+#undef auth_MAXMSGSIZE
+#define auth_MAXMSGSIZE auth_MAXMSGSIZE_R2
+#endif
+#if auth_MAXMSGSIZE < auth_MAXMSGSIZE_R3
+#undef auth_MAXMSGSIZE
+#define auth_MAXMSGSIZE auth_MAXMSGSIZE_R3
+#endif
+#if auth_MAXMSGSIZE < auth_MAXMSGSIZE_F1
+#undef auth_MAXMSGSIZE
+#define auth_MAXMSGSIZE auth_MAXMSGSIZE_F1
+#endif
+#if auth_MAXMSGSIZE < auth_MAXMSGSIZE_F2
+#undef auth_MAXMSGSIZE
+#define auth_MAXMSGSIZE auth_MAXMSGSIZE_F2
+#endif
+#if auth_MAXMSGSIZE < auth_MAXMSGSIZE_F3
+#undef auth_MAXMSGSIZE
+#define auth_MAXMSGSIZE auth_MAXMSGSIZE_F3
+#endif
+#if auth_MAXMSGSIZE < auth_MAXMSGSIZE_F4
+#undef auth_MAXMSGSIZE
+#define auth_MAXMSGSIZE auth_MAXMSGSIZE_F4
+#endif
 #if auth_MAXMSGSIZE > 960
 #error auth_MAXMSGSIZE too big
 #endif
@@ -129,9 +188,16 @@ struct s_auth_state {
 	unsigned char local_nonce[auth_NONCESIZE];
 	unsigned char remote_nonce[auth_NONCESIZE];
 	unsigned char remote_dhkey[dh_MAXSIZE];
+	unsigned char local_dhkey[dh_MAXSIZE];
+	int local_dhkey_size;
+	int dhkey;
 	unsigned char nextmsg[auth_MAXMSGSIZE];
 	unsigned char local_sesstoken[4];
 	unsigned char remote_sesstoken[4];
+	unsigned char resume_ticketid[resume_IDSIZE];
+	unsigned char resume_secret[resume_SECRETSIZE];
+	int attempt_sent;
+	int fastmode;
 	int local_peerid;
 	int remote_peerid;
 	struct s_nodekey *local_nodekey;
@@ -139,9 +205,28 @@ struct s_auth_state {
 	struct s_crypto crypto_ctx[auth_CRYPTOCTX_COUNT];
 	struct s_dh_state *dhstate;
 	struct s_netid *netid;
+	struct s_resume *resume;
 };
 
 
+// Get an ephemeral DH key for this auth session. The key exchange is deferred if the DH key pool is empty.
+static void authAcquireDHKey(struct s_auth_state *authstate) {
+	if(authstate->local_dhkey_size == 0) {
+		authstate->dhkey = dhAcquireKey(authstate->dhstate);
+		if(!(authstate->dhkey < 0)) authstate->local_dhkey_size = dhGetPubkey(authstate->local_dhkey, dh_MAXSIZE, authstate->dhstate, authstate->dhkey);
+	}
+}
+
+
+// Give the ephemeral DH key back. The public key stays available for signatures.
+static void authReleaseDHKey(struct s_auth_state *authstate) {
+	if(!(authstate->dhkey < 0)) {
+		dhReleaseKey(authstate->dhstate, authstate->dhkey);
+		authstate->dhkey = -1;
+	}
+}
+
+
 // Prepare signature input buffer for remote sig(authid, msgnum, remote_nonce, local_nonce, local_dhkey, remote_dhkey).
 static int authGenRemoteSigIn(struct s_auth_state *authstate, unsigned char *siginbuf, const unsigned char *msgnum) {
 	int dhsize;
@@ -150,7 +235,8 @@ static int authGenRemoteSigIn(struct s_auth_state *authstate, unsigned char *sig
 	memcpy(&siginbuf[4], msgnum, 2);
 	memcpy(&siginbuf[(4 + 2)], authstate->local_nonce, auth_NONCESIZE);
 	memcpy(&siginbuf[(4 + 2 + auth_NONCESIZE)], authstate->remote_nonce, auth_NONCESIZE);
-	dhsize = dhGetPubkey(&siginbuf[(4 + 2 + auth_NONCESIZE + auth_NONCESIZE)], dh_MAXSIZE, authstate->dhstate);
+	dhsize = authstate->local_dhkey_size;
+	memcpy(&siginbuf[(4 + 2 + auth_NONCESIZE + auth_NONCESIZE)], authstate->local_dhkey, dhsize);
 	memcpy(&siginbuf[(4 + 2 + auth_NONCESIZE + auth_NONCESIZE + dhsize)], authstate->remote_dhkey, authstate->remote_dhkey_size);
 	ret = (4 + 2 + auth_NONCESIZE + auth_NONCESIZE + dhsize + authstate->remote_dhkey_size);
 	return ret;
@@ -166,7 +252,8 @@ static int authGenSigIn(struct s_auth_state *authstate, unsigned char *siginbuf,
 	memcpy(&siginbuf[(4 + 2)], authstate->remote_nonce, auth_NONCESIZE);
 	memcpy(&siginbuf[(4 + 2 + auth_NONCESIZE)], authstate->local_nonce, auth_NONCESIZE);
 	memcpy(&siginbuf[(4 + 2 + auth_NONCESIZE + auth_NONCESIZE)], authstate->remote_dhkey, authstate->remote_dhkey_size);
-	dhsize = dhGetPubkey(&siginbuf[(4 + 2 + auth_NONCESIZE + auth_NONCESIZE + authstate->remote_dhkey_size)], dh_MAXSIZE, authstate->dhstate);
+	dhsize = authstate->local_dhkey_size;
+	memcpy(&siginbuf[(4 + 2 + auth_NONCESIZE + auth_NONCESIZE + authstate->remote_dhkey_size)], authstate->local_dhkey, dhsize);
 	ret = (4 + 2 + auth_NONCESIZE + auth_NONCESIZE + authstate->remote_dhkey_size + dhsize);
 	return ret;
 }
@@ -196,7 +283,7 @@ static int authDecodeS0(struct s_auth_state *authstate, const unsigned char *msg
 	unsigned char checksum[8];
 	if(msg_len >= (4 + 2 + 8 + 4 + 4 + netid_SIZE)) {
 		msgnum = utilReadInt16(&msg[4]);
-		if(msgnum == (authstate->state + 1)) {
+		if((msgnum == (authstate->state + 1)) || ((authstate->state == auth_F0a) && (msgnum == auth_S0b))) { // F1 may be answered with S0
 			if(cryptoCalculateSHA256(checksum, 8, &msg[(4 + 2 + 8)], (4 + 4 + netid_SIZE))) {
 				if(memcmp(checksum, &msg[(4 + 2)], 8) == 0) {
 					if(memcmp(authstate->netid->id, &msg[(4 + 2 + 8 + 4 + 4)], netid_SIZE) == 0) {
@@ -217,11 +304,13 @@ static void authGenS1(struct s_auth_state *authstate) {
 	// generate msg(remote_authid, msgnum, checksum, sesstoken, nonce, dhkey_len, dhkey)
 	int msgnum = authstate->state;
 	int dhsize;
+	authAcquireDHKey(authstate);
 	memcpy(authstate->nextmsg, authstate->remote_authid, 4);
 	utilWriteInt16(&authstate->nextmsg[4], msgnum);
 	memcpy(&authstate->nextmsg[(4 + 2 + 8)], &authstate->remote_sesstoken, 4);
 	memcpy(&authstate->nextmsg[(4 + 2 + 8 + 4)], authstate->local_nonce, auth_NONCESIZE);
-	dhsize = dhGetPubkey(&authstate->nextmsg[(4 + 2 + 8 + 4 + auth_NONCESIZE + 2)], dh_MAXSIZE, authstate->dhstate);
+	dhsize = authstate->local_dhkey_size;
+	memcpy(&authstate->nextmsg[(4 + 2 + 8 + 4 + auth_NONCESIZE + 2)], authstate->local_dhkey, dhsize);
 	if(dhsize > dh_MINSIZE && dhsize <= dh_MAXSIZE) {
 		utilWriteInt16(&authstate->nextmsg[(4 + 2 + 8 + 4 + auth_NONCESIZE)], dhsize);
 		if(cryptoCalculateSHA256(&authstate->nextmsg[(4 + 2)], 8, &authstate->nextmsg[(4 + 2 + 8)], (4 + auth_NONCESIZE + 2 + dhsize))) {
@@ -246,7 +335,8 @@ static int authDecodeS1(struct s_auth_state *authstate, const unsigned char *msg
 	if(msg_len > (4 + 2 + 8 + 4 + auth_NONCESIZE + 2)) {
 		msgnum = utilReadInt16(&msg[4]);
 		if(msgnum == (authstate->state + 1)) {
-			if(memcmp(authstate->local_sesstoken, &msg[(4 + 2 + 8)], 4) == 0) {
+			authAcquireDHKey(authstate);
+			if((!(authstate->dhkey < 0)) && (memcmp(authstate->local_sesstoken, &msg[(4 + 2 + 8)], 4) == 0)) {
 				dhsize = utilReadInt16(&msg[(4 + 2 + 8 + 4 + auth_NONCESIZE)]);
 				if((dhsize > dh_MINSIZE) && (dhsize <= dh_MAXSIZE) && (msg_len >= (4 + 2 + 8 + 4 + auth_NONCESIZE + 2 + dhsize))) {
 					if(cryptoCalculateSHA256(checksum, 8, &msg[(4 + 2 + 8)], (4 + auth_NONCESIZE + 2 + dhsize))) {
@@ -263,7 +353,8 @@ static int authDecodeS1(struct s_auth_state *authstate, const unsigned char *msg
 									memcpy(&shared_nonce[0], authstate->local_nonce, auth_NONCESIZE);
 									memcpy(&shared_nonce[auth_NONCESIZE], &msg[(4 + 2 + 8 + 4)], auth_NONCESIZE);
 								}
-								if(dhGenCryptoKeys(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT, authstate->dhstate, &msg[(4 + 2 + 8 + 4 + auth_NONCESIZE + 2)], dhsize, shared_nonce, (auth_NONCESIZE + auth_NONCESIZE))) {
+								if(dhGenCryptoKeys(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT, authstate->dhstate, authstate->dhkey, &msg[(4 + 2 + 8 + 4 + auth_NONCESIZE + 2)], dhsize, shared_nonce, (auth_NONCESIZE + auth_NONCESIZE))) {
+									authReleaseDHKey(authstate); // the shared secret is known now, the key can be refreshed
 									return 1;
 								}
 							}
@@ -277,45 +368,121 @@ static int authDecodeS1(struct s_auth_state *authstate, const unsigned char *msg
 }
 
 
-// Generate auth message S2
-static void authGenS2(struct s_auth_state *authstate) {
-	// generate msg(remote_authid, msgnum, enc(pubkey_len, pubkey, sig_len, sig(authid, msgnum, local_nonce, remote_nonce, remote_dhkey, local_dhkey), hmac(pubkey)))
-	unsigned char unencrypted_nextmsg[auth_MAXMSGSIZE_S2];
-	int unencrypted_nextmsg_size;
-	int msgnum = authstate->state;
+// Get size of the local identity block.
+static int authGetIdentitySize(struct s_auth_state *authstate) {
+	struct s_rsa *rsakey = &authstate->local_nodekey->key;
+	return (2 + rsaGetDERSize(rsakey) + 2 + rsaSignSize(rsakey) + auth_HMACSIZE);
+}
+
+
+// Generate identity block. Returns size of the block if successful.
+static int authGenIdentity(struct s_auth_state *authstate, unsigned char *buf, const int buf_size, const unsigned char *msgnum) {
+	// generate block(pubkey_len, pubkey, sig_len, sig(authid, msgnum, local_nonce, remote_nonce, remote_dhkey, local_dhkey), hmac(pubkey))
 	unsigned char siginbuf[auth_SIGINBUFSIZE];
 	struct s_nodekey *local_nodekey;
 	struct s_rsa *rsakey;
 	int siginbuf_size;
 	int nksize;
 	int signsize;
-	int encsize;
-	memcpy(unencrypted_nextmsg, authstate->remote_authid, 4);
-	utilWriteInt16(&unencrypted_nextmsg[4], msgnum);
-	memcpy(authstate->nextmsg, unencrypted_nextmsg, 6);
-	siginbuf_size = authGenSigIn(authstate, siginbuf, &unencrypted_nextmsg[4]);
-	local_nodekey = authstate->local_nodekey;
-	nksize = nodekeyGetDER(&unencrypted_nextmsg[(4 + 2 + 2)], nodekey_MAXSIZE, local_nodekey);
-	if(nksize > nodekey_MINSIZE) {
-		utilWriteInt16(&unencrypted_nextmsg[(4 + 2)], nksize);
-		rsakey = &local_nodekey->key;
-		signsize = rsaSign(rsakey, &unencrypted_nextmsg[(4 + 2 + 2 + nksize + 2)], nodekey_MAXSIZE, siginbuf, siginbuf_size);
-		if(signsize > 0) {
-			utilWriteInt16(&unencrypted_nextmsg[(4 + 2 + 2 + nksize)], signsize);
-			if(cryptoHMAC(&authstate->crypto_ctx[auth_CRYPTOCTX_AUTH], &unencrypted_nextmsg[(4 + 2 + 2 + nksize + 2 + signsize)], auth_HMACSIZE, &unencrypted_nextmsg[(4 + 2 + 2)], nksize)) {
-				unencrypted_nextmsg_size = (4 + 2 + 2 + nksize + 2 + signsize + auth_HMACSIZE);
-				encsize = cryptoEnc(&authstate->crypto_ctx[auth_CRYPTOCTX_IDP], &authstate->nextmsg[(4 + 2)], (auth_MAXMSGSIZE - 2 - 4), &unencrypted_nextmsg[(2 + 4)], (unencrypted_nextmsg_size - 2 - 4), auth_IDPHMACSIZE, auth_IDPIVSIZE);
-				if(encsize > 0) {
-					authstate->nextmsg_size = (encsize + 4 + 2);
-				}
-				else {
-					authstate->nextmsg_size = 0;
+	if(buf_size >= auth_IDENTITYSIZE) {
+		siginbuf_size = authGenSigIn(authstate, siginbuf, msgnum);
+		local_nodekey = authstate->local_nodekey;
+		nksize = nodekeyGetDER(&buf[2], nodekey_MAXSIZE, local_nodekey);
+		if(nksize > nodekey_MINSIZE) {
+			utilWriteInt16(buf, nksize);
+			rsakey = &local_nodekey->key;
+			signsize = rsaSign(rsakey, &buf[(2 + nksize + 2)], nodekey_MAXSIZE, siginbuf, siginbuf_size);
+			if(signsize > 0) {
+				utilWriteInt16(&buf[(2 + nksize)], signsize);
+				if(cryptoHMAC(&authstate->crypto_ctx[auth_CRYPTOCTX_AUTH], &buf[(2 + nksize + 2 + signsize)], auth_HMACSIZE, &buf[2], nksize)) {
+					return (2 + nksize + 2 + signsize + auth_HMACSIZE);
 				}
 			}
-			else {
-				authstate->nextmsg_size = 0;
+		}
+	}
+	return 0;
+}
+
+
+// Decode identity block. Returns size of the block if the remote public key and signature are valid.
+static int authDecodeIdentity(struct s_auth_state *authstate, const unsigned char *buf, const int buf_len, const unsigned char *msgnum) {
+	int nksize;
+	int signsize;
+	unsigned char hmac[auth_HMACSIZE];
+	unsigned char siginbuf[auth_SIGINBUFSIZE];
+	int siginbuf_size;
+	if(buf_len > 4) {
+		nksize = utilReadInt16(buf);
+		if((nksize > nodekey_MINSIZE) && (nksize <= nodekey_MAXSIZE) && (buf_len > (4 + nksize))) {
+			signsize = utilReadInt16(&buf[(2 + nksize)]);
+			if((signsize > 0) && (buf_len >= (4 + nksize + signsize + auth_HMACSIZE))) { // check block length
+				if(cryptoHMAC(&authstate->crypto_ctx[auth_CRYPTOCTX_AUTH], hmac, auth_HMACSIZE, &buf[2], nksize)) { // generate HMAC tag
+					if(memcmp(&buf[(4 + nksize + signsize)], hmac, auth_HMACSIZE) == 0) { // verify HMAC tag
+						if(nodekeyLoadDER(&authstate->remote_nodekey, &buf[2], nksize)) { // load remote public key
+							if(memcmp(authstate->remote_nodekey.nodeid.id, authstate->local_nodekey->nodeid.id, nodeid_SIZE) != 0) { // check if remote public key is different from local public key
+								siginbuf_size = authGenRemoteSigIn(authstate, siginbuf, msgnum);
+								if(rsaVerify(&authstate->remote_nodekey.key, &buf[(4 + nksize)], signsize, siginbuf, siginbuf_size)) { // verify signature
+									return (4 + nksize + signsize + auth_HMACSIZE);
+								}
+							}
+						}
+					}
+				}
 			}
 		}
+	}
+	return 0;
+}
+
+
+// Generate connection parameter block. Returns size of the block.
+static int authGenParams(struct s_auth_state *authstate, unsigned char *buf) {
+	// generate block(keygen_nonce, local_seq, local_peerid, local_flags)
+	memcpy(buf, authstate->local_keygen_nonce, auth_NONCESIZE);
+	memcpy(&buf[auth_NONCESIZE], authstate->local_seq, seq_SIZE);
+	utilWriteInt32(&buf[(auth_NONCESIZE + seq_SIZE)], authstate->local_peerid);
+	memcpy(&buf[(auth_NONCESIZE + seq_SIZE + 4)], authstate->local_flags, 8);
+	return auth_PARAMSSIZE;
+}
+
+
+// Decode connection parameter block.
+static void authDecodeParams(struct s_auth_state *authstate, const unsigned char *buf) {
+	memcpy(authstate->remote_keygen_nonce, buf, auth_NONCESIZE);
+	memcpy(authstate->remote_seq, &buf[auth_NONCESIZE], seq_SIZE);
+	authstate->remote_peerid = utilReadInt32(&buf[(auth_NONCESIZE + seq_SIZE)]);
+	memcpy(authstate->remote_flags, &buf[(auth_NONCESIZE + seq_SIZE + 4)], 8);
+}
+
+
+// Combine local and remote keygen nonces. The nonce of the initiating side comes first.
+static void authGenKeygenNonce(struct s_auth_state *authstate, const int initiator) {
+	if(initiator) {
+		memcpy(&authstate->keygen_nonce[0], authstate->local_keygen_nonce, auth_NONCESIZE);
+		memcpy(&authstate->keygen_nonce[auth_NONCESIZE], authstate->remote_keygen_nonce, auth_NONCESIZE);
+	}
+	else {
+		memcpy(&authstate->keygen_nonce[0], authstate->remote_keygen_nonce, auth_NONCESIZE);
+		memcpy(&authstate->keygen_nonce[auth_NONCESIZE], authstate->local_keygen_nonce, auth_NONCESIZE);
+	}
+}
+
+
+// Generate auth message S2
+static void authGenS2(struct s_auth_state *authstate) {
+	// generate msg(remote_authid, msgnum, enc(pubkey_len, pubkey, sig_len, sig(authid, msgnum, local_nonce, remote_nonce, remote_dhkey, local_dhkey), hmac(pubkey)))
+	unsigned char identity[auth_IDENTITYSIZE];
+	int identity_size;
+	int msgnum = authstate->state;
+	int encsize;
+	memcpy(authstate->nextmsg, authstate->remote_authid, 4);
+	utilWriteInt16(&authstate->nextmsg[4], msgnum);
+	identity_size = authGenIdentity(authstate, identity, auth_IDENTITYSIZE, &authstate->nextmsg[4]);
+	if(identity_size > 0) {
+		encsize = cryptoEnc(&authstate->crypto_ctx[auth_CRYPTOCTX_IDP], &authstate->nextmsg[(4 + 2)], (auth_MAXMSGSIZE - 2 - 4), identity, identity_size, auth_IDPHMACSIZE, auth_IDPIVSIZE);
+		if(encsize > 0) {
+			authstate->nextmsg_size = (encsize + 4 + 2);
+		}
 		else {
 			authstate->nextmsg_size = 0;
 		}
@@ -329,37 +496,14 @@ static void authGenS2(struct s_auth_state *authstate) {
 // Decode auth message S2
 static int authDecodeS2(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
 	int msgnum;
-	int nksize;
-	int signsize;
 	int decmsg_len;
-	unsigned char hmac[auth_HMACSIZE];
-	unsigned char siginbuf[auth_SIGINBUFSIZE];
 	unsigned char decmsg[auth_MAXMSGSIZE_S2];
-	int siginbuf_size;
 	if(msg_len > 10) {
-		memcpy(decmsg, msg, 6);
-		msgnum = utilReadInt16(&decmsg[4]);
+		msgnum = utilReadInt16(&msg[4]);
 		if(msgnum == (authstate->state + 1)) {
-			decmsg_len = (4 + 2 + cryptoDec(&authstate->crypto_ctx[auth_CRYPTOCTX_IDP], &decmsg[(4 + 2)], (auth_MAXMSGSIZE_S2 - 2 - 4), &msg[(4 + 2)], (msg_len - 2 - 4), auth_IDPHMACSIZE, auth_IDPIVSIZE)); // decrypt IDP layer
-			if(decmsg_len > 10) {
-				nksize = utilReadInt16(&decmsg[(4 + 2)]);
-				if((nksize > nodekey_MINSIZE) && (nksize <= nodekey_MAXSIZE) && (decmsg_len > (10 + nksize))) {
-					signsize = utilReadInt16(&decmsg[(4 + 4 + nksize)]);
-					if((signsize > 0) && (decmsg_len >= (10 + nksize + signsize + auth_HMACSIZE))) { // check message length
-						if(cryptoHMAC(&authstate->crypto_ctx[auth_CRYPTOCTX_AUTH], hmac, auth_HMACSIZE, &decmsg[(4 + 4)], nksize)) { // generate HMAC tag
-							if(memcmp(&decmsg[(10 + nksize + signsize)], hmac, auth_HMACSIZE) == 0) { // verify HMAC tag
-								if(nodekeyLoadDER(&authstate->remote_nodekey, &decmsg[(4 + 4)], nksize)) { // load remote public key
-									if(memcmp(authstate->remote_nodekey.nodeid.id, authstate->local_nodekey->nodeid.id, nodeid_SIZE) != 0) { // check if remote public key is different from local public key
-										siginbuf_size = authGenRemoteSigIn(authstate, siginbuf, &decmsg[4]);
-										if(rsaVerify(&authstate->remote_nodekey.key, &decmsg[(10 + nksize)], signsize, siginbuf, siginbuf_size)) { // verify signature
-											return 1;
-										}
-									}
-								}
-							}
-						}
-					}
-				}
+			decmsg_len = cryptoDec(&authstate->crypto_ctx[auth_CRYPTOCTX_IDP], decmsg, auth_MAXMSGSIZE_S2, &msg[(4 + 2)], (msg_len - 2 - 4), auth_IDPHMACSIZE, auth_IDPIVSIZE); // decrypt IDP layer
+			if(authDecodeIdentity(authstate, decmsg, decmsg_len, &msg[4]) > 0) {
+				return 1;
 			}
 		}
 	}
@@ -371,17 +515,14 @@ static int authDecodeS2(struct s_auth_state *authstate, const unsigned char *msg
 static void authGenS3(struct s_auth_state *authstate) {
 	// generate msg(remote_authid, msgnum, enc(keygen_nonce, local_seq, local_peerid, local_flags))
 	unsigned char unencrypted_nextmsg[auth_MAXMSGSIZE_S3];
-	int unencrypted_nextmsg_size = (4 + 2 + auth_NONCESIZE + seq_SIZE + 4 + 8);
+	int unencrypted_nextmsg_size = (4 + 2 + auth_PARAMSSIZE);
 	int msgnum = authstate->state;
 	int encsize;
 	if(authstate->local_cneg_set) {
 		memcpy(unencrypted_nextmsg, authstate->remote_authid, 4);
 		utilWriteInt16(&unencrypted_nextmsg[4], msgnum);
 		memcpy(authstate->nextmsg, unencrypted_nextmsg, 6);
-		memcpy(&unencrypted_nextmsg[(4 + 2)], authstate->local_keygen_nonce, auth_NONCESIZE);
-		memcpy(&unencrypted_nextmsg[(4 + 2 + auth_NONCESIZE)], authstate->local_seq, seq_SIZE);
-		utilWriteInt32(&unencrypted_nextmsg[(4 + 2 + auth_NONCESIZE + seq_SIZE)], authstate->local_peerid);
-		memcpy(&unencrypted_nextmsg[(4 + 2 + auth_NONCESIZE + seq_SIZE + 4)], authstate->local_flags, 8);
+		authGenParams(authstate, &unencrypted_nextmsg[(4 + 2)]);
 		encsize = cryptoEnc(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], &authstate->nextmsg[(4 + 2)], (auth_MAXMSGSIZE - 2 - 4), &unencrypted_nextmsg[(4 + 2)], (unencrypted_nextmsg_size - 2 - 4), auth_CNEGHMACSIZE, auth_CNEGIVSIZE);
 		if(encsize > 0) {
 			authstate->nextmsg_size = (encsize + 4 + 2);
@@ -406,19 +547,9 @@ static int authDecodeS3(struct s_auth_state *authstate, const unsigned char *msg
 		msgnum = utilReadInt16(&decmsg[4]);
 		if(msgnum == (authstate->state + 1)) {
 			decmsg_len = (4 + 2 + cryptoDec(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], &decmsg[(4 + 2)], (auth_MAXMSGSIZE_S3 - 2 - 4), &msg[(4 + 2)], (msg_len - 2 - 4), auth_CNEGHMACSIZE, auth_CNEGIVSIZE));
-			if(decmsg_len >= (4 + 2 + auth_NONCESIZE + seq_SIZE + 4 + 8)) {
-				memcpy(authstate->remote_keygen_nonce, &decmsg[(4 + 2)], auth_NONCESIZE);
-				if((msgnum % 2) == 0) {
-					memcpy(&authstate->keygen_nonce[0], authstate->local_keygen_nonce, auth_NONCESIZE);
-					memcpy(&authstate->keygen_nonce[auth_NONCESIZE], authstate->remote_keygen_nonce, auth_NONCESIZE);
-				}
-				else {
-					memcpy(&authstate->keygen_nonce[0], authstate->remote_keygen_nonce, auth_NONCESIZE);
-					memcpy(&authstate->keygen_nonce[auth_NONCESIZE], authstate->local_keygen_nonce, auth_NONCESIZE);
-				}
-				memcpy(authstate->remote_seq, &decmsg[(4 + 2 + auth_NONCESIZE)], seq_SIZE);
-				authstate->remote_peerid = utilReadInt32(&decmsg[(4 + 2 + auth_NONCESIZE + seq_SIZE)]);
-				memcpy(authstate->remote_flags, &decmsg[(4 + 2 + auth_NONCESIZE + seq_SIZE + 4)], 8);
+			if(decmsg_len >= (4 + 2 + auth_PARAMSSIZE)) {
+				authDecodeParams(authstate, &decmsg[(4 + 2)]);
+				authGenKeygenNonce(authstate, ((msgnum % 2) == 0));
 				return 1;
 			}
 		}
@@ -461,6 +592,388 @@ static int authDecodeS4(struct s_auth_state *authstate, const unsigned char *msg
 }
 
 
+// Generate auth message R1
+static void authGenR1(struct s_auth_state *authstate) {
+	// generate msg(remote_authid, msgnum, ticketid, authid, nonce, hmac(ticketid, authid, nonce, netid))
+	unsigned char hmacin[resume_IDSIZE + 4 + auth_NONCESIZE + netid_SIZE];
+	int msgnum = authstate->state;
+	memcpy(authstate->nextmsg, authstate->remote_authid, 4);
+	utilWriteInt16(&authstate->nextmsg[4], msgnum);
+	memcpy(&authstate->nextmsg[(4 + 2)], authstate->resume_ticketid, resume_IDSIZE);
+	memcpy(&authstate->nextmsg[(4 + 2 + resume_IDSIZE)], authstate->local_authid, 4);
+	memcpy(&authstate->nextmsg[(4 + 2 + resume_IDSIZE + 4)], authstate->local_nonce, auth_NONCESIZE);
+	memcpy(hmacin, &authstate->nextmsg[(4 + 2)], (resume_IDSIZE + 4 + auth_NONCESIZE));
+	memcpy(&hmacin[(resume_IDSIZE + 4 + auth_NONCESIZE)], authstate->netid->id, netid_SIZE);
+	if(cryptoHMAC(&authstate->crypto_ctx[auth_CRYPTOCTX_AUTH], &authstate->nextmsg[(4 + 2 + resume_IDSIZE + 4 + auth_NONCESIZE)], auth_HMACSIZE, hmacin, (resume_IDSIZE + 4 + auth_NONCESIZE + netid_SIZE))) {
+		authstate->nextmsg_size = (4 + 2 + resume_IDSIZE + 4 + auth_NONCESIZE + auth_HMACSIZE);
+	}
+	else {
+		authstate->nextmsg_size = 0;
+	}
+}
+
+
+// Decode auth message R1
+static int authDecodeR1(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+	int msgnum;
+	unsigned char hmacin[resume_IDSIZE + 4 + auth_NONCESIZE + netid_SIZE];
+	unsigned char hmac[auth_HMACSIZE];
+	struct s_resume_ticket ticket;
+	struct s_nodeid nodeid;
+	if((authstate->resume != NULL) && (msg_len >= (4 + 2 + resume_IDSIZE + 4 + auth_NONCESIZE + auth_HMACSIZE))) {
+		msgnum = utilReadInt16(&msg[4]);
+		if(msgnum == auth_R0a) {
+			if(resumeFind(authstate->resume, &msg[(4 + 2)], &nodeid, &ticket)) {
+				if(cryptoSetKeys(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT, ticket.secret, resume_SECRETSIZE, &msg[(4 + 2 + resume_IDSIZE + 4)], auth_NONCESIZE)) {
+					memcpy(hmacin, &msg[(4 + 2)], (resume_IDSIZE + 4 + auth_NONCESIZE));
+					memcpy(&hmacin[(resume_IDSIZE + 4 + auth_NONCESIZE)], authstate->netid->id, netid_SIZE);
+					if(cryptoHMAC(&authstate->crypto_ctx[auth_CRYPTOCTX_AUTH], hmac, auth_HMACSIZE, hmacin, (resume_IDSIZE + 4 + auth_NONCESIZE + netid_SIZE))) {
+						if(memcmp(hmac, &msg[(4 + 2 + resume_IDSIZE + 4 + auth_NONCESIZE)], auth_HMACSIZE) == 0) {
+							memcpy(authstate->remote_authid, &msg[(4 + 2 + resume_IDSIZE)], 4);
+							memcpy(authstate->remote_nonce, &msg[(4 + 2 + resume_IDSIZE + 4)], auth_NONCESIZE);
+							memcpy(&authstate->keygen_nonce[0], authstate->remote_nonce, auth_NONCESIZE);
+							memcpy(&authstate->keygen_nonce[auth_NONCESIZE], authstate->local_nonce, auth_NONCESIZE);
+							if(cryptoSetKeys(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT, ticket.secret, resume_SECRETSIZE, authstate->keygen_nonce, (auth_NONCESIZE + auth_NONCESIZE))) {
+								memcpy(authstate->remote_nodekey.nodeid.id, nodeid.id, nodeid_SIZE);
+								resumeDelete(authstate->resume, &nodeid); // tickets can only be used once
+								return 1;
+							}
+						}
+					}
+				}
+				cryptoSetKeysRandom(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT);
+			}
+		}
+	}
+	return 0;
+}
+
+
+// Generate auth message R2
+static void authGenR2(struct s_auth_state *authstate) {
+	// generate msg(remote_authid, msgnum, nonce, enc(authid, local_peerid, local_seq, local_flags))
+	unsigned char unencrypted_nextmsg[auth_MAXMSGSIZE_R2];
+	int unencrypted_nextmsg_size = (4 + 2 + 4 + 4 + seq_SIZE + 8);
+	int msgnum = authstate->state;
+	int encsize;
+	if(authstate->local_cneg_set) {
+		memcpy(authstate->nextmsg, authstate->remote_authid, 4);
+		utilWriteInt16(&authstate->nextmsg[4], msgnum);
+		memcpy(&authstate->nextmsg[(4 + 2)], authstate->local_nonce, auth_NONCESIZE);
+		memcpy(&unencrypted_nextmsg[(4 + 2)], authstate->local_authid, 4);
+		utilWriteInt32(&unencrypted_nextmsg[(4 + 2 + 4)], authstate->local_peerid);
+		memcpy(&unencrypted_nextmsg[(4 + 2 + 4 + 4)], authstate->local_seq, seq_SIZE);
+		memcpy(&unencrypted_nextmsg[(4 + 2 + 4 + 4 + seq_SIZE)], authstate->local_flags, 8);
+		encsize = cryptoEnc(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], &authstate->nextmsg[(4 + 2 + auth_NONCESIZE)], (auth_MAXMSGSIZE - auth_NONCESIZE - 2 - 4), &unencrypted_nextmsg[(4 + 2)], (unencrypted_nextmsg_size - 2 - 4), auth_CNEGHMACSIZE, auth_CNEGIVSIZE);
+		if(encsize > 0) {
+			authstate->nextmsg_size = (encsize + auth_NONCESIZE + 4 + 2);
+		}
+		else {
+			authstate->nextmsg_size = 0;
+		}
+	}
+	else {
+		authstate->nextmsg_size = 0;
+	}
+}
+
+
+// Decode auth message R2
+static int authDecodeR2(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+	int msgnum;
+	int decmsg_len;
+	unsigned char decmsg[auth_MAXMSGSIZE_R2];
+	if(msg_len > (4 + 2 + auth_NONCESIZE)) {
+		msgnum = utilReadInt16(&msg[4]);
+		if(msgnum == auth_R0b) {
+			memcpy(&authstate->keygen_nonce[0], authstate->local_nonce, auth_NONCESIZE);
+			memcpy(&authstate->keygen_nonce[auth_NONCESIZE], &msg[(4 + 2)], auth_NONCESIZE);
+			if(cryptoSetKeys(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT, authstate->resume_secret, resume_SECRETSIZE, authstate->keygen_nonce, (auth_NONCESIZE + auth_NONCESIZE))) {
+				decmsg_len = cryptoDec(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], decmsg, auth_MAXMSGSIZE_R2, &msg[(4 + 2 + auth_NONCESIZE)], (msg_len - auth_NONCESIZE - 2 - 4), auth_CNEGHMACSIZE, auth_CNEGIVSIZE);
+				if(decmsg_len >= (4 + 4 + seq_SIZE + 8)) {
+					memcpy(authstate->remote_nonce, &msg[(4 + 2)], auth_NONCESIZE);
+					memcpy(authstate->remote_authid, decmsg, 4);
+					authstate->remote_peerid = utilReadInt32(&decmsg[4]);
+					memcpy(authstate->remote_seq, &decmsg[(4 + 4)], seq_SIZE);
+					memcpy(authstate->remote_flags, &decmsg[(4 + 4 + seq_SIZE)], 8);
+					return 1;
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+
+// Generate auth message R3
+static void authGenR3(struct s_auth_state *authstate) {
+	// generate msg(remote_authid, msgnum, enc(local_peerid, local_seq, local_flags))
+	unsigned char unencrypted_nextmsg[auth_MAXMSGSIZE_R3];
+	int unencrypted_nextmsg_size = (4 + 2 + 4 + seq_SIZE + 8);
+	int msgnum = authstate->state;
+	int encsize;
+	if(authstate->local_cneg_set) {
+		memcpy(authstate->nextmsg, authstate->remote_authid, 4);
+		utilWriteInt16(&authstate->nextmsg[4], msgnum);
+		utilWriteInt32(&unencrypted_nextmsg[(4 + 2)], authstate->local_peerid);
+		memcpy(&unencrypted_nextmsg[(4 + 2 + 4)], authstate->local_seq, seq_SIZE);
+		memcpy(&unencrypted_nextmsg[(4 + 2 + 4 + seq_SIZE)], authstate->local_flags, 8);
+		encsize = cryptoEnc(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], &authstate->nextmsg[(4 + 2)], (auth_MAXMSGSIZE - 2 - 4), &unencrypted_nextmsg[(4 + 2)], (unencrypted_nextmsg_size - 2 - 4), auth_CNEGHMACSIZE, auth_CNEGIVSIZE);
+		if(encsize > 0) {
+			authstate->nextmsg_size = (encsize + 4 + 2);
+		}
+		else {
+			authstate->nextmsg_size = 0;
+		}
+	}
+	else {
+		authstate->nextmsg_size = 0;
+	}
+}
+
+
+// Decode auth message R3
+static int authDecodeR3(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+	int msgnum;
+	int decmsg_len;
+	unsigned char decmsg[auth_MAXMSGSIZE_R3];
+	if((authstate->local_cneg_set) && (msg_len > 6)) {
+		msgnum = utilReadInt16(&msg[4]);
+		if(msgnum == auth_R2a) {
+			decmsg_len = cryptoDec(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], decmsg, auth_MAXMSGSIZE_R3, &msg[(4 + 2)], (msg_len - 2 - 4), auth_CNEGHMACSIZE, auth_CNEGIVSIZE);
+			if(decmsg_len >= (4 + seq_SIZE + 8)) {
+				authstate->remote_peerid = utilReadInt32(decmsg);
+				memcpy(authstate->remote_seq, &decmsg[4], seq_SIZE);
+				memcpy(authstate->remote_flags, &decmsg[(4 + seq_SIZE)], 8);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+// Generate auth message F1
+static void authGenF1(struct s_auth_state *authstate) {
+	// generate msg(remote_authid, msgnum, checksum, authid, sesstoken, nonce, netid, dhkey_len, dhkey)
+	int msgnum = authstate->state;
+	int dhsize;
+	authAcquireDHKey(authstate);
+	memcpy(authstate->nextmsg, authstate->remote_authid, 4);
+	utilWriteInt16(&authstate->nextmsg[4], msgnum);
+	memcpy(&authstate->nextmsg[(4 + 2 + 8)], authstate->local_authid, 4);
+	memcpy(&authstate->nextmsg[(4 + 2 + 8 + 4)], authstate->local_sesstoken, 4);
+	memcpy(&authstate->nextmsg[(4 + 2 + 8 + 4 + 4)], authstate->local_nonce, auth_NONCESIZE);
+	memcpy(&authstate->nextmsg[(4 + 2 + 8 + 4 + 4 + auth_NONCESIZE)], authstate->netid->id, netid_SIZE);
+	dhsize = authstate->local_dhkey_size;
+	if((dhsize > dh_MINSIZE) && (dhsize <= dh_MAXSIZE)) {
+		utilWriteInt16(&authstate->nextmsg[(4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE)], dhsize);
+		memcpy(&authstate->nextmsg[(4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE + 2)], authstate->local_dhkey, dhsize);
+		if(cryptoCalculateSHA256(&authstate->nextmsg[(4 + 2)], 8, &authstate->nextmsg[(4 + 2 + 8)], (4 + 4 + auth_NONCESIZE + netid_SIZE + 2 + dhsize))) {
+			authstate->nextmsg_size = (4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE + 2 + dhsize);
+		}
+		else {
+			authstate->nextmsg_size = 0;
+		}
+	}
+	else {
+		authstate->nextmsg_size = 0;
+	}
+}
+
+
+// Decode auth message F1 without doing the key exchange. This is enough to answer it with S0.
+static int authDecodeF1Header(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+	int msgnum;
+	int dhsize;
+	unsigned char checksum[8];
+	if(msg_len > (4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE + 2)) {
+		msgnum = utilReadInt16(&msg[4]);
+		if(msgnum == auth_F0a) {
+			dhsize = utilReadInt16(&msg[(4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE)]);
+			if((dhsize > dh_MINSIZE) && (dhsize <= dh_MAXSIZE) && (msg_len >= (4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE + 2 + dhsize))) {
+				if(cryptoCalculateSHA256(checksum, 8, &msg[(4 + 2 + 8)], (4 + 4 + auth_NONCESIZE + netid_SIZE + 2 + dhsize))) {
+					if(memcmp(checksum, &msg[(4 + 2)], 8) == 0) {
+						if(memcmp(authstate->netid->id, &msg[(4 + 2 + 8 + 4 + 4 + auth_NONCESIZE)], netid_SIZE) == 0) {
+							memcpy(authstate->remote_authid, &msg[(4 + 2 + 8)], 4);
+							memcpy(authstate->remote_sesstoken, &msg[(4 + 2 + 8 + 4)], 4);
+							return 1;
+						}
+					}
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+
+// Decode auth message F1
+static int authDecodeF1(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+	int dhsize;
+	unsigned char shared_nonce[auth_NONCESIZE + auth_NONCESIZE];
+	const unsigned char *remote_nonce = &msg[(4 + 2 + 8 + 4 + 4)];
+	const unsigned char *remote_dhkey = &msg[(4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE + 2)];
+	if((authstate->fastmode) && (authDecodeF1Header(authstate, msg, msg_len))) {
+		dhsize = utilReadInt16(&msg[(4 + 2 + 8 + 4 + 4 + auth_NONCESIZE + netid_SIZE)]);
+		if(memcmp(authstate->local_nonce, remote_nonce, auth_NONCESIZE) != 0) {
+			authAcquireDHKey(authstate);
+			if((!(authstate->dhkey < 0)) && ((4 + 2 + 4 + auth_NONCESIZE + 2 + authstate->local_dhkey_size + auth_IDPHMACSIZE + auth_IDPIVSIZE + crypto_MAXIVSIZE + authGetIdentitySize(authstate)) <= auth_MAXMSGSIZE_F2)) { // check if F2 fits
+				memcpy(&shared_nonce[0], authstate->local_nonce, auth_NONCESIZE);
+				memcpy(&shared_nonce[auth_NONCESIZE], remote_nonce, auth_NONCESIZE);
+				if(dhGenCryptoKeys(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT, authstate->dhstate, authstate->dhkey, remote_dhkey, dhsize, shared_nonce, (auth_NONCESIZE + auth_NONCESIZE))) {
+					authReleaseDHKey(authstate); // the shared secret is known now, the key can be refreshed
+					memcpy(authstate->remote_nonce, remote_nonce, auth_NONCESIZE);
+					memcpy(authstate->remote_dhkey, remote_dhkey, dhsize);
+					authstate->remote_dhkey_size = dhsize;
+					return 1;
+				}
+			}
+			authReleaseDHKey(authstate);
+			authstate->local_dhkey_size = 0; // the key exchange of a full auth session needs a new key
+		}
+	}
+	return 0;
+}
+
+
+// Generate auth message F2
+static void authGenF2(struct s_auth_state *authstate) {
+	// generate msg(remote_authid, msgnum, authid, nonce, dhkey_len, dhkey, enc(pubkey_len, pubkey, sig_len, sig(authid, msgnum, local_nonce, remote_nonce, remote_dhkey, local_dhkey), hmac(pubkey)))
+	unsigned char identity[auth_IDENTITYSIZE];
+	int identity_size;
+	int msgnum = authstate->state;
+	int dhsize = authstate->local_dhkey_size;
+	int encsize;
+	memcpy(authstate->nextmsg, authstate->remote_authid, 4);
+	utilWriteInt16(&authstate->nextmsg[4], msgnum);
+	memcpy(&authstate->nextmsg[(4 + 2)], authstate->local_authid, 4);
+	memcpy(&authstate->nextmsg[(4 + 2 + 4)], authstate->local_nonce, auth_NONCESIZE);
+	utilWriteInt16(&authstate->nextmsg[(4 + 2 + 4 + auth_NONCESIZE)], dhsize);
+	memcpy(&authstate->nextmsg[(4 + 2 + 4 + auth_NONCESIZE + 2)], authstate->local_dhkey, dhsize);
+	identity_size = authGenIdentity(authstate, identity, auth_IDENTITYSIZE, &authstate->nextmsg[4]);
+	if(identity_size > 0) {
+		encsize = cryptoEnc(&authstate->crypto_ctx[auth_CRYPTOCTX_IDP], &authstate->nextmsg[(4 + 2 + 4 + auth_NONCESIZE + 2 + dhsize)], (auth_MAXMSGSIZE_F2 - (4 + 2 + 4 + auth_NONCESIZE + 2 + dhsize)), identity, identity_size, auth_IDPHMACSIZE, auth_IDPIVSIZE);
+		if(encsize > 0) {
+			authstate->nextmsg_size = (4 + 2 + 4 + auth_NONCESIZE + 2 + dhsize + encsize);
+		}
+		else {
+			authstate->nextmsg_size = 0;
+		}
+	}
+	else {
+		authstate->nextmsg_size = 0;
+	}
+}
+
+
+// Decode auth message F2
+static int authDecodeF2(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+	int msgnum;
+	int dhsize;
+	int decmsg_len;
+	unsigned char shared_nonce[auth_NONCESIZE + auth_NONCESIZE];
+	unsigned char decmsg[auth_MAXMSGSIZE_F2];
+	if((!(authstate->dhkey < 0)) && (msg_len > (4 + 2 + 4 + auth_NONCESIZE + 2))) {
+		msgnum = utilReadInt16(&msg[4]);
+		if(msgnum == auth_F0b) {
+			dhsize = utilReadInt16(&msg[(4 + 2 + 4 + auth_NONCESIZE)]);
+			if((dhsize > dh_MINSIZE) && (dhsize <= dh_MAXSIZE) && (msg_len > (4 + 2 + 4 + auth_NONCESIZE + 2 + dhsize))) {
+				if(memcmp(authstate->local_nonce, &msg[(4 + 2 + 4)], auth_NONCESIZE) != 0) {
+					memcpy(&shared_nonce[0], &msg[(4 + 2 + 4)], auth_NONCESIZE);
+					memcpy(&shared_nonce[auth_NONCESIZE], authstate->local_nonce, auth_NONCESIZE);
+					if(dhGenCryptoKeys(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT, authstate->dhstate, authstate->dhkey, &msg[(4 + 2 + 4 + auth_NONCESIZE + 2)], dhsize, shared_nonce, (auth_NONCESIZE + auth_NONCESIZE))) {
+						memcpy(authstate->remote_authid, &msg[(4 + 2)], 4);
+						memcpy(authstate->remote_nonce, &msg[(4 + 2 + 4)], auth_NONCESIZE);
+						memcpy(authstate->remote_dhkey, &msg[(4 + 2 + 4 + auth_NONCESIZE + 2)], dhsize);
+						authstate->remote_dhkey_size = dhsize;
+						decmsg_len = cryptoDec(&authstate->crypto_ctx[auth_CRYPTOCTX_IDP], decmsg, auth_MAXMSGSIZE_F2, &msg[(4 + 2 + 4 + auth_NONCESIZE + 2 + dhsize)], (msg_len - (4 + 2 + 4 + auth_NONCESIZE + 2 + dhsize)), auth_IDPHMACSIZE, auth_IDPIVSIZE); // decrypt IDP layer
+						if(authDecodeIdentity(authstate, decmsg, decmsg_len, &msg[4]) > 0) {
+							authReleaseDHKey(authstate); // the shared secret is known now, the key can be refreshed
+							return 1;
+						}
+						cryptoSetKeysRandom(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT);
+					}
+				}
+			}
+		}
+	}
+	return 0;
+}
+
+
+// Generate auth message F3
+static void authGenF3(struct s_auth_state *authstate) {
+	// generate msg(remote_authid, msgnum, enc(pubkey_len, pubkey, sig_len, sig(authid, msgnum, local_nonce, remote_nonce, remote_dhkey, local_dhkey), hmac(pubkey), keygen_nonce, local_seq, local_peerid, local_flags))
+	unsigned char unencrypted_nextmsg[(auth_IDENTITYSIZE + auth_PARAMSSIZE)];
+	int unencrypted_nextmsg_size;
+	int msgnum = authstate->state;
+	int encsize;
+	if(authstate->local_cneg_set) {
+		memcpy(authstate->nextmsg, authstate->remote_authid, 4);
+		utilWriteInt16(&authstate->nextmsg[4], msgnum);
+		unencrypted_nextmsg_size = authGenIdentity(authstate, unencrypted_nextmsg, auth_IDENTITYSIZE, &authstate->nextmsg[4]);
+		if(unencrypted_nextmsg_size > 0) {
+			unencrypted_nextmsg_size += authGenParams(authstate, &unencrypted_nextmsg[unencrypted_nextmsg_size]);
+			encsize = cryptoEnc(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], &authstate->nextmsg[(4 + 2)], (auth_MAXMSGSIZE_F3 - 2 - 4), unencrypted_nextmsg, unencrypted_nextmsg_size, auth_CNEGHMACSIZE, auth_CNEGIVSIZE);
+			if(encsize > 0) {
+				authstate->nextmsg_size = (encsize + 4 + 2);
+			}
+			else {
+				authstate->nextmsg_size = 0;
+			}
+		}
+		else {
+			authstate->nextmsg_size = 0;
+		}
+	}
+	else {
+		authstate->nextmsg_size = 0;
+	}
+}
+
+
+// Decode auth message F3
+static int authDecodeF3(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+	int msgnum;
+	int decmsg_len;
+	int identity_size;
+	unsigned char decmsg[auth_MAXMSGSIZE_F3];
+	if(msg_len > 6) {
+		msgnum = utilReadInt16(&msg[4]);
+		if(msgnum == auth_F1a) {
+			decmsg_len = cryptoDec(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], decmsg, auth_MAXMSGSIZE_F3, &msg[(4 + 2)], (msg_len - 2 - 4), auth_CNEGHMACSIZE, auth_CNEGIVSIZE);
+			identity_size = authDecodeIdentity(authstate, decmsg, decmsg_len, &msg[4]);
+			if((identity_size > 0) && (decmsg_len >= (identity_size + auth_PARAMSSIZE))) {
+				authDecodeParams(authstate, &decmsg[identity_size]);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+
+// Decode auth message F4. It has the same format as S3.
+static int authDecodeF4(struct s_auth_state *authstate, const unsigned char *msg, const int msg_len) {
+	int msgnum;
+	int decmsg_len;
+	unsigned char decmsg[auth_MAXMSGSIZE_F4];
+	if((authstate->local_cneg_set) && (msg_len > 6)) {
+		msgnum = utilReadInt16(&msg[4]);
+		if(msgnum == auth_F2b) {
+			decmsg_len = cryptoDec(&authstate->crypto_ctx[auth_CRYPTOCTX_CNEG], decmsg, auth_MAXMSGSIZE_F4, &msg[(4 + 2)], (msg_len - 2 - 4), auth_CNEGHMACSIZE, auth_CNEGIVSIZE);
+			if(decmsg_len >= auth_PARAMSSIZE) {
+				authDecodeParams(authstate, decmsg);
+				authGenKeygenNonce(authstate, 1);
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+
 // Generate auth message
 static void authGenMsg(struct s_auth_state *authstate) {
 	int state = authstate->state;
@@ -485,6 +998,27 @@ static void authGenMsg(struct s_auth_state *authstate) {
 		case auth_S4b:
 			authGenS4(authstate);
 			break;
+		case auth_R0a:
+			authGenR1(authstate);
+			break;
+		case auth_R0b:
+			authGenR2(authstate);
+			break;
+		case auth_R2a:
+			authGenR3(authstate);
+			break;
+		case auth_F0a:
+			authGenF1(authstate);
+			break;
+		case auth_F0b:
+			authGenF2(authstate);
+			break;
+		case auth_F1a:
+			authGenF3(authstate);
+			break;
+		case auth_F2b:
+			authGenS3(authstate); // F4
+			break;
 		default:
 			authstate->nextmsg_size = 0;
 			break;
@@ -498,7 +1032,7 @@ static int authDecodeMsg(struct s_auth_state *authstate, const unsigned char *ms
 	int newstate = state;
 	
 	switch(state) {
-		case auth_IDLE: if(authDecodeS0(authstate, msg, msg_len)) newstate = auth_S0b; break;
+		case auth_IDLE: if(authDecodeS0(authstate, msg, msg_len)) newstate = auth_S0b; else if(authDecodeR1(authstate, msg, msg_len)) newstate = auth_R0b; else if(authDecodeF1(authstate, msg, msg_len)) newstate = auth_F0b; else if(authDecodeF1Header(authstate, msg, msg_len)) newstate = auth_S0b; break;
 		case auth_S0a:  if(authDecodeS0(authstate, msg, msg_len)) newstate = auth_S1a; break;
 		case auth_S0b:  if(authDecodeS1(authstate, msg, msg_len)) newstate = auth_S1b; break;
 		case auth_S1a:  if(authDecodeS1(authstate, msg, msg_len)) newstate = auth_S2a; break;
@@ -508,6 +1042,11 @@ static int authDecodeMsg(struct s_auth_state *authstate, const unsigned char *ms
 		case auth_S3a:  if(authDecodeS3(authstate, msg, msg_len)) newstate = auth_S4a; break;
 		case auth_S3b:  if(authDecodeS4(authstate, msg, msg_len)) newstate = auth_S4b; break;
 		case auth_S4a:  if(authDecodeS4(authstate, msg, msg_len)) newstate = auth_S5a; break;
+		case auth_R0a:  if(authDecodeR2(authstate, msg, msg_len)) newstate = auth_R1a; break;
+		case auth_R0b:  if(authDecodeR3(authstate, msg, msg_len)) newstate = auth_R1b; break;
+		case auth_F0a:  if(authDecodeF2(authstate, msg, msg_len)) newstate = auth_F1a; else if(authDecodeS0(authstate, msg, msg_len)) newstate = auth_S1a; break;
+		case auth_F0b:  if(authDecodeF3(authstate, msg, msg_len)) newstate = auth_F1b; break;
+		case auth_F1a:  if(authDecodeF4(authstate, msg, msg_len)) newstate = auth_F2a; break;
 	}
 	
 	if(state != newstate) {
@@ -534,11 +1073,17 @@ static void authReset(struct s_auth_state *authstate) {
 	cryptoRand(authstate->local_nonce, auth_NONCESIZE);
 	memset(authstate->remote_nonce, 0, auth_NONCESIZE);
 	memset(authstate->remote_dhkey, 0, dh_MAXSIZE);
+	authReleaseDHKey(authstate);
+	memset(authstate->local_dhkey, 0, dh_MAXSIZE);
+	authstate->local_dhkey_size = 0;
 	memset(authstate->remote_authid, 0, 4);
 	memset(authstate->nextmsg, 0, auth_MAXMSGSIZE);
 	authstate->remote_peerid = -1;
 	cryptoRand(authstate->local_sesstoken, 4);
 	memset(authstate->remote_sesstoken, 0, 4);
+	memset(authstate->resume_ticketid, 0, resume_IDSIZE);
+	memset(authstate->resume_secret, 0, resume_SECRETSIZE);
+	authstate->attempt_sent = 0;
 	authstate->nextmsg_size = 0;
 	authstate->local_cneg_set = 0;
 	cryptoSetKeysRandom(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT);
@@ -558,8 +1103,80 @@ static int authStart(struct s_auth_state *authstate) {
 }
 
 
+// Start new auth session that resumes a previous session with the specified node.
+static int authStartResume(struct s_auth_state *authstate, const struct s_nodeid *nodeid, const struct s_resume_ticket *ticket) {
+	if(authstate->state == auth_IDLE) {
+		memcpy(authstate->resume_ticketid, ticket->id, resume_IDSIZE);
+		memcpy(authstate->resume_secret, ticket->secret, resume_SECRETSIZE);
+		memcpy(authstate->remote_nodekey.nodeid.id, nodeid->id, nodeid_SIZE);
+		if(cryptoSetKeys(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT, authstate->resume_secret, resume_SECRETSIZE, authstate->local_nonce, auth_NONCESIZE)) {
+			authstate->state = auth_R0a;
+			authGenMsg(authstate);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+// Start new auth session using the fast handshake. Returns 0 if the fast handshake is disabled or the local keys are too big for it.
+static int authStartFast(struct s_auth_state *authstate) {
+	if((authstate->state == auth_IDLE) && (authstate->fastmode)) {
+		if((4 + 2 + auth_CNEGHMACSIZE + auth_CNEGIVSIZE + crypto_MAXIVSIZE + authGetIdentitySize(authstate) + auth_PARAMSSIZE) <= auth_MAXMSGSIZE_F3) {
+			authstate->state = auth_F0a;
+			authGenMsg(authstate);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+// Fall back to a full auth session if a resumption or fast handshake attempt got no answer. Call this before a message is resent.
+static void authFallback(struct s_auth_state *authstate) {
+	if((authstate->state == auth_R0a) || (authstate->state == auth_F0a)) {
+		if(authstate->attempt_sent) {
+			if((authstate->state == auth_R0a) && (authstate->resume != NULL)) resumeDelete(authstate->resume, &authstate->remote_nodekey.nodeid);
+			authReset(authstate);
+			authStart(authstate);
+		}
+		else {
+			authstate->attempt_sent = 1;
+		}
+	}
+}
+
+
+// Check if auth session is a session resumption.
+static int authIsResume(struct s_auth_state *authstate) {
+	if((authstate->state >= auth_R0a) && (authstate->state <= auth_R2a)) {
+		return 1;
+	}
+	else {
+		return 0;
+	}
+}
+
+
+// Check if auth session uses the fast handshake.
+static int authIsFast(struct s_auth_state *authstate) {
+	if((authstate->state >= auth_F0a) && (authstate->state <= auth_F2b)) {
+		return 1;
+	}
+	else {
+		return 0;
+	}
+}
+
+
 // Check if peer has completed a dh exchange.
 static int authIsPreauth(struct s_auth_state *authstate) {
+	if(authIsResume(authstate)) {
+		return (authstate->state != auth_R0a);
+	}
+	if(authIsFast(authstate)) {
+		return (authstate->state != auth_F0a);
+	}
 	if(authstate->state >= auth_S1b) {
 		return 1;
 	}
@@ -571,6 +1188,12 @@ static int authIsPreauth(struct s_auth_state *authstate) {
 
 // Check if peer is authenticated.
 static int authIsAuthed(struct s_auth_state *authstate) {
+	if(authIsResume(authstate)) {
+		return (authstate->state != auth_R0a);
+	}
+	if(authIsFast(authstate)) {
+		return ((authstate->state != auth_F0a) && (authstate->state != auth_F0b));
+	}
 	if(authstate->state >= auth_S2b) {
 		return 1;
 	}
@@ -582,6 +1205,12 @@ static int authIsAuthed(struct s_auth_state *authstate) {
 
 // Check if peer is authenticated & connection parameters are negotiated.
 static int authIsCompleted(struct s_auth_state *authstate) {
+	if(authIsResume(authstate)) {
+		return ((authstate->state == auth_R1b) || (authstate->state == auth_R2a));
+	}
+	if(authIsFast(authstate)) {
+		return ((authstate->state == auth_F2a) || (authstate->state == auth_F2b));
+	}
 	if(authstate->state >= auth_S3b) {
 		return 1;
 	}
@@ -593,6 +1222,12 @@ static int authIsCompleted(struct s_auth_state *authstate) {
 
 // Check if peer has completed the authentication.
 static int authIsPeerCompleted(struct s_auth_state *authstate) {
+	if(authIsResume(authstate)) {
+		return ((authstate->state == auth_R1b) || (authstate->state == auth_R2a));
+	}
+	if(authIsFast(authstate)) {
+		return ((authstate->state == auth_F2a) || (authstate->state == auth_F2b));
+	}
 	if(authstate->state >= auth_S4b) {
 		return 1;
 	}
@@ -650,8 +1285,31 @@ static int authGetConnectionParams(struct s_auth_state *authstate, int64_t *seq,
 }
 
 
+// Get the resumption ticket of a completed session. Returns 1 if successful.
+static int authGetResumeTicket(struct s_auth_state *authstate, unsigned char *ticketid, unsigned char *secret) {
+	unsigned char in[(auth_NONCESIZE + auth_NONCESIZE + 1)];
+	if(authIsCompleted(authstate)) {
+		memcpy(in, authstate->keygen_nonce, (auth_NONCESIZE + auth_NONCESIZE));
+		in[(auth_NONCESIZE + auth_NONCESIZE)] = 1;
+		if(cryptoHMAC(&authstate->crypto_ctx[auth_CRYPTOCTX_RESUME], ticketid, resume_IDSIZE, in, (auth_NONCESIZE + auth_NONCESIZE + 1))) {
+			in[(auth_NONCESIZE + auth_NONCESIZE)] = 2;
+			return cryptoHMAC(&authstate->crypto_ctx[auth_CRYPTOCTX_RESUME], secret, resume_SECRETSIZE, in, (auth_NONCESIZE + auth_NONCESIZE + 1));
+		}
+	}
+	return 0;
+}
+
+
+// Check if the next message of the auth session could not be generated because no DH key was available.
+static int authIsWaitingForDHKey(struct s_auth_state *authstate) {
+	const int state = authstate->state;
+	return ((authstate->nextmsg_size == 0) && (authstate->local_dhkey_size == 0) && ((state == auth_S1a) || (state == auth_S1b) || (state == auth_F0a)));
+}
+
+
 // Get next auth message.
 static int authGetNextMsg(struct s_auth_state *authstate, struct s_msg *out_msg) {
+	if(authIsWaitingForDHKey(authstate)) authGenMsg(authstate);
 	if(authstate->nextmsg_size > 0) {
 		out_msg->msg = authstate->nextmsg;
 		out_msg->len = authstate->nextmsg_size;
@@ -671,12 +1329,28 @@ static void authSetLocalData(struct s_auth_state *authstate, const int peerid, c
 	utilWriteInt64(authstate->local_seq, seq);
 	utilWriteInt64(authstate->local_flags, flags);
 	authstate->local_cneg_set = 1;
+	if(authstate->state == auth_R1a) authstate->state = auth_R2a;
+	if(authstate->state == auth_F1b) {
+		authGenKeygenNonce(authstate, 0);
+		authstate->state = auth_F2b;
+	}
 	authGenMsg(authstate);
 }
 
 
+// Enable/disable the fast handshake for incoming auth sessions.
+static void authSetFastMode(struct s_auth_state *authstate, const int enable) {
+	if(enable) {
+		authstate->fastmode = 1;
+	}
+	else {
+		authstate->fastmode = 0;
+	}
+}
+
+
 // Create auth state object.
-static int authCreate(struct s_auth_state *authstate, struct s_netid *netid, struct s_nodekey *local_nodekey, struct s_dh_state *dhstate, const int authid) {
+static int authCreate(struct s_auth_state *authstate, struct s_netid *netid, struct s_nodekey *local_nodekey, struct s_dh_state *dhstate, struct s_resume *resume, const int authid) {
 	utilWriteInt32(authstate->local_authid, authid);
 	if(dhstate == NULL) return 0;
 	if(local_nodekey == NULL) return 0;
@@ -685,8 +1359,11 @@ static int authCreate(struct s_auth_state *authstate, struct s_netid *netid, str
 	if(!rsaIsPrivate(&local_nodekey->key)) return 0;
 	
 	authstate->dhstate = dhstate;
+	authstate->dhkey = -1;
 	authstate->local_nodekey = local_nodekey;
 	authstate->netid = netid;
+	authstate->resume = resume;
+	authstate->fastmode = 0;
 	if(nodekeyCreate(&authstate->remote_nodekey)) {
 		if(cryptoCreate(authstate->crypto_ctx, auth_CRYPTOCTX_COUNT)) {
 			authReset(authstate);
@@ -24,6 +24,7 @@
 #include "auth.c"
 #include "peeraddr.c"
 #include "idsp.c"
+#include "map.c"
 
 
 // Timeouts.
@@ -31,9 +32,25 @@
 #define authmgt_RESEND_TIMEOUT 3
 
 
+// Maximum number of auth sessions that are checked when searching for an unused session.
+#define authmgt_FINDUNUSED_MAX 16
+
+
+// The auth session queue structure.
+struct s_authmgt_queue {
+	int *next;
+	int *prev;
+	int head;
+	int tail;
+};
+
+
 // The auth manager structure.
 struct s_authmgt {
 	struct s_idsp idsp;
+	struct s_map addrmap; // PeerAddr -> auth session ID
+	struct s_authmgt_queue sendqueue; // auth sessions with pending messages, in order of last sent message
+	struct s_authmgt_queue recvqueue; // all auth sessions, in order of last received message
 	struct s_auth_state *authstate;
 	struct s_peeraddr *peeraddr;
 	int *lastrecv;
@@ -44,6 +61,97 @@ struct s_authmgt {
 };
 
 
+// Remove all auth sessions from queue.
+static void authmgtQueueReset(struct s_authmgt_queue *queue, const int size) {
+	int i;
+	for(i=0; i<size; i++) {
+		queue->next[i] = -2;
+		queue->prev[i] = -2;
+	}
+	queue->head = -1;
+	queue->tail = -1;
+}
+
+
+// Check if auth session is in queue.
+static int authmgtQueueContains(struct s_authmgt_queue *queue, const int authstateid) {
+	return (queue->next[authstateid] != -2);
+}
+
+
+// Remove auth session from queue.
+static void authmgtQueueRemove(struct s_authmgt_queue *queue, const int authstateid) {
+	int next = queue->next[authstateid];
+	int prev = queue->prev[authstateid];
+	if(authmgtQueueContains(queue, authstateid)) {
+		if(prev < 0) queue->head = next; else queue->next[prev] = next;
+		if(next < 0) queue->tail = prev; else queue->prev[next] = prev;
+		queue->next[authstateid] = -2;
+		queue->prev[authstateid] = -2;
+	}
+}
+
+
+// Add auth session to the start of the queue.
+static void authmgtQueueAddHead(struct s_authmgt_queue *queue, const int authstateid) {
+	authmgtQueueRemove(queue, authstateid);
+	queue->prev[authstateid] = -1;
+	queue->next[authstateid] = queue->head;
+	if(queue->head < 0) queue->tail = authstateid; else queue->prev[queue->head] = authstateid;
+	queue->head = authstateid;
+}
+
+
+// Add auth session to the queue, directly after another auth session.
+static void authmgtQueueAddAfter(struct s_authmgt_queue *queue, const int prevstateid, const int authstateid) {
+	int next;
+	authmgtQueueRemove(queue, authstateid);
+	next = queue->next[prevstateid];
+	queue->prev[authstateid] = prevstateid;
+	queue->next[authstateid] = next;
+	queue->next[prevstateid] = authstateid;
+	if(next < 0) queue->tail = authstateid; else queue->prev[next] = authstateid;
+}
+
+
+// Add auth session to the end of the queue.
+static void authmgtQueueAddTail(struct s_authmgt_queue *queue, const int authstateid) {
+	authmgtQueueRemove(queue, authstateid);
+	queue->next[authstateid] = -1;
+	queue->prev[authstateid] = queue->tail;
+	if(queue->tail < 0) queue->head = authstateid; else queue->next[queue->tail] = authstateid;
+	queue->tail = authstateid;
+}
+
+
+// Create queue.
+static int authmgtQueueCreate(struct s_authmgt_queue *queue, const int size) {
+	int *next_mem;
+	int *prev_mem;
+	if(size > 0) {
+		next_mem = malloc(sizeof(int) * size);
+		if(next_mem != NULL) {
+			prev_mem = malloc(sizeof(int) * size);
+			if(prev_mem != NULL) {
+				queue->next = next_mem;
+				queue->prev = prev_mem;
+				authmgtQueueReset(queue, size);
+				return 1;
+			}
+			free(next_mem);
+		}
+	}
+	return 0;
+}
+
+
+// Destroy queue.
+static void authmgtQueueDestroy(struct s_authmgt_queue *queue) {
+	free(queue->prev);
+	free(queue->next);
+}
+
+
 // Return number of auth slots.
 static int authmgtSlotCount(struct s_authmgt *mgt) {
 	return idspSize(&mgt->idsp);
@@ -56,6 +164,38 @@ static int authmgtUsedSlotCount(struct s_authmgt *mgt) {
 }
 
 
+// Remove the PeerAddr of an auth session from the address map, unless it already belongs to another auth session.
+static void authmgtRemoveAddr(struct s_authmgt *mgt, const int authstateid) {
+	int *mapid = mapGet(&mgt->addrmap, mgt->peeraddr[authstateid].addr);
+	if((mapid != NULL) && (*mapid == authstateid)) mapRemove(&mgt->addrmap, mgt->peeraddr[authstateid].addr);
+}
+
+
+// Set the PeerAddr of an auth session.
+static void authmgtSetAddr(struct s_authmgt *mgt, const int authstateid, const struct s_peeraddr *peeraddr) {
+	authmgtRemoveAddr(mgt, authstateid);
+	mgt->peeraddr[authstateid] = *peeraddr;
+	mapSet(&mgt->addrmap, peeraddr->addr, &authstateid);
+}
+
+
+// Queue auth session for sending its next message. The queue is kept in order of the last sent message, so the sessions that are due first are in front.
+// Most sessions have just sent a message and are added at the end, so the search starts there.
+static void authmgtSchedule(struct s_authmgt *mgt, const int authstateid) {
+	struct s_authmgt_queue *queue = &mgt->sendqueue;
+	int prev;
+	authmgtQueueRemove(queue, authstateid);
+	prev = queue->tail;
+	while((!(prev < 0)) && ((mgt->lastsend[authstateid] - mgt->lastsend[prev]) < 0)) prev = queue->prev[prev];
+	if(prev < 0) {
+		authmgtQueueAddHead(queue, authstateid);
+	}
+	else {
+		authmgtQueueAddAfter(queue, prev, authstateid);
+	}
+}
+
+
 // Create new auth session. Returns ID of session if successful.
 static int authmgtNew(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr) {
 	int authstateid = idspNew(&mgt->idsp);
@@ -68,7 +208,9 @@ static int authmgtNew(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr)
 			mgt->lastsend[authstateid] = tnow;
 		}
 		mgt->lastrecv[authstateid] = tnow;
-		mgt->peeraddr[authstateid] = *peeraddr;
+		authmgtSetAddr(mgt, authstateid, peeraddr);
+		authmgtQueueAddTail(&mgt->recvqueue, authstateid);
+		authmgtSchedule(mgt, authstateid);
 		return authstateid;
 	}
 	else {
@@ -81,6 +223,9 @@ static int authmgtNew(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr)
 static void authmgtDelete(struct s_authmgt *mgt, const int authstateid) {
 	if(mgt->current_authed_id == authstateid) mgt->current_authed_id = -1;
 	if(mgt->current_completed_id == authstateid) mgt->current_completed_id = -1;
+	authmgtRemoveAddr(mgt, authstateid);
+	authmgtQueueRemove(&mgt->sendqueue, authstateid);
+	authmgtQueueRemove(&mgt->recvqueue, authstateid);
 	authReset(&mgt->authstate[authstateid]);
 	idspDelete(&mgt->idsp, authstateid);
 }
@@ -90,7 +235,7 @@ static void authmgtDelete(struct s_authmgt *mgt, const int authstateid) {
 static int authmgtStart(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr) {
 	int authstateid = authmgtNew(mgt, peeraddr);
 	if(!(authstateid < 0)) {
-		authStart(&mgt->authstate[authstateid]);
+		if(!authStartFast(&mgt->authstate[authstateid])) authStart(&mgt->authstate[authstateid]);
 		return 1;
 	}
 	else {
@@ -99,6 +244,17 @@ static int authmgtStart(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr
 }
 
 
+// Start new auth session that resumes a previous session. Returns 1 on success.
+static int authmgtStartResume(struct s_authmgt *mgt, const struct s_peeraddr *peeraddr, const struct s_nodeid *nodeid, const struct s_resume_ticket *ticket) {
+	int authstateid = authmgtNew(mgt, peeraddr);
+	if(!(authstateid < 0)) {
+		if(authStartResume(&mgt->authstate[authstateid], nodeid, ticket)) return 1;
+		authmgtDelete(mgt, authstateid);
+	}
+	return 0;
+}
+
+
 // Check if auth manager has an authed peer.
 static int authmgtHasAuthedPeer(struct s_authmgt *mgt) {
 	if(!(mgt->current_authed_id < 0)) {
@@ -125,6 +281,8 @@ static int authmgtGetAuthedPeerNodeID(struct s_authmgt *mgt, struct s_nodeid *no
 static void authmgtAcceptAuthedPeer(struct s_authmgt *mgt, const int local_peerid, const int64_t seq, const int64_t flags) {
 	if(authmgtHasAuthedPeer(mgt)) {
 		authSetLocalData(&mgt->authstate[mgt->current_authed_id], local_peerid, seq, flags);
+		authmgtSchedule(mgt, mgt->current_authed_id);
+		if(authIsCompleted(&mgt->authstate[mgt->current_authed_id])) mgt->current_completed_id = mgt->current_authed_id; // resumed sessions may complete here
 		mgt->current_authed_id = -1;
 	}
 }
@@ -203,6 +361,17 @@ static int authmgtGetCompletedPeerConnectionParams(struct s_authmgt *mgt, int64_
 	}
 }
 
+// Get the resumption ticket of the current completed peer.
+static int authmgtGetCompletedPeerResumeTicket(struct s_authmgt *mgt, unsigned char *ticketid, unsigned char *secret) {
+	if(authmgtHasCompletedPeer(mgt)) {
+		return authGetResumeTicket(&mgt->authstate[mgt->current_completed_id], ticketid, secret);
+	}
+	else {
+		return 0;
+	}
+}
+
+
 // Finish the current completed peer.
 static void authmgtFinishCompletedPeer(struct s_authmgt *mgt) {
 	mgt->current_completed_id = -1;
@@ -211,52 +380,58 @@ static void authmgtFinishCompletedPeer(struct s_authmgt *mgt) {
 
 // Get next auth manager message.
 static int authmgtGetNextMsg(struct s_authmgt *mgt, struct s_msg *out_msg, struct s_peeraddr *target) {
-	int used = idspUsedCount(&mgt->idsp);
 	int tnow = utilGetClock();
 	int authstateid;
-	int i;
-	for(i=0; i<used; i++) {
-		authstateid = idspNext(&mgt->idsp);
-		if((tnow - mgt->lastrecv[authstateid]) < authmgt_RECV_TIMEOUT) { // check if auth session has expired
-			if((tnow - mgt->lastsend[authstateid]) > authmgt_RESEND_TIMEOUT) { // only send one auth message per specified time interval and session
-				if(authGetNextMsg(&mgt->authstate[authstateid], out_msg)) {
-					mgt->lastsend[authstateid] = tnow;
-					*target = mgt->peeraddr[authstateid];
-					return 1;
-				}
-			}
+
+	// delete expired auth sessions
+	while(!((authstateid = mgt->recvqueue.head) < 0)) {
+		if((tnow - mgt->lastrecv[authstateid]) < authmgt_RECV_TIMEOUT) break;
+		authmgtDelete(mgt, authstateid);
+	}
+
+	// only send one auth message per specified time interval and session
+	while(!((authstateid = mgt->sendqueue.head) < 0)) {
+		if(!((tnow - mgt->lastsend[authstateid]) > authmgt_RESEND_TIMEOUT)) break;
+		authFallback(&mgt->authstate[authstateid]);
+		if(authGetNextMsg(&mgt->authstate[authstateid], out_msg)) {
+			mgt->lastsend[authstateid] = tnow;
+			authmgtSchedule(mgt, authstateid);
+			*target = mgt->peeraddr[authstateid];
+			return 1;
+		}
+		if(authIsWaitingForDHKey(&mgt->authstate[authstateid])) { // try again when the DH key pool has been refilled
+			mgt->lastsend[authstateid] = tnow;
+			authmgtSchedule(mgt, authstateid);
 		}
 		else {
-			authmgtDelete(mgt, authstateid);
+			authmgtQueueRemove(&mgt->sendqueue, authstateid); // nothing to send until the auth session changes
 		}
 	}
+
 	return 0;
 }
 
 
 // Find auth session with specified PeerAddr.
 static int authmgtFindAddr(struct s_authmgt *mgt, const struct s_peeraddr *addr) {
-	int count = idspUsedCount(&mgt->idsp);
-	int i;
-	int j;
-	for(i=0; i<count; i++) {
-		j = idspNext(&mgt->idsp);
-		if(memcmp(mgt->peeraddr[j].addr, addr->addr, peeraddr_SIZE) == 0) return j;
+	int *mapid = mapGet(&mgt->addrmap, addr->addr);
+	if(mapid != NULL) {
+		if(idspIsValid(&mgt->idsp, *mapid)) return *mapid;
 	}
 	return -1;
 }
 
 
-// Find unused auth session.
+// Find unused auth session. Only the auth sessions with the oldest received messages are checked.
 static int authmgtFindUnused(struct s_authmgt *mgt) {
-	int count = idspUsedCount(&mgt->idsp);
-	int i;
-	int j;
+	int i = 0;
+	int j = mgt->recvqueue.head;
 	struct s_auth_state *authstate;
-	for(i=0; i<count; i++) {
-		j = idspNext(&mgt->idsp);
+	while((!(j < 0)) && (i < authmgt_FINDUNUSED_MAX)) {
 		authstate = &mgt->authstate[j];
 		if((!authIsPreauth(authstate)) || (authIsPeerCompleted(authstate))) return j;
+		j = mgt->recvqueue.next[j];
+		i++;
 	}
 	return -1;
 }
@@ -269,20 +444,24 @@ static int authmgtDecodeMsg(struct s_authmgt *mgt, const unsigned char *msg, con
 	int tnow = utilGetClock();
 	int newsession;
 	int dupid;
+	int completed;
 	if(msg_len > 4) {
 		authid = utilReadInt32(msg);
 		if(authid > 0) {
 			// message belongs to existing auth session
 			authstateid = (authid - 1);
-			if(authstateid < idspSize(&mgt->idsp)) {
+			if((authstateid < idspSize(&mgt->idsp)) && (idspIsValid(&mgt->idsp, authstateid))) {
+				completed = authIsCompleted(&mgt->authstate[authstateid]);
 				if(authDecodeMsg(&mgt->authstate[authstateid], msg, msg_len)) {
 					mgt->lastrecv[authstateid] = tnow;
-					mgt->peeraddr[authstateid] = *peeraddr;
+					authmgtSetAddr(mgt, authstateid, peeraddr);
+					authmgtQueueAddTail(&mgt->recvqueue, authstateid);
 					if(mgt->fastauth) {
 						mgt->lastsend[authstateid] = (tnow - authmgt_RESEND_TIMEOUT - 3);
 					}
+					authmgtSchedule(mgt, authstateid);
 					if((authIsAuthed(&mgt->authstate[authstateid])) && (!authIsCompleted(&mgt->authstate[authstateid]))) mgt->current_authed_id = authstateid;
-					if((authIsCompleted(&mgt->authstate[authstateid])) && (!authIsPeerCompleted(&mgt->authstate[authstateid]))) mgt->current_completed_id = authstateid;
+					if((authIsCompleted(&mgt->authstate[authstateid])) && (!completed)) mgt->current_completed_id = authstateid;
 					return 1;
 				}
 			}
@@ -295,7 +474,7 @@ static int authmgtDecodeMsg(struct s_authmgt *mgt, const unsigned char *msg, con
 			}
 			else {
 				// auth session with same PeerAddr found.
-				if(authIsPreauth(&mgt->authstate[dupid])) {
+				if((authIsPreauth(&mgt->authstate[dupid])) && (!authIsPeerCompleted(&mgt->authstate[dupid]))) {
 					newsession = 0;
 				}
 				else {
@@ -316,10 +495,11 @@ static int authmgtDecodeMsg(struct s_authmgt *mgt, const unsigned char *msg, con
 				if(!(authstateid < 0)) {
 					if(authDecodeMsg(&mgt->authstate[authstateid], msg, msg_len)) {
 						mgt->lastrecv[authstateid] = tnow;
-						mgt->peeraddr[authstateid] = *peeraddr;
 						if(mgt->fastauth) {
 							mgt->lastsend[authstateid] = (tnow - authmgt_RESEND_TIMEOUT - 3);
 						}
+						authmgtSchedule(mgt, authstateid);
+						if(authIsAuthed(&mgt->authstate[authstateid])) mgt->current_authed_id = authstateid; // resumed sessions are authed by the first message
 						return 1;
 					}
 					else {
@@ -344,6 +524,16 @@ static void authmgtSetFastauth(struct s_authmgt *mgt, const int enable) {
 }
 
 
+// Enable/disable the fast handshake.
+static void authmgtSetFastHandshake(struct s_authmgt *mgt, const int enable) {
+	int i;
+	int count = idspSize(&mgt->idsp);
+	for(i=0; i<count; i++) {
+		authSetFastMode(&mgt->authstate[i], enable);
+	}
+}
+
+
 // Reset auth manager object.
 static void authmgtReset(struct s_authmgt *mgt) {
 	int i;
@@ -352,20 +542,23 @@ static void authmgtReset(struct s_authmgt *mgt) {
 		authReset(&mgt->authstate[i]);
 	}
 	idspReset(&mgt->idsp);
+	mapInit(&mgt->addrmap);
+	authmgtQueueReset(&mgt->sendqueue, count);
+	authmgtQueueReset(&mgt->recvqueue, count);
 	mgt->fastauth = 0;
 	mgt->current_authed_id = -1;
 	mgt->current_completed_id = -1;
 }
 
 
-// Create auth manager object.
-static int authmgtCreate(struct s_authmgt *mgt, struct s_netid *netid, const int auth_slots, struct s_nodekey *local_nodekey, struct s_dh_state *dhstate) {
+// Create auth manager object. The DH key pool is grown to one key per auth slot, so that concurrent auth sessions never have to share a key.
+static int authmgtCreate(struct s_authmgt *mgt, struct s_netid *netid, const int auth_slots, struct s_nodekey *local_nodekey, struct s_dh_state *dhstate, struct s_resume *resume) {
 	int ac;
 	struct s_auth_state *authstate_mem;
 	struct s_peeraddr *peeraddr_mem;
 	int *lastsend_mem;
 	int *lastrecv_mem;
-	if(auth_slots > 0) {
+	if((auth_slots > 0) && (dhstate != NULL) && (dhResize(dhstate, auth_slots))) {
 		lastsend_mem = malloc(sizeof(int) * auth_slots);
 		if(lastsend_mem != NULL) {
 			lastrecv_mem = malloc(sizeof(int) * auth_slots);
@@ -376,17 +569,26 @@ static int authmgtCreate(struct s_authmgt *mgt, struct s_netid *netid, const int
 					if(peeraddr_mem != NULL) {
 						ac = 0;
 						while(ac < auth_slots) {
-							if(!authCreate(&authstate_mem[ac], netid, local_nodekey, dhstate, (ac + 1))) break;
+							if(!authCreate(&authstate_mem[ac], netid, local_nodekey, dhstate, resume, (ac + 1))) break;
 							ac++;
 						}
 						if(!(ac < auth_slots)) {
 							if(idspCreate(&mgt->idsp, auth_slots)) {
-								mgt->lastsend = lastsend_mem;
-								mgt->lastrecv = lastrecv_mem;
-								mgt->authstate = authstate_mem;
-								mgt->peeraddr = peeraddr_mem;
-								authmgtReset(mgt);
-								return 1;
+								if(mapCreate(&mgt->addrmap, auth_slots, peeraddr_SIZE, sizeof(int))) {
+									if(authmgtQueueCreate(&mgt->sendqueue, auth_slots)) {
+										if(authmgtQueueCreate(&mgt->recvqueue, auth_slots)) {
+											mgt->lastsend = lastsend_mem;
+											mgt->lastrecv = lastrecv_mem;
+											mgt->authstate = authstate_mem;
+											mgt->peeraddr = peeraddr_mem;
+											authmgtReset(mgt);
+											return 1;
+										}
+										authmgtQueueDestroy(&mgt->sendqueue);
+									}
+									mapDestroy(&mgt->addrmap);
+								}
+								idspDestroy(&mgt->idsp);
 							}
 						}
 						while(ac > 0) {
@@ -410,6 +612,9 @@ static int authmgtCreate(struct s_authmgt *mgt, struct s_netid *netid, const int
 static void authmgtDestroy(struct s_authmgt *mgt) {
 	int i;
 	int count = idspSize(&mgt->idsp);
+	authmgtQueueDestroy(&mgt->recvqueue);
+	authmgtQueueDestroy(&mgt->sendqueue);
+	mapDestroy(&mgt->addrmap);
 	idspDestroy(&mgt->idsp);
 	for(i=0; i<count; i++) authDestroy(&mgt->authstate[i]);
 	free(mgt->peeraddr);
@@ -24,11 +24,14 @@
 #include "authmgt.c"
 #include <stdlib.h>
 #include <stdio.h>
+#include <unistd.h>
 
 
 #define authmgtTestsuite_NODECOUNT 16
 #define authmgtTestsuite_PUBKEYSIZE 2048
 
+#define authmgtCapacityTestsuite_SLOTS 256
+
 
 struct s_authmgt_test {
 	struct s_nodekey nk[authmgtTestsuite_NODECOUNT];
@@ -136,7 +139,7 @@ static int authmgtTestsuiteCreateNodes(struct s_authmgt_test *teststate) {
 				}
 				if(!(dhc < authmgtTestsuite_NODECOUNT)) {
 					while(mgtc < authmgtTestsuite_NODECOUNT) {
-						if(!authmgtCreate(&teststate->mgt[mgtc], &teststate->netid, (authmgtTestsuite_NODECOUNT * 2), &teststate->nk[mgtc], &teststate->dhstate[mgtc])) break;
+						if(!authmgtCreate(&teststate->mgt[mgtc], &teststate->netid, (authmgtTestsuite_NODECOUNT * 2), &teststate->nk[mgtc], &teststate->dhstate[mgtc], NULL)) break;
 						mgtc++;
 					}
 					if(!(mgtc < authmgtTestsuite_NODECOUNT)) {
@@ -217,4 +220,173 @@ static int authmgtTestsuite() {
 }
 
 
+static void authmgtCapacityTestsuiteGetAddr(struct s_peeraddr *addr, const int id) {
+	memset(addr->addr, 0, peeraddr_SIZE);
+	addr->addr[0] = 42;
+	addr->addr[1] = 42;
+	addr->addr[2] = 42;
+	addr->addr[3] = 42;
+	utilWriteInt32(&addr->addr[4], id);
+}
+
+
+// Check that the address map and both queues agree with the used auth slots.
+static int authmgtCapacityTestsuiteCheck(struct s_authmgt *mgt) {
+	int count = authmgtUsedSlotCount(mgt);
+	int i;
+	int j;
+	if(mapGetKeyCount(&mgt->addrmap) != count) return 0;
+	for(i=0; i<authmgtSlotCount(mgt); i++) {
+		if(idspIsValid(&mgt->idsp, i)) {
+			if(authmgtFindAddr(mgt, &mgt->peeraddr[i]) != i) return 0;
+			if(!authmgtQueueContains(&mgt->recvqueue, i)) return 0;
+		}
+	}
+	i = 0;
+	j = mgt->recvqueue.head;
+	while(!(j < 0)) {
+		if((!idspIsValid(&mgt->idsp, j)) || (i > count)) return 0;
+		if((!(mgt->recvqueue.next[j] < 0)) && ((mgt->lastrecv[mgt->recvqueue.next[j]] - mgt->lastrecv[j]) < 0)) return 0;
+		j = mgt->recvqueue.next[j];
+		i++;
+	}
+	if(i != count) return 0;
+	i = 0;
+	j = mgt->sendqueue.head;
+	while(!(j < 0)) {
+		if((!idspIsValid(&mgt->idsp, j)) || (i > count)) return 0;
+		if((!(mgt->sendqueue.next[j] < 0)) && ((mgt->lastsend[mgt->sendqueue.next[j]] - mgt->lastsend[j]) < 0)) return 0;
+		j = mgt->sendqueue.next[j];
+		i++;
+	}
+	return 1;
+}
+
+
+// Deliver an auth message to the other auth manager and complete the session if possible. Returns 1 if the session is completed.
+static int authmgtCapacityTestsuiteDeliver(struct s_authmgt *mgt, const struct s_msg *msg, const struct s_peeraddr *source) {
+	struct s_nodeid nodeid;
+	int peerid;
+	struct s_peeraddr addr;
+	if(authmgtDecodeMsg(mgt, msg->msg, msg->len, source)) {
+		if(authmgtGetAuthedPeerNodeID(mgt, &nodeid)) authmgtAcceptAuthedPeer(mgt, 23, 1337, 0);
+		if(authmgtGetCompletedPeerNodeID(mgt, &nodeid)) {
+			if(!authmgtGetCompletedPeerAddress(mgt, &peerid, &addr)) return 0;
+			authmgtFinishCompletedPeer(mgt);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+// Node 0 fills all its auth slots with sessions to silent addresses, then node 1 authenticates with it.
+static int authmgtCapacityTestsuiteRun(struct s_authmgt *mgt, struct s_dh_state *dhstate) {
+	const int slots = authmgtCapacityTestsuite_SLOTS;
+	struct s_peeraddr addr;
+	struct s_peeraddr target;
+	struct s_msg msg;
+	int completed[2] = { 0, 0 };
+	int oldest;
+	int i;
+	int r;
+
+	// every slot can be used and is found by its address
+	for(i=0; i<slots; i++) {
+		authmgtCapacityTestsuiteGetAddr(&addr, (1000 + i));
+		if(!authmgtStart(&mgt[0], &addr)) return 0;
+	}
+	authmgtCapacityTestsuiteGetAddr(&addr, (1000 + slots));
+	if(authmgtStart(&mgt[0], &addr)) return 0;
+	if(authmgtUsedSlotCount(&mgt[0]) != slots) return 0;
+	if(!authmgtCapacityTestsuiteCheck(&mgt[0])) return 0;
+
+	// deleted sessions are removed from the map and the queues, their slots are reused
+	for(i=0; i<slots; i=i+2) {
+		authmgtCapacityTestsuiteGetAddr(&addr, (1000 + i));
+		r = authmgtFindAddr(&mgt[0], &addr);
+		if(r < 0) return 0;
+		authmgtDelete(&mgt[0], r);
+		if(authmgtFindAddr(&mgt[0], &addr) >= 0) return 0;
+	}
+	if(authmgtUsedSlotCount(&mgt[0]) != (slots / 2)) return 0;
+	if(!authmgtCapacityTestsuiteCheck(&mgt[0])) return 0;
+	authmgtCapacityTestsuiteGetAddr(&addr, 1001);
+	r = authmgtFindAddr(&mgt[0], &addr);
+	authmgtCapacityTestsuiteGetAddr(&target, 999);
+	authmgtSetAddr(&mgt[0], r, &target);
+	if((authmgtFindAddr(&mgt[0], &addr) >= 0) || (authmgtFindAddr(&mgt[0], &target) != r)) return 0;
+	for(i=0; i<(slots / 2); i++) {
+		authmgtCapacityTestsuiteGetAddr(&addr, (2000 + i));
+		if(!authmgtStart(&mgt[0], &addr)) return 0;
+	}
+	if(authmgtUsedSlotCount(&mgt[0]) != slots) return 0;
+	if(!authmgtCapacityTestsuiteCheck(&mgt[0])) return 0;
+
+	// a new peer replaces the oldest unanswered session and completes the handshake
+	oldest = mgt[0].recvqueue.head;
+	addr = mgt[0].peeraddr[oldest];
+	authmgtSetFastauth(&mgt[0], 1);
+	authmgtSetFastauth(&mgt[1], 1);
+	authmgtCapacityTestsuiteGetAddr(&target, 0);
+	if(!authmgtStart(&mgt[1], &target)) return 0;
+	for(r=0; (r<5000) && (!(completed[0] && completed[1])); r++) {
+		for(i=0; i<2; i++) {
+			dhRefresh(&dhstate[i], utilGetClockUS());
+			if(authmgtGetNextMsg(&mgt[i], &msg, &target)) {
+				if(utilReadInt32(&target.addr[4]) == (1 - i)) {
+					authmgtCapacityTestsuiteGetAddr(&target, i);
+					if(authmgtCapacityTestsuiteDeliver(&mgt[(1 - i)], &msg, &target)) completed[(1 - i)] = 1;
+				}
+			}
+		}
+		usleep(1000);
+	}
+	if(!(completed[0] && completed[1])) return 0;
+	if(authmgtFindAddr(&mgt[0], &addr) >= 0) return 0;
+	authmgtCapacityTestsuiteGetAddr(&target, 1);
+	if(authmgtFindAddr(&mgt[0], &target) < 0) return 0;
+	if(authmgtUsedSlotCount(&mgt[0]) != slots) return 0;
+	if(!authmgtCapacityTestsuiteCheck(&mgt[0])) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int authmgtCapacityTestsuite() {
+	const int slots[2] = { authmgtCapacityTestsuite_SLOTS, 4 };
+	int ret = 0;
+	int count = 0;
+	struct s_netid netid;
+	struct s_nodekey nk[2];
+	struct s_dh_state dhstate[2];
+	struct s_authmgt mgt[2];
+	if(!netidSet(&netid, "test", 4)) return 0;
+	while(count < 2) {
+		if(!nodekeyCreate(&nk[count])) break;
+		if(nodekeyGenerate(&nk[count], authmgtTestsuite_PUBKEYSIZE)) {
+			if(dhCreate(&dhstate[count])) {
+				if(authmgtCreate(&mgt[count], &netid, slots[count], &nk[count], &dhstate[count], NULL)) {
+					count++;
+					continue;
+				}
+				dhDestroy(&dhstate[count]);
+			}
+		}
+		nodekeyDestroy(&nk[count]);
+		break;
+	}
+	if(!(count < 2)) ret = authmgtCapacityTestsuiteRun(mgt, dhstate);
+	while(count > 0) {
+		count--;
+		authmgtDestroy(&mgt[count]);
+		dhDestroy(&dhstate[count]);
+		nodekeyDestroy(&nk[count]);
+	}
+	return ret;
+}
+
+
 #endif // F_AUTHMGT_TEST_C
@@ -0,0 +1,129 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_COMPRESS_C
+#define F_COMPRESS_C
+
+
+#include <string.h>
+#include <zlib.h>
+
+
+// Deflate settings. Every message is compressed on its own, so a small window is enough.
+#define compress_LEVEL 1
+#define compress_WINDOWBITS 13
+#define compress_MEMLEVEL 8
+
+
+// Messages smaller than this are not worth compressing.
+#define compress_MINSIZE 96
+
+
+// Entropy estimate settings. The sample is taken behind the protocol headers if the message is long enough.
+#define compress_SAMPLE_OFFSET 64
+#define compress_SAMPLE_SIZE 128
+#define compress_SAMPLE_MAXDISTINCT 88
+
+
+// The compression state structure.
+struct s_compress {
+	z_stream deflate_strm;
+	z_stream inflate_strm;
+};
+
+
+// Estimate if a message is compressible by counting the distinct byte values of a sample. Returns 1 if compression should be tried.
+static int compressEstimate(const unsigned char *buf, const int len) {
+	unsigned char seen[256];
+	int start, end, i, distinct;
+	if(len < compress_MINSIZE) return 0;
+	if(len >= (compress_SAMPLE_OFFSET + compress_SAMPLE_SIZE)) {
+		start = compress_SAMPLE_OFFSET;
+		end = (compress_SAMPLE_OFFSET + compress_SAMPLE_SIZE);
+	}
+	else {
+		start = ((len > compress_SAMPLE_SIZE) ? (len - compress_SAMPLE_SIZE) : 0);
+		end = len;
+	}
+	memset(seen, 0, 256);
+	distinct = 0;
+	for(i=start; i<end; i++) {
+		if(!seen[buf[i]]) {
+			seen[buf[i]] = 1;
+			distinct++;
+		}
+	}
+	return ((distinct * compress_SAMPLE_SIZE) <= (compress_SAMPLE_MAXDISTINCT * (end - start)));
+}
+
+
+// Compress a message. Returns the compressed length, or 0 if it doesn't fit into the output buffer.
+static int compressEncode(struct s_compress *compress, unsigned char *out_buf, const int out_len, const unsigned char *in_buf, const int in_len) {
+	z_stream *strm = &compress->deflate_strm;
+	int ret;
+	if(!((out_len > 0) && (in_len > 0))) return 0;
+	if(deflateReset(strm) != Z_OK) return 0;
+	strm->next_in = (unsigned char *)in_buf;
+	strm->avail_in = in_len;
+	strm->next_out = out_buf;
+	strm->avail_out = out_len;
+	ret = deflate(strm, Z_FINISH);
+	if(ret != Z_STREAM_END) return 0;
+	return (out_len - strm->avail_out);
+}
+
+
+// Decompress a message. Returns the decompressed length, or 0 if the input is invalid or doesn't fit into the output buffer.
+static int compressDecode(struct s_compress *compress, unsigned char *out_buf, const int out_len, const unsigned char *in_buf, const int in_len) {
+	z_stream *strm = &compress->inflate_strm;
+	int ret;
+	if(!((out_len > 0) && (in_len > 0))) return 0;
+	if(inflateReset(strm) != Z_OK) return 0;
+	strm->next_in = (unsigned char *)in_buf;
+	strm->avail_in = in_len;
+	strm->next_out = out_buf;
+	strm->avail_out = out_len;
+	ret = inflate(strm, Z_FINISH);
+	if(ret != Z_STREAM_END) return 0;
+	if(strm->avail_in != 0) return 0;
+	return (out_len - strm->avail_out);
+}
+
+
+// Create compression state.
+static int compressCreate(struct s_compress *compress) {
+	memset(compress, 0, sizeof(struct s_compress));
+	if(deflateInit2(&compress->deflate_strm, compress_LEVEL, Z_DEFLATED, -compress_WINDOWBITS, compress_MEMLEVEL, Z_DEFAULT_STRATEGY) == Z_OK) {
+		if(inflateInit2(&compress->inflate_strm, -MAX_WBITS) == Z_OK) {
+			return 1;
+		}
+		deflateEnd(&compress->deflate_strm);
+	}
+	return 0;
+}
+
+
+// Destroy compression state.
+static void compressDestroy(struct s_compress *compress) {
+	inflateEnd(&compress->inflate_strm);
+	deflateEnd(&compress->deflate_strm);
+}
+
+
+#endif // F_COMPRESS_C
@@ -28,6 +28,12 @@
 #include "authmgt_test.c"
 #include "mapstr_test.c"
 #include "packet_test.c"
+#include "txq_test.c"
+#include "fec_test.c"
+#include "tbf_test.c"
+#include "timer_test.c"
+#include "dh_test.c"
+#include "seq_test.c"
 #include <stdio.h>
 #include <unistd.h>
 
@@ -381,6 +387,11 @@ void consoleTestsuiteSeqVerify(struct s_console_args *args) {
 }
 
 
+void consoleTestsuiteSeqTestsuite(struct s_console_args *args) {
+	seqTestsuite();
+}
+
+
 void consoleTestsuiteTreeview(struct s_console_args *args) {
 	struct s_console *console = args->arg[0];
 	struct s_map *map = args->arg[1];
@@ -582,10 +593,10 @@ void consoleTestsuiteKeygen(struct s_console_args *args) {
 	}
 	
 	if(dhCreate(&dhstate)) {
-		dhGenKey(&dhstate);
+		dhGenKey(&dhstate, 0);
 		consoleMsg(console, "dh pubkey generated.");
 		consoleNL(console);
-		ksize = dhGetPubkey(dercode, hexsize, &dhstate);
+		ksize = dhGetPubkey(dercode, hexsize, &dhstate, 0);
 		if(!(ksize > 0)) { consoleMsg(console, "failed."); consoleNL(console); }
 		snprintf(hexcode, hexsize, "%d", ksize);
 		consoleMsg(console, "size=");
@@ -787,8 +798,8 @@ void consoleTestsuiteAuthtest(struct s_console_args *args) {
 					if(nodekeyCreate(&nk_user_b)) {
 						if(nodekeyGenerate(&nk_user_a, 1024)) {
 							if(nodekeyGenerate(&nk_user_b, 1024)) {
-								if(authCreate(&user_a, &netid_a, &nk_user_a, &dh_user_a, 5)) {
-									if(authCreate(&user_b, &netid_b, &nk_user_b, &dh_user_b, 23)) {
+								if(authCreate(&user_a, &netid_a, &nk_user_a, &dh_user_a, NULL, 5)) {
+									if(authCreate(&user_b, &netid_b, &nk_user_b, &dh_user_b, NULL, 23)) {
 										consoleMsg(console, "auth state structures loaded."); consoleNL(console);
 										consoleTestsuiteAuthtestX(console, &user_a, &user_b);
 										consoleMsg(console, "user a: "); consoleTestsuiteAuthtestZ(console, &user_a);
@@ -844,6 +855,11 @@ void consoleTestsuiteAuthTestsuite(struct s_console_args *args) {
 }
 
 
+void consoleTestsuiteAuthCapacityTestsuite(struct s_console_args *args) {
+	authmgtCapacityTestsuite();
+}
+
+
 void consoleTestsuitePeerTestsuite(struct s_console_args *args) {
 	peermgtTestsuite();
 }
@@ -854,6 +870,56 @@ void consoleTestsuiteDfragTestsuite(struct s_console_args *args) {
 }
 
 
+void consoleTestsuiteTxqTestsuite(struct s_console_args *args) {
+	txqTestsuite();
+}
+
+
+void consoleTestsuiteFecTestsuite(struct s_console_args *args) {
+	fecTestsuite();
+}
+
+
+void consoleTestsuiteTbfTestsuite(struct s_console_args *args) {
+	tbfTestsuite();
+}
+
+
+void consoleTestsuitePeerRateTestsuite(struct s_console_args *args) {
+	peermgtRateTestsuite();
+}
+
+
+void consoleTestsuitePeerAggTestsuite(struct s_console_args *args) {
+	peermgtAggTestsuite();
+}
+
+
+void consoleTestsuitePeerResizeTestsuite(struct s_console_args *args) {
+	peermgtResizeTestsuite();
+}
+
+
+void consoleTestsuitePeerLinkTestsuite(struct s_console_args *args) {
+	peermgtLinkTestsuite();
+}
+
+
+void consoleTestsuitePeerResumeTestsuite(struct s_console_args *args) {
+	peermgtResumeTestsuite();
+}
+
+
+void consoleTestsuiteTimerTestsuite(struct s_console_args *args) {
+	timerTestsuite();
+}
+
+
+void consoleTestsuiteDHTestsuite(struct s_console_args *args) {
+	dhTestsuite();
+}
+
+
 void consoleTestsuiteEndian(struct s_console_args *args) {
 	struct s_console *console = args->arg[0];
 	if(utilIsLittleEndian()) {
@@ -892,6 +958,7 @@ int consoleTestsuite() {
 	struct s_console console;
 	struct s_map testmap;
 	struct s_seq_state seqstate;
+	uint64_t seqmask[(seq_REPLAYWINDOW_MAX / 64)];
 	struct s_ctr_state testctr;
 	char buf[rw_bufsize];
 	int run = 1;
@@ -899,10 +966,13 @@ int consoleTestsuite() {
 
 	ctrInit(&testctr);
 
+	seqSetWindow(&seqstate, seqmask, seq_REPLAYWINDOW_MAX);
+	seqInit(&seqstate, 0);
+
 	mapCreate(&testmap, 32, teststr_size, teststr_size);
 	mapEnableReplaceOld(&testmap);
 
-	consoleCreate(&console, 32, 512, cl_bufsize);
+	consoleCreate(&console, 64, 512, cl_bufsize);
 	consoleSetPrompt(&console, "test-console $ ");
 	consoleSetPromptStatus(&console, 1);
 	consoleWrite(&console, "\r\n", 2);
@@ -920,6 +990,7 @@ int consoleTestsuite() {
 	consoleRegisterCommand(&console, "packettestsuite", &consoleTestsuitePacketTestsuite, consoleArgs0());
 	consoleRegisterCommand(&console, "seqinit", &consoleTestsuiteSeqInit, consoleArgs3(&console, &seqstate, NULL));
 	consoleRegisterCommand(&console, "seqverify", &consoleTestsuiteSeqVerify, consoleArgs3(&console, &seqstate, NULL));
+	consoleRegisterCommand(&console, "seqtest", &consoleTestsuiteSeqTestsuite, consoleArgs0());
 	consoleRegisterCommand(&console, "treeview", &consoleTestsuiteTreeview, consoleArgs2(&console, &testmap));
 	consoleRegisterCommand(&console, "get", &consoleTestsuiteGet, consoleArgs3(&console, &testmap, NULL));
 	consoleRegisterCommand(&console, "getpf", &consoleTestsuiteGetpf, consoleArgs3(&console, &testmap, NULL));
@@ -932,8 +1003,19 @@ int consoleTestsuite() {
 	consoleRegisterCommand(&console, "masskeygen", &consoleTestsuiteMassKeygen, consoleArgs2(&console, NULL));
 	consoleRegisterCommand(&console, "authtest", &consoleTestsuiteAuthtest, consoleArgs1(&console));
 	consoleRegisterCommand(&console, "authtestsuite", &consoleTestsuiteAuthTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "authcaptest", &consoleTestsuiteAuthCapacityTestsuite, consoleArgs0());
 	consoleRegisterCommand(&console, "peermgttest", &consoleTestsuitePeerTestsuite, consoleArgs0());
 	consoleRegisterCommand(&console, "dfragtest", &consoleTestsuiteDfragTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "txqtest", &consoleTestsuiteTxqTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "fectest", &consoleTestsuiteFecTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "tbftest", &consoleTestsuiteTbfTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "ratetest", &consoleTestsuitePeerRateTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "aggtest", &consoleTestsuitePeerAggTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "resizetest", &consoleTestsuitePeerResizeTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "linktest", &consoleTestsuitePeerLinkTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "resumetest", &consoleTestsuitePeerResumeTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "timertest", &consoleTestsuiteTimerTestsuite, consoleArgs0());
+	consoleRegisterCommand(&console, "dhtest", &consoleTestsuiteDHTestsuite, consoleArgs0());
 	consoleRegisterCommand(&console, "textgen", &consoleTestsuiteTextgen, consoleArgs3(&console, NULL, NULL));
 	consoleRegisterCommand(&console, "endian", &consoleTestsuiteEndian, consoleArgs1(&console));
 	consoleRegisterCommand(&console, "ctrinc", &consoleTestsuiteCtrInc, consoleArgs2(&console, &testctr));
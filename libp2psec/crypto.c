@@ -22,8 +22,9 @@
 
 
 #include "util.c"
+#include <openssl/core_names.h>
 #include <openssl/evp.h>
-#include <openssl/hmac.h>
+#include <openssl/params.h>
 #include <openssl/rand.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -47,9 +48,9 @@
 
 // cipher context storage
 struct s_crypto {
-	EVP_CIPHER_CTX enc_ctx;
-	EVP_CIPHER_CTX dec_ctx;
-	HMAC_CTX hmac_ctx;
+	EVP_CIPHER_CTX *enc_ctx;
+	EVP_CIPHER_CTX *dec_ctx;
+	EVP_MAC_CTX *hmac_ctx;
 };
 
 
@@ -65,9 +66,22 @@ struct s_crypto_md {
 };
 
 
+// prefetched algorithms & shared contexts
+struct s_crypto_algorithms {
+	EVP_CIPHER *aes256cbc;
+	EVP_MD *sha256;
+	EVP_MD *sha512;
+	EVP_MAC *hmac;
+	EVP_MAC_CTX *keygen_ctx; // HMAC-SHA512 used as the pseudorandom function for key generation
+	EVP_MD_CTX *md_ctx;
+	int loaded;
+};
+struct s_crypto_algorithms cryptoAlgorithms = { .loaded = 0 };
+
+
 // return EVP cipher key size
 static int cryptoGetEVPCipherSize(struct s_crypto_cipher *st_cipher) {
-	return EVP_CIPHER_key_length(st_cipher->cipher);
+	return EVP_CIPHER_get_key_length(st_cipher->cipher);
 }
 
 
@@ -85,6 +99,44 @@ static struct s_crypto_md cryptoGetEVPMD(const EVP_MD *md) {
 }
 
 
+// set the digest of a HMAC context
+static int cryptoSetHMACDigest(EVP_MAC_CTX *hmac_ctx, const EVP_MD *md) {
+	OSSL_PARAM params[2];
+	params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char *)EVP_MD_get0_name(md), 0);
+	params[1] = OSSL_PARAM_construct_end();
+	return EVP_MAC_CTX_set_params(hmac_ctx, params);
+}
+
+
+// fetch algorithms. this is only done once, all other functions reuse the fetched algorithms.
+static int cryptoLoadAlgorithms() {
+	struct s_crypto_algorithms *alg = &cryptoAlgorithms;
+	if(alg->loaded) { return 1; }
+	if((alg->aes256cbc = EVP_CIPHER_fetch(NULL, "AES-256-CBC", NULL)) != NULL) {
+		if((alg->sha256 = EVP_MD_fetch(NULL, "SHA256", NULL)) != NULL) {
+			if((alg->sha512 = EVP_MD_fetch(NULL, "SHA512", NULL)) != NULL) {
+				if((alg->hmac = EVP_MAC_fetch(NULL, "HMAC", NULL)) != NULL) {
+					if((alg->keygen_ctx = EVP_MAC_CTX_new(alg->hmac)) != NULL) {
+						if(cryptoSetHMACDigest(alg->keygen_ctx, alg->sha512)) {
+							if((alg->md_ctx = EVP_MD_CTX_new()) != NULL) {
+								alg->loaded = 1;
+								return 1;
+							}
+						}
+						EVP_MAC_CTX_free(alg->keygen_ctx);
+					}
+					EVP_MAC_free(alg->hmac);
+				}
+				EVP_MD_free(alg->sha512);
+			}
+			EVP_MD_free(alg->sha256);
+		}
+		EVP_CIPHER_free(alg->aes256cbc);
+	}
+	return 0;
+}
+
+
 // initialize random number generator
 int cryptoRandFD = -1;
 static int cryptoRandInit() {
@@ -161,52 +213,53 @@ static int cryptoRandInt() {
 
 // generate keys
 static int cryptoSetKeys(struct s_crypto *ctxs, const int count, const unsigned char *secret_buf, const int secret_len, const unsigned char *nonce_buf, const int nonce_len) {
-	int cur_key_len;
+	size_t cur_key_len;
 	unsigned char cur_key[EVP_MAX_MD_SIZE];
-	int seed_key_len;
+	size_t seed_key_len;
 	unsigned char seed_key[EVP_MAX_MD_SIZE];
-	const EVP_MD *keygen_md = EVP_sha512();
-	const EVP_MD *out_md = EVP_sha256();
-	const EVP_CIPHER *out_cipher = EVP_aes_256_cbc();
-	const int key_size = EVP_CIPHER_key_length(out_cipher);
-	HMAC_CTX hmac_ctx;
+	EVP_MAC_CTX *hmac_ctx;
+	const EVP_CIPHER *out_cipher;
+	int key_size;
 	int16_t i;
 	unsigned char in[2];
 	int j,k;
 
 	// setup hmac as the pseudorandom function
-	HMAC_CTX_init(&hmac_ctx);
+	if(!cryptoLoadAlgorithms()) return 0;
+	hmac_ctx = cryptoAlgorithms.keygen_ctx;
+	out_cipher = cryptoAlgorithms.aes256cbc;
+	key_size = EVP_CIPHER_get_key_length(out_cipher);
 	
 	// calculate seed key
-	HMAC_Init_ex(&hmac_ctx, nonce_buf, nonce_len, keygen_md, NULL);
-	HMAC_Update(&hmac_ctx, secret_buf, secret_len);
-	HMAC_Final(&hmac_ctx, seed_key, (unsigned int *)&seed_key_len);
+	if(!EVP_MAC_init(hmac_ctx, nonce_buf, nonce_len, NULL)) return 0;
+	if(!EVP_MAC_update(hmac_ctx, secret_buf, secret_len)) return 0;
+	if(!EVP_MAC_final(hmac_ctx, seed_key, &seed_key_len, EVP_MAX_MD_SIZE)) return 0;
 	
 	// calculate derived keys
-	HMAC_Init_ex(&hmac_ctx, seed_key, seed_key_len, keygen_md, NULL);
-	HMAC_Update(&hmac_ctx, nonce_buf, nonce_len);
-	HMAC_Final(&hmac_ctx, cur_key, (unsigned int *)&cur_key_len);
+	if(!EVP_MAC_init(hmac_ctx, seed_key, seed_key_len, NULL)) return 0;
+	if(!EVP_MAC_update(hmac_ctx, nonce_buf, nonce_len)) return 0;
+	if(!EVP_MAC_final(hmac_ctx, cur_key, &cur_key_len, EVP_MAX_MD_SIZE)) return 0;
 	i = 0;
 	j = 0;
 	k = 0;
 	while(k < count) {
 		// calculate next key
 		utilWriteInt16(in, i);
-		HMAC_Init_ex(&hmac_ctx, NULL, -1, NULL, NULL);
-		HMAC_Update(&hmac_ctx, cur_key, cur_key_len);
-		HMAC_Update(&hmac_ctx, nonce_buf, nonce_len);
-		HMAC_Update(&hmac_ctx, in, 2);
-		HMAC_Final(&hmac_ctx, cur_key, (unsigned int *)&cur_key_len);
-		if(cur_key_len < key_size) return 0; // check if key is long enough
+		if(!EVP_MAC_init(hmac_ctx, NULL, 0, NULL)) return 0;
+		if(!EVP_MAC_update(hmac_ctx, cur_key, cur_key_len)) return 0;
+		if(!EVP_MAC_update(hmac_ctx, nonce_buf, nonce_len)) return 0;
+		if(!EVP_MAC_update(hmac_ctx, in, 2)) return 0;
+		if(!EVP_MAC_final(hmac_ctx, cur_key, &cur_key_len, EVP_MAX_MD_SIZE)) return 0;
+		if((int)cur_key_len < key_size) return 0; // check if key is long enough
 		switch(j) {
 			case 1:
 				// save this key as the decryption and encryption key
-				if(!EVP_EncryptInit_ex(&ctxs[k].enc_ctx, out_cipher, NULL, cur_key, NULL)) return 0;
-				if(!EVP_DecryptInit_ex(&ctxs[k].dec_ctx, out_cipher, NULL, cur_key, NULL)) return 0;
+				if(!EVP_EncryptInit_ex2(ctxs[k].enc_ctx, out_cipher, cur_key, NULL, NULL)) return 0;
+				if(!EVP_DecryptInit_ex2(ctxs[k].dec_ctx, out_cipher, cur_key, NULL, NULL)) return 0;
 				break;
 			case 2:
 				// save this key as the hmac key
-				HMAC_Init_ex(&ctxs[k].hmac_ctx, cur_key, cur_key_len, out_md, NULL);
+				if(!EVP_MAC_init(ctxs[k].hmac_ctx, cur_key, cur_key_len, NULL)) return 0;
 				break;
 			default:
 				// throw this key away
@@ -221,7 +274,8 @@ static int cryptoSetKeys(struct s_crypto *ctxs, const int count, const unsigned
 	}
 	
 	// clean up
-	HMAC_CTX_cleanup(&hmac_ctx);
+	OPENSSL_cleanse(seed_key, EVP_MAX_MD_SIZE);
+	OPENSSL_cleanse(cur_key, EVP_MAX_MD_SIZE);
 	return 1;
 }
 
@@ -239,11 +293,13 @@ static int cryptoSetKeysRandom(struct s_crypto *ctxs, const int count) {
 // destroy cipher contexts
 static void cryptoDestroy(struct s_crypto *ctxs, const int count) {
 	int i;
-	cryptoSetKeysRandom(ctxs, count);
 	for(i=0; i<count; i++) {
-		HMAC_CTX_cleanup(&ctxs[i].hmac_ctx);
-		EVP_CIPHER_CTX_cleanup(&ctxs[i].dec_ctx);
-		EVP_CIPHER_CTX_cleanup(&ctxs[i].enc_ctx);
+		EVP_MAC_CTX_free(ctxs[i].hmac_ctx);
+		EVP_CIPHER_CTX_free(ctxs[i].dec_ctx);
+		EVP_CIPHER_CTX_free(ctxs[i].enc_ctx);
+		ctxs[i].hmac_ctx = NULL;
+		ctxs[i].dec_ctx = NULL;
+		ctxs[i].enc_ctx = NULL;
 	}
 }
 
@@ -252,28 +308,36 @@ static void cryptoDestroy(struct s_crypto *ctxs, const int count) {
 static int cryptoCreate(struct s_crypto *ctxs, const int count) {
 	int i;
 	for(i=0; i<count; i++) {
-		EVP_CIPHER_CTX_init(&ctxs[i].enc_ctx);
-		EVP_CIPHER_CTX_init(&ctxs[i].dec_ctx);
-		HMAC_CTX_init(&ctxs[i].hmac_ctx);
+		ctxs[i].enc_ctx = NULL;
+		ctxs[i].dec_ctx = NULL;
+		ctxs[i].hmac_ctx = NULL;
 	}
-	if(cryptoSetKeysRandom(ctxs, count)) {
-		return 1;
-	}
-	else {
-		cryptoDestroy(ctxs, count);
-		return 0;
+	if(cryptoLoadAlgorithms()) {
+		for(i=0; i<count; i++) {
+			if((ctxs[i].enc_ctx = EVP_CIPHER_CTX_new()) == NULL) break;
+			if((ctxs[i].dec_ctx = EVP_CIPHER_CTX_new()) == NULL) break;
+			if((ctxs[i].hmac_ctx = EVP_MAC_CTX_new(cryptoAlgorithms.hmac)) == NULL) break;
+			if(!cryptoSetHMACDigest(ctxs[i].hmac_ctx, cryptoAlgorithms.sha256)) break;
+		}
+		if(!(i < count)) {
+			if(cryptoSetKeysRandom(ctxs, count)) {
+				return 1;
+			}
+		}
 	}
+	cryptoDestroy(ctxs, count);
+	return 0;
 }
 
 
 // generate HMAC tag
 static int cryptoHMAC(struct s_crypto *ctx, unsigned char *hmac_buf, const int hmac_len, const unsigned char *in_buf, const int in_len) {
 	unsigned char hmac[EVP_MAX_MD_SIZE];
-	int len;
-	HMAC_Init_ex(&ctx->hmac_ctx, NULL, -1, NULL, NULL);
-	HMAC_Update(&ctx->hmac_ctx, in_buf, in_len);
-	HMAC_Final(&ctx->hmac_ctx, hmac, (unsigned int *)&len);
-	if(len < hmac_len) return 0;
+	size_t len;
+	if(!EVP_MAC_init(ctx->hmac_ctx, NULL, 0, NULL)) return 0; // restart with the current key
+	if(!EVP_MAC_update(ctx->hmac_ctx, in_buf, in_len)) return 0;
+	if(!EVP_MAC_final(ctx->hmac_ctx, hmac, &len, EVP_MAX_MD_SIZE)) return 0;
+	if((int)len < hmac_len) return 0;
 	memcpy(hmac_buf, hmac, hmac_len);
 	return 1;
 }
@@ -286,11 +350,11 @@ static int cryptoSetSessionKeys(struct s_crypto *session_ctx, struct s_crypto *c
 	
 	// select algorithms
 	switch(cipher_algorithm) {
-		case crypto_AES256: st_cipher = cryptoGetEVPCipher(EVP_aes_256_cbc()); break;
+		case crypto_AES256: st_cipher = cryptoGetEVPCipher(cryptoAlgorithms.aes256cbc); break;
 		default: return 0;
 	}
 	switch(hmac_algorithm) {
-		case crypto_SHA256: st_md = cryptoGetEVPMD(EVP_sha256()); break;
+		case crypto_SHA256: st_md = cryptoGetEVPMD(cryptoAlgorithms.sha256); break;
 		default: return 0;
 	}
 	
@@ -302,50 +366,58 @@ static int cryptoSetSessionKeys(struct s_crypto *session_ctx, struct s_crypto *c
 	if(!cryptoHMAC(md_keygen_ctx, hmac_key, key_size, nonce, nonce_len)) return 0;
 
 	// set the keys
-	if(!EVP_EncryptInit_ex(&session_ctx->enc_ctx, st_cipher.cipher, NULL, cipher_key, NULL)) return 0;
-	if(!EVP_DecryptInit_ex(&session_ctx->dec_ctx, st_cipher.cipher, NULL, cipher_key, NULL)) return 0;
-	HMAC_Init_ex(&session_ctx->hmac_ctx, hmac_key, key_size, st_md.md, NULL);
+	if(!EVP_EncryptInit_ex2(session_ctx->enc_ctx, st_cipher.cipher, cipher_key, NULL, NULL)) return 0;
+	if(!EVP_DecryptInit_ex2(session_ctx->dec_ctx, st_cipher.cipher, cipher_key, NULL, NULL)) return 0;
+	if(!cryptoSetHMACDigest(session_ctx->hmac_ctx, st_md.md)) return 0;
+	if(!EVP_MAC_init(session_ctx->hmac_ctx, hmac_key, key_size, NULL)) return 0;
 
 	return 1;
 }
 
 
-// encrypt buffer
-static int cryptoEnc(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, const unsigned char *dec_buf, const int dec_len, const int hmac_len, const int iv_len) {
-	if(!((enc_len > 0) && (dec_len > 0) && (dec_len < enc_len) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE) && (iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
+// encrypt buffer, with additional data that is authenticated but not encrypted. output format: hmac | additional data | iv | ciphertext
+static int cryptoEncAD(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, const unsigned char *ad_buf, const int ad_len, const unsigned char *dec_buf, const int dec_len, const int hmac_len, const int iv_len) {
+	if(!((enc_len > 0) && (dec_len > 0) && (dec_len < enc_len) && (ad_len >= 0) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE) && (iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
 
 	unsigned char iv[crypto_MAXIVSIZE];
 	unsigned char hmac[hmac_len];
-	const int hdr_len = (hmac_len + iv_len);
+	const int hdr_len = (hmac_len + ad_len + iv_len);
 	int cr_len;
 	int len;
 
 	if(enc_len < (hdr_len + crypto_MAXIVSIZE + dec_len)) { return 0; }
 
+	if(ad_len > 0) memcpy(&enc_buf[hmac_len], ad_buf, ad_len);
 	memset(iv, 0, crypto_MAXIVSIZE);
 	cryptoRand(iv, iv_len);
-	memcpy(&enc_buf[hmac_len], iv, iv_len);
+	memcpy(&enc_buf[(hmac_len + ad_len)], iv, iv_len);
 
-	if(!EVP_EncryptInit_ex(&ctx->enc_ctx, NULL, NULL, NULL, iv)) { return 0; }
-	if(!EVP_EncryptUpdate(&ctx->enc_ctx, &enc_buf[(hdr_len)], &len, dec_buf, dec_len)) { return 0; }
+	if(!EVP_EncryptInit_ex2(ctx->enc_ctx, NULL, NULL, iv, NULL)) { return 0; }
+	if(!EVP_EncryptUpdate(ctx->enc_ctx, &enc_buf[(hdr_len)], &len, dec_buf, dec_len)) { return 0; }
 	cr_len = len;
-	if(!EVP_EncryptFinal(&ctx->enc_ctx, &enc_buf[(hdr_len + cr_len)], &len)) { return 0; }
+	if(!EVP_EncryptFinal_ex(ctx->enc_ctx, &enc_buf[(hdr_len + cr_len)], &len)) { return 0; }
 	cr_len += len;
 
-	if(!cryptoHMAC(ctx, hmac, hmac_len, &enc_buf[hmac_len], (iv_len + cr_len))) { return 0; }
+	if(!cryptoHMAC(ctx, hmac, hmac_len, &enc_buf[hmac_len], (ad_len + iv_len + cr_len))) { return 0; }
 	memcpy(enc_buf, hmac, hmac_len);
 
 	return (hdr_len + cr_len);
 }
 
 
-// decrypt buffer
-static int cryptoDec(struct s_crypto *ctx, unsigned char *dec_buf, const int dec_len, const unsigned char *enc_buf, const int enc_len, const int hmac_len, const int iv_len) {
-	if(!((enc_len > 0) && (dec_len > 0) && (enc_len < dec_len) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE) && (iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
+// encrypt buffer
+static int cryptoEnc(struct s_crypto *ctx, unsigned char *enc_buf, const int enc_len, const unsigned char *dec_buf, const int dec_len, const int hmac_len, const int iv_len) {
+	return cryptoEncAD(ctx, enc_buf, enc_len, NULL, 0, dec_buf, dec_len, hmac_len, iv_len);
+}
+
+
+// decrypt buffer that contains additional data. the additional data is authenticated, but left in place.
+static int cryptoDecAD(struct s_crypto *ctx, unsigned char *dec_buf, const int dec_len, const unsigned char *enc_buf, const int enc_len, const int ad_len, const int hmac_len, const int iv_len) {
+	if(!((enc_len > 0) && (dec_len > 0) && (enc_len < dec_len) && (ad_len >= 0) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE) && (iv_len > 0) && (iv_len <= crypto_MAXIVSIZE))) { return 0; }
 
 	unsigned char iv[crypto_MAXIVSIZE];
 	unsigned char hmac[hmac_len];
-	const int hdr_len = (hmac_len + iv_len);
+	const int hdr_len = (hmac_len + ad_len + iv_len);
 	int cr_len;
 	int len;
 
@@ -355,29 +427,71 @@ static int cryptoDec(struct s_crypto *ctx, unsigned char *dec_buf, const int dec
 	if(memcmp(hmac, enc_buf, hmac_len) != 0) { return 0; }
 
 	memset(iv, 0, crypto_MAXIVSIZE);
-	memcpy(iv, &enc_buf[hmac_len], iv_len);
+	memcpy(iv, &enc_buf[(hmac_len + ad_len)], iv_len);
 
-	if(!EVP_DecryptInit_ex(&ctx->dec_ctx, NULL, NULL, NULL, iv)) { return 0; }
-	if(!EVP_DecryptUpdate(&ctx->dec_ctx, dec_buf, &len, &enc_buf[hdr_len], (enc_len - hdr_len))) { return 0; }
+	if(!EVP_DecryptInit_ex2(ctx->dec_ctx, NULL, NULL, iv, NULL)) { return 0; }
+	if(!EVP_DecryptUpdate(ctx->dec_ctx, dec_buf, &len, &enc_buf[hdr_len], (enc_len - hdr_len))) { return 0; }
 	cr_len = len;
-	if(!EVP_DecryptFinal(&ctx->dec_ctx, &dec_buf[cr_len], &len)) { return 0; }
+	if(!EVP_DecryptFinal_ex(ctx->dec_ctx, &dec_buf[cr_len], &len)) { return 0; }
 	cr_len += len;
 	
 	return cr_len;
 }
 
 
+// decrypt buffer
+static int cryptoDec(struct s_crypto *ctx, unsigned char *dec_buf, const int dec_len, const unsigned char *enc_buf, const int enc_len, const int hmac_len, const int iv_len) {
+	return cryptoDecAD(ctx, dec_buf, dec_len, enc_buf, enc_len, 0, hmac_len, iv_len);
+}
+
+
+// authenticate buffer without encrypting it. output format: hmac | additional data | cleartext
+static int cryptoSignAD(struct s_crypto *ctx, unsigned char *out_buf, const int out_len, const unsigned char *ad_buf, const int ad_len, const unsigned char *in_buf, const int in_len, const int hmac_len) {
+	if(!((out_len > 0) && (in_len > 0) && (ad_len >= 0) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE))) { return 0; }
+
+	unsigned char hmac[hmac_len];
+	const int hdr_len = (hmac_len + ad_len);
+
+	if(out_len < (hdr_len + in_len)) { return 0; }
+
+	if(ad_len > 0) memcpy(&out_buf[hmac_len], ad_buf, ad_len);
+	memcpy(&out_buf[hdr_len], in_buf, in_len);
+
+	if(!cryptoHMAC(ctx, hmac, hmac_len, &out_buf[hmac_len], (ad_len + in_len))) { return 0; }
+	memcpy(out_buf, hmac, hmac_len);
+
+	return (hdr_len + in_len);
+}
+
+
+// verify buffer that was authenticated with cryptoSignAD and copy the cleartext. the additional data is left in place.
+static int cryptoVerifyAD(struct s_crypto *ctx, unsigned char *out_buf, const int out_len, const unsigned char *in_buf, const int in_len, const int ad_len, const int hmac_len) {
+	if(!((out_len > 0) && (in_len > 0) && (ad_len >= 0) && (hmac_len > 0) && (hmac_len <= crypto_MAXHMACSIZE))) { return 0; }
+
+	unsigned char hmac[hmac_len];
+	const int hdr_len = (hmac_len + ad_len);
+	const int len = (in_len - hdr_len);
+
+	if(!((len > 0) && (len <= out_len))) { return 0; }
+
+	if(!cryptoHMAC(ctx, hmac, hmac_len, &in_buf[hmac_len], (in_len - hmac_len))) { return 0; }
+	if(memcmp(hmac, in_buf, hmac_len) != 0) { return 0; }
+
+	memcpy(out_buf, &in_buf[hdr_len], len);
+
+	return len;
+}
+
+
 // calculate hash
 static int cryptoCalculateHash(unsigned char *hash_buf, const int hash_len, const unsigned char *in_buf, const int in_len, const EVP_MD *hash_func) {
 	unsigned char hash[EVP_MAX_MD_SIZE];
-	int len;
-	EVP_MD_CTX *ctx;
-	ctx = EVP_MD_CTX_create();
-	EVP_DigestInit_ex(ctx, hash_func, NULL);
-	EVP_DigestUpdate(ctx, in_buf, in_len);
-	EVP_DigestFinal(ctx, hash, (unsigned int *)&len);
-	EVP_MD_CTX_destroy(ctx);
-	if(len < hash_len) return 0;
+	unsigned int len;
+	EVP_MD_CTX *ctx = cryptoAlgorithms.md_ctx;
+	if(!EVP_DigestInit_ex2(ctx, hash_func, NULL)) return 0;
+	if(!EVP_DigestUpdate(ctx, in_buf, in_len)) return 0;
+	if(!EVP_DigestFinal_ex(ctx, hash, &len)) return 0;
+	if((int)len < hash_len) return 0;
 	memcpy(hash_buf, hash, hash_len);
 	return 1;
 }
@@ -385,13 +499,15 @@ static int cryptoCalculateHash(unsigned char *hash_buf, const int hash_len, cons
 
 // calculate SHA-256 hash
 static int cryptoCalculateSHA256(unsigned char *hash_buf, const int hash_len, const unsigned char *in_buf, const int in_len) {
-	return cryptoCalculateHash(hash_buf, hash_len, in_buf, in_len, EVP_sha256());
+	if(!cryptoLoadAlgorithms()) return 0;
+	return cryptoCalculateHash(hash_buf, hash_len, in_buf, in_len, cryptoAlgorithms.sha256);
 }
 
 
 // calculate SHA-512 hash
 static int cryptoCalculateSHA512(unsigned char *hash_buf, const int hash_len, const unsigned char *in_buf, const int in_len) {
-	return cryptoCalculateHash(hash_buf, hash_len, in_buf, in_len, EVP_sha512());
+	if(!cryptoLoadAlgorithms()) return 0;
+	return cryptoCalculateHash(hash_buf, hash_len, in_buf, in_len, cryptoAlgorithms.sha512);
 }
 
 
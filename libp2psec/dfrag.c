@@ -21,175 +21,262 @@
 #define F_DFRAG_C
 
 
+#include "idsp.c"
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 
 
+// Maximum number of fragments per message.
+#define dfrag_FRAGMENT_MAX 64
+
+
+// Incomplete messages are dropped after this amount of seconds.
+#define dfrag_TIMEOUT 2
+
+
+// The message entry structure. Non-final fragments are stored at their final position as soon as their size is known.
+// The last fragment is stored at the end of the buffer until the size of the other fragments is known.
+struct s_dfrag_entry {
+	int peerct;
+	int peerid;
+	int64_t seq;
+	int fragcount;
+	uint64_t fragmask;
+	int fraglen;
+	int lastlen;
+	int lastpos;
+	int msglength;
+	int start;
+	int next;
+};
+
+
+// The fragment buffer structure. Messages are indexed by a hash table of (PeerID, PeerCT, sequence number).
 struct s_dfrag {
-	unsigned char *fragbuf;
-	int *used;
-	int *peerct;
-	int *peerid;
-	int64_t *seq;
-	int *length;
-	int *msglength;
-	int fragbuf_size;
-	int fragbuf_count;
-	int pos;
+	struct s_idsp idsp;
+	struct s_dfrag_entry *entry;
+	unsigned char *msgbuf;
+	int *hashtable;
+	int *peerentries;
+	int msgbuf_size;
+	int msgbuf_count;
+	int hash_size;
+	int peer_count;
+	int peer_max;
 };
 
 
-// Reset fragment buffer structure.
-static void dfragReset(struct s_dfrag *dfrag) {
-	int i, j;
-	j = dfrag->fragbuf_count;
-	for(i=0; i<j; i++) {
-		dfrag->used[i] = 0;
-	}
-	dfrag->pos = 0;
+// Calculate hash table position of a message.
+static int dfragHash(struct s_dfrag *dfrag, const int peerct, const int peerid, const int64_t seq) {
+	uint64_t h;
+	h = ((uint64_t)seq * 0x9E3779B97F4A7C15ULL);
+	h = h ^ ((uint64_t)((uint32_t)peerid) * 0xC2B2AE3D27D4EB4FULL);
+	h = h ^ (uint64_t)((uint32_t)peerct);
+	h = h ^ (h >> 29);
+	return (int)(h & (uint64_t)(dfrag->hash_size - 1));
 }
 
 
-// Returns 1 if the specified message has the specified ID.
-static int dfragIsID(struct s_dfrag *dfrag, const int peerct, const int peerid, const int64_t seq, const int id) {
-	if(dfrag->used[id] > 0) {
-		if(dfrag->peerct[id] == peerct) {
-			if(dfrag->peerid[id] == peerid) {
-				if(dfrag->seq[id] == seq) {
-					return 1;
-				}
-			}
-		}
+// Reset fragment buffer structure.
+static void dfragReset(struct s_dfrag *dfrag) {
+	int i;
+	idspReset(&dfrag->idsp);
+	for(i=0; i<dfrag->hash_size; i++) {
+		dfrag->hashtable[i] = -1;
+	}
+	for(i=0; i<dfrag->peer_count; i++) {
+		dfrag->peerentries[i] = 0;
 	}
-	return 0;
 }
 
 
 // Return message ID.
 static int dfragGetID(struct s_dfrag *dfrag, const int peerct, const int peerid, const int64_t seq) {
-	int i, j;
-	j = dfrag->fragbuf_count;
-	for(i=0; i<j; i++) {
-		if(dfragIsID(dfrag, peerct, peerid, seq, i)) {
-			return i;
+	struct s_dfrag_entry *entry;
+	int id = dfrag->hashtable[dfragHash(dfrag, peerct, peerid, seq)];
+	while(!(id < 0)) {
+		entry = &dfrag->entry[id];
+		if((entry->seq == seq) && (entry->peerid == peerid) && (entry->peerct == peerct)) {
+			return id;
 		}
+		id = entry->next;
 	}
 	return -1;
 }
 
 
-// Allocate message ID.
-static int dfragAllocateID(struct s_dfrag *dfrag, const int fragment_count) {
-	int i;
-	int id;
-	int pos = dfrag->pos;
-	int fbcount = dfrag->fragbuf_count;
-	if(fbcount >= fragment_count) {
-		// allocate ID
-		if((fbcount - pos) >= fragment_count) {
-			id = pos;
-		}
-		else {
-			id = 0;
-		}
-		dfrag->used[id] = fragment_count;
-		dfrag->length[id] = 0;
-		dfrag->msglength[id] = 0;
-		dfrag->pos = id + fragment_count;
-		
-		// overwrite previous message(s)
-		for(i=1; i<fragment_count; i++) {
-			dfrag->used[(id + i)] = 0;
-			dfrag->length[(id + i)] = 0;
-			dfrag->msglength[(id + i)] = 0;
+// Clear message.
+static void dfragClear(struct s_dfrag *dfrag, const int id) {
+	struct s_dfrag_entry *entry = &dfrag->entry[id];
+	int *link;
+	if(!idspIsValid(&dfrag->idsp, id)) return;
+
+	// remove from hash table
+	link = &dfrag->hashtable[dfragHash(dfrag, entry->peerct, entry->peerid, entry->seq)];
+	while(!(*link < 0)) {
+		if(*link == id) {
+			*link = entry->next;
+			break;
 		}
-		
-		return id;
-	}
-	else {
-		return -1;
+		link = &dfrag->entry[*link].next;
 	}
+
+	// release ID
+	dfrag->peerentries[entry->peerid]--;
+	idspDelete(&dfrag->idsp, id);
 }
 
 
-// Clear message.
-static void dfragClear(struct s_dfrag *dfrag, const int id) {
-	dfrag->used[id] = 0;
-	dfrag->length[id] = 0;
-	dfrag->msglength[id] = 0;
+// Allocate message ID. A peer that reached its share replaces its own oldest message, otherwise stale or the oldest messages of all peers are replaced if the buffer is full.
+static int dfragAllocateID(struct s_dfrag *dfrag, const int peerct, const int peerid, const int64_t seq, const int fragment_count, const int tnow) {
+	struct s_dfrag_entry *entry;
+	int i, id, oldest, used;
+	int hash;
+
+	if(!((peerid >= 0) && (peerid < dfrag->peer_count))) return -1;
+	if(!((fragment_count > 0) && (fragment_count <= dfrag_FRAGMENT_MAX))) return -1;
+
+	// replace the oldest message of the peer if it reached its share
+	if(!(dfrag->peerentries[peerid] < dfrag->peer_max)) {
+		oldest = -1;
+		used = idspUsedCount(&dfrag->idsp);
+		for(i=0; i<used; i++) {
+			id = idspGetUsedID(&dfrag->idsp, i);
+			if((dfrag->entry[id].peerid == peerid) && ((oldest < 0) || ((dfrag->entry[id].start - dfrag->entry[oldest].start) < 0))) {
+				oldest = id;
+			}
+		}
+		if(!(oldest < 0)) dfragClear(dfrag, oldest);
+	}
+
+	// drop stale messages and replace the oldest message if the buffer is full
+	if(!(idspUsedCount(&dfrag->idsp) < idspSize(&dfrag->idsp))) {
+		oldest = -1;
+		i = 0;
+		while(i < idspUsedCount(&dfrag->idsp)) {
+			id = idspGetUsedID(&dfrag->idsp, i);
+			if((tnow - dfrag->entry[id].start) >= dfrag_TIMEOUT) {
+				dfragClear(dfrag, id); // the last used ID takes its place in the list
+			}
+			else {
+				if((oldest < 0) || ((dfrag->entry[id].start - dfrag->entry[oldest].start) < 0)) oldest = id;
+				i++;
+			}
+		}
+		if((!(idspUsedCount(&dfrag->idsp) < idspSize(&dfrag->idsp))) && (!(oldest < 0))) dfragClear(dfrag, oldest);
+	}
+
+	// allocate ID
+	id = idspNew(&dfrag->idsp);
+	if(id < 0) return -1;
+	entry = &dfrag->entry[id];
+	entry->peerct = peerct;
+	entry->peerid = peerid;
+	entry->seq = seq;
+	entry->fragcount = fragment_count;
+	entry->fragmask = 0;
+	entry->fraglen = 0;
+	entry->lastlen = 0;
+	entry->lastpos = 0;
+	entry->msglength = 0;
+	entry->start = tnow;
+	hash = dfragHash(dfrag, peerct, peerid, seq);
+	entry->next = dfrag->hashtable[hash];
+	dfrag->hashtable[hash] = id;
+	dfrag->peerentries[peerid]++;
+	return id;
 }
 
 
 // Return length of completed message.
 static int dfragLength(struct s_dfrag *dfrag, const int id) {
-	return dfrag->msglength[id];
+	return dfrag->entry[id].msglength;
 }
 
 
 // Return pointer to message (dfragLength should be called first to get the message length).
 static unsigned char *dfragGet(struct s_dfrag *dfrag, const int id) {
-	return &dfrag->fragbuf[(id * dfrag->fragbuf_size)];
+	return &dfrag->msgbuf[(id * dfrag->msgbuf_size)];
 }
 
 
-// Calculate message length and save result.
+// Calculate message length and save result. The last fragment is moved to its final position when the message is complete.
 static int dfragCalcLength(struct s_dfrag *dfrag, const int id) {
-	int i;
-	int len;
-	int fragcount = dfrag->used[id];
-
-	if(!(fragcount > 0)) { return 0; }
-
-	// length of last fragment
-	len = dfrag->length[id + (fragcount - 1)];
-	if(!(len > 0)) { return 0; }
-
-	// length of other fragments
-	i = fragcount - 1;
-	while(i > 0) {
-		i = i - 1;
-		if(dfrag->length[id + i] != dfrag->fragbuf_size) { return 0; }
-		len = len + dfrag->fragbuf_size;
+	struct s_dfrag_entry *entry = &dfrag->entry[id];
+	const uint64_t fullmask = ((entry->fragcount < 64) ? ((((uint64_t)1) << entry->fragcount) - 1) : (~((uint64_t)0)));
+	unsigned char *buf = dfragGet(dfrag, id);
+	int lastpos;
+
+	if(entry->fragmask != fullmask) { return 0; }
+
+	// move last fragment
+	lastpos = ((entry->fragcount - 1) * entry->fraglen);
+	if(entry->lastpos != lastpos) {
+		memmove(&buf[lastpos], &buf[entry->lastpos], entry->lastlen);
+		entry->lastpos = lastpos;
 	}
-	
+
 	// save message length
-	dfrag->msglength[id] = len;
-	return len;
+	entry->msglength = (lastpos + entry->lastlen);
+	return entry->msglength;
 }
 
 
 // Combine fragments to a message. Returns an ID if the message is completed or -1 in every other case.
-static int dfragAssemble(struct s_dfrag *dfrag, const int peerct, const int peerid, const int64_t seq, const unsigned char *fragment, const int fragment_len, const int fragment_pos, const int fragment_count) {
+static int dfragAssemble(struct s_dfrag *dfrag, const int peerct, const int peerid, const int64_t seq, const unsigned char *fragment, const int fragment_len, const int fragment_pos, const int fragment_count, const int tnow) {
+	struct s_dfrag_entry *entry;
+	unsigned char *buf;
 	int id;
+	int pos;
 
 	// check arguments
-	if((!(fragment_count > 0)) || (fragment_pos < 0) || (!(fragment_pos < fragment_count)) || (!(fragment_len > 0)) || (fragment_len > dfrag->fragbuf_size) || ((fragment_len != dfrag->fragbuf_size) && ((fragment_pos + 1) != fragment_count))) { return -1; }
+	if((!(fragment_count > 0)) || (fragment_count > dfrag_FRAGMENT_MAX) || (fragment_pos < 0) || (!(fragment_pos < fragment_count)) || (!(fragment_len > 0)) || (fragment_len > dfrag->msgbuf_size)) { return -1; }
 
 	// find message ID
 	id = dfragGetID(dfrag, peerct, peerid, seq);
-	
+
 	if(id < 0) {
 		// allocate an ID if nothing is found
-		id = dfragAllocateID(dfrag, fragment_count);
+		id = dfragAllocateID(dfrag, peerct, peerid, seq, fragment_count, tnow);
 		if(id < 0) { return -1; }
+	}
+	entry = &dfrag->entry[id];
+	buf = dfragGet(dfrag, id);
 
-		dfrag->peerct[id] = peerct;
-		dfrag->peerid[id] = peerid;
-		dfrag->seq[id] = seq;
+	// check arguments
+	if((fragment_count != entry->fragcount) || (entry->fragmask & (((uint64_t)1) << fragment_pos))) { return -1; }
+
+	if((fragment_pos + 1) < fragment_count) {
+		// start or middle fragment, all of them have the same size
+		if(entry->fraglen == 0) {
+			if((entry->lastlen > fragment_len) || ((((fragment_count - 1) * fragment_len) + entry->lastlen) > dfrag->msgbuf_size)) { dfragClear(dfrag, id); return -1; }
+			entry->fraglen = fragment_len;
+		}
+		else {
+			if(entry->fraglen != fragment_len) { dfragClear(dfrag, id); return -1; }
+		}
+		pos = (fragment_pos * fragment_len);
 	}
 	else {
-		// check arguments
-		if((fragment_count != dfrag->used[id]) || (peerid != dfrag->peerid[id]) || (seq != dfrag->seq[id]) || (!((id + fragment_pos) < dfrag->fragbuf_count))) { return -1; }
+		// end fragment, stored at the end of the buffer if its position is unknown
+		if(entry->fraglen > 0) {
+			pos = ((fragment_count - 1) * entry->fraglen);
+			if((fragment_len > entry->fraglen) || ((pos + fragment_len) > dfrag->msgbuf_size)) { dfragClear(dfrag, id); return -1; }
+		}
+		else {
+			pos = ((fragment_count > 1) ? (dfrag->msgbuf_size - fragment_len) : 0);
+		}
+		entry->lastlen = fragment_len;
+		entry->lastpos = pos;
 	}
 
 	// copy fragment to buffer
-	dfrag->length[(id + fragment_pos)] = fragment_len;
-	memcpy(&dfrag->fragbuf[((id + fragment_pos) * dfrag->fragbuf_size)], fragment, fragment_len);
-	
+	memcpy(&buf[pos], fragment, fragment_len);
+	entry->fragmask = (entry->fragmask | (((uint64_t)1) << fragment_pos));
+
 	// check if message is complete
-	dfragCalcLength(dfrag, id);
-	if(dfragLength(dfrag, id) > 0) {
+	if(dfragCalcLength(dfrag, id) > 0) {
 		return id;
 	}
 	else {
@@ -198,68 +285,106 @@ static int dfragAssemble(struct s_dfrag *dfrag, const int peerct, const int peer
 }
 
 
-// Create fragment buffer structure.
-static int dfragCreate(struct s_dfrag *dfrag, const int size, const int count) {
-	unsigned char *fragbuf_mem = NULL;
-	int *used_mem = NULL;
-	int *peerct_mem = NULL;
-	int *peerid_mem = NULL;
-	int64_t *seq_mem = NULL;
-	int *length_mem = NULL;
-	int *msglength_mem = NULL;
-	if(size > 0 && count > 0) {
-		fragbuf_mem = malloc(size * count);
-		if(fragbuf_mem != NULL) {
-			used_mem = malloc(sizeof(int) * count);
-			if(used_mem != NULL) {
-				peerct_mem = malloc(sizeof(int) * count);
-				if(peerct_mem != NULL) {
-					peerid_mem = malloc(sizeof(int) * count);
-					if(peerid_mem != NULL) {
-						seq_mem = malloc(sizeof(int64_t) * count);
-						if(seq_mem != NULL) {
-							length_mem = malloc(sizeof(int) * count);
-							if(length_mem != NULL) {
-								msglength_mem = malloc(sizeof(int) * count);
-								if(msglength_mem != NULL) {
-									dfrag->fragbuf = fragbuf_mem;
-									dfrag->used = used_mem;
-									dfrag->peerct = peerct_mem;
-									dfrag->peerid = peerid_mem;
-									dfrag->seq = seq_mem;
-									dfrag->length = length_mem;
-									dfrag->msglength = msglength_mem;
-									dfrag->fragbuf_count = count;
-									dfrag->fragbuf_size = size;
-									dfragReset(dfrag);
-									return 1;
-								}
-								free(length_mem);
-							}
-							free(seq_mem);
+// Create fragment buffer structure. Each peer may use up to peer_max of the msgbuf_count message buffers.
+static int dfragCreate(struct s_dfrag *dfrag, const int msgbuf_size, const int msgbuf_count, const int peer_count, const int peer_max) {
+	struct s_dfrag_entry *entry_mem = NULL;
+	unsigned char *msgbuf_mem = NULL;
+	int *hashtable_mem = NULL;
+	int *peerentries_mem = NULL;
+	int hash_size;
+	if((msgbuf_size > 0) && (msgbuf_count > 0) && (peer_count > 0) && (peer_max > 0)) {
+		hash_size = 1;
+		while(hash_size < (msgbuf_count * 2)) hash_size = (hash_size * 2);
+		entry_mem = malloc(sizeof(struct s_dfrag_entry) * msgbuf_count);
+		if(entry_mem != NULL) {
+			msgbuf_mem = malloc(msgbuf_size * msgbuf_count);
+			if(msgbuf_mem != NULL) {
+				hashtable_mem = malloc(sizeof(int) * hash_size);
+				if(hashtable_mem != NULL) {
+					peerentries_mem = malloc(sizeof(int) * peer_count);
+					if(peerentries_mem != NULL) {
+						if(idspCreate(&dfrag->idsp, msgbuf_count)) {
+							dfrag->entry = entry_mem;
+							dfrag->msgbuf = msgbuf_mem;
+							dfrag->hashtable = hashtable_mem;
+							dfrag->peerentries = peerentries_mem;
+							dfrag->msgbuf_size = msgbuf_size;
+							dfrag->msgbuf_count = msgbuf_count;
+							dfrag->hash_size = hash_size;
+							dfrag->peer_count = peer_count;
+							dfrag->peer_max = peer_max;
+							dfragReset(dfrag);
+							return 1;
 						}
-						free(peerid_mem);
+						free(peerentries_mem);
 					}
-					free(peerct_mem);
+					free(hashtable_mem);
 				}
-				free(used_mem);
+				free(msgbuf_mem);
 			}
-			free(fragbuf_mem);
+			free(entry_mem);
 		}
 	}
 	return 0;
 }
 
 
+// Increase the number of message buffers and peers. Incomplete messages are kept.
+static int dfragResize(struct s_dfrag *dfrag, const int msgbuf_count, const int peer_count) {
+	struct s_dfrag_entry *entry_mem;
+	unsigned char *msgbuf_mem;
+	int *hashtable_mem;
+	int *peerentries_mem;
+	int hash_size;
+	int hash;
+	int i, id;
+	if((msgbuf_count < dfrag->msgbuf_count) || (peer_count < dfrag->peer_count)) return 0;
+	hash_size = dfrag->hash_size;
+	while(hash_size < (msgbuf_count * 2)) hash_size = (hash_size * 2);
+	entry_mem = realloc(dfrag->entry, (sizeof(struct s_dfrag_entry) * msgbuf_count));
+	if(entry_mem == NULL) return 0;
+	dfrag->entry = entry_mem;
+	msgbuf_mem = realloc(dfrag->msgbuf, (dfrag->msgbuf_size * msgbuf_count));
+	if(msgbuf_mem == NULL) return 0;
+	dfrag->msgbuf = msgbuf_mem;
+	hashtable_mem = realloc(dfrag->hashtable, (sizeof(int) * hash_size));
+	if(hashtable_mem == NULL) return 0;
+	dfrag->hashtable = hashtable_mem;
+	peerentries_mem = realloc(dfrag->peerentries, (sizeof(int) * peer_count));
+	if(peerentries_mem == NULL) return 0;
+	dfrag->peerentries = peerentries_mem;
+	if(!idspResize(&dfrag->idsp, msgbuf_count)) return 0;
+	for(i=dfrag->peer_count; i<peer_count; i++) {
+		dfrag->peerentries[i] = 0;
+	}
+	dfrag->msgbuf_count = msgbuf_count;
+	dfrag->peer_count = peer_count;
+
+	// rebuild the hash table if it has grown
+	if(hash_size != dfrag->hash_size) {
+		dfrag->hash_size = hash_size;
+		for(i=0; i<hash_size; i++) {
+			dfrag->hashtable[i] = -1;
+		}
+		for(i=0; i<idspUsedCount(&dfrag->idsp); i++) {
+			id = idspGetUsedID(&dfrag->idsp, i);
+			hash = dfragHash(dfrag, dfrag->entry[id].peerct, dfrag->entry[id].peerid, dfrag->entry[id].seq);
+			dfrag->entry[id].next = dfrag->hashtable[hash];
+			dfrag->hashtable[hash] = id;
+		}
+	}
+
+	return 1;
+}
+
+
 // Destroy fragment buffer structure.
 static void dfragDestroy(struct s_dfrag *dfrag) {
-	free(dfrag->msglength);
-	free(dfrag->length);
-	free(dfrag->seq);
-	free(dfrag->peerid);
-	free(dfrag->peerct);
-	free(dfrag->used);
-	free(dfrag->fragbuf);
+	idspDestroy(&dfrag->idsp);
+	free(dfrag->peerentries);
+	free(dfrag->hashtable);
+	free(dfrag->msgbuf);
+	free(dfrag->entry);
 }
 
 
@@ -103,7 +103,7 @@ static int dfragTestsuiteRun(struct s_dfrag *dfrag, const int fragsize, const un
 			for(i = 0; i < 4; i++) {
 				pos = order[(4*j)+i];
 				msgid = (pos/2);
-				ret = dfragAssemble(dfrag, k, k, msgid, &cmpstr[((k * fragsize * 4) + (pos * fragsize))], fragsize, (pos - (msgid * 2)), 2);
+				ret = dfragAssemble(dfrag, k, k, msgid, &cmpstr[((k * fragsize * 4) + (pos * fragsize))], fragsize, (pos - (msgid * 2)), 2, 0);
 				if(!(ret < 0)) {
 					len = dfragLength(dfrag, ret);
 					if(len > 0 && len <= (fragsize * 2)) {
@@ -125,6 +125,33 @@ static int dfragTestsuiteRun(struct s_dfrag *dfrag, const int fragsize, const un
 }
 
 
+// A peer that floods incomplete messages must not evict the messages of other peers.
+static int dfragTestsuiteFlood(struct s_dfrag *dfrag, const int fragsize, const unsigned char *cmpstr) {
+	int i;
+	int ret;
+	if(dfragAssemble(dfrag, 1, 1, 1000, &cmpstr[0], fragsize, 0, 2, 0) >= 0) return 0;
+	for(i = 0; i < 1000; i++) {
+		if(dfragAssemble(dfrag, 2, 2, i, &cmpstr[fragsize], fragsize, 0, 2, 0) >= 0) return 0;
+	}
+	ret = dfragAssemble(dfrag, 1, 1, 1000, &cmpstr[fragsize], fragsize, 1, 2, 0);
+	if(ret < 0) return 0;
+	if(dfragLength(dfrag, ret) != (fragsize * 2)) return 0;
+	if(memcmp(dfragGet(dfrag, ret), cmpstr, (fragsize * 2)) != 0) return 0;
+	dfragClear(dfrag, ret);
+
+	// stale messages are replaced when the buffer is full
+	for(i = 0; i < 4; i++) {
+		if(dfragAssemble(dfrag, (3 + i), (3 + i), 0, cmpstr, fragsize, 0, 2, 0) >= 0) return 0;
+	}
+	if(dfragAssemble(dfrag, 7, 7, 0, cmpstr, fragsize, 0, 2, dfrag_TIMEOUT) >= 0) return 0;
+	if(idspUsedCount(&dfrag->idsp) != 1) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
 static int dfragTestsuite() {
 	unsigned char *str1;
 	unsigned char *str2;
@@ -137,7 +164,7 @@ static int dfragTestsuite() {
 	struct s_dfrag *dfrag;
 	dfrag = malloc(sizeof(struct s_dfrag));
 	if(dfrag != NULL) {
-		if(dfragCreate(dfrag, fragsize, fragcount)) {
+		if(dfragCreate(dfrag, (fragsize * 2), fragcount, 64, 2)) {
 			str1 = malloc(str_len);
 			if(str1 != NULL) {
 				str2 = malloc(str_len);
@@ -150,6 +177,8 @@ static int dfragTestsuite() {
 							dfragTestsuiteText(str2, 8192, 9, 0);
 							dfragTestsuiteText(str3, 8192, 10, 0);
 							ret = dfragTestsuiteRun(dfrag, fragsize, str1, buf, str_len);
+							if(ret) ret = dfragTestsuiteRun(dfrag, (fragsize - 56), str2, buf, str_len); // fragments smaller than the buffer size
+							if(ret) ret = dfragTestsuiteFlood(dfrag, fragsize, str3);
 							free(buf);
 						}
 						free(str3);
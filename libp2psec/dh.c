@@ -25,6 +25,7 @@
 #include <openssl/dh.h>
 #include <openssl/pem.h>
 #include <openssl/bn.h>
+#include <stdlib.h>
 
 
 // Maximum and minimum sizes of DH public key in bytes.
@@ -32,18 +33,38 @@
 #define dh_MAXSIZE 768
 
 
-// The DH state structure.
-struct s_dh_state {
+// Number of DH keys that are precomputed when the DH state is created.
+#define dh_KEYCOUNT 8
+
+
+// Minimum time between two key regenerations in microseconds.
+#define dh_REFRESH_INTERVAL 25000
+
+
+// The DH key structure. A key is either fresh, in use by one key exchange, or stale until it is regenerated.
+struct s_dh_key {
 	DH *dh;
-	BIGNUM *bn;
 	unsigned char pubkey[dh_MAXSIZE];
 	int pubkey_size;
+	int used;
+	int fresh;
+};
+
+
+// The DH state structure.
+struct s_dh_state {
+	DH *params;
+	BIGNUM *bn;
+	struct s_dh_key *key;
+	int keycount;
+	int stalecount;
+	int64_t lastrefresh;
 };
 
 
 // Load DH parameters.
 static int dhLoadParams(struct s_dh_state *dhstate, unsigned char *dhpem, const int dhpem_size) {
-	DH *dhptr = dhstate->dh;
+	DH *dhptr = dhstate->params;
 	BIO *biodh;
 	int ret;
 	int err;
@@ -51,7 +72,7 @@ static int dhLoadParams(struct s_dh_state *dhstate, unsigned char *dhpem, const
 		ret = 0;
 		biodh = BIO_new_mem_buf(dhpem, dhpem_size);
 		if(PEM_read_bio_DHparams(biodh, &dhptr, NULL, NULL) != NULL) {
-			ret = DH_check(dhstate->dh, &err);
+			ret = DH_check(dhstate->params, &err);
 		}
 		BIO_free(biodh);
 		return ret;
@@ -79,44 +100,145 @@ CXzWzPkElg5L22pMUCPfYxo10HKoUHmSYwIBAg==\n\
 }
 
 
-// Generate a key.
-static int dhGenKey(struct s_dh_state *dhstate) {
-	BIGNUM *bn;
+// Generate a new key pair for the specified key slot.
+static int dhGenKey(struct s_dh_state *dhstate, const int keyid) {
+	struct s_dh_key *key = &dhstate->key[keyid];
+	DH *dh;
+	const BIGNUM *bn;
 	int bn_size;
-	if(DH_generate_key(dhstate->dh)) {
-		bn = dhstate->dh->pub_key;
-		bn_size = BN_num_bytes(bn);
-		if((bn_size > dh_MINSIZE) && (bn_size < dh_MAXSIZE)) {
-			BN_bn2bin(bn, dhstate->pubkey);
-			dhstate->pubkey_size = bn_size;
-			return 1;
+	key->pubkey_size = 0;
+	key->fresh = 0;
+	dh = DHparams_dup(dhstate->params); // start from the parameters only, so that a new private key is generated
+	if(dh != NULL) {
+		if(DH_generate_key(dh)) {
+			bn = DH_get0_pub_key(dh);
+			bn_size = BN_num_bytes(bn);
+			if((bn_size > dh_MINSIZE) && (bn_size < dh_MAXSIZE)) {
+				BN_bn2bin(bn, key->pubkey);
+				if(key->dh != NULL) DH_free(key->dh);
+				key->dh = dh;
+				key->pubkey_size = bn_size;
+				key->fresh = 1;
+				return 1;
+			}
+		}
+		DH_free(dh);
+	}
+	return 0;
+}
+
+
+// Get a fresh key for a new key exchange. A key is never shared by two key exchanges. Returns the key ID, or -1 if no fresh key is available.
+static int dhAcquireKey(struct s_dh_state *dhstate) {
+	int i;
+	for(i=0; i<dhstate->keycount; i++) {
+		if((!dhstate->key[i].used) && (dhstate->key[i].fresh)) {
+			dhstate->key[i].used = 1;
+			dhstate->key[i].fresh = 0;
+			return i;
 		}
-		else {
-			return 0;
+	}
+	return -1;
+}
+
+
+// Release a key after the key exchange is done. The key is stale until it is regenerated.
+static void dhReleaseKey(struct s_dh_state *dhstate, const int keyid) {
+	if((keyid >= 0) && (keyid < dhstate->keycount)) {
+		if(dhstate->key[keyid].used) {
+			dhstate->key[keyid].used = 0;
+			dhstate->stalecount++;
 		}
 	}
-	else {
-		return 0;
+}
+
+
+// Return the amount of microseconds until the next key can be regenerated, or -1 if there is no stale key.
+static int dhGetRefreshDelay(struct s_dh_state *dhstate, const int64_t now) {
+	int64_t elapsed = (now - dhstate->lastrefresh);
+	if(!(dhstate->stalecount > 0)) return -1;
+	if((elapsed < 0) || (elapsed >= dh_REFRESH_INTERVAL)) return 0;
+	return (int)(dh_REFRESH_INTERVAL - elapsed);
+}
+
+
+// Regenerate one stale key if the time since the last regeneration is at least dh_REFRESH_INTERVAL. Returns 1 if a key has been regenerated.
+static int dhRefresh(struct s_dh_state *dhstate, const int64_t now) {
+	int i;
+	if(dhGetRefreshDelay(dhstate, now) != 0) return 0;
+	for(i=0; i<dhstate->keycount; i++) {
+		if((!dhstate->key[i].used) && (!dhstate->key[i].fresh)) {
+			dhstate->lastrefresh = now;
+			if(!dhGenKey(dhstate, i)) return 0;
+			dhstate->stalecount--;
+			return 1;
+		}
 	}
+	return 0;
 }
 
 
-// Create a DH state object.
+// Increase the number of keys to count. The new keys are stale and get generated by dhRefresh.
+static int dhResize(struct s_dh_state *dhstate, const int count) {
+	struct s_dh_key *key_mem;
+	int i;
+	if(!(count > dhstate->keycount)) return 1;
+	key_mem = realloc(dhstate->key, (sizeof(struct s_dh_key) * count));
+	if(key_mem == NULL) return 0;
+	for(i=dhstate->keycount; i<count; i++) {
+		key_mem[i].dh = NULL;
+		key_mem[i].pubkey_size = 0;
+		key_mem[i].used = 0;
+		key_mem[i].fresh = 0;
+	}
+	dhstate->stalecount = (dhstate->stalecount + (count - dhstate->keycount));
+	dhstate->key = key_mem;
+	dhstate->keycount = count;
+	return 1;
+}
+
+
+// Create a DH state object with dh_KEYCOUNT precomputed keys.
 static int dhCreate(struct s_dh_state *dhstate) {
-	dhstate->bn = BN_new();
-	if(dhstate->bn != NULL) {
-		BN_zero(dhstate->bn);
-		dhstate->pubkey_size = 0;
-		dhstate->dh = DH_new();
-		if(dhstate->dh != NULL) {
-			if(dhLoadDefaultParams(dhstate)) {
-				if(dhGenKey(dhstate)) {
-					return 1;
+	struct s_dh_key *key_mem;
+	int i;
+	key_mem = malloc(sizeof(struct s_dh_key) * dh_KEYCOUNT);
+	if(key_mem != NULL) {
+		for(i=0; i<dh_KEYCOUNT; i++) {
+			key_mem[i].dh = NULL;
+			key_mem[i].pubkey_size = 0;
+			key_mem[i].used = 0;
+			key_mem[i].fresh = 0;
+		}
+		dhstate->key = key_mem;
+		dhstate->keycount = dh_KEYCOUNT;
+		dhstate->stalecount = 0;
+		dhstate->lastrefresh = 0;
+		dhstate->bn = BN_new();
+		if(dhstate->bn != NULL) {
+			BN_zero(dhstate->bn);
+			dhstate->params = DH_new();
+			if(dhstate->params != NULL) {
+				if(dhLoadDefaultParams(dhstate)) {
+					i = 0;
+					while(i < dh_KEYCOUNT) {
+						if(!dhGenKey(dhstate, i)) break;
+						i++;
+					}
+					if(!(i < dh_KEYCOUNT)) {
+						return 1;
+					}
+					while(i > 0) {
+						i--;
+						DH_free(dhstate->key[i].dh);
+						dhstate->key[i].dh = NULL;
+					}
 				}
+				DH_free(dhstate->params);
 			}
-			DH_free(dhstate->dh);
+			BN_free(dhstate->bn);
 		}
-		BN_free(dhstate->bn);
+		free(key_mem);
 	}
 	return 0;
 }
@@ -124,23 +246,29 @@ static int dhCreate(struct s_dh_state *dhstate) {
 
 // Destroy a DH state object.
 static void dhDestroy(struct s_dh_state *dhstate) {
-	DH_free(dhstate->dh);
+	int i;
+	for(i=0; i<dhstate->keycount; i++) {
+		DH_free(dhstate->key[i].dh);
+	}
+	free(dhstate->key);
+	dhstate->key = NULL;
+	dhstate->keycount = 0;
+	DH_free(dhstate->params);
 	BN_free(dhstate->bn);
-	dhstate->pubkey_size = 0;
 }
 
 
 // Get size of binary encoded DH public key in bytes.
-static int dhGetPubkeySize(const struct s_dh_state *dhstate) {
-	return dhstate->pubkey_size;
+static int dhGetPubkeySize(const struct s_dh_state *dhstate, const int keyid) {
+	return dhstate->key[keyid].pubkey_size;
 }
 
 
 // Get binary encoded DH public key. Returns length if successful.
-static int dhGetPubkey(unsigned char *buf, const int buf_size, const struct s_dh_state *dhstate) {
-	int dhsize = dhGetPubkeySize(dhstate);
+static int dhGetPubkey(unsigned char *buf, const int buf_size, const struct s_dh_state *dhstate, const int keyid) {
+	int dhsize = dhGetPubkeySize(dhstate, keyid);
 	if((dhsize > dh_MINSIZE) && (dhsize < buf_size)) {
-		memcpy(buf, dhstate->pubkey, dhsize);
+		memcpy(buf, dhstate->key[keyid].pubkey, dhsize);
 		return dhsize;
 	}
 	else {
@@ -150,15 +278,15 @@ static int dhGetPubkey(unsigned char *buf, const int buf_size, const struct s_dh
 
 
 // Generate symmetric keys. Returns 1 if succesful.
-static int dhGenCryptoKeys(struct s_crypto *ctx, const int ctx_count, const struct s_dh_state *dhstate, const unsigned char *peerkey, const int peerkey_len, const unsigned char *nonce, const int nonce_len) {
+static int dhGenCryptoKeys(struct s_crypto *ctx, const int ctx_count, const struct s_dh_state *dhstate, const int keyid, const unsigned char *peerkey, const int peerkey_len, const unsigned char *nonce, const int nonce_len) {
 	BIGNUM *bn = dhstate->bn;
-	DH *dh = dhstate->dh;
+	DH *dh = dhstate->key[keyid].dh;
 	int ret = 0;
 	int maxsize = DH_size(dh);
 	unsigned char secret[maxsize];
 	int size;
 	BN_bin2bn(peerkey, peerkey_len, bn);
-	if(BN_ucmp(bn, dh->pub_key) != 0) {
+	if(BN_ucmp(bn, DH_get0_pub_key(dh)) != 0) {
 		size = DH_compute_key(secret, bn, dh);
 		if(size > 0) {
 			ret = cryptoSetKeys(ctx, ctx_count, secret, size, nonce, nonce_len);
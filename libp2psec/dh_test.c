@@ -0,0 +1,112 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_DH_TEST_C
+#define F_DH_TEST_C
+
+
+#include "dh.c"
+#include <stdio.h>
+#include <string.h>
+
+
+#define dhTestsuite_KEYCOUNT (dh_KEYCOUNT * 2)
+
+
+// Acquire keys until the pool is drained. No key may be handed out while another key exchange holds it. Returns the number of acquired keys.
+static int dhTestsuiteDrain(struct s_dh_state *dhstate, int *held) {
+	int count = 0;
+	int keyid;
+	while(!((keyid = dhAcquireKey(dhstate)) < 0)) {
+		if(!(keyid < dhstate->keycount)) return -1;
+		if(held[keyid]) return -1;
+		held[keyid] = 1;
+		count++;
+	}
+	return count;
+}
+
+
+static int dhTestsuiteRun(struct s_dh_state *dhstate) {
+	unsigned char oldkey[dh_MAXSIZE];
+	unsigned char newkey[dh_MAXSIZE];
+	int oldkey_size;
+	int held[dhTestsuite_KEYCOUNT];
+	int64_t now = 1000000;
+	int count;
+	int i;
+
+	// the pool is grown to the number of auth slots, the new keys are generated later
+	memset(held, 0, sizeof(held));
+	if(!dhResize(dhstate, dhTestsuite_KEYCOUNT)) return 0;
+	if(dhstate->keycount != dhTestsuite_KEYCOUNT) return 0;
+	if(dhTestsuiteDrain(dhstate, held) != dh_KEYCOUNT) return 0;
+	if(dhAcquireKey(dhstate) != -1) return 0;
+
+	// released keys are regenerated before they are handed out again
+	oldkey_size = dhGetPubkey(oldkey, dh_MAXSIZE, dhstate, 0);
+	if(!(oldkey_size > 0)) return 0;
+	dhReleaseKey(dhstate, 0);
+	dhReleaseKey(dhstate, 0); // releasing twice has no effect
+	held[0] = 0;
+	if(dhAcquireKey(dhstate) != -1) return 0;
+
+	// one key per interval is regenerated
+	count = 0;
+	while(dhGetRefreshDelay(dhstate, now) == 0) {
+		if(!dhRefresh(dhstate, now)) return 0;
+		if(dhRefresh(dhstate, now)) return 0;
+		if(dhGetRefreshDelay(dhstate, now) > 0) {
+			if(dhGetRefreshDelay(dhstate, now) != dh_REFRESH_INTERVAL) return 0;
+			if(dhGetRefreshDelay(dhstate, (now + dh_REFRESH_INTERVAL - 1)) != 1) return 0;
+		}
+		now = (now + dh_REFRESH_INTERVAL);
+		count++;
+	}
+	if(count != (dhTestsuite_KEYCOUNT - dh_KEYCOUNT + 1)) return 0;
+	if(dhGetRefreshDelay(dhstate, now) != -1) return 0;
+	if((dhGetPubkey(newkey, dh_MAXSIZE, dhstate, 0) == oldkey_size) && (memcmp(oldkey, newkey, oldkey_size) == 0)) return 0;
+
+	// the refilled pool hands out every key that is not held exactly once
+	if(dhTestsuiteDrain(dhstate, held) != count) return 0;
+	for(i=0; i<dhTestsuite_KEYCOUNT; i++) {
+		if(!held[i]) return 0;
+		dhReleaseKey(dhstate, i);
+	}
+	if(dhAcquireKey(dhstate) != -1) return 0;
+	if(dhGetRefreshDelay(dhstate, now) != 0) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int dhTestsuite() {
+	int ret = 0;
+	struct s_dh_state dhstate;
+	if(dhCreate(&dhstate)) {
+		ret = dhTestsuiteRun(&dhstate);
+		dhDestroy(&dhstate);
+	}
+	return ret;
+}
+
+
+#endif // F_DH_TEST_C
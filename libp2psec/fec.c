@@ -0,0 +1,335 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_FEC_C
+#define F_FEC_C
+
+
+#include "seq.c"
+#include "util.c"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+// Maximum number of packets protected by one parity packet.
+#define fec_GROUP_MAX 16
+
+
+// Parity packet layout: base sequence number | packet count | sequence number offsets | XOR of all protected items.
+// Each item consists of payload type, payload options, payload length and the zero padded payload.
+#define fec_HDR_SEQ_START 0
+#define fec_HDR_COUNT_START 8
+#define fec_HDR_OFFSETS_START 9
+#define fec_ITEMHDR_SIZE 4
+
+
+// The encoder group structure.
+struct s_fec_group {
+	int64_t seq[fec_GROUP_MAX];
+	int size;
+	int count;
+	int maxlen;
+	int64_t start;
+	int prev;
+	int next;
+	unsigned char *parity;
+};
+
+
+// The decoder cache entry structure.
+struct s_fec_item {
+	int peerid;
+	int64_t seq;
+	int len;
+	unsigned char *buf;
+};
+
+
+// The FEC state structure. Parity is built in one encoder group per peer, received packets are kept in a direct mapped cache.
+// Open encoder groups are linked in the order they were started, so the oldest group is always at the head of the list.
+struct s_fec {
+	struct s_fec_group *group;
+	int head;
+	int tail;
+	struct s_fec_item *item;
+	unsigned char *mem;
+	int group_count;
+	int item_count;
+	int item_size;
+};
+
+
+// XOR a protected item into a parity buffer.
+static void fecXor(unsigned char *parity, const int type, const int options, const unsigned char *buf, const int len) {
+	int i;
+	parity[0] ^= type;
+	parity[1] ^= options;
+	parity[2] ^= ((len >> 8) & 0xFF);
+	parity[3] ^= (len & 0xFF);
+	for(i=0; i<len; i++) {
+		parity[(fec_ITEMHDR_SIZE + i)] ^= buf[i];
+	}
+}
+
+
+// Reset encoder group.
+static void fecGroupReset(struct s_fec *fec, const int id) {
+	struct s_fec_group *group = &fec->group[id];
+	if(group->count > 0) {
+		if(group->prev < 0) fec->head = group->next; else fec->group[group->prev].next = group->next;
+		if(group->next < 0) fec->tail = group->prev; else fec->group[group->next].prev = group->prev;
+	}
+	group->count = 0;
+	group->maxlen = 0;
+	memset(group->parity, 0, (fec_ITEMHDR_SIZE + fec->item_size));
+}
+
+
+// Return number of packets in the encoder group.
+static int fecGroupCount(struct s_fec *fec, const int id) {
+	return fec->group[id].count;
+}
+
+
+// Return start time of the encoder group.
+static int64_t fecGroupStart(struct s_fec *fec, const int id) {
+	return fec->group[id].start;
+}
+
+
+// Return the ID of the oldest encoder group that contains packets, or -1 if all groups are empty.
+static int fecGetOldestGroup(struct s_fec *fec) {
+	return fec->head;
+}
+
+
+// Add a packet to the encoder group. A new group protects up to size packets. Returns 1 if the group is complete.
+static int fecEncode(struct s_fec *fec, const int id, const int size, const int64_t seq, const int type, const int options, const unsigned char *buf, const int len, const int64_t tnow_us) {
+	struct s_fec_group *group = &fec->group[id];
+	if(!((len > 0) && (len <= fec->item_size))) return 0;
+	if((group->count > 0) && (group->count >= group->size)) return 1; // parity of the full group has not been sent yet
+	if((group->count > 0) && (!((seq - group->seq[0]) < 65536))) fecGroupReset(fec, id); // offset would not fit, start a new group
+	if(group->count == 0) {
+		if(!(size > 1)) return 0;
+		group->size = ((size < fec_GROUP_MAX) ? size : fec_GROUP_MAX);
+		group->start = tnow_us;
+		group->prev = fec->tail;
+		group->next = -1;
+		if(fec->tail < 0) fec->head = id; else fec->group[fec->tail].next = id;
+		fec->tail = id;
+	}
+	group->seq[group->count] = seq;
+	group->count++;
+	if(len > group->maxlen) group->maxlen = len;
+	fecXor(group->parity, type, options, buf, len);
+	return (group->count >= group->size);
+}
+
+
+// Generate parity payload of the encoder group and reset the group. Returns the payload length.
+static int fecGetParity(struct s_fec *fec, const int id, unsigned char *out, const int out_len) {
+	struct s_fec_group *group = &fec->group[id];
+	int hdrlen = (fec_HDR_OFFSETS_START + (2 * group->count));
+	int len = (hdrlen + fec_ITEMHDR_SIZE + group->maxlen);
+	int i;
+	if(!((group->count > 0) && (len <= out_len))) {
+		fecGroupReset(fec, id);
+		return 0;
+	}
+	utilWriteInt64(&out[fec_HDR_SEQ_START], group->seq[0]);
+	out[fec_HDR_COUNT_START] = group->count;
+	for(i=0; i<group->count; i++) {
+		utilWriteInt16(&out[(fec_HDR_OFFSETS_START + (2 * i))], (group->seq[i] - group->seq[0]));
+	}
+	memcpy(&out[hdrlen], group->parity, (fec_ITEMHDR_SIZE + group->maxlen));
+	fecGroupReset(fec, id);
+	return len;
+}
+
+
+// Return cache position of a received packet.
+static int fecItemPos(struct s_fec *fec, const int peerid, const int64_t seq) {
+	uint64_t h = (((uint64_t)seq * 0x9E3779B97F4A7C15ULL) ^ ((uint64_t)((uint32_t)peerid) * 0xC2B2AE3D27D4EB4FULL));
+	return (int)((h >> 32) % (uint64_t)fec->item_count);
+}
+
+
+// Store a received packet in the cache.
+static void fecStore(struct s_fec *fec, const int peerid, const int64_t seq, const int type, const int options, const unsigned char *buf, const int len) {
+	struct s_fec_item *item;
+	if(!((len > 0) && (len <= fec->item_size))) return;
+	item = &fec->item[fecItemPos(fec, peerid, seq)];
+	item->peerid = peerid;
+	item->seq = seq;
+	item->len = (fec_ITEMHDR_SIZE + len);
+	memset(item->buf, 0, (fec_ITEMHDR_SIZE + len));
+	fecXor(item->buf, type, options, buf, len);
+}
+
+
+// Recover a lost packet from a parity payload. The packets that have not been received yet are determined using the sequence number state.
+// Returns the payload length and writes the recovered packet to out if exactly one packet of the group is missing.
+static int fecDecode(struct s_fec *fec, const int peerid, const struct s_seq_state *seqstate, const unsigned char *parity, const int parity_len, int64_t *seq, int *type, int *options, unsigned char *out, const int out_len) {
+	struct s_fec_item *item;
+	int64_t baseseq;
+	int64_t itemseq;
+	int count;
+	int hdrlen;
+	int xorlen;
+	int missing;
+	int len;
+	int i, j;
+
+	// check header
+	if(!(parity_len > fec_HDR_OFFSETS_START)) return 0;
+	baseseq = utilReadInt64(&parity[fec_HDR_SEQ_START]);
+	count = parity[fec_HDR_COUNT_START];
+	hdrlen = (fec_HDR_OFFSETS_START + (2 * count));
+	xorlen = (parity_len - hdrlen);
+	if(!((count > 0) && (count <= fec_GROUP_MAX) && (xorlen > fec_ITEMHDR_SIZE) && (xorlen <= (fec_ITEMHDR_SIZE + fec->item_size)) && ((xorlen - fec_ITEMHDR_SIZE) <= out_len))) return 0;
+
+	// find the missing packet
+	missing = -1;
+	for(i=0; i<count; i++) {
+		itemseq = (baseseq + (uint16_t)utilReadInt16(&parity[(fec_HDR_OFFSETS_START + (2 * i))]));
+		if(seqCheck(seqstate, itemseq)) {
+			if(!(missing < 0)) return 0; // more than one packet is missing
+			missing = i;
+			*seq = itemseq;
+		}
+		else {
+			item = &fec->item[fecItemPos(fec, peerid, itemseq)];
+			if(!((item->peerid == peerid) && (item->seq == itemseq) && (item->len <= xorlen))) return 0; // not in cache anymore
+		}
+	}
+	if(missing < 0) return 0;
+
+	// XOR the parity with all received packets
+	memcpy(out, &parity[(hdrlen + fec_ITEMHDR_SIZE)], (xorlen - fec_ITEMHDR_SIZE));
+	*type = parity[hdrlen];
+	*options = parity[(hdrlen + 1)];
+	len = ((parity[(hdrlen + 2)] << 8) | parity[(hdrlen + 3)]);
+	for(i=0; i<count; i++) {
+		if(i == missing) continue;
+		itemseq = (baseseq + (uint16_t)utilReadInt16(&parity[(fec_HDR_OFFSETS_START + (2 * i))]));
+		item = &fec->item[fecItemPos(fec, peerid, itemseq)];
+		*type ^= item->buf[0];
+		*options ^= item->buf[1];
+		len ^= ((item->buf[2] << 8) | item->buf[3]);
+		for(j=fec_ITEMHDR_SIZE; j<item->len; j++) {
+			out[(j - fec_ITEMHDR_SIZE)] ^= item->buf[j];
+		}
+	}
+	if(!((len > 0) && (len <= (xorlen - fec_ITEMHDR_SIZE)))) return 0;
+	return len;
+}
+
+
+// Reset FEC state.
+static void fecReset(struct s_fec *fec) {
+	int i;
+	for(i=0; i<fec->group_count; i++) {
+		fec->group[i].count = 0;
+		fecGroupReset(fec, i);
+	}
+	fec->head = -1;
+	fec->tail = -1;
+	for(i=0; i<fec->item_count; i++) {
+		fec->item[i].peerid = -1;
+		fec->item[i].len = 0;
+	}
+}
+
+
+// Create FEC state with group_count encoder groups and item_count cache entries for payloads up to item_size bytes.
+static int fecCreate(struct s_fec *fec, const int group_count, const int item_count, const int item_size) {
+	const int bufsize = (fec_ITEMHDR_SIZE + item_size);
+	struct s_fec_group *group_mem = NULL;
+	struct s_fec_item *item_mem = NULL;
+	unsigned char *mem = NULL;
+	int i;
+	if((group_count > 0) && (item_count > 0) && (item_size > 0)) {
+		group_mem = malloc(sizeof(struct s_fec_group) * group_count);
+		if(group_mem != NULL) {
+			item_mem = malloc(sizeof(struct s_fec_item) * item_count);
+			if(item_mem != NULL) {
+				mem = malloc(bufsize * (item_count + group_count));
+				if(mem != NULL) {
+					for(i=0; i<item_count; i++) {
+						item_mem[i].buf = &mem[(bufsize * i)];
+					}
+					for(i=0; i<group_count; i++) {
+						group_mem[i].parity = &mem[(bufsize * (item_count + i))];
+					}
+					fec->group = group_mem;
+					fec->item = item_mem;
+					fec->mem = mem;
+					fec->group_count = group_count;
+					fec->item_count = item_count;
+					fec->item_size = item_size;
+					fecReset(fec);
+					return 1;
+				}
+				free(item_mem);
+			}
+			free(group_mem);
+		}
+	}
+	return 0;
+}
+
+
+// Increase the number of encoder groups. The buffers of the cache entries are stored before the parity buffers, so both keep their content.
+static int fecResize(struct s_fec *fec, const int group_count) {
+	const int bufsize = (fec_ITEMHDR_SIZE + fec->item_size);
+	struct s_fec_group *group_mem;
+	unsigned char *mem;
+	int i;
+	if(group_count < fec->group_count) return 0;
+	group_mem = realloc(fec->group, (sizeof(struct s_fec_group) * group_count));
+	if(group_mem == NULL) return 0;
+	fec->group = group_mem;
+	mem = realloc(fec->mem, (bufsize * (fec->item_count + group_count)));
+	if(mem == NULL) return 0;
+	fec->mem = mem;
+	for(i=0; i<fec->item_count; i++) {
+		fec->item[i].buf = &mem[(bufsize * i)];
+	}
+	for(i=0; i<group_count; i++) {
+		fec->group[i].parity = &mem[(bufsize * (fec->item_count + i))];
+	}
+	for(i=fec->group_count; i<group_count; i++) {
+		fec->group[i].count = 0;
+		fecGroupReset(fec, i);
+	}
+	fec->group_count = group_count;
+	return 1;
+}
+
+
+// Destroy FEC state.
+static void fecDestroy(struct s_fec *fec) {
+	free(fec->mem);
+	free(fec->item);
+	free(fec->group);
+}
+
+
+#endif // F_FEC_C
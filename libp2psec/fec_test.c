@@ -0,0 +1,140 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_FEC_TEST_C
+#define F_FEC_TEST_C
+
+
+#include "fec.c"
+#include <stdio.h>
+
+
+#define fecTestsuite_ITEMSIZE 256
+#define fecTestsuite_PARITYSIZE (fec_HDR_OFFSETS_START + (2 * fec_GROUP_MAX) + fec_ITEMHDR_SIZE + fecTestsuite_ITEMSIZE)
+#define fecTestsuite_GROUPSIZE 4
+
+
+// Encode a group of packets of different sizes and deliver all of them except the ones in the drop mask to the receiver.
+// Returns the parity payload length.
+static int fecTestsuiteGroup(struct s_fec *tx, struct s_fec *rx, struct s_seq_state *rxseq, const int64_t baseseq, unsigned char pkt[][fecTestsuite_ITEMSIZE], int *pktlen, const int dropmask, unsigned char *parity) {
+	int i, j;
+	for(i=0; i<fecTestsuite_GROUPSIZE; i++) {
+		pktlen[i] = (fecTestsuite_ITEMSIZE - (i * 37));
+		for(j=0; j<pktlen[i]; j++) pkt[i][j] = (unsigned char)((baseseq * 7) + (i * 31) + j);
+		if(fecEncode(tx, 1, fecTestsuite_GROUPSIZE, (baseseq + i), (0x10 + i), i, pkt[i], pktlen[i], 0) != (i == (fecTestsuite_GROUPSIZE - 1))) return 0;
+		if(!(dropmask & (1 << i))) {
+			if(!seqVerify(rxseq, (baseseq + i))) return 0;
+			fecStore(rx, 1, (baseseq + i), (0x10 + i), i, pkt[i], pktlen[i]);
+		}
+	}
+	return fecGetParity(tx, 1, parity, fecTestsuite_PARITYSIZE);
+}
+
+
+// Start encoder groups in a mixed order and check that the oldest open group is always found, also after growing the state.
+static int fecTestsuiteOrder(struct s_fec *tx) {
+	unsigned char pkt[16];
+	unsigned char parity[fecTestsuite_PARITYSIZE];
+	memset(pkt, 0x55, sizeof(pkt));
+	if(fecGetOldestGroup(tx) != -1) return 0;
+	if(!fecResize(tx, 8)) return 0;
+	if(fecEncode(tx, 3, fecTestsuite_GROUPSIZE, 100, 0x10, 0, pkt, sizeof(pkt), 10) != 0) return 0;
+	if(fecEncode(tx, 1, fecTestsuite_GROUPSIZE, 200, 0x10, 0, pkt, sizeof(pkt), 20) != 0) return 0;
+	if(fecEncode(tx, 5, fecTestsuite_GROUPSIZE, 300, 0x10, 0, pkt, sizeof(pkt), 30) != 0) return 0;
+	if(fecEncode(tx, 3, fecTestsuite_GROUPSIZE, 101, 0x10, 0, pkt, sizeof(pkt), 40) != 0) return 0; // adding to a group keeps its position
+	if(fecGetOldestGroup(tx) != 3) return 0;
+	if(!(fecGetParity(tx, 3, parity, sizeof(parity)) > 0)) return 0;
+	if((fecGetOldestGroup(tx) != 1) || (fecGroupStart(tx, 1) != 20)) return 0;
+	if(fecEncode(tx, 3, fecTestsuite_GROUPSIZE, 102, 0x10, 0, pkt, sizeof(pkt), 50) != 0) return 0; // restarted group goes to the end
+	fecGroupReset(tx, 5); // remove from the middle
+	if(!fecResize(tx, 12)) return 0;
+	if(fecGetOldestGroup(tx) != 1) return 0;
+	if(fecEncode(tx, 10, fecTestsuite_GROUPSIZE, 400, 0x10, 0, pkt, sizeof(pkt), 60) != 0) return 0;
+	if(fecEncode(tx, 1, fecTestsuite_GROUPSIZE, (200 + 65536), 0x10, 0, pkt, sizeof(pkt), 70) != 0) return 0; // offset overflow starts a new group
+	if(fecGetOldestGroup(tx) != 3) return 0;
+	fecGroupReset(tx, 3);
+	if(fecGetOldestGroup(tx) != 10) return 0;
+	fecGroupReset(tx, 10);
+	if((fecGetOldestGroup(tx) != 1) || (fecGroupStart(tx, 1) != 70)) return 0;
+	fecGroupReset(tx, 1);
+	fecGroupReset(tx, 1);
+	if(fecGetOldestGroup(tx) != -1) return 0;
+	return 1;
+}
+
+
+// Drop one packet of a group and check that it is rebuilt byte for byte, then check that a group with two missing packets is rejected.
+static int fecTestsuiteRun(struct s_fec *tx, struct s_fec *rx) {
+	unsigned char pkt[fecTestsuite_GROUPSIZE][fecTestsuite_ITEMSIZE];
+	int pktlen[fecTestsuite_GROUPSIZE];
+	unsigned char parity[fecTestsuite_PARITYSIZE];
+	unsigned char out[fecTestsuite_PARITYSIZE];
+	struct s_seq_state rxseq;
+	uint64_t rxseqmask[(seq_REPLAYWINDOW_DEFAULT / 64)];
+	int64_t baseseq = 1001;
+	int64_t seq;
+	int type;
+	int options;
+	int paritylen;
+	int len;
+	int i;
+
+	if(!fecTestsuiteOrder(tx)) return 0;
+
+	seqSetWindow(&rxseq, rxseqmask, seq_REPLAYWINDOW_DEFAULT);
+	seqInit(&rxseq, 1000);
+	for(i=0; i<fecTestsuite_GROUPSIZE; i++) {
+		paritylen = fecTestsuiteGroup(tx, rx, &rxseq, baseseq, pkt, pktlen, (1 << i), parity);
+		if(!(paritylen > 0)) return 0;
+		len = fecDecode(rx, 1, &rxseq, parity, paritylen, &seq, &type, &options, out, sizeof(out));
+		if(len != pktlen[i]) return 0;
+		if((seq != (baseseq + i)) || (type != (0x10 + i)) || (options != i)) return 0;
+		if(memcmp(out, pkt[i], len) != 0) return 0;
+		if(!seqVerify(&rxseq, seq)) return 0;
+		if(fecDecode(rx, 1, &rxseq, parity, paritylen, &seq, &type, &options, out, sizeof(out)) != 0) return 0; // nothing missing anymore
+		baseseq = (baseseq + fecTestsuite_GROUPSIZE);
+	}
+
+	// two missing packets can't be recovered
+	paritylen = fecTestsuiteGroup(tx, rx, &rxseq, baseseq, pkt, pktlen, 0x5, parity);
+	if(!(paritylen > 0)) return 0;
+	if(fecDecode(rx, 1, &rxseq, parity, paritylen, &seq, &type, &options, out, sizeof(out)) != 0) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int fecTestsuite() {
+	int ret = 0;
+	struct s_fec tx;
+	struct s_fec rx;
+	if(fecCreate(&tx, 2, 64, fecTestsuite_ITEMSIZE)) {
+		if(fecCreate(&rx, 2, 64, fecTestsuite_ITEMSIZE)) {
+			ret = fecTestsuiteRun(&tx, &rx);
+			fecDestroy(&rx);
+		}
+		fecDestroy(&tx);
+	}
+	return ret;
+}
+
+
+#endif // F_FEC_TEST_C
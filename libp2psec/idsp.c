@@ -101,6 +101,26 @@ static int idspCreate(struct s_idsp *idsp, const int size) {
 }
 
 
+static int idspResize(struct s_idsp *idsp, const int size) {
+	int *idfwd_mem;
+	int *idlist_mem;
+	int i;
+	if(size < idsp->count) return 0;
+	idfwd_mem = realloc(idsp->idfwd, (sizeof(int) * size));
+	if(idfwd_mem == NULL) return 0;
+	idsp->idfwd = idfwd_mem;
+	idlist_mem = realloc(idsp->idlist, (sizeof(int) * size));
+	if(idlist_mem == NULL) return 0;
+	idsp->idlist = idlist_mem;
+	for(i=idsp->count; i<size; i++) {
+		idsp->idfwd[i] = -1;
+		idsp->idlist[i] = i;
+	}
+	idsp->count = size;
+	return 1;
+}
+
+
 static int idspNextN(struct s_idsp *idsp, const int start) {
 	int nextid;
 	int iter;
@@ -201,6 +221,16 @@ static void idspDelete(struct s_idsp *idsp, const int id) {
 }
 
 
+static int idspGetUsedID(struct s_idsp *idsp, const int pos) {
+	if((pos >= 0) && (pos < idsp->used)) {
+		return idsp->idlist[pos];
+	}
+	else {
+		return -1;
+	}
+}
+
+
 static int idspIsValid(struct s_idsp *idsp, const int id) {
 	return (!(idspGetPos(idsp, id) < 0));
 }
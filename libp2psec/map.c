@@ -518,6 +518,25 @@ static int mapCreate(struct s_map *map, const int map_size, const int key_size,
 }
 
 
+// Increase the size of a map that was allocated by mapCreate. Stored keys keep their IDs.
+static int mapResize(struct s_map *map, const int map_size) {
+	void *keymem;
+	void *valuemem;
+	int *leftmem;
+	int *rightmem;
+	if(map_size < mapGetMapSize(map)) return 0;
+	if((keymem = realloc(map->key, (map_size * map->key_size))) == NULL) return 0;
+	map->key = keymem;
+	if((valuemem = realloc(map->value, (map_size * map->value_size))) == NULL) return 0;
+	map->value = valuemem;
+	if((leftmem = realloc(map->left, ((map_size+1) * sizeof(int)))) == NULL) return 0;
+	map->left = leftmem;
+	if((rightmem = realloc(map->right, ((map_size+1) * sizeof(int)))) == NULL) return 0;
+	map->right = rightmem;
+	return idspResize(&map->idsp, map_size);
+}
+
+
 // Free the memory used by the map.
 static int mapDestroy(struct s_map *map) {
 	// destroy map
@@ -210,6 +210,32 @@ static void nodedbDestroy(struct s_nodedb *db) {
 }
 
 
+// Increase the size of the NodeDB. The nested address maps can't be moved, so all entries are copied into a new NodeDB.
+static int nodedbResize(struct s_nodedb *db, const int size) {
+	struct s_nodedb newdb;
+	struct s_map *addrset;
+	struct s_map *newaddrset;
+	int i;
+	int j;
+	if(size < mapGetMapSize(db->addrdb)) return 0;
+	if(!nodedbCreate(&newdb, size, db->num_peeraddrs)) return 0;
+	for(i=0; i<mapGetMapSize(db->addrdb); i++) {
+		if(!mapIsValidID(db->addrdb, i)) continue;
+		addrset = mapGetValueByID(db->addrdb, i);
+		newaddrset = mapGetValueByID(newdb.addrdb, mapAddReturnID(newdb.addrdb, mapGetKeyByID(db->addrdb, i), NULL));
+		if(newaddrset == NULL) continue;
+		if(!mapMemInit(newaddrset, mapMemSize(db->num_peeraddrs, peeraddr_SIZE, sizeof(struct s_nodedb_addrdata)), db->num_peeraddrs, peeraddr_SIZE, sizeof(struct s_nodedb_addrdata))) continue;
+		mapEnableReplaceOld(newaddrset);
+		for(j=0; j<mapGetMapSize(addrset); j++) {
+			if(mapIsValidID(addrset, j)) mapAdd(newaddrset, mapGetKeyByID(addrset, j), mapGetValueByID(addrset, j));
+		}
+	}
+	nodedbDestroy(db);
+	*db = newdb;
+	return 1;
+}
+
+
 // Generate NodeDB status report.
 static void nodedbStatus(struct s_nodedb *db, char *report, const int report_len) {
 	int i;
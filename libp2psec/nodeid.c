@@ -102,6 +102,12 @@ static int nodekeyLoadPrivatePEM(struct s_nodekey *nodekey, unsigned char *privk
 }
 
 
+// Get PEM encoded private key from NodeKey object. Returns length if successful.
+static int nodekeyGetPrivatePEM(unsigned char *buf, const int buf_size, const struct s_nodekey *nodekey) {
+	return rsaGetPrivatePEM(buf, buf_size, &nodekey->key);
+}
+
+
 // Destroy a NodeKey object.
 static void nodekeyDestroy(struct s_nodekey *nodekey) {
 	rsaDestroy(&nodekey->key);
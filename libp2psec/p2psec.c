@@ -36,7 +36,14 @@ P2PSEC_CTX {
 	int auth_count;
 	int loopback_enable;
 	int fastauth_enable;
+	int fasthandshake_enable;
 	int fragmentation_enable;
+	int pmtudisc_enable;
+	int fastfailover_enable;
+	int aggregation_delay;
+	int rate_limit;
+	int replay_window;
+	int resume_timeout;
 	int flags;
 	char password[1024];
 	int password_len;
@@ -51,7 +58,14 @@ int p2psecStart(P2PSEC_CTX *p2psec) {
 			if(peermgtCreate(&p2psec->mgt, p2psec->peer_count, p2psec->auth_count, &p2psec->nk, &p2psec->dh)) {
 				peermgtSetLoopback(&p2psec->mgt, p2psec->loopback_enable);
 				peermgtSetFastauth(&p2psec->mgt, p2psec->fastauth_enable);
+				peermgtSetFastHandshake(&p2psec->mgt, p2psec->fasthandshake_enable);
 				peermgtSetFragmentation(&p2psec->mgt, p2psec->fragmentation_enable);
+				peermgtSetPMTUDiscovery(&p2psec->mgt, p2psec->pmtudisc_enable);
+				peermgtSetFastFailover(&p2psec->mgt, p2psec->fastfailover_enable);
+				peermgtSetAggregation(&p2psec->mgt, p2psec->aggregation_delay);
+				peermgtSetRateLimit(&p2psec->mgt, p2psec->rate_limit);
+				peermgtSetReplayWindow(&p2psec->mgt, p2psec->replay_window);
+				peermgtSetResumeTimeout(&p2psec->mgt, p2psec->resume_timeout);
 				peermgtSetNetID(&p2psec->mgt, p2psec->netname, p2psec->netname_len);
 				peermgtSetPassword(&p2psec->mgt, p2psec->password, p2psec->password_len);
 				peermgtSetFlags(&p2psec->mgt, p2psec->flags);
@@ -112,6 +126,14 @@ int p2psecGeneratePrivkey(P2PSEC_CTX *p2psec, const int bits) {
 }
 
 
+int p2psecGetPrivkey(P2PSEC_CTX *p2psec, unsigned char *pembuf, const int pembuf_size) {
+	if(p2psec->key_loaded) {
+		return nodekeyGetPrivatePEM(pembuf, pembuf_size, &p2psec->nk);
+	}
+	return 0;
+}
+
+
 int p2psecLoadDH(P2PSEC_CTX *p2psec) {
 	if(p2psec->dh_loaded) return 1;
 	if(dhCreate(&p2psec->dh)) {
@@ -122,6 +144,17 @@ int p2psecLoadDH(P2PSEC_CTX *p2psec) {
 }
 
 
+void p2psecRefreshDH(P2PSEC_CTX *p2psec) {
+	if(p2psec->dh_loaded) dhRefresh(&p2psec->dh, utilGetClockUS());
+}
+
+
+int p2psecRefreshDHDelay(P2PSEC_CTX *p2psec) {
+	if(p2psec->dh_loaded) return dhGetRefreshDelay(&p2psec->dh, utilGetClockUS());
+	return -1;
+}
+
+
 void p2psecSetMaxConnectedPeers(P2PSEC_CTX *p2psec, const int peer_count) {
 	if(peer_count > 0) p2psec->peer_count = peer_count;
 	
@@ -199,6 +232,18 @@ void p2psecDisableFastauth(P2PSEC_CTX *p2psec) {
 }
 
 
+void p2psecEnableFastHandshake(P2PSEC_CTX *p2psec) {
+	p2psec->fasthandshake_enable = 1;
+	if(p2psec->started) peermgtSetFastHandshake(&p2psec->mgt, 1);
+}
+
+
+void p2psecDisableFastHandshake(P2PSEC_CTX *p2psec) {
+	p2psec->fasthandshake_enable = 0;
+	if(p2psec->started) peermgtSetFastHandshake(&p2psec->mgt, 0);
+}
+
+
 void p2psecEnableFragmentation(P2PSEC_CTX *p2psec) {
 	p2psec->fragmentation_enable = 1;
 	if(p2psec->started) peermgtSetFragmentation(&p2psec->mgt, 1);
@@ -211,6 +256,18 @@ void p2psecDisableFragmentation(P2PSEC_CTX *p2psec) {
 }
 
 
+void p2psecEnablePMTUDiscovery(P2PSEC_CTX *p2psec) {
+	p2psec->pmtudisc_enable = 1;
+	if(p2psec->started) peermgtSetPMTUDiscovery(&p2psec->mgt, 1);
+}
+
+
+void p2psecDisablePMTUDiscovery(P2PSEC_CTX *p2psec) {
+	p2psec->pmtudisc_enable = 0;
+	if(p2psec->started) peermgtSetPMTUDiscovery(&p2psec->mgt, 0);
+}
+
+
 void p2psecSetFlag(P2PSEC_CTX *p2psec, const int flag, const int enable) {
 	int f;
 	if(enable) {
@@ -224,6 +281,44 @@ void p2psecSetFlag(P2PSEC_CTX *p2psec, const int flag, const int enable) {
 }
 
 
+void p2psecSetAggregationDelay(P2PSEC_CTX *p2psec, const int delay) {
+	if(delay > 0) {
+		p2psec->aggregation_delay = delay;
+	}
+	else {
+		p2psec->aggregation_delay = 0;
+	}
+	if(p2psec->started) peermgtSetAggregation(&p2psec->mgt, p2psec->aggregation_delay);
+}
+
+
+void p2psecSetRateLimit(P2PSEC_CTX *p2psec, const int kbps) {
+	if((kbps > 0) && (kbps < 16000000)) {
+		p2psec->rate_limit = (kbps * 125);
+	}
+	else {
+		p2psec->rate_limit = 0;
+	}
+	if(p2psec->started) peermgtSetRateLimit(&p2psec->mgt, p2psec->rate_limit);
+}
+
+
+void p2psecSetReplayWindow(P2PSEC_CTX *p2psec, const int window) {
+	p2psec->replay_window = seqWindowSize(window);
+	if(p2psec->started) peermgtSetReplayWindow(&p2psec->mgt, p2psec->replay_window);
+}
+
+
+void p2psecEnableAdaptiveRateLimit(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_RATELEARN, 1);
+}
+
+
+void p2psecDisableAdaptiveRateLimit(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_RATELEARN, 0);
+}
+
+
 void p2psecEnableUserdata(P2PSEC_CTX *p2psec) {
 	p2psecSetFlag(p2psec, peermgt_FLAG_USERDATA, 1);
 }
@@ -244,16 +339,107 @@ void p2psecDisableRelay(P2PSEC_CTX *p2psec) {
 }
 
 
+void p2psecEnableIntegrityOnly(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_INTEGRITYONLY, 1);
+}
+
+
+void p2psecDisableIntegrityOnly(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_INTEGRITYONLY, 0);
+}
+
+
+void p2psecEnableCompression(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_COMPRESS, 1);
+}
+
+
+void p2psecDisableCompression(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_COMPRESS, 0);
+}
+
+
+void p2psecEnableFastFailover(P2PSEC_CTX *p2psec) {
+	p2psec->fastfailover_enable = 1;
+	if(p2psec->started) peermgtSetFastFailover(&p2psec->mgt, 1);
+}
+
+
+void p2psecDisableFastFailover(P2PSEC_CTX *p2psec) {
+	p2psec->fastfailover_enable = 0;
+	if(p2psec->started) peermgtSetFastFailover(&p2psec->mgt, 0);
+}
+
+
+void p2psecEnableBonding(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_BONDING, 1);
+}
+
+
+void p2psecDisableBonding(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_BONDING, 0);
+}
+
+
+void p2psecEnableFEC(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_FEC, 1);
+}
+
+
+void p2psecDisableFEC(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_FEC, 0);
+}
+
+
+void p2psecEnableBroadcastTree(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_BCTREE, 1);
+}
+
+
+void p2psecDisableBroadcastTree(P2PSEC_CTX *p2psec) {
+	p2psecSetFlag(p2psec, peermgt_FLAG_BCTREE, 0);
+}
+
+
+void p2psecSetResumeTimeout(P2PSEC_CTX *p2psec, const int timeout) {
+	if(timeout > 0) {
+		p2psec->resume_timeout = timeout;
+	}
+	else {
+		p2psec->resume_timeout = 0;
+	}
+	if(p2psec->started) peermgtSetResumeTimeout(&p2psec->mgt, p2psec->resume_timeout);
+	p2psecSetFlag(p2psec, peermgt_FLAG_RESUME, (p2psec->resume_timeout > 0));
+}
+
+
 int p2psecLoadDefaults(P2PSEC_CTX *p2psec) {
 	if(!p2psecLoadDH(p2psec)) return 0;
 	p2psecSetFlag(p2psec, (~(0)), 0);
 	p2psecSetMaxConnectedPeers(p2psec, 256);
-	p2psecSetAuthSlotCount(p2psec, 32);
+	p2psecSetAuthSlotCount(p2psec, 256);
 	p2psecDisableLoopback(p2psec);
 	p2psecEnableFastauth(p2psec);
+	p2psecDisableFastHandshake(p2psec);
 	p2psecDisableFragmentation(p2psec);
+	p2psecDisablePMTUDiscovery(p2psec);
+	p2psecSetAggregationDelay(p2psec, 0);
 	p2psecEnableUserdata(p2psec);
 	p2psecDisableRelay(p2psec);
+	p2psecDisableIntegrityOnly(p2psec);
+	p2psecDisableCompression(p2psec);
+	p2psecDisableFEC(p2psec);
+	p2psecDisableFastFailover(p2psec);
+	p2psecDisableBonding(p2psec);
+	p2psecDisableBroadcastTree(p2psec);
+	p2psecDisableAdaptiveRateLimit(p2psec);
+	p2psecSetRateLimit(p2psec, 0);
+	p2psecSetReplayWindow(p2psec, seq_REPLAYWINDOW_DEFAULT);
+	p2psecSetResumeTimeout(p2psec, 600);
+	p2psecSetFlag(p2psec, peermgt_FLAG_CLEARSEQ, 1);
+	p2psecSetFlag(p2psec, peermgt_FLAG_AGGREGATE, 1);
+	p2psecSetFlag(p2psec, peermgt_FLAG_PMTU, 1);
+	p2psecSetFlag(p2psec, peermgt_FLAG_JUMBO, 1);
 	p2psecSetNetname(p2psec, NULL, 0);
 	p2psecSetPassword(p2psec, NULL, 0);
 	return 1;
@@ -307,6 +493,23 @@ int p2psecConnect(P2PSEC_CTX *p2psec, const unsigned char *destination_addr) {
 }
 
 
+int p2psecSetPeerWeight(P2PSEC_CTX *p2psec, const unsigned char *nodeid, const int weight) {
+	struct s_nodeid id;
+	if(!p2psec->started) return 0;
+	memcpy(id.id, nodeid, nodeid_SIZE);
+	return peermgtSetPeerWeight(&p2psec->mgt, &id, weight);
+}
+
+
+int p2psecSetPeerRateLimit(P2PSEC_CTX *p2psec, const unsigned char *nodeid, const int kbps) {
+	struct s_nodeid id;
+	if(!p2psec->started) return 0;
+	if(!((kbps >= 0) && (kbps < 16000000))) return 0;
+	memcpy(id.id, nodeid, nodeid_SIZE);
+	return peermgtSetPeerRateLimit(&p2psec->mgt, &id, (kbps * 125));
+}
+
+
 int p2psecInputPacket(P2PSEC_CTX *p2psec, const unsigned char *packet_input, const int packet_input_len, const unsigned char *packet_source_addr) {
 	struct s_peeraddr addr;
 	memcpy(addr.addr, packet_source_addr, peeraddr_SIZE);
@@ -373,6 +576,11 @@ int p2psecOutputPacket(P2PSEC_CTX *p2psec, unsigned char *packet_output, const i
 }
 
 
+int p2psecOutputDelay(P2PSEC_CTX *p2psec) {
+	return peermgtGetOutputDelay(&p2psec->mgt);
+}
+
+
 int p2psecPeerCount(P2PSEC_CTX *p2psec) {
 	int n = peermgtPeerCount(&p2psec->mgt);
 	return n;
@@ -42,6 +42,13 @@
 #define packet_CRHDR_PLLEN_START (packet_CRHDR_SEQ_START + packet_SEQ_SIZE)
 #define packet_CRHDR_PLTYPE_START (packet_CRHDR_PLLEN_START + packet_PLLEN_SIZE)
 #define packet_CRHDR_PLOPT_START (packet_CRHDR_PLTYPE_START + packet_PLTYPE_SIZE)
+#define packet_CLEARSEQ_START (packet_PEERID_SIZE + packet_HMAC_SIZE)
+
+
+// packet formats
+#define packet_FORMAT_DEFAULT 0 // peer ID | hmac | IV | encrypted (sequence number, pl* fields, payload)
+#define packet_FORMAT_CLEARSEQ 1 // peer ID | hmac | sequence number | IV | encrypted (pl* fields, payload), the hmac also covers the cleartext sequence number
+#define packet_FORMAT_INTEGRITYONLY 2 // peer ID | hmac | sequence number | pl* fields | payload, nothing is encrypted
 
 
 // payload types
@@ -53,6 +60,12 @@
 #define packet_PLTYPE_PONG 5
 #define packet_PLTYPE_RELAY_IN 6
 #define packet_PLTYPE_RELAY_OUT 7
+#define packet_PLTYPE_USERDATA_AGGREGATE 8
+#define packet_PLTYPE_USERDATA_COMPRESSED 9
+#define packet_PLTYPE_USERDATA_FRAGMENT_EXT 10
+#define packet_PLTYPE_USERDATA_FEC 11
+#define packet_PLTYPE_LOSSREPORT 12
+#define packet_PLTYPE_USERDATA_BROADCAST 13
 
 
 // constraints
@@ -91,7 +104,7 @@ static int packetGetPeerID(const unsigned char *pbuf) {
 
 
 // encode packet
-static int packetEncode(unsigned char *pbuf, const int pbuf_size, const struct s_packet_data *data, struct s_crypto *ctx) {
+static int packetEncode(unsigned char *pbuf, const int pbuf_size, const struct s_packet_data *data, struct s_crypto *ctx, const int format) {
 	unsigned char dec_buf[packet_CRHDR_SIZE + data->pl_buf_size];
 	int32_t *scr_peerid = ((int32_t *)pbuf);
 	int32_t ne_peerid;
@@ -108,8 +121,20 @@ static int packetEncode(unsigned char *pbuf, const int pbuf_size, const struct s
 	memcpy(&dec_buf[packet_CRHDR_SIZE], data->pl_buf, data->pl_length);
 	
 	// encrypt buffer
-	len = cryptoEnc(ctx, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), dec_buf, (packet_CRHDR_SIZE + data->pl_length), packet_HMAC_SIZE, packet_IV_SIZE);
-	if(len < (packet_HMAC_SIZE + packet_IV_SIZE + packet_CRHDR_SIZE)) { return 0; }
+	if(format == packet_FORMAT_INTEGRITYONLY) {
+		// only authenticate, the sequence number is in front of the pl* fields already
+		len = cryptoSignAD(ctx, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), &dec_buf[packet_CRHDR_SEQ_START], packet_SEQ_SIZE, &dec_buf[packet_CRHDR_PLLEN_START], (packet_CRHDR_SIZE - packet_SEQ_SIZE + data->pl_length), packet_HMAC_SIZE);
+		if(len < (packet_HMAC_SIZE + packet_CRHDR_SIZE)) { return 0; }
+	}
+	else if(format == packet_FORMAT_CLEARSEQ) {
+		// move the sequence number in front of the IV
+		len = cryptoEncAD(ctx, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), &dec_buf[packet_CRHDR_SEQ_START], packet_SEQ_SIZE, &dec_buf[packet_CRHDR_PLLEN_START], (packet_CRHDR_SIZE - packet_SEQ_SIZE + data->pl_length), packet_HMAC_SIZE, packet_IV_SIZE);
+		if(len < (packet_HMAC_SIZE + packet_IV_SIZE + packet_CRHDR_SIZE)) { return 0; }
+	}
+	else {
+		len = cryptoEnc(ctx, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), dec_buf, (packet_CRHDR_SIZE + data->pl_length), packet_HMAC_SIZE, packet_IV_SIZE);
+		if(len < (packet_HMAC_SIZE + packet_IV_SIZE + packet_CRHDR_SIZE)) { return 0; }
+	}
 	
 	// write the scrambled peer ID
 	utilWriteInt32((unsigned char *)&ne_peerid, data->peerid);
@@ -121,14 +146,32 @@ static int packetEncode(unsigned char *pbuf, const int pbuf_size, const struct s
 
 
 // decode packet
-static int packetDecode(struct s_packet_data *data, const unsigned char *pbuf, const int pbuf_size, struct s_crypto *ctx, struct s_seq_state *seqstate) {
-	unsigned char dec_buf[pbuf_size];
+static int packetDecode(struct s_packet_data *data, const unsigned char *pbuf, const int pbuf_size, struct s_crypto *ctx, struct s_seq_state *seqstate, const int format) {
+	unsigned char dec_buf[packet_SEQ_SIZE + pbuf_size];
 	int len;
 
 	// decrypt packet
-	if(pbuf_size < (packet_PEERID_SIZE + packet_HMAC_SIZE + packet_IV_SIZE)) { return 0; }
-	len = cryptoDec(ctx, dec_buf, pbuf_size, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), packet_HMAC_SIZE, packet_IV_SIZE);
-	if(len < packet_CRHDR_SIZE) { return 0; };
+	if((format == packet_FORMAT_CLEARSEQ) || (format == packet_FORMAT_INTEGRITYONLY)) {
+		if(pbuf_size < (packet_PEERID_SIZE + packet_HMAC_SIZE + packet_SEQ_SIZE)) { return 0; }
+
+		// reject duplicate and out of window sequence numbers before doing any crypto
+		if(seqstate != NULL) if(!seqCheck(seqstate, utilReadInt64(&pbuf[packet_CLEARSEQ_START]))) { return 0; }
+
+		if(format == packet_FORMAT_INTEGRITYONLY) {
+			len = cryptoVerifyAD(ctx, &dec_buf[packet_CRHDR_PLLEN_START], pbuf_size, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), packet_SEQ_SIZE, packet_HMAC_SIZE);
+		}
+		else {
+			len = cryptoDecAD(ctx, &dec_buf[packet_CRHDR_PLLEN_START], pbuf_size, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), packet_SEQ_SIZE, packet_HMAC_SIZE, packet_IV_SIZE);
+		}
+		if(len < (packet_CRHDR_SIZE - packet_SEQ_SIZE)) { return 0; }
+		memcpy(&dec_buf[packet_CRHDR_SEQ_START], &pbuf[packet_CLEARSEQ_START], packet_SEQ_SIZE);
+		len = (len + packet_SEQ_SIZE);
+	}
+	else {
+		if(pbuf_size < (packet_PEERID_SIZE + packet_HMAC_SIZE + packet_IV_SIZE)) { return 0; }
+		len = cryptoDec(ctx, dec_buf, pbuf_size, &pbuf[packet_PEERID_SIZE], (pbuf_size - packet_PEERID_SIZE), packet_HMAC_SIZE, packet_IV_SIZE);
+		if(len < packet_CRHDR_SIZE) { return 0; };
+	}
 
 	// get packet data
 	data->peerid = packetGetPeerID(pbuf);
@@ -33,7 +33,7 @@
 #endif
 
 
-static int packetTestsuiteMsg(const int random_msg) {
+static int packetTestsuiteMsg(const int random_msg, const int format) {
 	unsigned char plbuf[packetTestsuite_PLBUF_SIZE];
 	unsigned char plbufdec[packetTestsuite_PLBUF_SIZE];
 	struct s_packet_data testdata = { .pl_buf_size = packetTestsuite_PLBUF_SIZE, .pl_buf = plbuf };
@@ -43,6 +43,7 @@ static int packetTestsuiteMsg(const int random_msg) {
 	unsigned char secret[64];
 	unsigned char nonce[16];
 	struct s_seq_state seqstate;
+	uint64_t seqmask[(seq_REPLAYWINDOW_DEFAULT / 64)];
 	char str[4096];
 	int len;
 	
@@ -54,6 +55,7 @@ static int packetTestsuiteMsg(const int random_msg) {
 	if(!cryptoSetKeys(&ctx[0], 1, secret, 64, nonce, 16)) return 0;
 	if(!cryptoSetKeys(&ctx[1], 1, secret, 64, nonce, 16)) return 0;
 
+	seqSetWindow(&seqstate, seqmask, seq_REPLAYWINDOW_DEFAULT);
 	seqInit(&seqstate, 0);
 	
 	memset(plbuf, 0, packetTestsuite_PLBUF_SIZE);
@@ -67,11 +69,12 @@ static int packetTestsuiteMsg(const int random_msg) {
 	testdata.seq = 1;
 	utilByteArrayToHexstring(str, 4096, plbuf, len);
 	printf("%s (len=%d, peerid=%d) -> ", str, len, testdata.peerid);
-	len = packetEncode(pkbuf, packetTestsuite_PKBUF_SIZE, &testdata, &ctx[0]);
+	len = packetEncode(pkbuf, packetTestsuite_PKBUF_SIZE, &testdata, &ctx[0], format);
 	if(!(len > 0)) return 0;
 	utilByteArrayToHexstring(str, 4096, pkbuf, len);
 	printf("%s (%d) -> ", str, len);
-	if(!(packetDecode(&testdatadec, pkbuf, len, &ctx[1], &seqstate))) return 0;
+	if(!(packetDecode(&testdatadec, pkbuf, len, &ctx[1], &seqstate, format))) return 0;
+	if(packetDecode(&testdatadec, pkbuf, len, &ctx[1], &seqstate, format)) return 0; // replayed packet must be rejected
 	if(!(testdatadec.pl_length > 0)) return 0;
 	if(!(testdatadec.peerid == plbuf[0])) return 0;
 	if(!memcmp(testdatadec.pl_buf, testdata.pl_buf, packetTestsuite_PLBUF_SIZE) == 0) return 0;
@@ -86,8 +89,12 @@ static int packetTestsuiteMsg(const int random_msg) {
 
 static int packetTestsuite() {
 	int i;
-	for(i=0; i<100; i++) if(!packetTestsuiteMsg(1)) return 0;
-	for(i=0; i<100; i++) if(!packetTestsuiteMsg(0)) return 0;
+	for(i=0; i<100; i++) if(!packetTestsuiteMsg(1, packet_FORMAT_DEFAULT)) return 0;
+	for(i=0; i<100; i++) if(!packetTestsuiteMsg(0, packet_FORMAT_DEFAULT)) return 0;
+	for(i=0; i<100; i++) if(!packetTestsuiteMsg(1, packet_FORMAT_CLEARSEQ)) return 0;
+	for(i=0; i<100; i++) if(!packetTestsuiteMsg(0, packet_FORMAT_CLEARSEQ)) return 0;
+	for(i=0; i<100; i++) if(!packetTestsuiteMsg(1, packet_FORMAT_INTEGRITYONLY)) return 0;
+	for(i=0; i<100; i++) if(!packetTestsuiteMsg(0, packet_FORMAT_INTEGRITYONLY)) return 0;
 	return 1;
 }
 
@@ -25,22 +25,122 @@
 #include "authmgt.c"
 #include "packet.c"
 #include "dfrag.c"
+#include "resume.c"
+#include "compress.c"
+#include "fec.c"
+#include "txq.c"
+#include "tbf.c"
+#include "timer.c"
 
 
 // Minimum message size supported (without fragmentation).
 #define peermgt_MSGSIZE_MIN 1024
 
 
-// Maximum message size supported (with or without fragmentation).
-#define peermgt_MSGSIZE_MAX 8192
+// Maximum message size supported (with or without fragmentation). Large enough for jumbo frames.
+#define peermgt_MSGSIZE_MAX 16384
+
+
+// Maximum message size supported by peers without the JUMBO flag.
+#define peermgt_MSGSIZE_MAX_COMPAT 8192
 
 
 // Ping buffer size.
 #define peermgt_PINGBUF_SIZE 64
 
 
-// Number of fragment buffers.
+// Number of reassembly buffers for fragmented messages in addition to one per peer slot, the maximum number of buffers, and how many of them a single peer may use.
 #define peermgt_FRAGBUF_COUNT 64
+#define peermgt_FRAGBUF_COUNT_MAX 512
+#define peermgt_FRAGBUF_PEER_MAX 4
+
+
+// Fragment numbering. Regular fragments store count and position in 4 bits each of the payload options.
+// Messages with more fragments are sent as extended fragments to peers with the JUMBO flag, which start with a 1 byte count and a 1 byte position.
+#define peermgt_FRAGMENT_COUNT_MAX 15
+#define peermgt_FRAGMENT_EXT_COUNT_MAX 255
+#define peermgt_FRAGMENT_EXT_HDRSIZE 2
+
+
+// Path MTU discovery. Probes are padded pings that are answered by a regular sized pong.
+// The link MTUs of the ladder are tried from top to bottom, each one PMTU_TRIES times with PMTU_TIMEOUT seconds in between.
+// The search is repeated every PMTU_INTERVAL seconds. The overhead covers IPv6/UDP headers, packet headers and cipher padding.
+#define peermgt_PMTU_LADDER_SIZE 8
+#define peermgt_PMTU_OVERHEAD (48 + packet_PEERID_SIZE + packet_HMAC_SIZE + packet_IV_SIZE + packet_CRHDR_SIZE + packet_IV_SIZE)
+#define peermgt_PMTU_TRIES 2
+#define peermgt_PMTU_TIMEOUT 2
+#define peermgt_PMTU_INTERVAL 600
+static const int peermgt_PMTU_LADDER[peermgt_PMTU_LADDER_SIZE] = { 9000, 4352, 1500, 1492, 1480, 1420, 1400, 1280 };
+
+
+// Aggregation of small user data frames. Each frame in an aggregate is prefixed by its length.
+#define peermgt_AGGREGATE_SIZE peermgt_MSGSIZE_MIN
+#define peermgt_AGGREGATE_FRAMESIZE 512
+#define peermgt_AGGREGATE_HDRSIZE 2
+
+
+// Adaptive compression. The compression ratio of each peer is evaluated every COMPRESS_STATS_SIZE bytes.
+// If it saves less than COMPRESS_MINSAVING percent, the next COMPRESS_BACKOFF messages to that peer are sent uncompressed.
+#define peermgt_COMPRESS_STATS_SIZE 65536
+#define peermgt_COMPRESS_MINSAVING 5
+#define peermgt_COMPRESS_BACKOFF 1024
+
+
+// Transmit queues. User data and request-response messages wait in one queue per peer that holds up to *_PEER_MAX messages.
+// The queues of each kind share *_SIZE message slots. Broadcast user data uses queue 0.
+#define peermgt_OUTQ_SIZE 64
+#define peermgt_OUTQ_PEER_MAX 16
+#define peermgt_RRQ_SIZE 32
+#define peermgt_RRQ_PEER_MAX 4
+
+
+// Initial number of peer slots. The peer table doubles in size when it is full, up to the configured maximum.
+#define peermgt_PEER_SLOTS_INIT 32
+
+
+// Maximum number of NodeIDs with configured transmit settings.
+#define peermgt_PEERCONF_SIZE 256
+
+
+// Rate limits. Limits are given in bytes per second, the token buckets hold up to RATELIMIT_BURST microseconds of traffic.
+// A peer that reports RATELIMIT_LOSS_THRESHOLD or more lost packets out of the last 64 gets a learned limit that stays above RATELIMIT_MIN.
+#define peermgt_RATELIMIT_BURST 5000
+#define peermgt_RATELIMIT_MIN 16384
+#define peermgt_RATELIMIT_LOSS_THRESHOLD 3
+
+
+// Traffic classes of user data. Frames are classified by the DSCP of their IP header or by their 802.1p priority.
+// Every class has its own transmit queues, the classes share the user data bandwidth by weight.
+#define peermgt_CLASS_COUNT 3
+#define peermgt_CLASS_INTERACTIVE 0
+#define peermgt_CLASS_DEFAULT 1
+#define peermgt_CLASS_BULK 2
+static const int peermgt_CLASS_WEIGHT[peermgt_CLASS_COUNT] = { 8, 4, 1 };
+
+
+// Broadcast distribution tree. Broadcast frames are passed along a tree of relay capable peers instead of being sent to every peer.
+// Every node of the tree is responsible for a range of the NodeID space and splits it among up to BCTREE_FANOUT children.
+// Frames carry a random ID and the range of the receiver, the last BCTREE_SEEN_SIZE IDs are remembered to drop duplicates.
+#define peermgt_BCTREE_FANOUT 4
+#define peermgt_BCTREE_HDRSIZE 24
+#define peermgt_BCTREE_SEEN_SIZE 256
+#define peermgt_BCTREE_FRAMESIZE (peermgt_MSGSIZE_MIN - peermgt_BCTREE_HDRSIZE)
+
+
+// Types of queued user data messages.
+#define peermgt_OUTMSG_DEFAULT 0
+#define peermgt_OUTMSG_BCTREE_ORIGIN 1
+#define peermgt_OUTMSG_BCTREE_FORWARD 2
+
+
+// Forward error correction. Groups of user data packets are protected by XOR parity packets.
+// The group size adapts to the loss rate that peers report every FEC_REPORT_INTERVAL seconds. Incomplete groups are sent after FEC_FLUSH_DELAY microseconds.
+// Received packets up to FEC_ITEMSIZE bytes are kept in a cache of FEC_CACHE_SIZE entries to recover lost packets.
+#define peermgt_FEC_ITEMSIZE 1536
+#define peermgt_FEC_CACHE_SIZE 1024
+#define peermgt_FEC_PARITYSIZE (fec_HDR_OFFSETS_START + (2 * fec_GROUP_MAX) + fec_ITEMHDR_SIZE + peermgt_FEC_ITEMSIZE)
+#define peermgt_FEC_REPORT_INTERVAL 1
+#define peermgt_FEC_FLUSH_DELAY 20000
 
 
 // Maximum packet decode recursion depth.
@@ -62,6 +162,7 @@
 #define peermgt_RECV_TIMEOUT 100
 #define peermgt_KEEPALIVE_INTERVAL 10
 #define peermgt_PEERINFO_INTERVAL 60
+#define peermgt_RTT_INTERVAL peermgt_KEEPALIVE_INTERVAL
 #define peermgt_NEWCONNECT_MAX_LASTSEEN 604800
 #define peermgt_NEWCONNECT_MIN_LASTCONNTRY 60
 #define peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN 300
@@ -70,17 +171,17 @@
 // Flags.
 #define peermgt_FLAG_USERDATA 0x0001
 #define peermgt_FLAG_RELAY 0x0002
-#define peermgt_FLAG_F03 0x0004
-#define peermgt_FLAG_F04 0x0008
-#define peermgt_FLAG_F05 0x0010
-#define peermgt_FLAG_F06 0x0020
-#define peermgt_FLAG_F07 0x0040
-#define peermgt_FLAG_F08 0x0080
-#define peermgt_FLAG_F09 0x0100
-#define peermgt_FLAG_F10 0x0200
-#define peermgt_FLAG_F11 0x0400
-#define peermgt_FLAG_F12 0x0800
-#define peermgt_FLAG_F13 0x1000
+#define peermgt_FLAG_RESUME 0x0004
+#define peermgt_FLAG_CLEARSEQ 0x0008
+#define peermgt_FLAG_INTEGRITYONLY 0x0010
+#define peermgt_FLAG_AGGREGATE 0x0020
+#define peermgt_FLAG_COMPRESS 0x0040
+#define peermgt_FLAG_PMTU 0x0080
+#define peermgt_FLAG_JUMBO 0x0100
+#define peermgt_FLAG_FEC 0x0200
+#define peermgt_FLAG_BCTREE 0x0400
+#define peermgt_FLAG_RATELEARN 0x0800
+#define peermgt_FLAG_BONDING 0x1000
 #define peermgt_FLAG_F14 0x2000
 #define peermgt_FLAG_F15 0x4000
 #define peermgt_FLAG_F16 0x8000
@@ -93,6 +194,48 @@
 #if peermgt_PINGBUF_SIZE > peermgt_MSGSIZE_MIN
 #error peermgt_PINGBUF_SIZE too big
 #endif
+#if peermgt_MSGSIZE_MAX > 32767
+#error peermgt_MSGSIZE_MAX too big
+#endif
+#if ((peermgt_MSGSIZE_MAX / peermgt_MSGSIZE_MIN) + 1) > peermgt_FRAGMENT_EXT_COUNT_MAX
+#error peermgt_MSGSIZE_MAX too big
+#endif
+
+
+// Link quality measurement. Every RTT_INTERVAL seconds a timestamped ping is sent to each peer, a probe without a pong until the next one counts as lost.
+// The probe also serves as keepalive, so idle peers do not see more packets than without the measurement.
+// Round trip time, jitter (mean deviation of the round trip time) and loss are smoothed like TCP does, loss is also taken from the loss reports of peers.
+#define peermgt_RTT_PPM 1000000
+
+
+// Path selection. Every address a peer has been reached at, directly or through a relay, is a candidate path.
+// If a peer has more than one, all of them are probed every PATH_PROBE_INTERVAL seconds and the peer is moved to the healthy path with the lowest round trip time.
+// A path is unhealthy after PATH_LOST_MAX unanswered probes in a row and is forgotten after PATH_TIMEOUT seconds without packets.
+// Relayed paths are charged PATH_RELAY_PENALTY microseconds, and the current path is only left for one that is at least 1/8 or PATH_HYSTERESIS microseconds faster.
+#define peermgt_PATH_COUNT 4
+#define peermgt_PATH_PROBE_INTERVAL 5
+#define peermgt_PATH_PROBE_INTERVAL_FAST 1
+#define peermgt_PATH_TIMEOUT 120
+#define peermgt_PATH_LOST_MAX 2
+#define peermgt_PATH_RELAY_PENALTY 2000
+#define peermgt_PATH_HYSTERESIS 2000
+
+
+// Multipath bonding. If both sides have it enabled, user data is striped across all healthy direct paths that are at most twice as slow as the best one plus BOND_SLACK microseconds.
+// Each path gets a weight of up to BOND_WEIGHT that is inversely proportional to its round trip time. Relayed paths are only used as backup.
+#define peermgt_PATH_BOND_WEIGHT 8
+#define peermgt_PATH_BOND_SLACK 5000
+
+
+// The candidate path structure.
+struct s_peermgt_path {
+	struct s_peeraddr addr;
+	int64_t probetime;
+	int rtt;
+	int lost;
+	int lastseen;
+	int used;
+};
 
 
 // The peer manager data structure.
@@ -107,43 +250,134 @@ struct s_peermgt_data {
 	int remoteid;
 	int64_t remoteseq;
 	struct s_seq_state seq;
+	struct s_seq_state recvseq;
+	int compin;
+	int compout;
+	int compskip;
+	int fragsize;
+	int pmtustep;
+	int pmtutries;
+	int pmtuprobe;
+	int64_t pmtunonce;
+	int lastpmtuprobe;
+	int lastpmtusearch;
+	int fecsize;
+	int fecrecv;
+	int lastfecreport;
+	int64_t rttnonce;
+	int64_t rttprobe;
+	int lastrttprobe;
+	int rtt;
+	int jitter;
+	int loss;
+	struct s_peermgt_path path[peermgt_PATH_COUNT];
+	int pathcredit[peermgt_PATH_COUNT];
+	int lastpathprobe;
+	struct s_tbf tbf;
+	int ratelimit;
+	int learnedrate;
+	int64_t pacetime;
+	int64_t txbytes;
+	int64_t txstart;
 	int state;
 };
 
 
+// The transmit settings of a NodeID.
+struct s_peermgt_peerconf {
+	int32_t weight;
+	int32_t ratelimit;
+};
+
+
+// The user data aggregate structure.
+struct s_peermgt_aggregate {
+	unsigned char buf[peermgt_AGGREGATE_SIZE];
+	int size;
+	int count;
+	int peerid;
+	int conntime;
+	int64_t start;
+};
+
+
+// The broadcast tree child structure.
+struct s_peermgt_bcchild {
+	int peerid;
+	int peerct;
+	uint64_t lo;
+	uint64_t hi;
+};
+
+
 // The peer manager structure.
 struct s_peermgt {
 	struct s_netid netid;
 	struct s_map map;
+	struct s_map peerconf;
 	struct s_nodedb nodedb;
 	struct s_nodedb relaydb;
 	struct s_authmgt authmgt;
 	struct s_dfrag dfrag;
+	struct s_resume resume;
+	struct s_compress compress;
+	struct s_fec fec;
+	struct s_txq outq[peermgt_CLASS_COUNT];
+	struct s_txq rrq;
 	struct s_nodekey *nodekey;
 	struct s_peermgt_data *data;
 	struct s_crypto *ctx;
+	int ctxcount;
+	int peermax;
 	int localflags;
 	unsigned char msgbuf[peermgt_MSGSIZE_MAX];
 	unsigned char relaymsgbuf[peermgt_MSGSIZE_MAX];
-	unsigned char rrmsgbuf[peermgt_MSGSIZE_MAX];
+	unsigned char compbuf[peermgt_MSGSIZE_MIN];
+	int compbuflen;
+	unsigned char pmtubuf[peermgt_MSGSIZE_MAX];
+	unsigned char fragoutbuf[peermgt_MSGSIZE_MAX];
+	unsigned char fecbuf[peermgt_FEC_PARITYSIZE];
+	int fecoutpeerid;
 	int msgsize;
+	int msgpos;
 	int msgpeerid;
+	int msgaggsize;
+	int msgaggpos;
 	struct s_msg outmsg;
+	int outmsgid;
+	int outmsgclass;
+	int outclass;
+	int outclassdeficit[peermgt_CLASS_COUNT];
 	int outmsgpeerid;
+	int outmsgpeerct;
 	int outmsgbroadcast;
 	int outmsgbroadcastcount;
-	struct s_msg rrmsg;
-	int rrmsgpeerid;
-	int rrmsgtype;
-	int rrmsgusetargetaddr;
-	struct s_peeraddr rrmsgtargetaddr;
+	int outmsgbctree;
+	int outmsgbcorigin;
+	int outmsgbcskip;
+	struct s_peermgt_bcchild bcchild[peermgt_BCTREE_FANOUT];
+	struct s_peermgt_bcchild *bcmember;
+	int bcchildcount;
+	int bcchildpos;
+	uint64_t bcseen[peermgt_BCTREE_SEEN_SIZE];
 	int loopback;
 	int fragmentation;
+	int pmtudisc;
 	int fragoutpeerid;
 	int fragoutcount;
 	int fragoutsize;
+	int fragoutchunk;
 	int fragoutpos;
+	struct s_peermgt_aggregate agg[2];
+	int aggfillid;
+	int aggdelay;
+	int replaywindow;
+	uint64_t *seqmask;
+	int fastfailover;
+	struct s_tbf tbf;
+	int64_t pacenext;
 	int lastconntry;
+	struct s_timer timer;
 	int tinit;
 };
 
@@ -284,18 +518,415 @@ static int peermgtGetNodeID(struct s_peermgt *mgt, struct s_nodeid *nodeid, cons
 }
 
 
+// Get the transmit settings of a NodeID.
+static void peermgtGetPeerConf(struct s_peermgt *mgt, const struct s_nodeid *nodeid, struct s_peermgt_peerconf *conf) {
+	struct s_peermgt_peerconf *ret = mapGet(&mgt->peerconf, nodeid->id);
+	if(ret != NULL) {
+		*conf = *ret;
+	}
+	else {
+		conf->weight = 1;
+		conf->ratelimit = 0;
+	}
+}
+
+
+// Store the transmit settings of a NodeID. Returns 1 if successful.
+static int peermgtSetPeerConf(struct s_peermgt *mgt, const struct s_nodeid *nodeid, const struct s_peermgt_peerconf *conf) {
+	if((conf->weight == 1) && (conf->ratelimit == 0)) {
+		mapRemove(&mgt->peerconf, nodeid->id);
+		return 1;
+	}
+	return mapSet(&mgt->peerconf, nodeid->id, conf);
+}
+
+
+// Set the transmit weight of a NodeID. A peer of weight n gets n times the share of user data bandwidth of a peer of weight 1 when the output is congested.
+static int peermgtSetPeerWeight(struct s_peermgt *mgt, const struct s_nodeid *nodeid, const int weight) {
+	struct s_peermgt_peerconf conf;
+	int peerid;
+	int i;
+	if(!((weight > 0) && (weight <= txq_WEIGHT_MAX))) return 0;
+	peermgtGetPeerConf(mgt, nodeid, &conf);
+	conf.weight = weight;
+	if(!peermgtSetPeerConf(mgt, nodeid, &conf)) return 0;
+	peerid = peermgtGetID(mgt, nodeid);
+	if(peerid > 0) {
+		for(i=0; i<peermgt_CLASS_COUNT; i++) txqSetWeight(&mgt->outq[i], peerid, weight);
+	}
+	return 1;
+}
+
+
+// Return the traffic class of an ethernet frame.
+static int peermgtGetFrameClass(const unsigned char *frame, const int len) {
+	int pos = 12;
+	int pcp = -1;
+	int dscp = -1;
+	int ethertype;
+	if(len < (pos + 2)) return peermgt_CLASS_DEFAULT;
+	ethertype = ((frame[pos] << 8) | frame[pos + 1]);
+	if((ethertype == 0x8100) || (ethertype == 0x88A8)) { // VLAN tag
+		if(len < (pos + 6)) return peermgt_CLASS_DEFAULT;
+		pcp = (frame[pos + 2] >> 5);
+		pos = (pos + 4);
+		ethertype = ((frame[pos] << 8) | frame[pos + 1]);
+	}
+	pos = (pos + 2);
+	if(len >= (pos + 2)) {
+		if((ethertype == 0x0800) && ((frame[pos] >> 4) == 4)) { // IPv4
+			dscp = (frame[pos + 1] >> 2);
+		}
+		else if((ethertype == 0x86DD) && ((frame[pos] >> 4) == 6)) { // IPv6
+			dscp = ((((frame[pos] & 0x0F) << 4) | (frame[pos + 1] >> 4)) >> 2);
+		}
+	}
+	if(dscp > 0) {
+		if(dscp >= 32) return peermgt_CLASS_INTERACTIVE; // CS4 to CS7, AF4x and EF
+		if((dscp == 1) || (dscp == 8)) return peermgt_CLASS_BULK; // LE and CS1
+		return peermgt_CLASS_DEFAULT;
+	}
+	if(pcp >= 0) {
+		if(pcp >= 4) return peermgt_CLASS_INTERACTIVE; // video, voice and network control
+		if((pcp == 1) || (pcp == 2)) return peermgt_CLASS_BULK; // background
+	}
+	return peermgt_CLASS_DEFAULT;
+}
+
+
+// Return number of queued user data messages for a PeerID, or for all PeerIDs if peerid is -1.
+static int peermgtGetOutmsgCount(struct s_peermgt *mgt, const int peerid) {
+	int count = 0;
+	int i;
+	for(i=0; i<peermgt_CLASS_COUNT; i++) {
+		if(peerid < 0) {
+			count = (count + txqPending(&mgt->outq[i]));
+		}
+		else {
+			count = (count + txqCount(&mgt->outq[i], peerid));
+		}
+	}
+	return count;
+}
+
+
+// Return 1 if a queued user data message can be sent now.
+static int peermgtIsOutmsgReady(struct s_peermgt *mgt) {
+	int i;
+	for(i=0; i<peermgt_CLASS_COUNT; i++) {
+		if(txqIsReady(&mgt->outq[i])) return 1;
+	}
+	return 0;
+}
+
+
+// Return the size of a token bucket for a rate.
+static int peermgtGetRateBurst(const int rate) {
+	int64_t burst = (((int64_t)rate * peermgt_RATELIMIT_BURST) / 1000000);
+	if(burst < peermgt_MSGSIZE_MIN) burst = peermgt_MSGSIZE_MIN;
+	return (int)burst;
+}
+
+
+// Stop sending user data to a PeerID until the specified time.
+static void peermgtPausePeer(struct s_peermgt *mgt, const int peerid, const int64_t until) {
+	int i;
+	if(mgt->data[peerid].pacetime == 0) {
+		for(i=0; i<peermgt_CLASS_COUNT; i++) txqBlock(&mgt->outq[i], peerid);
+	}
+	mgt->data[peerid].pacetime = until;
+	if((mgt->pacenext == 0) || (until < mgt->pacenext)) mgt->pacenext = until;
+}
+
+
+// Continue sending user data to a paused PeerID.
+static void peermgtResumePeer(struct s_peermgt *mgt, const int peerid) {
+	int i;
+	if(mgt->data[peerid].pacetime == 0) return;
+	mgt->data[peerid].pacetime = 0;
+	for(i=0; i<peermgt_CLASS_COUNT; i++) txqUnblock(&mgt->outq[i], peerid);
+}
+
+
+// Continue sending user data to paused PeerIDs whose pause time is over.
+static void peermgtResumePeers(struct s_peermgt *mgt, const int64_t now) {
+	int size = mapGetMapSize(&mgt->map);
+	int64_t next = 0;
+	int i;
+	if((mgt->pacenext == 0) || (now < mgt->pacenext)) return;
+	for(i=1; i<size; i++) {
+		if(mgt->data[i].pacetime > 0) {
+			if(now < mgt->data[i].pacetime) {
+				if((next == 0) || (mgt->data[i].pacetime < next)) next = mgt->data[i].pacetime;
+			}
+			else {
+				peermgtResumePeer(mgt, i);
+			}
+		}
+	}
+	mgt->pacenext = next;
+}
+
+
+// Apply the configured and the learned rate limit of a PeerID. The lower one is used.
+static void peermgtUpdatePeerRate(struct s_peermgt *mgt, const int peerid) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int rate = data->ratelimit;
+	if((data->learnedrate > 0) && ((rate == 0) || (data->learnedrate < rate))) rate = data->learnedrate;
+	tbfSetRate(&data->tbf, rate, peermgtGetRateBurst(rate), utilGetClockUS());
+	if(rate == 0) peermgtResumePeer(mgt, peerid);
+}
+
+
+// Account a user data packet sent to a PeerID. A PeerID that exceeds its rate limit is paused until its token bucket is filled again.
+static void peermgtConsumeRate(struct s_peermgt *mgt, const int peerid, const int len) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int64_t now = utilGetClockUS();
+	int delay;
+	data->txbytes = (data->txbytes + len);
+	tbfConsume(&mgt->tbf, len, now);
+	if(tbfIsEnabled(&data->tbf)) {
+		tbfConsume(&data->tbf, len, now);
+		delay = tbfGetDelay(&data->tbf, now);
+		if(delay > 0) peermgtPausePeer(mgt, peerid, (now + delay));
+	}
+}
+
+
+// Learn the rate limit of a PeerID from a loss report. The limit is decreased multiplicatively while packets are lost and increased slowly otherwise.
+static void peermgtLearnRate(struct s_peermgt *mgt, const int peerid, const int lost) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int64_t now = utilGetClockUS();
+	int64_t elapsed = (now - data->txstart);
+	int64_t measured;
+	int64_t rate;
+	if(!(elapsed > 0)) return;
+	measured = ((data->txbytes * 1000000) / elapsed);
+	data->txbytes = 0;
+	data->txstart = now;
+	rate = data->learnedrate;
+	if(lost >= peermgt_RATELIMIT_LOSS_THRESHOLD) {
+		if((rate == 0) || (measured < rate)) rate = measured;
+		rate = ((rate * 3) / 4);
+		if(rate < peermgt_RATELIMIT_MIN) rate = peermgt_RATELIMIT_MIN;
+	}
+	else if((lost == 0) && (rate > 0)) {
+		rate = (rate + (rate / 8));
+		if(rate > (measured * 4)) rate = 0; // the limit is not reached anymore
+	}
+	if(rate > INT32_MAX) rate = 0;
+	if(rate != data->learnedrate) {
+		data->learnedrate = rate;
+		peermgtUpdatePeerRate(mgt, peerid);
+	}
+}
+
+
+// Set the rate limit of a NodeID in bytes per second. A limit of 0 disables the limit.
+static int peermgtSetPeerRateLimit(struct s_peermgt *mgt, const struct s_nodeid *nodeid, const int ratelimit) {
+	struct s_peermgt_peerconf conf;
+	int peerid;
+	if(ratelimit < 0) return 0;
+	peermgtGetPeerConf(mgt, nodeid, &conf);
+	conf.ratelimit = ratelimit;
+	if(!peermgtSetPeerConf(mgt, nodeid, &conf)) return 0;
+	peerid = peermgtGetID(mgt, nodeid);
+	if(peerid > 0) {
+		mgt->data[peerid].ratelimit = ratelimit;
+		peermgtUpdatePeerRate(mgt, peerid);
+	}
+	return 1;
+}
+
+
+// Set the rate limit for all user data in bytes per second. A limit of 0 disables the limit.
+static void peermgtSetRateLimit(struct s_peermgt *mgt, const int ratelimit) {
+	tbfSetRate(&mgt->tbf, ratelimit, peermgtGetRateBurst(ratelimit), utilGetClockUS());
+}
+
+
+// Return the amount of microseconds until user data may be sent again because of the global rate limit.
+static int peermgtGetRateDelay(struct s_peermgt *mgt, const int64_t now) {
+	return tbfGetDelay(&mgt->tbf, now);
+}
+
+
 // Reset the data for an ID.
 static void peermgtResetID(struct s_peermgt *mgt, const int peerid) {
+	int i;
 	mgt->data[peerid].state = peermgt_STATE_INVALID;
 	memset(mgt->data[peerid].remoteaddr.addr, 0, peeraddr_SIZE);
 	cryptoSetKeysRandom(&mgt->ctx[peerid], 1);
+	for(i=0; i<peermgt_CLASS_COUNT; i++) txqFlush(&mgt->outq[i], peerid);
+	txqFlush(&mgt->rrq, peerid);
+	peermgtResumePeer(mgt, peerid);
+	timerCancel(&mgt->timer, peerid);
+}
+
+
+// Returns the candidate path index of a PeerAddr, or -1 if it is not a candidate path of the PeerID.
+static int peermgtFindPath(struct s_peermgt *mgt, const int peerid, const struct s_peeraddr *addr) {
+	int i;
+	for(i=0; i<peermgt_PATH_COUNT; i++) {
+		if(mgt->data[peerid].path[i].used && (memcmp(mgt->data[peerid].path[i].addr.addr, addr->addr, peeraddr_SIZE) == 0)) return i;
+	}
+	return -1;
+}
+
+
+// Add a PeerAddr as candidate path of a PeerID. If all slots are used, the path that has not been seen for the longest time is replaced. Returns the path index.
+static int peermgtAddPath(struct s_peermgt *mgt, const int peerid, const struct s_peeraddr *addr, const int tnow) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int cur = peermgtFindPath(mgt, peerid, &data->remoteaddr);
+	int i = peermgtFindPath(mgt, peerid, addr);
+	int j;
+	if(!(i < 0)) return i;
+	for(j=0; j<peermgt_PATH_COUNT; j++) {
+		if(!data->path[j].used) {
+			i = j;
+			break;
+		}
+		if((j != cur) && ((i < 0) || ((tnow - data->path[j].lastseen) > (tnow - data->path[i].lastseen)))) i = j;
+	}
+	data->path[i].addr = *addr;
+	data->path[i].probetime = 0;
+	data->path[i].rtt = -1;
+	data->path[i].lost = 0;
+	data->path[i].lastseen = tnow;
+	data->path[i].used = 1;
+	data->lastpathprobe = (tnow - peermgt_PATH_PROBE_INTERVAL); // measure the new path soon
+	timerSetEarlier(&mgt->timer, peerid, tnow);
+	return i;
+}
+
+
+// Returns the cost of a candidate path in microseconds, or -1 if the path is not usable.
+static int peermgtGetPathCost(struct s_peermgt *mgt, const int peerid, const int pathid) {
+	struct s_peermgt_path *path = &mgt->data[peerid].path[pathid];
+	if(!(path->used && (path->rtt >= 0) && (path->lost < peermgt_PATH_LOST_MAX))) return -1;
+	if(peeraddrIsInternal(&path->addr)) return (path->rtt + peermgt_PATH_RELAY_PENALTY);
+	return path->rtt;
+}
+
+
+// Move a PeerID to its best candidate path.
+static void peermgtSelectPath(struct s_peermgt *mgt, const int peerid) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int cur = peermgtFindPath(mgt, peerid, &data->remoteaddr);
+	int curcost = ((cur < 0) ? -1 : peermgtGetPathCost(mgt, peerid, cur));
+	int best = -1;
+	int bestcost = -1;
+	int cost;
+	int margin;
+	int i;
+	for(i=0; i<peermgt_PATH_COUNT; i++) {
+		cost = peermgtGetPathCost(mgt, peerid, i);
+		if((cost >= 0) && ((best < 0) || (cost < bestcost))) {
+			best = i;
+			bestcost = cost;
+		}
+	}
+	if((best < 0) || (best == cur)) return;
+	margin = (curcost / 8);
+	if(margin < peermgt_PATH_HYSTERESIS) margin = peermgt_PATH_HYSTERESIS;
+	if((curcost < 0) || ((bestcost + margin) < curcost)) data->remoteaddr = data->path[best].addr;
+}
+
+
+// Update the candidate paths of a PeerID after a packet has been received from a PeerAddr.
+// Packets from unknown addresses move the PeerID to the new address, unless they are probes. Otherwise the current path is only left if it is unhealthy.
+static void peermgtUpdatePath(struct s_peermgt *mgt, const int peerid, const struct s_peeraddr *addr, const int probe, const int tnow) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int cur = peermgtFindPath(mgt, peerid, &data->remoteaddr);
+	int i = peermgtFindPath(mgt, peerid, addr);
+	if(i < 0) {
+		i = peermgtAddPath(mgt, peerid, addr, tnow);
+		if(!probe) cur = -1;
+	}
+	data->path[i].lastseen = tnow;
+	data->path[i].lost = 0;
+	if((!probe) && ((cur < 0) || (data->path[cur].lost >= peermgt_PATH_LOST_MAX))) data->remoteaddr = *addr;
+}
+
+
+// Point the replay windows of a peer slot to its part of the replay window memory.
+static void peermgtSetSeqWindow(struct s_peermgt *mgt, const int peerid) {
+	const int words = seqMaskWords(mgt->replaywindow);
+	seqSetWindow(&mgt->data[peerid].seq, &mgt->seqmask[(words * (2 * peerid))], mgt->replaywindow);
+	seqSetWindow(&mgt->data[peerid].recvseq, &mgt->seqmask[(words * ((2 * peerid) + 1))], mgt->replaywindow);
+}
+
+
+// Return the number of reassembly buffers for a number of peer slots.
+static int peermgtGetFragbufCount(const int peer_slots) {
+	const int count = (peer_slots + peermgt_FRAGBUF_COUNT);
+	return ((count < peermgt_FRAGBUF_COUNT_MAX) ? count : peermgt_FRAGBUF_COUNT_MAX);
+}
+
+
+// Increase the number of peer slots. Existing PeerIDs stay valid.
+static int peermgtResize(struct s_peermgt *mgt, const int peer_slots) {
+	const int size = (peer_slots + 1);
+	const int oldsize = mapGetMapSize(&mgt->map);
+	struct s_peermgt_data *data_mem;
+	struct s_crypto *ctx_mem;
+	struct s_peermgt_bcchild *bcmember_mem;
+	uint64_t *seqmask_mem;
+	int i;
+	if(!(size > oldsize)) return 0;
+	if((data_mem = realloc(mgt->data, (sizeof(struct s_peermgt_data) * size))) == NULL) return 0;
+	mgt->data = data_mem;
+	for(i=oldsize; i<size; i++) {
+		mgt->data[i].state = peermgt_STATE_INVALID;
+		mgt->data[i].pacetime = 0;
+	}
+	if((seqmask_mem = realloc(mgt->seqmask, (sizeof(uint64_t) * 2 * seqMaskWords(mgt->replaywindow) * size))) == NULL) return 0;
+	mgt->seqmask = seqmask_mem;
+	for(i=0; i<size; i++) {
+		peermgtSetSeqWindow(mgt, i);
+	}
+	if((bcmember_mem = realloc(mgt->bcmember, (sizeof(struct s_peermgt_bcchild) * size))) == NULL) return 0;
+	mgt->bcmember = bcmember_mem;
+	if(mgt->ctxcount < size) {
+		if((ctx_mem = realloc(mgt->ctx, (sizeof(struct s_crypto) * size))) == NULL) return 0;
+		mgt->ctx = ctx_mem;
+		if(!cryptoCreate(&mgt->ctx[mgt->ctxcount], (size - mgt->ctxcount))) return 0;
+		mgt->ctxcount = size;
+	}
+	if(!dfragResize(&mgt->dfrag, peermgtGetFragbufCount(peer_slots), size)) return 0;
+	if(!resumeResize(&mgt->resume, ((peer_slots * 2) + 1))) return 0;
+	if(!fecResize(&mgt->fec, size)) return 0;
+	for(i=0; i<peermgt_CLASS_COUNT; i++) {
+		if(!txqResize(&mgt->outq[i], size)) return 0;
+	}
+	if(!txqResize(&mgt->rrq, size)) return 0;
+	if(!nodedbResize(&mgt->relaydb, size)) return 0;
+	if(!nodedbResize(&mgt->nodedb, ((peer_slots * 8) + 1))) return 0;
+	if(!timerResize(&mgt->timer, size)) return 0;
+	return mapResize(&mgt->map, size); // the size of the PeerID map is the number of usable peer slots
+}
+
+
+// Make room for a new peer if all peer slots are used. The number of peer slots is doubled until the maximum is reached.
+static void peermgtGrow(struct s_peermgt *mgt) {
+	int peer_slots = (mapGetMapSize(&mgt->map) - 1);
+	if(mapGetKeyCount(&mgt->map) < mapGetMapSize(&mgt->map)) return;
+	if(!(peer_slots < mgt->peermax)) return;
+	peer_slots = (peer_slots * 2);
+	if(peer_slots > mgt->peermax) peer_slots = mgt->peermax;
+	peermgtResize(mgt, peer_slots);
 }
 
 
 // Register new peer.
 static int peermgtNew(struct s_peermgt *mgt, const struct s_nodeid *nodeid, const struct s_peeraddr *addr) {
 	int tnow = utilGetClock();
-	int peerid = mapAddReturnID(&mgt->map, nodeid->id, &tnow);
+	int64_t seq;
+	int peerid;
+	struct s_peermgt_peerconf conf;
+	int i;
+	peermgtGrow(mgt);
+	peerid = mapAddReturnID(&mgt->map, nodeid->id, &tnow);
 	if(!(peerid < 0)) {
 		mgt->data[peerid].state = peermgt_STATE_AUTHED;
 		mgt->data[peerid].remoteaddr = *addr;
@@ -304,8 +935,44 @@ static int peermgtNew(struct s_peermgt *mgt, const struct s_nodeid *nodeid, cons
 		mgt->data[peerid].lastsend = tnow;
 		mgt->data[peerid].lastpeerinfo = tnow;
 		mgt->data[peerid].lastpeerinfosendpeerid = peermgtGetNextID(mgt);
-		seqInit(&mgt->data[peerid].seq, cryptoRand64());
+		seq = cryptoRand64();
+		seqInit(&mgt->data[peerid].seq, seq);
+		seqInit(&mgt->data[peerid].recvseq, seq);
 		mgt->data[peerid].remoteflags = 0;
+		mgt->data[peerid].compin = 0;
+		mgt->data[peerid].compout = 0;
+		mgt->data[peerid].compskip = 0;
+		mgt->data[peerid].fragsize = peermgt_MSGSIZE_MIN;
+		mgt->data[peerid].pmtustep = 0;
+		mgt->data[peerid].pmtutries = 0;
+		mgt->data[peerid].pmtuprobe = 0;
+		mgt->data[peerid].lastpmtuprobe = (tnow - peermgt_PMTU_TIMEOUT);
+		mgt->data[peerid].lastpmtusearch = tnow;
+		mgt->data[peerid].fecsize = 0;
+		mgt->data[peerid].fecrecv = 0;
+		mgt->data[peerid].lastfecreport = tnow;
+		mgt->data[peerid].rttnonce = cryptoRand64();
+		mgt->data[peerid].rttprobe = 0;
+		mgt->data[peerid].lastrttprobe = (tnow - peermgt_RTT_INTERVAL);
+		mgt->data[peerid].rtt = -1;
+		mgt->data[peerid].jitter = -1;
+		mgt->data[peerid].loss = 0;
+		for(i=0; i<peermgt_PATH_COUNT; i++) {
+			mgt->data[peerid].path[i].used = 0;
+			mgt->data[peerid].pathcredit[i] = 0;
+		}
+		peermgtAddPath(mgt, peerid, addr, tnow);
+		timerSet(&mgt->timer, peerid, tnow);
+		fecGroupReset(&mgt->fec, peerid);
+		peermgtGetPeerConf(mgt, nodeid, &conf);
+		for(i=0; i<peermgt_CLASS_COUNT; i++) txqSetWeight(&mgt->outq[i], peerid, conf.weight);
+		tbfReset(&mgt->data[peerid].tbf);
+		mgt->data[peerid].ratelimit = conf.ratelimit;
+		mgt->data[peerid].learnedrate = 0;
+		mgt->data[peerid].pacetime = 0;
+		mgt->data[peerid].txbytes = 0;
+		mgt->data[peerid].txstart = utilGetClockUS();
+		peermgtUpdatePeerRate(mgt, peerid);
 		return peerid;
 	}
 	return -1;
@@ -316,6 +983,7 @@ static int peermgtNew(struct s_peermgt *mgt, const struct s_nodeid *nodeid, cons
 static void peermgtDelete(struct s_peermgt *mgt, const struct s_nodeid *nodeid) {
 	int peerid = peermgtGetID(mgt, nodeid);
 	if(peerid > 0) { // don't allow special ID 0 to be deleted.
+		resumeTouch(&mgt->resume, nodeid); // resumption window starts when the session ends
 		mapRemove(&mgt->map, nodeid->id);
 		peermgtResetID(mgt, peerid);
 	}
@@ -359,6 +1027,26 @@ static int peermgtConnect(struct s_peermgt *mgt, const struct s_peeraddr *remote
 }
 
 
+// Connect to a known node. Resumes a previous session with the node if possible.
+static int peermgtConnectNode(struct s_peermgt *mgt, const struct s_nodeid *nodeid, const struct s_peeraddr *remote_addr) {
+	struct s_resume_ticket ticket;
+	if(remote_addr != NULL) {
+		if((!peeraddrIsInternal(remote_addr)) && (resumeGet(&mgt->resume, nodeid, &ticket))) {
+			if(authmgtStartResume(&mgt->authmgt, remote_addr, nodeid, &ticket)) {
+				return 1;
+			}
+		}
+	}
+	return peermgtConnect(mgt, remote_addr);
+}
+
+
+// Set session resumption window in seconds. A window of 0 disables session resumption.
+static void peermgtSetResumeTimeout(struct s_peermgt *mgt, const int timeout) {
+	resumeSetTimeout(&mgt->resume, timeout);
+}
+
+
 // Enable/Disable loopback messages.
 static void peermgtSetLoopback(struct s_peermgt *mgt, const int enable) {
 	if(enable) {
@@ -376,6 +1064,12 @@ static void peermgtSetFastauth(struct s_peermgt *mgt, const int enable) {
 }
 
 
+// Enable/disable the fast handshake.
+static void peermgtSetFastHandshake(struct s_peermgt *mgt, const int enable) {
+	authmgtSetFastHandshake(&mgt->authmgt, enable);
+}
+
+
 // Enable/disable packet fragmentation.
 static void peermgtSetFragmentation(struct s_peermgt *mgt, const int enable) {
 	if(enable) {
@@ -387,6 +1081,67 @@ static void peermgtSetFragmentation(struct s_peermgt *mgt, const int enable) {
 }
 
 
+// Enable/disable path MTU discovery.
+static void peermgtSetPMTUDiscovery(struct s_peermgt *mgt, const int enable) {
+	if(enable) {
+		mgt->pmtudisc = 1;
+	}
+	else {
+		mgt->pmtudisc = 0;
+	}
+}
+
+
+// Enable/disable aggregation of small user data frames. Frames are delayed by up to the specified amount of microseconds.
+static void peermgtSetAggregation(struct s_peermgt *mgt, const int delay) {
+	if(delay > 0) {
+		mgt->aggdelay = delay;
+	}
+	else {
+		mgt->aggdelay = 0;
+	}
+}
+
+
+// Set replay window size in bits. The replay windows of existing connections restart at their highest received sequence number.
+static int peermgtSetReplayWindow(struct s_peermgt *mgt, const int window) {
+	const int size = mapGetMapSize(&mgt->map);
+	const int w = seqWindowSize(window);
+	uint64_t *seqmask_mem;
+	int64_t seq;
+	int64_t recvseq;
+	int i;
+	if(w == mgt->replaywindow) return 1;
+	if((seqmask_mem = realloc(mgt->seqmask, (sizeof(uint64_t) * 2 * seqMaskWords(w) * size))) == NULL) return 0;
+	mgt->seqmask = seqmask_mem;
+	mgt->replaywindow = w;
+	for(i=0; i<size; i++) {
+		if(mgt->data[i].state != peermgt_STATE_INVALID) {
+			seq = seqGet(&mgt->data[i].seq);
+			recvseq = seqGet(&mgt->data[i].recvseq);
+			peermgtSetSeqWindow(mgt, i);
+			seqInit(&mgt->data[i].seq, seq);
+			seqInit(&mgt->data[i].recvseq, recvseq);
+		}
+		else {
+			peermgtSetSeqWindow(mgt, i);
+		}
+	}
+	return 1;
+}
+
+
+// Enable/Disable fast failover between candidate paths.
+static void peermgtSetFastFailover(struct s_peermgt *mgt, const int enable) {
+	if(enable) {
+		mgt->fastfailover = 1;
+	}
+	else {
+		mgt->fastfailover = 0;
+	}
+}
+
+
 // Set flags.
 static void peermgtSetFlags(struct s_peermgt *mgt, const int flags) {
 	mgt->localflags = flags;
@@ -409,6 +1164,61 @@ static int peermgtGetRemoteFlag(struct s_peermgt *mgt, const int peerid, const i
 }
 
 
+// Returns the interval in seconds in which candidate paths are probed.
+static int peermgtGetPathProbeInterval(struct s_peermgt *mgt) {
+	if((mgt->fastfailover > 0) || peermgtGetFlag(mgt, peermgt_FLAG_BONDING)) return peermgt_PATH_PROBE_INTERVAL_FAST;
+	return peermgt_PATH_PROBE_INTERVAL;
+}
+
+
+// Returns the PeerAddr that the next user data packet to a PeerID is sent to.
+// With bonding, the packets are spread across the usable paths by smooth weighted round robin. Otherwise all packets take the current path.
+static const struct s_peeraddr *peermgtGetDataAddr(struct s_peermgt *mgt, const int peerid) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int cost[peermgt_PATH_COUNT];
+	int bestcost = -1;
+	int total = 0;
+	int sel = -1;
+	int w;
+	int i;
+	if(!(peermgtGetFlag(mgt, peermgt_FLAG_BONDING) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_BONDING))) return &data->remoteaddr;
+	for(i=0; i<peermgt_PATH_COUNT; i++) {
+		cost[i] = peermgtGetPathCost(mgt, peerid, i);
+		if(peeraddrIsInternal(&data->path[i].addr)) cost[i] = -1;
+		if((cost[i] >= 0) && ((bestcost < 0) || (cost[i] < bestcost))) bestcost = cost[i];
+	}
+	if(bestcost < 0) return &data->remoteaddr;
+	for(i=0; i<peermgt_PATH_COUNT; i++) {
+		if((cost[i] >= 0) && (cost[i] <= ((bestcost * 2) + peermgt_PATH_BOND_SLACK))) {
+			w = ((peermgt_PATH_BOND_WEIGHT * (bestcost + peermgt_PATH_HYSTERESIS)) / (cost[i] + peermgt_PATH_HYSTERESIS));
+			if(w < 1) w = 1;
+			data->pathcredit[i] = (data->pathcredit[i] + w);
+			total = (total + w);
+			if((sel < 0) || (data->pathcredit[i] > data->pathcredit[sel])) sel = i;
+		}
+		else {
+			data->pathcredit[i] = 0;
+		}
+	}
+	data->pathcredit[sel] = (data->pathcredit[sel] - total);
+	return &data->path[sel].addr;
+}
+
+
+// Get the packet format that is used for a PeerID. Sequence numbers are sent in cleartext if both sides support it, encryption is skipped if both sides enabled integrity only mode.
+static int peermgtGetPacketFormat(struct s_peermgt *mgt, const int peerid) {
+	if((peerid > 0) && peermgtGetFlag(mgt, peermgt_FLAG_INTEGRITYONLY) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_INTEGRITYONLY)) {
+		return packet_FORMAT_INTEGRITYONLY;
+	}
+	else if((peerid > 0) && peermgtGetFlag(mgt, peermgt_FLAG_CLEARSEQ) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_CLEARSEQ)) {
+		return packet_FORMAT_CLEARSEQ;
+	}
+	else {
+		return packet_FORMAT_DEFAULT;
+	}
+}
+
+
 // Generate peerinfo packet.
 static void peermgtGenPacketPeerinfo(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid) {
 	const int peerinfo_size = (packet_PEERID_SIZE + nodeid_SIZE + peeraddr_SIZE);
@@ -438,35 +1248,720 @@ static void peermgtGenPacketPeerinfo(struct s_packet_data *data, struct s_peermg
 			pos = pos + peerinfo_size;
 			peerinfo_count++;
 		}
-		i++;
+		i++;
+	}
+
+	// write peerinfo_count
+	utilWriteInt32(data->pl_buf, peerinfo_count);
+
+	// set packet metadata
+	data->pl_length = (4 + (peerinfo_count * peerinfo_size));
+	data->pl_type = packet_PLTYPE_PEERINFO;
+	data->pl_options = 0;
+}
+
+
+// Add request-response message to the queue of a PeerID. If a target PeerAddr is given, the message is sent there instead of the peer's current address.
+// Returns a pointer to the message buffer that has to be filled by the caller, or NULL if the queue is full.
+static unsigned char *peermgtAddRRMsg(struct s_peermgt *mgt, const int peerid, const int type, const struct s_peeraddr *targetaddr, const int len) {
+	unsigned char *buf;
+	if(targetaddr != NULL) {
+		buf = txqAdd(&mgt->rrq, peerid, mgt->data[peerid].conntime, type, 1, (peeraddr_SIZE + len));
+		if(buf == NULL) return NULL;
+		memcpy(buf, targetaddr->addr, peeraddr_SIZE);
+		return &buf[peeraddr_SIZE];
+	}
+	return txqAdd(&mgt->rrq, peerid, mgt->data[peerid].conntime, type, 0, len);
+}
+
+
+// Send ping to PeerAddr. Return 1 if successful.
+static int peermgtSendPingToAddr(struct s_peermgt *mgt, const struct s_nodeid *tonodeid, const int topeerid, const int topeerct, const struct s_peeraddr *peeraddr) {
+	int outpeerid;
+	unsigned char *pingbuf;
+
+	outpeerid = peermgtGetActiveID(mgt, tonodeid, topeerid, topeerct);
+
+	if(outpeerid > 0) {
+		pingbuf = peermgtAddRRMsg(mgt, outpeerid, packet_PLTYPE_PING, peeraddr, peermgt_PINGBUF_SIZE);
+		if(pingbuf != NULL) {
+			cryptoRand(pingbuf, peermgt_PINGBUF_SIZE); // generate ping message
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+// Returns the payload size of the next path MTU probe for a PeerID, or 0 if no probe is due.
+static int peermgtGetPMTUProbeSize(struct s_peermgt *mgt, const int peerid, const int tnow) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int size;
+	if(!((mgt->pmtudisc > 0) && (mgt->fragmentation > 0) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_PMTU))) return 0;
+	if(data->pmtustep < 0) {
+		// start a new search
+		if((tnow - data->lastpmtusearch) < peermgt_PMTU_INTERVAL) return 0;
+		data->pmtustep = 0;
+		data->pmtutries = 0;
+	}
+	else {
+		// wait for the pong of the previous probe
+		if((tnow - data->lastpmtuprobe) < peermgt_PMTU_TIMEOUT) return 0;
+	}
+	while(data->pmtustep < peermgt_PMTU_LADDER_SIZE) {
+		size = (peermgt_PMTU_LADDER[data->pmtustep] - peermgt_PMTU_OVERHEAD);
+		if(size > (peermgt_MSGSIZE_MAX - 1)) size = (peermgt_MSGSIZE_MAX - 1);
+		if(!(size > peermgt_MSGSIZE_MIN)) break;
+		if(data->pmtutries < peermgt_PMTU_TRIES) {
+			data->pmtutries++;
+			data->pmtuprobe = size;
+			data->lastpmtuprobe = tnow;
+			return size;
+		}
+		data->pmtustep++;
+		data->pmtutries = 0;
+	}
+
+	// no probe got through, fall back to the minimum message size
+	data->fragsize = peermgt_MSGSIZE_MIN;
+	data->pmtustep = -1;
+	data->pmtuprobe = 0;
+	data->lastpmtusearch = tnow;
+	return 0;
+}
+
+
+// Generate path MTU probe packet. The probe starts with a nonce and its own size, the rest is padding.
+static void peermgtGenPacketPMTUProbe(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid, const int size) {
+	mgt->data[peerid].pmtunonce = cryptoRand64();
+	utilWriteInt64(&mgt->pmtubuf[0], mgt->data[peerid].pmtunonce);
+	utilWriteInt32(&mgt->pmtubuf[8], size);
+	memset(&mgt->pmtubuf[12], 0, (size - 12));
+	data->pl_buf = mgt->pmtubuf;
+	data->pl_buf_size = peermgt_MSGSIZE_MAX;
+	data->pl_length = size;
+	data->pl_type = packet_PLTYPE_PING;
+	data->pl_options = 0;
+}
+
+
+// Add a loss sample in parts per million to the loss estimate of a PeerID.
+static void peermgtAddLossSample(struct s_peermgt *mgt, const int peerid, const int loss) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	data->loss = ((data->loss * 7) + loss) / 8;
+}
+
+
+// Add a round trip time sample in microseconds to the estimates of a PeerID.
+static void peermgtAddRTTSample(struct s_peermgt *mgt, const int peerid, const int rtt) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int diff;
+	if(data->rtt < 0) {
+		data->rtt = rtt;
+		data->jitter = (rtt / 2);
+	}
+	else {
+		diff = ((data->rtt > rtt) ? (data->rtt - rtt) : (rtt - data->rtt));
+		data->jitter = ((data->jitter * 3) + diff) / 4;
+		data->rtt = ((data->rtt * 7) + rtt) / 8;
+	}
+}
+
+
+// Returns the smoothed round trip time of a PeerID in microseconds, or -1 if it is not known yet.
+static int peermgtGetRTT(struct s_peermgt *mgt, const int peerid) {
+	return mgt->data[peerid].rtt;
+}
+
+
+// Returns the jitter of a PeerID in microseconds, or -1 if it is not known yet.
+static int peermgtGetJitter(struct s_peermgt *mgt, const int peerid) {
+	return mgt->data[peerid].jitter;
+}
+
+
+// Returns the loss rate of a PeerID in parts per million.
+static int peermgtGetLoss(struct s_peermgt *mgt, const int peerid) {
+	return mgt->data[peerid].loss;
+}
+
+
+// Send probes to the candidate paths of a PeerID and select the best path. Probes are only sent if there is more than one candidate.
+static void peermgtProbePaths(struct s_peermgt *mgt, const int peerid, const int tnow) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	struct s_peermgt_path *path;
+	unsigned char *pingbuf;
+	int64_t now = utilGetClockUS();
+	int count = 0;
+	int i;
+	data->lastpathprobe = tnow;
+	for(i=0; i<peermgt_PATH_COUNT; i++) {
+		path = &data->path[i];
+		if(path->used && ((tnow - path->lastseen) > peermgt_PATH_TIMEOUT) && (memcmp(path->addr.addr, data->remoteaddr.addr, peeraddr_SIZE) != 0)) path->used = 0; // forget old paths
+		if(path->used && ((!peeraddrIsInternal(&path->addr)) || peermgtIsValidIndirectPeerAddr(mgt, &path->addr))) count++;
+	}
+	if(count < 2) return;
+	for(i=0; i<peermgt_PATH_COUNT; i++) {
+		path = &data->path[i];
+		if(!path->used) continue;
+		if(path->probetime != 0) path->lost++; // the previous probe got lost
+		path->probetime = 0;
+		if(peeraddrIsInternal(&path->addr) && (!peermgtIsValidIndirectPeerAddr(mgt, &path->addr))) {
+			path->lost = peermgt_PATH_LOST_MAX; // relay is gone
+			continue;
+		}
+		pingbuf = peermgtAddRRMsg(mgt, peerid, packet_PLTYPE_PING, &path->addr, peermgt_PINGBUF_SIZE);
+		if(pingbuf != NULL) {
+			path->probetime = now;
+			utilWriteInt64(&pingbuf[0], data->rttnonce);
+			utilWriteInt64(&pingbuf[8], now);
+			utilWriteInt32(&pingbuf[16], (i + 1));
+			memset(&pingbuf[20], 0, (peermgt_PINGBUF_SIZE - 20));
+		}
+	}
+	peermgtSelectPath(mgt, peerid);
+}
+
+
+// Generate round trip time probe packet. The probe is a ping that contains a nonce and the time it was sent.
+static void peermgtGenPacketRTTProbe(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid) {
+	int64_t now = utilGetClockUS();
+	if(mgt->data[peerid].rttprobe != 0) peermgtAddLossSample(mgt, peerid, peermgt_RTT_PPM); // the previous probe got lost
+	mgt->data[peerid].rttprobe = now;
+	utilWriteInt64(&data->pl_buf[0], mgt->data[peerid].rttnonce);
+	utilWriteInt64(&data->pl_buf[8], now);
+	memset(&data->pl_buf[16], 0, (peermgt_PINGBUF_SIZE - 16));
+	data->pl_length = peermgt_PINGBUF_SIZE;
+	data->pl_type = packet_PLTYPE_PING;
+	data->pl_options = 0;
+}
+
+
+// Move the pending aggregate to the output slot. Returns 0 if the output slot is still in use.
+static int peermgtSealAggregate(struct s_peermgt *mgt) {
+	if(mgt->agg[mgt->aggfillid].size > 0) {
+		if(mgt->agg[!mgt->aggfillid].size > 0) {
+			return 0;
+		}
+		mgt->aggfillid = !mgt->aggfillid;
+	}
+	return 1;
+}
+
+
+// Add user data frame to the pending aggregate. Returns 1 if successful.
+static int peermgtAddAggregate(struct s_peermgt *mgt, const struct s_msg *sendmsg, const int peerid) {
+	struct s_peermgt_aggregate *agg = &mgt->agg[mgt->aggfillid];
+	const int conntime = mgt->data[peerid].conntime;
+	if((agg->size > 0) && ((agg->peerid != peerid) || (agg->conntime != conntime) || ((agg->size + peermgt_AGGREGATE_HDRSIZE + sendmsg->len) > peermgt_AGGREGATE_SIZE))) {
+		if(!peermgtSealAggregate(mgt)) return 0;
+		agg = &mgt->agg[mgt->aggfillid];
+	}
+	if(agg->size == 0) {
+		agg->count = 0;
+		agg->peerid = peerid;
+		agg->conntime = conntime;
+		agg->start = utilGetClockUS();
+	}
+	utilWriteInt16(&agg->buf[agg->size], sendmsg->len);
+	memcpy(&agg->buf[(agg->size + peermgt_AGGREGATE_HDRSIZE)], sendmsg->msg, sendmsg->len);
+	agg->size = (agg->size + peermgt_AGGREGATE_HDRSIZE + sendmsg->len);
+	agg->count++;
+	return 1;
+}
+
+
+// Returns the amount of microseconds until the pending aggregate has to be sent, or -1 if there is none.
+static int peermgtGetAggregateDelay(struct s_peermgt *mgt) {
+	struct s_peermgt_aggregate *agg = &mgt->agg[mgt->aggfillid];
+	int64_t elapsed;
+	if(mgt->agg[!mgt->aggfillid].size > 0) {
+		return 0;
+	}
+	if(agg->size > 0) {
+		elapsed = (utilGetClockUS() - agg->start);
+		if(elapsed < mgt->aggdelay) {
+			return (mgt->aggdelay - elapsed);
+		}
+		return 0;
+	}
+	return -1;
+}
+
+
+// Returns 1 if forward error correction is used for a PeerID.
+static int peermgtIsFEC(struct s_peermgt *mgt, const int peerid) {
+	return (peermgtGetFlag(mgt, peermgt_FLAG_FEC) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_FEC));
+}
+
+
+// Returns 1 if loss reports should be sent to a PeerID.
+static int peermgtIsLossReport(struct s_peermgt *mgt, const int peerid) {
+	return (peermgtIsFEC(mgt, peerid) || peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_RATELEARN));
+}
+
+
+// Returns 1 if the payload type carries user data that can be protected by forward error correction.
+static int peermgtIsFECType(const int pl_type) {
+	return ((pl_type == packet_PLTYPE_USERDATA) || (pl_type == packet_PLTYPE_USERDATA_FRAGMENT) || (pl_type == packet_PLTYPE_USERDATA_FRAGMENT_EXT) || (pl_type == packet_PLTYPE_USERDATA_AGGREGATE) || (pl_type == packet_PLTYPE_USERDATA_COMPRESSED) || (pl_type == packet_PLTYPE_USERDATA_BROADCAST));
+}
+
+
+// Calculate the FEC group size from the amount of received packets out of the last 64. Returns 0 if nothing was lost.
+static int peermgtGetFECGroupSize(const int rq) {
+	int lost = (64 - rq);
+	int size;
+	if(!(lost > 0)) return 0;
+	size = (32 / lost);
+	if(size < 2) size = 2;
+	if(size > fec_GROUP_MAX) size = fec_GROUP_MAX;
+	return size;
+}
+
+
+// Add an outgoing user data packet to the FEC group of a PeerID. The parity packet is sent next when the group is complete.
+static void peermgtAddFEC(struct s_peermgt *mgt, const int peerid, const struct s_packet_data *data) {
+	if((mgt->data[peerid].fecsize > 1) && peermgtIsFEC(mgt, peerid)) {
+		if(fecEncode(&mgt->fec, peerid, mgt->data[peerid].fecsize, data->seq, data->pl_type, data->pl_options, data->pl_buf, data->pl_length, utilGetClockUS())) {
+			mgt->fecoutpeerid = peerid;
+		}
+	}
+}
+
+
+// Returns the PeerID of a FEC group whose parity has to be sent now, or 0 if there is none.
+// All groups have the same flush delay, so only the oldest group has to be checked.
+static int peermgtGetFECOutputID(struct s_peermgt *mgt) {
+	int i;
+	if(mgt->fragoutsize > 0) return 0; // fragments of a message need consecutive sequence numbers
+	if(mgt->fecoutpeerid > 0) return mgt->fecoutpeerid;
+	if(!peermgtGetFlag(mgt, peermgt_FLAG_FEC)) return 0;
+	i = fecGetOldestGroup(&mgt->fec);
+	if((i > 0) && (!((utilGetClockUS() - fecGroupStart(&mgt->fec, i)) < peermgt_FEC_FLUSH_DELAY))) return i;
+	return 0;
+}
+
+
+// Returns the amount of microseconds until the parity of an incomplete FEC group has to be sent, or -1 if there is none.
+static int peermgtGetFECDelay(struct s_peermgt *mgt) {
+	int64_t remaining;
+	int i;
+	if(mgt->fecoutpeerid > 0) return 0;
+	if(!peermgtGetFlag(mgt, peermgt_FLAG_FEC)) return -1;
+	i = fecGetOldestGroup(&mgt->fec);
+	if(i < 0) return -1;
+	remaining = (peermgt_FEC_FLUSH_DELAY - (utilGetClockUS() - fecGroupStart(&mgt->fec, i)));
+	if(!(remaining > 0)) return 0;
+	return remaining;
+}
+
+
+// Returns the amount of microseconds until a delayed packet has to be sent, or -1 if there is none.
+static int peermgtGetOutputDelay(struct s_peermgt *mgt) {
+	int64_t now;
+	int ratedelay;
+	int fecdelay;
+	int delay;
+	if(txqPending(&mgt->rrq) > 0) return 0;
+	now = utilGetClockUS();
+	ratedelay = peermgtGetRateDelay(mgt, now);
+	fecdelay = peermgtGetFECDelay(mgt);
+	if(ratedelay > 0) { // user data has to wait for the global rate limit
+		delay = ratedelay;
+	}
+	else {
+		if(peermgtIsOutmsgReady(mgt)) return 0;
+		delay = peermgtGetAggregateDelay(mgt);
+		if((mgt->pacenext > 0) && (peermgtGetOutmsgCount(mgt, -1) > 0)) { // user data has to wait for paused peers
+			ratedelay = ((mgt->pacenext > now) ? (int)(mgt->pacenext - now) : 0);
+			if((delay < 0) || (ratedelay < delay)) delay = ratedelay;
+		}
+	}
+	if(delay < 0) return fecdelay;
+	if(fecdelay < 0) return delay;
+	return ((delay < fecdelay) ? delay : fecdelay);
+}
+
+
+// Generate FEC parity packet for a PeerID. Returns 0 if the group is empty.
+static int peermgtGenPacketFEC(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid) {
+	int len = fecGetParity(&mgt->fec, peerid, mgt->fecbuf, peermgt_FEC_PARITYSIZE);
+	if(!(len > 0)) return 0;
+	data->pl_buf = mgt->fecbuf;
+	data->pl_buf_size = peermgt_FEC_PARITYSIZE;
+	data->pl_length = len;
+	data->pl_type = packet_PLTYPE_USERDATA_FEC;
+	data->pl_options = 0;
+	return 1;
+}
+
+
+// Generate loss report packet for a PeerID. It contains the amount of packets received out of the last 64.
+static void peermgtGenPacketLossReport(struct s_packet_data *data, struct s_peermgt *mgt, const int peerid) {
+	mgt->fecbuf[0] = seqRQ(&mgt->data[peerid].recvseq);
+	data->pl_buf = mgt->fecbuf;
+	data->pl_buf_size = peermgt_FEC_PARITYSIZE;
+	data->pl_length = 1;
+	data->pl_type = packet_PLTYPE_LOSSREPORT;
+	data->pl_options = 0;
+}
+
+
+// Compress the pending user data message for a PeerID. Returns the compressed length if the compressed message in compbuf should be sent.
+static int peermgtCompressUserdata(struct s_peermgt *mgt, const int peerid, const int len) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	if(!(peermgtGetFlag(mgt, peermgt_FLAG_COMPRESS) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_COMPRESS))) return 0;
+	if(data->compskip > 0) {
+		data->compskip--;
+		return 0;
+	}
+
+	// compress message, the result is reused for all peers of a broadcast
+	if(mgt->compbuflen < 0) {
+		if(compressEstimate(mgt->outmsg.msg, len)) {
+			mgt->compbuflen = compressEncode(&mgt->compress, mgt->compbuf, peermgt_MSGSIZE_MIN, mgt->outmsg.msg, len);
+			if(!(mgt->compbuflen < len)) mgt->compbuflen = 0;
+		}
+		else {
+			mgt->compbuflen = 0;
+			return 0;
+		}
+	}
+
+	// update compression ratio
+	data->compin += len;
+	data->compout += ((mgt->compbuflen > 0) ? mgt->compbuflen : len);
+	if(data->compin > peermgt_COMPRESS_STATS_SIZE) {
+		if((data->compout * 100) > (data->compin * (100 - peermgt_COMPRESS_MINSAVING))) {
+			data->compskip = peermgt_COMPRESS_BACKOFF;
+		}
+		data->compin = (data->compin / 2);
+		data->compout = (data->compout / 2);
+	}
+
+	return mgt->compbuflen;
+}
+
+
+// Returns 1 if the broadcast tree is used locally.
+static int peermgtIsLocalBCTree(struct s_peermgt *mgt) {
+	return (peermgtGetFlag(mgt, peermgt_FLAG_BCTREE) && peermgtGetFlag(mgt, peermgt_FLAG_RELAY));
+}
+
+
+// Returns 1 if a PeerID is part of the broadcast tree.
+static int peermgtIsBCTree(struct s_peermgt *mgt, const int peerid) {
+	return (peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_BCTREE) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_RELAY));
+}
+
+
+// Returns the position of a PeerID in the broadcast tree, which is derived from its NodeID.
+static uint64_t peermgtGetBCKey(struct s_peermgt *mgt, const int peerid) {
+	return (uint64_t)utilReadInt64(mapGetKeyByID(&mgt->map, peerid));
+}
+
+
+// Check if a broadcast ID has been seen before and remember it. Returns 1 if it is new.
+static int peermgtCheckBCSeen(struct s_peermgt *mgt, const uint64_t bcid) {
+	const int pos = (int)((bcid >> 32) % peermgt_BCTREE_SEEN_SIZE);
+	if(mgt->bcseen[pos] == bcid) return 0;
+	mgt->bcseen[pos] = bcid;
+	return 1;
+}
+
+
+// Compare broadcast tree children by position.
+static int peermgtCompareBCChild(const void *a, const void *b) {
+	const uint64_t ka = ((const struct s_peermgt_bcchild *)a)->lo;
+	const uint64_t kb = ((const struct s_peermgt_bcchild *)b)->lo;
+	return ((ka > kb) - (ka < kb));
+}
+
+
+// Select the children a broadcast frame covering the range lo..hi is forwarded to. The peers of the range are sorted by position and split into
+// up to BCTREE_FANOUT parts, the first peer of each part becomes responsible for it. The PeerID the frame was received from is skipped.
+static void peermgtPlanBCTree(struct s_peermgt *mgt, const uint64_t lo, const uint64_t hi, const int skippeerid) {
+	struct s_peermgt_bcchild *member = mgt->bcmember;
+	int size = mapGetMapSize(&mgt->map);
+	int count = 0;
+	int parts;
+	int start;
+	int next;
+	int i;
+	uint64_t key;
+	for(i=1; i<size; i++) {
+		if((i != skippeerid) && peermgtIsActiveRemoteID(mgt, i) && peermgtIsBCTree(mgt, i) && peermgtGetRemoteFlag(mgt, i, peermgt_FLAG_USERDATA)) {
+			key = peermgtGetBCKey(mgt, i);
+			if((key >= lo) && (key <= hi)) {
+				member[count].peerid = i;
+				member[count].peerct = mgt->data[i].conntime;
+				member[count].lo = key;
+				count++;
+			}
+		}
+	}
+	qsort(member, count, sizeof(struct s_peermgt_bcchild), peermgtCompareBCChild);
+	parts = ((count < peermgt_BCTREE_FANOUT) ? count : peermgt_BCTREE_FANOUT);
+	for(i=0; i<parts; i++) {
+		start = ((i * count) / parts);
+		next = (((i + 1) * count) / parts);
+		mgt->bcchild[i].peerid = member[start].peerid;
+		mgt->bcchild[i].peerct = member[start].peerct;
+		mgt->bcchild[i].lo = ((i == 0) ? lo : member[start].lo);
+		mgt->bcchild[i].hi = ((i == (parts - 1)) ? hi : (member[next].lo - 1));
+	}
+	mgt->bcchildcount = parts;
+	mgt->bcchildpos = 0;
+}
+
+
+// Select the traffic class that sends the next user data message. The classes are served by deficit round robin.
+// Returns -1 if no message can be sent.
+static int peermgtGetNextOutclass(struct s_peermgt *mgt) {
+	int c;
+	if(!peermgtIsOutmsgReady(mgt)) return -1;
+	for(;;) {
+		c = mgt->outclass;
+		if(txqIsReady(&mgt->outq[c])) {
+			if(mgt->outclassdeficit[c] > 0) return c;
+			mgt->outclassdeficit[c] = (mgt->outclassdeficit[c] + (peermgt_CLASS_WEIGHT[c] * txq_QUANTUM));
+			if(mgt->outclassdeficit[c] > 0) return c;
+		}
+		else {
+			mgt->outclassdeficit[c] = 0;
+		}
+		mgt->outclass = ((c + 1) % peermgt_CLASS_COUNT);
+	}
+}
+
+
+// Take the next user data message from the transmit queues. Returns 1 if there is one.
+static int peermgtGetNextOutmsg(struct s_peermgt *mgt) {
+	struct s_txq *outq;
+	int id;
+	int c;
+	if(!(mgt->outmsgid < 0)) {
+		txqRelease(&mgt->outq[mgt->outmsgclass], mgt->outmsgid);
+		mgt->outmsgid = -1;
+	}
+	c = peermgtGetNextOutclass(mgt);
+	if(c < 0) return 0;
+	outq = &mgt->outq[c];
+	id = txqGet(outq);
+	if(id < 0) return 0;
+	mgt->outmsgid = id;
+	mgt->outmsgclass = c;
+	mgt->outmsg.msg = txqGetBuf(outq, id);
+	mgt->outmsg.len = txqGetLen(outq, id);
+	mgt->outclassdeficit[c] = (mgt->outclassdeficit[c] - mgt->outmsg.len);
+	mgt->compbuflen = -1;
+	mgt->outmsgbctree = 0;
+	mgt->outmsgbcskip = 0;
+	if(txqGetQueue(outq, id) == 0) {
+		mgt->outmsgpeerid = -1;
+		if(txqGetType(outq, id) == peermgt_OUTMSG_DEFAULT) {
+			mgt->outmsgbroadcast = 1;
+			mgt->outmsgbroadcastcount = 0;
+		}
+		else {
+			// broadcast frame with tree header, the children get the frame first
+			mgt->outmsgbroadcast = 0;
+			mgt->outmsgbctree = 1;
+			mgt->outmsgbcorigin = (txqGetType(outq, id) == peermgt_OUTMSG_BCTREE_ORIGIN);
+			peermgtPlanBCTree(mgt, (uint64_t)utilReadInt64(&mgt->outmsg.msg[8]), (uint64_t)utilReadInt64(&mgt->outmsg.msg[16]), txqGetOptions(outq, id));
+		}
+	}
+	else {
+		mgt->outmsgpeerid = txqGetQueue(outq, id);
+		mgt->outmsgpeerct = txqGetPeerCT(outq, id);
+		mgt->outmsgbroadcast = 0;
+	}
+	return 1;
+}
+
+
+// Add user data message to the transmit queue of a PeerID. PeerID 0 queues a broadcast message. Returns 1 if successful.
+static int peermgtAddOutmsg(struct s_peermgt *mgt, const struct s_msg *sendmsg, const int peerid) {
+	unsigned char *buf = txqAdd(&mgt->outq[peermgtGetFrameClass(sendmsg->msg, sendmsg->len)], peerid, mgt->data[peerid].conntime, peermgt_OUTMSG_DEFAULT, 0, sendmsg->len);
+	if(buf == NULL) return 0;
+	memcpy(buf, sendmsg->msg, sendmsg->len);
+	return 1;
+}
+
+
+// Returns the time when a PeerID has to be checked for due packets or session expiry next.
+static int peermgtGetDeadline(struct s_peermgt *mgt, const int peerid, const int tnow) {
+	struct s_peermgt_data *data = &mgt->data[peerid];
+	int due = (data->lastrecv + peermgt_RECV_TIMEOUT);
+	int t;
+	if(data->state == peermgt_STATE_COMPLETE) {
+		t = (data->lastsend + peermgt_KEEPALIVE_INTERVAL + 1);
+		if(t < due) due = t;
+		t = (data->lastpeerinfo + peermgt_PEERINFO_INTERVAL + 1);
+		if(t < due) due = t;
+		t = (data->lastrttprobe + peermgt_RTT_INTERVAL);
+		if(t < due) due = t;
+		t = (data->lastpathprobe + peermgtGetPathProbeInterval(mgt));
+		if(t < due) due = t;
+		if(peermgtIsLossReport(mgt, peerid)) {
+			t = (data->lastfecreport + peermgt_FEC_REPORT_INTERVAL);
+			if(t < due) due = t;
+		}
+		if((mgt->pmtudisc > 0) && (mgt->fragmentation > 0) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_PMTU)) {
+			t = ((data->pmtustep < 0) ? (data->lastpmtusearch + peermgt_PMTU_INTERVAL) : (data->lastpmtuprobe + peermgt_PMTU_TIMEOUT));
+			if(t < due) due = t;
+		}
+	}
+	if(!(due > tnow)) due = (tnow + 1);
+	return due;
+}
+
+
+// Generate the next due peerinfo, probe or loss report packet for a PeerID. Deletes the PeerID if its session has expired. Returns length if successful.
+static int peermgtGetNextPacketMaint(struct s_peermgt *mgt, const int peerid, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
+	const int plbuf_size = peermgt_MSGSIZE_MIN;
+	unsigned char plbuf[plbuf_size];
+	struct s_packet_data data;
+	int len;
+	int j;
+	if((tnow - mgt->data[peerid].lastrecv) < peermgt_RECV_TIMEOUT) { // check if session has expired
+		if(mgt->data[peerid].state == peermgt_STATE_COMPLETE) {  // check if session is active
+			if(peermgtIsLossReport(mgt, peerid) && (mgt->data[peerid].fecrecv >= 64) && ((tnow - mgt->data[peerid].lastfecreport) >= peermgt_FEC_REPORT_INTERVAL)) { // check if we should send a loss report
+				peermgtGenPacketLossReport(&data, mgt, peerid);
+				data.peerid = mgt->data[peerid].remoteid;
+				data.seq = ++mgt->data[peerid].remoteseq;
+				len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+				mgt->data[peerid].fecrecv = 0;
+				mgt->data[peerid].lastfecreport = tnow;
+				if(len > 0) {
+					*target = mgt->data[peerid].remoteaddr;
+					return len;
+				}
+			}
+			if((j = peermgtGetPMTUProbeSize(mgt, peerid, tnow)) > 0) { // check if we should send a path MTU probe
+				peermgtGenPacketPMTUProbe(&data, mgt, peerid, j);
+				data.peerid = mgt->data[peerid].remoteid;
+				data.seq = ++mgt->data[peerid].remoteseq;
+				len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+				if(len > 0) {
+					*target = mgt->data[peerid].remoteaddr;
+					return len;
+				}
+			}
+			if((tnow - mgt->data[peerid].lastpathprobe) >= peermgtGetPathProbeInterval(mgt)) { // check if we should probe the candidate paths
+				peermgtProbePaths(mgt, peerid, tnow);
+			}
+			if((tnow - mgt->data[peerid].lastrttprobe) >= peermgt_RTT_INTERVAL) { // check if we should send a round trip time probe
+				data.pl_buf = plbuf;
+				data.pl_buf_size = plbuf_size;
+				data.peerid = mgt->data[peerid].remoteid;
+				data.seq = ++mgt->data[peerid].remoteseq;
+				peermgtGenPacketRTTProbe(&data, mgt, peerid);
+				len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+				mgt->data[peerid].lastrttprobe = tnow;
+				if(len > 0) {
+					mgt->data[peerid].lastsend = tnow;
+					*target = mgt->data[peerid].remoteaddr;
+					return len;
+				}
+			}
+			if(((tnow - mgt->data[peerid].lastsend) > peermgt_KEEPALIVE_INTERVAL) || ((tnow - mgt->data[peerid].lastpeerinfo) > peermgt_PEERINFO_INTERVAL)) { // check if we should send peerinfo packet
+				data.pl_buf = plbuf;
+				data.pl_buf_size = plbuf_size;
+				data.peerid = mgt->data[peerid].remoteid;
+				data.seq = ++mgt->data[peerid].remoteseq;
+				peermgtGenPacketPeerinfo(&data, mgt, peerid);
+				len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+				if(len > 0) {
+					mgt->data[peerid].lastsend = tnow;
+					mgt->data[peerid].lastpeerinfo = tnow;
+					*target = mgt->data[peerid].remoteaddr;
+					return len;
+				}
+			}
+		}
+	}
+	else {
+		peermgtDeleteID(mgt, peerid);
+	}
+	return 0;
+}
+
+
+// Generate next control packet. Returns length if successful.
+static int peermgtGetNextPacketCtrl(struct s_peermgt *mgt, unsigned char *pbuf, const int pbuf_size, const int tnow, struct s_peeraddr *target) {
+	int len;
+	int outlen;
+	int peerid;
+	int usetargetaddr;
+	int i;
+	struct s_msg authmsg;
+	struct s_packet_data data;
+	struct s_peeraddr rrtargetaddr;
+
+	// send out queued request-response packets
+	while(!((i = txqGet(&mgt->rrq)) < 0)) {
+		peerid = txqGetQueue(&mgt->rrq, i);
+		usetargetaddr = txqGetOptions(&mgt->rrq, i);
+		outlen = txqGetLen(&mgt->rrq, i);
+		len = 0;
+		if(peermgtIsActiveRemoteIDCT(mgt, peerid, txqGetPeerCT(&mgt->rrq, i))) {  // check if session is active
+			data.pl_buf = txqGetBuf(&mgt->rrq, i);
+			if(usetargetaddr > 0) {
+				memcpy(rrtargetaddr.addr, data.pl_buf, peeraddr_SIZE);
+				data.pl_buf = &data.pl_buf[peeraddr_SIZE];
+				outlen = (outlen - peeraddr_SIZE);
+			}
+			data.pl_buf_size = outlen;
+			data.pl_length = outlen;
+			data.pl_type = txqGetType(&mgt->rrq, i);
+			data.pl_options = 0;
+			data.peerid = mgt->data[peerid].remoteid;
+			data.seq = ++mgt->data[peerid].remoteseq;
+			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+		}
+		txqRelease(&mgt->rrq, i);
+		if(len > 0) {
+			if(usetargetaddr > 0) {
+				*target = rrtargetaddr;
+			}
+			else {
+				mgt->data[peerid].lastsend = tnow;
+				*target = mgt->data[peerid].remoteaddr;
+			}
+			return len;
+		}
 	}
 
-	// write peerinfo_count
-	utilWriteInt32(data->pl_buf, peerinfo_count);
-
-	// set packet metadata
-	data->pl_length = (4 + (peerinfo_count * peerinfo_size));
-	data->pl_type = packet_PLTYPE_PEERINFO;
-	data->pl_options = 0;
-}
-
-
-// Send ping to PeerAddr. Return 1 if successful.
-static int peermgtSendPingToAddr(struct s_peermgt *mgt, const struct s_nodeid *tonodeid, const int topeerid, const int topeerct, const struct s_peeraddr *peeraddr) {
-	int outpeerid;
-	unsigned char pingbuf[peermgt_PINGBUF_SIZE];
-
-	outpeerid = peermgtGetActiveID(mgt, tonodeid, topeerid, topeerct);
+	// send peerinfo, probes and loss reports to the peers that are due and expire old sessions
+	while(!((peerid = timerGetNext(&mgt->timer, tnow)) < 0)) {
+		if(peerid > 0) {
+			len = peermgtGetNextPacketMaint(mgt, peerid, pbuf, pbuf_size, tnow, target);
+			if(len > 0) {
+				timerSet(&mgt->timer, peerid, tnow); // check the peer again on the next call
+				return len;
+			}
+			if(mgt->data[peerid].state != peermgt_STATE_INVALID) timerSet(&mgt->timer, peerid, peermgtGetDeadline(mgt, peerid, tnow));
+		}
+	}
 
-	if(outpeerid > 0) {
-		cryptoRand(pingbuf, 64); // generate ping message
-		memcpy(mgt->rrmsg.msg, pingbuf, peermgt_PINGBUF_SIZE);
-		mgt->rrmsgpeerid = outpeerid;
-		mgt->rrmsgtype = packet_PLTYPE_PING;
-		mgt->rrmsg.len = peermgt_PINGBUF_SIZE;
-		mgt->rrmsgusetargetaddr = 1;
-		mgt->rrmsgtargetaddr = *peeraddr;
-		return 1;
+	// send auth manager message
+	if(authmgtGetNextMsg(&mgt->authmgt, &authmsg, target)) {
+		data.pl_buf = authmsg.msg;
+		data.pl_buf_size = authmsg.len;
+		data.peerid = 0;
+		data.seq = 0;
+		data.pl_length = authmsg.len;
+		if(data.pl_length > 0) {
+			data.pl_type = packet_PLTYPE_AUTH;
+			data.pl_options = 0;
+			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[0], packet_FORMAT_DEFAULT);
+			if(len > 0) {
+				mgt->data[0].lastsend = tnow;
+				return len;
+			}
+		}
 	}
 
 	return 0;
@@ -480,43 +1975,170 @@ static int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, c
 	int outlen;
 	int fragoutlen;
 	int peerid;
-	int usetargetaddr;
+	int broadcast;
 	int i;
 	int j;
 	int fragcount;
 	int fragpos;
-	const int plbuf_size = peermgt_MSGSIZE_MIN;
-	unsigned char plbuf[plbuf_size];
-	struct s_msg authmsg;
 	struct s_packet_data data;
 	struct s_nodeid *nodeid;
 	struct s_peeraddr *peeraddr;
+	struct s_peermgt_aggregate *agg;
+	struct s_peermgt_bcchild *child;
+	int complen;
+	int ratelimited;
+	const int64_t now_us = utilGetClockUS();
+
+	// control traffic has strict priority over user data, but does not interrupt a running fragment stream
+	if(!(mgt->fragoutsize > 0)) {
+		len = peermgtGetNextPacketCtrl(mgt, pbuf, pbuf_size, tnow, target);
+		if(len > 0) return len;
+	}
+
+	// send out parity of completed or expired FEC groups
+	peerid = peermgtGetFECOutputID(mgt);
+	if(peerid > 0) {
+		mgt->fecoutpeerid = 0;
+		if(!(peermgtIsActiveRemoteID(mgt, peerid) && peermgtIsFEC(mgt, peerid))) {
+			fecGroupReset(&mgt->fec, peerid);
+		}
+		else if(peermgtGenPacketFEC(&data, mgt, peerid)) {
+			data.peerid = mgt->data[peerid].remoteid;
+			data.seq = ++mgt->data[peerid].remoteseq;
+			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+			if(len > 0) {
+				peermgtConsumeRate(mgt, peerid, len);
+				mgt->data[peerid].lastsend = tnow;
+				*target = *peermgtGetDataAddr(mgt, peerid);
+				return len;
+			}
+		}
+	}
+
+	// check rate limits, user data is held back while the global limit is exceeded
+	peermgtResumePeers(mgt, now_us);
+	ratelimited = (peermgtGetRateDelay(mgt, now_us) > 0);
+
+	// send out aggregated user data, but do not interrupt a running fragment stream
+	if(!(mgt->fragoutsize > 0)) {
+		if(peermgtGetAggregateDelay(mgt) == 0) peermgtSealAggregate(mgt);
+		agg = &mgt->agg[!mgt->aggfillid];
+		if((agg->size > 0) && (!ratelimited)) {
+			peerid = agg->peerid;
+			if(peermgtIsActiveRemoteIDCT(mgt, peerid, agg->conntime)) {
+				if(agg->count > 1) {
+					data.pl_buf = agg->buf;
+					data.pl_length = agg->size;
+					data.pl_type = packet_PLTYPE_USERDATA_AGGREGATE;
+				}
+				else {
+					// a single frame is sent as regular user data
+					data.pl_buf = &agg->buf[peermgt_AGGREGATE_HDRSIZE];
+					data.pl_length = (agg->size - peermgt_AGGREGATE_HDRSIZE);
+					data.pl_type = packet_PLTYPE_USERDATA;
+				}
+				data.pl_buf_size = data.pl_length;
+				data.pl_options = 0;
+				data.peerid = mgt->data[peerid].remoteid;
+				data.seq = ++mgt->data[peerid].remoteseq;
+				len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+				agg->size = 0;
+				if(len > 0) {
+					peermgtAddFEC(mgt, peerid, &data);
+					peermgtConsumeRate(mgt, peerid, len);
+					mgt->data[peerid].lastsend = tnow;
+					*target = *peermgtGetDataAddr(mgt, peerid);
+					return len;
+				}
+			}
+			agg->size = 0;
+		}
+	}
 
-	// send out user data
-	outlen = mgt->outmsg.len;
+	// send out queued user data
 	fragoutlen = mgt->fragoutsize;
-	if(outlen > 0 && (!(fragoutlen > 0))) {
-		if(mgt->outmsgbroadcast) { // get PeerID for broadcast message
+	while((!(fragoutlen > 0)) && (!ratelimited) && ((mgt->outmsg.len > 0) || peermgtGetNextOutmsg(mgt))) {
+		if(mgt->outmsgbctree) { // send broadcast frame to the children in the broadcast tree
+			if(mgt->bcchildpos < mgt->bcchildcount) {
+				child = &mgt->bcchild[mgt->bcchildpos++];
+				peerid = child->peerid;
+				if(peermgtIsActiveRemoteIDCT(mgt, peerid, child->peerct)) {
+					utilWriteInt64(&mgt->outmsg.msg[8], (int64_t)child->lo);
+					utilWriteInt64(&mgt->outmsg.msg[16], (int64_t)child->hi);
+					data.pl_buf = mgt->outmsg.msg;
+					data.pl_buf_size = mgt->outmsg.len;
+					data.peerid = mgt->data[peerid].remoteid;
+					data.seq = ++mgt->data[peerid].remoteseq;
+					data.pl_length = mgt->outmsg.len;
+					data.pl_type = packet_PLTYPE_USERDATA_BROADCAST;
+					data.pl_options = 0;
+					len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+					if(len > 0) {
+						peermgtAddFEC(mgt, peerid, &data);
+						peermgtConsumeRate(mgt, peerid, len);
+						mgt->data[peerid].lastsend = tnow;
+						*target = *peermgtGetDataAddr(mgt, peerid);
+						return len;
+					}
+				}
+			}
+			else if(mgt->outmsgbcorigin) { // the origin sends the frame to peers outside of the tree itself
+				mgt->outmsgbctree = 0;
+				mgt->outmsgbcskip = 1;
+				mgt->outmsgbroadcast = 1;
+				mgt->outmsgbroadcastcount = 0;
+				mgt->outmsg.msg = &mgt->outmsg.msg[peermgt_BCTREE_HDRSIZE];
+				mgt->outmsg.len = (mgt->outmsg.len - peermgt_BCTREE_HDRSIZE);
+			}
+			else {
+				mgt->outmsgbctree = 0;
+				mgt->outmsg.len = 0;
+			}
+			continue;
+		}
+		outlen = mgt->outmsg.len;
+		broadcast = mgt->outmsgbroadcast;
+		if(broadcast) { // get PeerID for broadcast message
 			do {
 				peerid = peermgtGetNextID(mgt);
 				mgt->outmsgbroadcastcount++;
 			}
-			while((!(peermgtIsActiveRemoteID(mgt, peerid) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA))) && (mgt->outmsgbroadcastcount < used));
+			while((!(peermgtIsActiveRemoteID(mgt, peerid) && peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA) && (!(mgt->outmsgbcskip && peermgtIsBCTree(mgt, peerid))))) && (mgt->outmsgbroadcastcount < used));
 			if(mgt->outmsgbroadcastcount >= used) {
 				mgt->outmsgbroadcast = 0;
 				mgt->outmsg.len = 0;
+				if((peerid > 0) && mgt->outmsgbcskip && peermgtIsBCTree(mgt, peerid)) peerid = -1; // the frame was passed to this peer in the tree
 			}
 		}
 		else { // get PeerID for unicast message
 			peerid = mgt->outmsgpeerid;
 			mgt->outmsg.len = 0;
 		}
-		if(peermgtIsActiveRemoteID(mgt, peerid)) {  // check if session is active
-			if(peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA)) {
-				if((mgt->fragmentation > 0) && (outlen > peermgt_MSGSIZE_MIN)) {
-					// start generating fragmented userdata packets
+		if(peermgtIsActiveRemoteID(mgt, peerid) && (broadcast || (mgt->data[peerid].conntime == mgt->outmsgpeerct))) {  // check if session is active
+			if(peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_USERDATA) && ((outlen <= peermgt_MSGSIZE_MAX_COMPAT) || peermgtGetRemoteFlag(mgt, peerid, peermgt_FLAG_JUMBO))) {
+				if((complen = peermgtCompressUserdata(mgt, peerid, outlen)) > 0) {
+					// generate compressed userdata packet
+					data.pl_buf = mgt->compbuf;
+					data.pl_buf_size = complen;
+					data.peerid = mgt->data[peerid].remoteid;
+					data.seq = ++mgt->data[peerid].remoteseq;
+					data.pl_length = complen;
+					data.pl_type = packet_PLTYPE_USERDATA_COMPRESSED;
+					data.pl_options = 0;
+					len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
+					if(len > 0) {
+						peermgtAddFEC(mgt, peerid, &data);
+						peermgtConsumeRate(mgt, peerid, len);
+						mgt->data[peerid].lastsend = tnow;
+						*target = *peermgtGetDataAddr(mgt, peerid);
+						return len;
+					}
+				}
+				else if((mgt->fragmentation > 0) && (outlen > mgt->data[peerid].fragsize)) {
+					// start generating fragmented userdata packets, the fragment size depends on the path MTU of the peer
 					mgt->fragoutpeerid = peerid;
-					mgt->fragoutcount = (((outlen - 1) / peermgt_MSGSIZE_MIN) + 1); // calculate number of fragments
+					mgt->fragoutchunk = mgt->data[peerid].fragsize;
+					mgt->fragoutcount = (((outlen - 1) / mgt->fragoutchunk) + 1); // calculate number of fragments
 					mgt->fragoutsize = outlen;
 					fragoutlen = outlen;
 					mgt->fragoutpos = 0;
@@ -530,10 +2152,12 @@ static int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, c
 					data.pl_length = outlen;
 					data.pl_type = packet_PLTYPE_USERDATA;
 					data.pl_options = 0;
-					len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+					len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
 					if(len > 0) {
+						peermgtAddFEC(mgt, peerid, &data);
+						peermgtConsumeRate(mgt, peerid, len);
 						mgt->data[peerid].lastsend = tnow;
-						*target = mgt->data[peerid].remoteaddr;
+						*target = *peermgtGetDataAddr(mgt, peerid);
 						return len;
 					}
 				}
@@ -548,12 +2172,12 @@ static int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, c
 		peerid = mgt->fragoutpeerid;
 		if(peermgtIsActiveRemoteID(mgt, peerid)) {  // check if session is active
 			// generate fragmented packet
-			data.pl_buf = &mgt->outmsg.msg[(fragpos * peermgt_MSGSIZE_MIN)];
-			if(fragoutlen > peermgt_MSGSIZE_MIN) {
+			data.pl_buf = &mgt->outmsg.msg[(fragpos * mgt->fragoutchunk)];
+			if(fragoutlen > mgt->fragoutchunk) {
 				// start or middle fragment
-				data.pl_buf_size = peermgt_MSGSIZE_MIN;
-				data.pl_length = peermgt_MSGSIZE_MIN;
-				mgt->fragoutsize = (fragoutlen - peermgt_MSGSIZE_MIN);
+				data.pl_buf_size = mgt->fragoutchunk;
+				data.pl_length = mgt->fragoutchunk;
+				mgt->fragoutsize = (fragoutlen - mgt->fragoutchunk);
 			}
 			else {
 				// end fragment
@@ -563,13 +2187,28 @@ static int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, c
 			}
 			data.peerid = mgt->data[peerid].remoteid;
 			data.seq = ++mgt->data[peerid].remoteseq;
-			data.pl_type = packet_PLTYPE_USERDATA_FRAGMENT;
-			data.pl_options = (fragcount << 4) | (fragpos);
-			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
+			if(fragcount > peermgt_FRAGMENT_COUNT_MAX) {
+				// extended fragment
+				mgt->fragoutbuf[0] = fragcount;
+				mgt->fragoutbuf[1] = fragpos;
+				memcpy(&mgt->fragoutbuf[peermgt_FRAGMENT_EXT_HDRSIZE], data.pl_buf, data.pl_length);
+				data.pl_buf = mgt->fragoutbuf;
+				data.pl_length = (data.pl_length + peermgt_FRAGMENT_EXT_HDRSIZE);
+				data.pl_buf_size = data.pl_length;
+				data.pl_type = packet_PLTYPE_USERDATA_FRAGMENT_EXT;
+				data.pl_options = 0;
+			}
+			else {
+				data.pl_type = packet_PLTYPE_USERDATA_FRAGMENT;
+				data.pl_options = (fragcount << 4) | (fragpos);
+			}
+			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid], peermgtGetPacketFormat(mgt, peerid));
 			mgt->fragoutpos = (fragpos + 1);
 			if(len > 0) {
+				peermgtAddFEC(mgt, peerid, &data);
+				peermgtConsumeRate(mgt, peerid, len);
 				mgt->data[peerid].lastsend = tnow;
-				*target = mgt->data[peerid].remoteaddr;
+				*target = *peermgtGetDataAddr(mgt, peerid);
 				return len;
 			}
 		}
@@ -579,82 +2218,6 @@ static int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, c
 		}
 	}
 
-	// send out request-response packet
-	outlen = mgt->rrmsg.len;
-	if(outlen > 0) {
-		peerid = mgt->rrmsgpeerid;
-		usetargetaddr = mgt->rrmsgusetargetaddr;
-		mgt->rrmsg.len = 0;
-		mgt->rrmsgusetargetaddr = 0;
-		if((outlen < peermgt_MSGSIZE_MAX) && (peermgtIsActiveRemoteID(mgt, peerid))) {  // check if session is active
-			data.pl_buf = mgt->rrmsg.msg;
-			data.pl_buf_size = peermgt_MSGSIZE_MAX;
-			data.pl_length = outlen;
-			data.pl_type = mgt->rrmsgtype;
-			data.pl_options = 0;
-			data.peerid = mgt->data[peerid].remoteid;
-			data.seq = ++mgt->data[peerid].remoteseq;
-
-			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
-			if(len > 0) {
-				if(usetargetaddr > 0) {
-					*target = mgt->rrmsgtargetaddr;
-				}
-				else {
-					mgt->data[peerid].lastsend = tnow;
-					*target = mgt->data[peerid].remoteaddr;
-				}
-				return len;
-			}
-		}
-	}
-
-	// send peerinfo to peers
-	for(i=0; i<used; i++) {
-		peerid = peermgtGetNextID(mgt);
-		if(peerid > 0) {
-			if((tnow - mgt->data[peerid].lastrecv) < peermgt_RECV_TIMEOUT) { // check if session has expired
-				if(mgt->data[peerid].state == peermgt_STATE_COMPLETE) {  // check if session is active
-					if(((tnow - mgt->data[peerid].lastsend) > peermgt_KEEPALIVE_INTERVAL) || ((tnow - mgt->data[peerid].lastpeerinfo) > peermgt_PEERINFO_INTERVAL)) { // check if we should send peerinfo packet
-						data.pl_buf = plbuf;
-						data.pl_buf_size = plbuf_size;
-						data.peerid = mgt->data[peerid].remoteid;
-						data.seq = ++mgt->data[peerid].remoteseq;
-						peermgtGenPacketPeerinfo(&data, mgt, peerid);
-						len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[peerid]);
-						if(len > 0) {
-							mgt->data[peerid].lastsend = tnow;
-							mgt->data[peerid].lastpeerinfo = tnow;
-							*target = mgt->data[peerid].remoteaddr;
-							return len;
-						}
-					}
-				}
-			}
-			else {
-				peermgtDeleteID(mgt, peerid);
-			}
-		}
-	}
-
-	// send auth manager message
-	if(authmgtGetNextMsg(&mgt->authmgt, &authmsg, target)) {
-		data.pl_buf = authmsg.msg;
-		data.pl_buf_size = authmsg.len;
-		data.peerid = 0;
-		data.seq = 0;
-		data.pl_length = authmsg.len;
-		if(data.pl_length > 0) {
-			data.pl_type = packet_PLTYPE_AUTH;
-			data.pl_options = 0;
-			len = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[0]);
-			if(len > 0) {
-				mgt->data[0].lastsend = tnow;
-				return len;
-			}
-		}
-	}
-
 	// connect new peer
 	if((tnow - mgt->lastconntry) > 0) { // limit to one per second
 		mgt->lastconntry = tnow;
@@ -678,7 +2241,7 @@ static int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, c
 			peeraddr = nodedbGetNodeAddress(&mgt->nodedb, i);
 			nodedbUpdate(&mgt->nodedb, nodeid, peeraddr, 0, 0, 1);
 			if(peerid < 0) { // node is not connected yet
-				if(peermgtConnect(mgt, peeraddr)) { // try to connect
+				if(peermgtConnectNode(mgt, nodeid, peeraddr)) { // try to connect
 					j = nodedbGetDBID(&mgt->relaydb, nodeid, peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN, -1, peermgt_NEWCONNECT_MIN_LASTCONNTRY);
 					if(!(j < 0)) {
 						peermgtConnect(mgt, nodedbGetNodeAddress(&mgt->relaydb, j)); // try to connect via relay
@@ -688,8 +2251,10 @@ static int peermgtGetNextPacketGen(struct s_peermgt *mgt, unsigned char *pbuf, c
 			}
 			else { // node is already connected
 				if(peermgtIsActiveRemoteID(mgt, peerid)) {
-					if(peeraddrIsInternal(&mgt->data[peerid].remoteaddr)) { // node connection is indirect
-						peermgtSendPingToAddr(mgt, NULL, peerid, mgt->data[peerid].conntime, peeraddr); // try to switch peer to a direct connection
+					peermgtAddPath(mgt, peerid, peeraddr, tnow); // measure the address as a candidate path
+					j = nodedbGetDBID(&mgt->relaydb, nodeid, peermgt_NEWCONNECT_RELAY_MAX_LASTSEEN, -1, -1);
+					if((!(j < 0)) && peermgtIsValidIndirectPeerAddr(mgt, nodedbGetNodeAddress(&mgt->relaydb, j))) {
+						peermgtAddPath(mgt, peerid, nodedbGetNodeAddress(&mgt->relaydb, j), tnow); // measure the relay as a candidate path
 					}
 				}
 			}
@@ -735,7 +2300,7 @@ static int peermgtGetNextPacket(struct s_peermgt *mgt, unsigned char *pbuf, cons
 							data.pl_options = 0;
 
 							// encode relay-in packet
-							outlen = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[relayid]);
+							outlen = packetEncode(pbuf, pbuf_size, &data, &mgt->ctx[relayid], peermgtGetPacketFormat(mgt, relayid));
 							if(outlen > 0) {
 								mgt->data[relayid].lastsend = tnow;
 								*target = mgt->data[relayid].remoteaddr;
@@ -771,6 +2336,8 @@ static int peermgtDecodePacketAuth(struct s_peermgt *mgt, const struct s_packet_
 	int peerid;
 	int dupid;
 	int64_t remoteflags = 0;
+	unsigned char ticketid[resume_IDSIZE];
+	unsigned char secret[resume_SECRETSIZE];
 
 	if(authmgtDecodeMsg(authmgt, data->pl_buf, data->pl_length, source_addr)) {
 		if(authmgtGetAuthedPeerNodeID(authmgt, &peer_nodeid)) {
@@ -785,6 +2352,7 @@ static int peermgtDecodePacketAuth(struct s_peermgt *mgt, const struct s_packet_
 
 				// Upgrade indirect connection to a direct one
 				if((peeraddrIsInternal(&mgt->data[dupid].remoteaddr)) && (!peeraddrIsInternal(source_addr))) {
+					peermgtAddPath(mgt, dupid, source_addr, tnow);
 					mgt->data[dupid].remoteaddr = *source_addr;
 					peermgtSendPingToAddr(mgt, NULL, dupid, mgt->data[dupid].conntime, source_addr); // send a ping using the new peer address
 				}
@@ -808,6 +2376,11 @@ static int peermgtDecodePacketAuth(struct s_peermgt *mgt, const struct s_packet_
 				mgt->data[peerid].remoteflags = remoteflags;
 				mgt->data[peerid].state = peermgt_STATE_COMPLETE;
 				mgt->data[peerid].lastrecv = tnow;
+				timerSet(&mgt->timer, peerid, tnow);
+				if((mgt->localflags & peermgt_FLAG_RESUME) && (remoteflags & peermgt_FLAG_RESUME) && (authmgtGetCompletedPeerResumeTicket(authmgt, ticketid, secret))) {
+					// Store ticket for session resumption.
+					resumeSet(&mgt->resume, &peer_nodeid, ticketid, secret);
+				}
 			}
 			authmgtFinishCompletedPeer(authmgt);
 		}
@@ -861,25 +2434,54 @@ static int peermgtDecodePacketPeerinfo(struct s_peermgt *mgt, const struct s_pac
 
 
 // Decode ping packet
-static int peermgtDecodePacketPing(struct s_peermgt *mgt, const struct s_packet_data *data) {
+static int peermgtDecodePacketPing(struct s_peermgt *mgt, const struct s_packet_data *data, const struct s_peeraddr *source_addr) {
+	unsigned char *pongbuf;
 	int len = data->pl_length;
-	if(len == peermgt_PINGBUF_SIZE) {
-		memcpy(mgt->rrmsg.msg, data->pl_buf, peermgt_PINGBUF_SIZE);
-		mgt->rrmsgpeerid = data->peerid;
-		mgt->rrmsgtype = packet_PLTYPE_PONG;
-		mgt->rrmsg.len = peermgt_PINGBUF_SIZE;
-		mgt->rrmsgusetargetaddr = 0;
-		return 1;
+	if((len == peermgt_PINGBUF_SIZE) || ((len > peermgt_PINGBUF_SIZE) && peermgtGetFlag(mgt, peermgt_FLAG_PMTU))) { // padded path MTU probes are answered by a regular sized pong
+		pongbuf = peermgtAddRRMsg(mgt, data->peerid, packet_PLTYPE_PONG, source_addr, peermgt_PINGBUF_SIZE); // answer on the path the ping came from
+		if(pongbuf != NULL) {
+			memcpy(pongbuf, data->pl_buf, peermgt_PINGBUF_SIZE);
+			return 1;
+		}
 	}
 	return 0;
 }
 
 
 // Decode pong packet
-static int peermgtDecodePacketPong(struct s_peermgt *mgt, const struct s_packet_data *data) {
+static int peermgtDecodePacketPong(struct s_peermgt *mgt, const struct s_packet_data *data, const int tnow) {
+	struct s_peermgt_data *peer = &mgt->data[data->peerid];
+	struct s_peermgt_path *path;
 	int len = data->pl_length;
+	int rtt;
+	int i;
 	if(len == peermgt_PINGBUF_SIZE) {
-		// content is not checked, any response is acceptable
+		// check if the pong answers the current path MTU probe
+		if((peer->pmtustep >= 0) && (peer->pmtuprobe > 0) && (utilReadInt64(&data->pl_buf[0]) == peer->pmtunonce) && (utilReadInt32(&data->pl_buf[8]) == peer->pmtuprobe)) {
+			peer->fragsize = peer->pmtuprobe;
+			peer->pmtustep = -1;
+			peer->pmtuprobe = 0;
+			peer->lastpmtusearch = tnow;
+		}
+		// check if the pong answers the current round trip time probe
+		if((peer->rttprobe != 0) && (utilReadInt64(&data->pl_buf[0]) == peer->rttnonce) && (utilReadInt64(&data->pl_buf[8]) == peer->rttprobe)) {
+			peermgtAddRTTSample(mgt, data->peerid, (int)(utilGetClockUS() - peer->rttprobe));
+			peermgtAddLossSample(mgt, data->peerid, 0);
+			peer->rttprobe = 0;
+		}
+		// check if the pong answers a path probe
+		i = (utilReadInt32(&data->pl_buf[16]) - 1);
+		if((i >= 0) && (i < peermgt_PATH_COUNT) && (utilReadInt64(&data->pl_buf[0]) == peer->rttnonce)) {
+			path = &peer->path[i];
+			if(path->used && (path->probetime != 0) && (utilReadInt64(&data->pl_buf[8]) == path->probetime)) {
+				rtt = (int)(utilGetClockUS() - path->probetime);
+				path->rtt = ((path->rtt < 0) ? rtt : (((path->rtt * 3) + rtt) / 4));
+				path->lost = 0;
+				path->probetime = 0;
+				peermgtSelectPath(mgt, data->peerid);
+			}
+		}
+		// content is not checked otherwise, any response is acceptable
 		return 1;
 	}
 	return 0;
@@ -888,19 +2490,19 @@ static int peermgtDecodePacketPong(struct s_peermgt *mgt, const struct s_packet_
 
 // Decode relay-in packet
 static int peermgtDecodePacketRelayIn(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	unsigned char *relaybuf;
 	int targetpeerid;
 	int len = data->pl_length;
 
 	if((len > 4) && (len < (peermgt_MSGSIZE_MAX - 4))) {
 		targetpeerid = utilReadInt32(data->pl_buf);
 		if(peermgtIsActiveRemoteID(mgt, targetpeerid)) {
-			utilWriteInt32(&mgt->rrmsg.msg[0], data->peerid);
-			memcpy(&mgt->rrmsg.msg[4], &data->pl_buf[4], (len - 4));
-			mgt->rrmsgpeerid = targetpeerid;
-			mgt->rrmsgtype = packet_PLTYPE_RELAY_OUT;
-			mgt->rrmsg.len = len;
-			mgt->rrmsgusetargetaddr = 0;
-			return 1;
+			relaybuf = peermgtAddRRMsg(mgt, targetpeerid, packet_PLTYPE_RELAY_OUT, NULL, len);
+			if(relaybuf != NULL) {
+				utilWriteInt32(&relaybuf[0], data->peerid);
+				memcpy(&relaybuf[4], &data->pl_buf[4], (len - 4));
+				return 1;
+			}
 		}
 	}
 	
@@ -909,13 +2511,27 @@ static int peermgtDecodePacketRelayIn(struct s_peermgt *mgt, const struct s_pack
 
 
 // Decode fragmented packet
-static int peermgtDecodeUserdataFragment(struct s_peermgt *mgt, struct s_packet_data *data) {
-	int fragcount = (data->pl_options >> 4);
-	int fragpos = (data->pl_options & 0x0F);
-	int64_t fragseq = (data->seq - (int64_t)fragpos);
+static int peermgtDecodeUserdataFragment(struct s_peermgt *mgt, struct s_packet_data *data, const int tnow) {
+	int fragcount;
+	int fragpos;
+	int hdrsize;
+	int64_t fragseq;
 	int peerid = data->peerid;
-	int id = dfragAssemble(&mgt->dfrag, mgt->data[peerid].conntime, peerid, fragseq, data->pl_buf, data->pl_length, fragpos, fragcount);
+	int id;
 	int len;
+	if(data->pl_type == packet_PLTYPE_USERDATA_FRAGMENT_EXT) {
+		if(!(data->pl_length > peermgt_FRAGMENT_EXT_HDRSIZE)) return 0;
+		fragcount = data->pl_buf[0];
+		fragpos = data->pl_buf[1];
+		hdrsize = peermgt_FRAGMENT_EXT_HDRSIZE;
+	}
+	else {
+		fragcount = (data->pl_options >> 4);
+		fragpos = (data->pl_options & 0x0F);
+		hdrsize = 0;
+	}
+	fragseq = (data->seq - (int64_t)fragpos);
+	id = dfragAssemble(&mgt->dfrag, mgt->data[peerid].conntime, peerid, fragseq, &data->pl_buf[hdrsize], (data->pl_length - hdrsize), fragpos, fragcount, tnow);
 	if(!(id < 0)) {
 		len = dfragLength(&mgt->dfrag, id);
 		if(len > 0 && len <= data->pl_buf_size) {
@@ -936,6 +2552,90 @@ static int peermgtDecodeUserdataFragment(struct s_peermgt *mgt, struct s_packet_
 }
 
 
+// Decode compressed user data.
+static int peermgtDecodeUserdataCompressed(struct s_peermgt *mgt, struct s_packet_data *data) {
+	unsigned char compbuf[peermgt_MSGSIZE_MIN];
+	int len = data->pl_length;
+	if(!((len > 0) && (len <= peermgt_MSGSIZE_MIN))) return 0;
+	memcpy(compbuf, data->pl_buf, len);
+	len = compressDecode(&mgt->compress, data->pl_buf, data->pl_buf_size, compbuf, len);
+	if(!(len > 0)) {
+		data->pl_length = 0;
+		return 0;
+	}
+	data->pl_length = len;
+	return 1;
+}
+
+
+// Decode aggregated user data. The frames are returned one by one by peermgtRecvUserdata.
+static int peermgtDecodeUserdataAggregate(struct s_peermgt *mgt, struct s_packet_data *data) {
+	int pos = 0;
+	int len;
+	while(pos < data->pl_length) {
+		if((pos + peermgt_AGGREGATE_HDRSIZE) > data->pl_length) return 0;
+		len = utilReadInt16(&data->pl_buf[pos]);
+		if(!((len > 0) && ((pos + peermgt_AGGREGATE_HDRSIZE + len) <= data->pl_length))) return 0;
+		pos = (pos + peermgt_AGGREGATE_HDRSIZE + len);
+	}
+	mgt->msgaggsize = data->pl_length;
+	mgt->msgaggpos = 0;
+	return 1;
+}
+
+
+// Decode FEC parity packet. Recovers a lost user data packet of the group if possible.
+static int peermgtDecodeUserdataFEC(struct s_peermgt *mgt, struct s_packet_data *data) {
+	const int peerid = data->peerid;
+	int64_t seq = 0;
+	int type;
+	int options;
+	int len;
+	len = fecDecode(&mgt->fec, peerid, &mgt->data[peerid].seq, data->pl_buf, data->pl_length, &seq, &type, &options, mgt->fecbuf, peermgt_FEC_PARITYSIZE);
+	if((len > 0) && (len <= data->pl_buf_size) && peermgtIsFECType(type) && seqVerify(&mgt->data[peerid].seq, seq)) {
+		memcpy(data->pl_buf, mgt->fecbuf, len);
+		data->pl_length = len;
+		data->pl_type = type;
+		data->pl_options = options;
+		data->seq = seq;
+		return 1;
+	}
+	data->pl_length = 0;
+	return 0;
+}
+
+
+// Decode broadcast tree packet. The frame is forwarded to the own part of the tree and then returned without the tree header.
+static int peermgtDecodeUserdataBroadcast(struct s_peermgt *mgt, struct s_packet_data *data) {
+	unsigned char *buf;
+	int len = data->pl_length;
+	if(!((len > peermgt_BCTREE_HDRSIZE) && (len <= peermgt_MSGSIZE_MIN))) return 0;
+	if(!peermgtCheckBCSeen(mgt, (uint64_t)utilReadInt64(&data->pl_buf[0]))) return 0; // duplicate
+	if(utilReadInt64(&data->pl_buf[8]) != utilReadInt64(&data->pl_buf[16])) { // range contains other nodes
+		buf = txqAdd(&mgt->outq[peermgtGetFrameClass(&data->pl_buf[peermgt_BCTREE_HDRSIZE], (len - peermgt_BCTREE_HDRSIZE))], 0, 0, peermgt_OUTMSG_BCTREE_FORWARD, data->peerid, len);
+		if(buf != NULL) memcpy(buf, data->pl_buf, len);
+	}
+	memmove(data->pl_buf, &data->pl_buf[peermgt_BCTREE_HDRSIZE], (len - peermgt_BCTREE_HDRSIZE));
+	data->pl_length = (len - peermgt_BCTREE_HDRSIZE);
+	return 1;
+}
+
+
+// Decode loss report packet. The report holds the number of packets received out of the last 64.
+// Adjusts the FEC group size and the learned rate limit used for a PeerID.
+static int peermgtDecodePacketLossReport(struct s_peermgt *mgt, const struct s_packet_data *data) {
+	const int peerid = data->peerid;
+	int lost;
+	if(!(data->pl_length > 0)) return 0;
+	if(!(data->pl_buf[0] <= 64)) return 0;
+	lost = (64 - data->pl_buf[0]);
+	if(peermgtIsFEC(mgt, peerid)) mgt->data[peerid].fecsize = peermgtGetFECGroupSize(data->pl_buf[0]);
+	peermgtAddLossSample(mgt, peerid, ((lost * peermgt_RTT_PPM) / 64));
+	if(peermgtGetFlag(mgt, peermgt_FLAG_RATELEARN)) peermgtLearnRate(mgt, peerid, lost);
+	return 1;
+}
+
+
 // Decode input packet recursively. Decapsulates relayed packets if necessary.
 static int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned char *packet, const int packet_len, const struct s_peeraddr *source_addr, const int tnow, const int depth) {
 	int ret;
@@ -950,7 +2650,21 @@ static int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned ch
 			if(peerid > 0) {
 				// packet has an active PeerID
 				mgt->msgsize = 0;
-				if(packetDecode(&data, packet, packet_len, &mgt->ctx[peerid], &mgt->data[peerid].seq) > 0) {
+				mgt->msgpos = 0;
+				mgt->msgaggsize = 0;
+				if(packetDecode(&data, packet, packet_len, &mgt->ctx[peerid], &mgt->data[peerid].seq, peermgtGetPacketFormat(mgt, peerid)) > 0) {
+					seqVerify(&mgt->data[peerid].recvseq, data.seq);
+					if(peermgtIsLossReport(mgt, peerid)) {
+						if(mgt->data[peerid].fecrecv < 64) mgt->data[peerid].fecrecv++;
+					}
+					if(peermgtIsFEC(mgt, peerid)) { // forward error correction
+						if(data.pl_type == packet_PLTYPE_USERDATA_FEC) {
+							peermgtDecodeUserdataFEC(mgt, &data);
+						}
+						else if(peermgtIsFECType(data.pl_type)) {
+							fecStore(&mgt->fec, peerid, data.seq, data.pl_type, data.pl_options, data.pl_buf, data.pl_length);
+						}
+					}
 					if((data.pl_length > 0) && (data.pl_length < peermgt_MSGSIZE_MAX)) {
 						switch(data.pl_type) {
 							case packet_PLTYPE_USERDATA:
@@ -964,8 +2678,33 @@ static int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned ch
 								}
 								break;
 							case packet_PLTYPE_USERDATA_FRAGMENT:
+							case packet_PLTYPE_USERDATA_FRAGMENT_EXT:
 								if(peermgtGetFlag(mgt, peermgt_FLAG_USERDATA)) {
-									ret = peermgtDecodeUserdataFragment(mgt, &data);
+									ret = peermgtDecodeUserdataFragment(mgt, &data, tnow);
+									if(ret > 0) {
+										mgt->msgsize = data.pl_length;
+										mgt->msgpeerid = data.peerid;
+									}
+								}
+								else {
+									ret = 0;
+								}
+								break;
+							case packet_PLTYPE_USERDATA_COMPRESSED:
+								if(peermgtGetFlag(mgt, peermgt_FLAG_USERDATA) && peermgtGetFlag(mgt, peermgt_FLAG_COMPRESS)) {
+									ret = peermgtDecodeUserdataCompressed(mgt, &data);
+									if(ret > 0) {
+										mgt->msgsize = data.pl_length;
+										mgt->msgpeerid = data.peerid;
+									}
+								}
+								else {
+									ret = 0;
+								}
+								break;
+							case packet_PLTYPE_USERDATA_BROADCAST:
+								if(peermgtGetFlag(mgt, peermgt_FLAG_USERDATA) && peermgtIsLocalBCTree(mgt)) {
+									ret = peermgtDecodeUserdataBroadcast(mgt, &data);
 									if(ret > 0) {
 										mgt->msgsize = data.pl_length;
 										mgt->msgpeerid = data.peerid;
@@ -975,14 +2714,33 @@ static int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned ch
 									ret = 0;
 								}
 								break;
+							case packet_PLTYPE_USERDATA_AGGREGATE:
+								if(peermgtGetFlag(mgt, peermgt_FLAG_USERDATA)) {
+									ret = peermgtDecodeUserdataAggregate(mgt, &data);
+									if(ret > 0) {
+										mgt->msgpeerid = data.peerid;
+									}
+								}
+								else {
+									ret = 0;
+								}
+								break;
 							case packet_PLTYPE_PEERINFO:
 								ret = peermgtDecodePacketPeerinfo(mgt, &data);
 								break;
 							case packet_PLTYPE_PING:
-								ret = peermgtDecodePacketPing(mgt, &data);
+								ret = peermgtDecodePacketPing(mgt, &data, source_addr);
 								break;
 							case packet_PLTYPE_PONG:
-								ret = peermgtDecodePacketPong(mgt, &data);
+								ret = peermgtDecodePacketPong(mgt, &data, tnow);
+								break;
+							case packet_PLTYPE_LOSSREPORT:
+								if(peermgtIsFEC(mgt, peerid) || peermgtGetFlag(mgt, peermgt_FLAG_RATELEARN)) {
+									ret = peermgtDecodePacketLossReport(mgt, &data);
+								}
+								else {
+									ret = 0;
+								}
 								break;
 							case packet_PLTYPE_RELAY_IN:
 								if(peermgtGetFlag(mgt, peermgt_FLAG_RELAY)) {
@@ -1012,7 +2770,7 @@ static int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned ch
 								}
 							}
 							mgt->data[peerid].lastrecv = tnow;
-							mgt->data[peerid].remoteaddr = *source_addr;
+							peermgtUpdatePath(mgt, peerid, source_addr, ((data.pl_type == packet_PLTYPE_PING) || (data.pl_type == packet_PLTYPE_PONG)), tnow);
 							return 1;
 						}
 					}
@@ -1020,7 +2778,7 @@ static int peermgtDecodePacketRecursive(struct s_peermgt *mgt, const unsigned ch
 			}
 			else if(peerid == 0) {
 				// packet has an anonymous PeerID
-				if(packetDecode(&data, packet, packet_len, &mgt->ctx[0], NULL)) {
+				if(packetDecode(&data, packet, packet_len, &mgt->ctx[0], NULL, packet_FORMAT_DEFAULT)) {
 					switch(data.pl_type) {
 						case packet_PLTYPE_AUTH:
 							return peermgtDecodePacketAuth(mgt, &data, source_addr);
@@ -1045,8 +2803,14 @@ static int peermgtDecodePacket(struct s_peermgt *mgt, const unsigned char *packe
 
 // Return received user data. Return 1 if successful.
 static int peermgtRecvUserdata(struct s_peermgt *mgt, struct s_msg *recvmsg, struct s_nodeid *fromnodeid, int *frompeerid, int *frompeerct) {
+	if((mgt->msgsize == 0) && (mgt->msgaggpos < mgt->msgaggsize)) {
+		// get next frame of aggregated user data
+		mgt->msgpos = (mgt->msgaggpos + peermgt_AGGREGATE_HDRSIZE);
+		mgt->msgsize = utilReadInt16(&mgt->msgbuf[mgt->msgaggpos]);
+		mgt->msgaggpos = (mgt->msgpos + mgt->msgsize);
+	}
 	if((mgt->msgsize > 0) && (recvmsg != NULL)) {
-		recvmsg->msg = mgt->msgbuf;
+		recvmsg->msg = &mgt->msgbuf[mgt->msgpos];
 		recvmsg->len = mgt->msgsize;
 		if(fromnodeid != NULL) peermgtGetNodeID(mgt, fromnodeid, mgt->msgpeerid);
 		if(frompeerid != NULL) *frompeerid = mgt->msgpeerid;
@@ -1071,24 +2835,31 @@ static int peermgtRecvUserdata(struct s_peermgt *mgt, struct s_msg *recvmsg, str
 static int peermgtSendUserdata(struct s_peermgt *mgt, const struct s_msg *sendmsg, const struct s_nodeid *tonodeid, const int topeerid, const int topeerct) {
 	int outpeerid;
 
-	mgt->outmsgbroadcast = 0;
-	mgt->outmsg.len = 0;
 	if(sendmsg != NULL) {
 		if((sendmsg->len > 0) && (sendmsg->len <= peermgt_MSGSIZE_MAX)) {
 			outpeerid = peermgtGetActiveID(mgt, tonodeid, topeerid, topeerct);
 			if(outpeerid >= 0) {
 				if(outpeerid > 0) {
-					// message goes out
-					mgt->outmsg.msg = sendmsg->msg;
-					mgt->outmsg.len = sendmsg->len;
-					mgt->outmsgpeerid = outpeerid;
-					return 1;
+					// small messages are aggregated if the remote peer supports it and no earlier message is queued
+					if((mgt->aggdelay > 0) && (peermgtGetOutmsgCount(mgt, outpeerid) == 0) && (mgt->data[outpeerid].pacetime == 0) && (sendmsg->len <= peermgt_AGGREGATE_FRAMESIZE) && peermgtGetRemoteFlag(mgt, outpeerid, peermgt_FLAG_AGGREGATE)) {
+						return peermgtAddAggregate(mgt, sendmsg, outpeerid);
+					}
+
+					// send pending aggregate first to keep the message order
+					if((mgt->agg[mgt->aggfillid].size > 0) && (mgt->agg[mgt->aggfillid].peerid == outpeerid)) {
+						if(!peermgtSealAggregate(mgt)) return 0;
+					}
+
+					// message goes to the transmit queue of the peer
+					return peermgtAddOutmsg(mgt, sendmsg, outpeerid);
 				}
 				else {
 					// message goes to loopback
 					if(mgt->loopback) {
 						memcpy(mgt->msgbuf, sendmsg->msg, sendmsg->len);
 						mgt->msgsize = sendmsg->len;
+						mgt->msgpos = 0;
+						mgt->msgaggsize = 0;
 						mgt->msgpeerid = outpeerid;
 						return 1;
 					}
@@ -1102,16 +2873,24 @@ static int peermgtSendUserdata(struct s_peermgt *mgt, const struct s_msg *sendms
 
 // Send user data to all connected peers. Return 1 if successful.
 static int peermgtSendBroadcastUserdata(struct s_peermgt *mgt, const struct s_msg *sendmsg) {
-	mgt->outmsgbroadcast = 0;
-	mgt->outmsg.len = 0;
+	unsigned char *buf;
+	int64_t bcid;
 	if(sendmsg != NULL) {
 		if((sendmsg->len > 0) && (sendmsg->len <= peermgt_MSGSIZE_MAX)) {
-			mgt->outmsg.msg = sendmsg->msg;
-			mgt->outmsg.len = sendmsg->len;
-			mgt->outmsgpeerid = -1;
-			mgt->outmsgbroadcast = 1;
-			mgt->outmsgbroadcastcount = 0;
-			return 1;
+			if(!peermgtSealAggregate(mgt)) return 0;
+			if(peermgtIsLocalBCTree(mgt) && (sendmsg->len <= peermgt_BCTREE_FRAMESIZE)) {
+				// the tree covers the whole NodeID space
+				buf = txqAdd(&mgt->outq[peermgtGetFrameClass(sendmsg->msg, sendmsg->len)], 0, 0, peermgt_OUTMSG_BCTREE_ORIGIN, 0, (peermgt_BCTREE_HDRSIZE + sendmsg->len));
+				if(buf == NULL) return 0;
+				bcid = cryptoRand64();
+				peermgtCheckBCSeen(mgt, (uint64_t)bcid);
+				utilWriteInt64(&buf[0], bcid);
+				utilWriteInt64(&buf[8], 0);
+				utilWriteInt64(&buf[16], -1);
+				memcpy(&buf[peermgt_BCTREE_HDRSIZE], sendmsg->msg, sendmsg->len);
+				return 1;
+			}
+			return peermgtAddOutmsg(mgt, sendmsg, 0);
 		}
 	}
 	return 0;
@@ -1140,26 +2919,50 @@ static int peermgtInit(struct s_peermgt *mgt) {
 	struct s_nodeid *local_nodeid = &mgt->nodekey->nodeid;
 
 	mgt->msgsize = 0;
+	mgt->msgpos = 0;
+	mgt->msgaggsize = 0;
+	mgt->msgaggpos = 0;
 	mgt->loopback = 0;
 	mgt->outmsg.len = 0;
+	mgt->outmsgid = -1;
+	mgt->outmsgclass = 0;
+	mgt->outclass = 0;
+	memset(mgt->outclassdeficit, 0, sizeof(mgt->outclassdeficit));
 	mgt->outmsgbroadcast = 0;
 	mgt->outmsgbroadcastcount = 0;
-	mgt->rrmsg.len = 0;
-	mgt->rrmsgpeerid = 0;
-	mgt->rrmsgusetargetaddr = 0;
+	mgt->outmsgbctree = 0;
+	mgt->outmsgbcskip = 0;
+	memset(mgt->bcseen, 0, sizeof(mgt->bcseen));
 	mgt->fragoutpeerid = 0;
 	mgt->fragoutcount = 0;
 	mgt->fragoutsize = 0;
+	mgt->fragoutchunk = peermgt_MSGSIZE_MIN;
 	mgt->fragoutpos = 0;
+	mgt->compbuflen = -1;
+	mgt->agg[0].size = 0;
+	mgt->agg[1].size = 0;
+	mgt->aggfillid = 0;
+	mgt->aggdelay = 0;
+	mgt->fastfailover = 0;
+	mgt->pmtudisc = 0;
+	mgt->pacenext = 0;
+	tbfReset(&mgt->tbf);
+	mgt->fecoutpeerid = 0;
 	mgt->localflags = 0;
 
 	for(i=0; i<s; i++) {
 		mgt->data[i].state = peermgt_STATE_INVALID;
+		mgt->data[i].pacetime = 0;
 	}
 
 	memset(empty_addr.addr, 0, peeraddr_SIZE);
+	timerReset(&mgt->timer, utilGetClock());
 	mapInit(&mgt->map);
 	authmgtReset(&mgt->authmgt);
+	resumeInit(&mgt->resume);
+	fecReset(&mgt->fec);
+	for(i=0; i<peermgt_CLASS_COUNT; i++) txqReset(&mgt->outq[i]);
+	txqReset(&mgt->rrq);
 	nodedbInit(&mgt->nodedb);
 	nodedbInit(&mgt->relaydb);
 
@@ -1191,22 +2994,28 @@ static void peermgtStatus(struct s_peermgt *mgt, char *report, const int report_
 	int tnow = utilGetClock();
 	int pos = 0;
 	int size = mapGetMapSize(&mgt->map);
-	int maxpos = (((size + 2) * (160)) + 1);
+	const int headsize = 184;
+	const int rowsize = ((packet_PEERID_SIZE * 2) + (nodeid_SIZE * 2) + (peeraddr_SIZE * 2) + 2 + 8 + 8 + 4 + 2 + 8 + 8 + 8 + (10 * 2) + 1);
 	unsigned char infoid[packet_PEERID_SIZE];
 	unsigned char infostate[1];
 	unsigned char infoflags[2];
 	unsigned char inforq[1];
 	unsigned char timediff[4];
+	unsigned char infolink[4];
 	struct s_nodeid nodeid;
 	int i = 0;
 
-	if(maxpos > report_len) { maxpos = report_len; }
-	
-	memcpy(&report[pos], "PeerID    NodeID                                                            Address                                       Status  LastPkt   SessAge   Flag  RQ", 158);
-	pos = pos + 158;
+	if(!(report_len > 0)) return;
+	if(!(report_len > (headsize + 1))) {
+		report[pos] = '\0';
+		return;
+	}
+
+	memcpy(&report[pos], "PeerID    NodeID                                                            Address                                       Status  LastPkt   SessAge   Flag  RQ  RTT       Jitter    Loss", headsize);
+	pos = pos + headsize;
 	report[pos++] = '\n';
 
-	while(i < size && pos < maxpos) {
+	while((i < size) && ((pos + rowsize) < report_len)) {
 		if(peermgtGetNodeID(mgt, &nodeid, i)) {
 			utilWriteInt32(infoid, i);
 			utilByteArrayToHexstring(&report[pos], ((packet_PEERID_SIZE * 2) + 2), infoid, packet_PEERID_SIZE);
@@ -1244,6 +3053,21 @@ static void peermgtStatus(struct s_peermgt *mgt, char *report, const int report_
 			inforq[0] = seqRQ(&mgt->data[i].seq);
 			utilByteArrayToHexstring(&report[pos], 4, inforq, 1);
 			pos = pos + 2;
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			utilWriteInt32(infolink, peermgtGetRTT(mgt, i));
+			utilByteArrayToHexstring(&report[pos], 10, infolink, 4);
+			pos = pos + 8;
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			utilWriteInt32(infolink, peermgtGetJitter(mgt, i));
+			utilByteArrayToHexstring(&report[pos], 10, infolink, 4);
+			pos = pos + 8;
+			report[pos++] = ' ';
+			report[pos++] = ' ';
+			utilWriteInt32(infolink, peermgtGetLoss(mgt, i));
+			utilByteArrayToHexstring(&report[pos], 10, infolink, 4);
+			pos = pos + 8;
 			report[pos++] = '\n';
 		}
 		i++;
@@ -1252,44 +3076,109 @@ static void peermgtStatus(struct s_peermgt *mgt, char *report, const int report_
 }
 
 
-// Create peer manager object.
+// Create the user data transmit queues of all traffic classes.
+static int peermgtCreateOutq(struct s_peermgt *mgt, const int queue_count) {
+	int i;
+	for(i=0; i<peermgt_CLASS_COUNT; i++) {
+		if(!txqCreate(&mgt->outq[i], peermgt_MSGSIZE_MAX, peermgt_OUTQ_SIZE, queue_count, peermgt_OUTQ_PEER_MAX)) {
+			while(i > 0) {
+				i--;
+				txqDestroy(&mgt->outq[i]);
+			}
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+// Destroy the user data transmit queues.
+static void peermgtDestroyOutq(struct s_peermgt *mgt) {
+	int i;
+	for(i=0; i<peermgt_CLASS_COUNT; i++) txqDestroy(&mgt->outq[i]);
+}
+
+
+// Create peer manager object. Memory is allocated for a small number of peers first, up to peer_slots peers are added later on demand.
 static int peermgtCreate(struct s_peermgt *mgt, const int peer_slots, const int auth_slots, struct s_nodekey *local_nodekey, struct s_dh_state *dhstate) {
 	const char *defaultid = "default";
 	struct s_peermgt_data *data_mem;
 	struct s_crypto *ctx_mem;
+	struct s_peermgt_bcchild *bcmember_mem;
+	uint64_t *seqmask_mem;
+	const int slots = ((peer_slots < peermgt_PEER_SLOTS_INIT) ? peer_slots : peermgt_PEER_SLOTS_INIT);
+	int i;
 
 	if((peer_slots > 0) && (auth_slots > 0) && (peermgtSetNetID(mgt, defaultid, 7))) {
-		data_mem = malloc(sizeof(struct s_peermgt_data) * (peer_slots + 1));
+		data_mem = malloc(sizeof(struct s_peermgt_data) * (slots + 1));
 		if(data_mem != NULL) {
-			ctx_mem = malloc(sizeof(struct s_crypto) * (peer_slots + 1));
+			ctx_mem = malloc(sizeof(struct s_crypto) * (slots + 1));
 			if(ctx_mem != NULL) {
-				if(cryptoCreate(ctx_mem, (peer_slots + 1))) {
-					if(dfragCreate(&mgt->dfrag, peermgt_MSGSIZE_MIN, peermgt_FRAGBUF_COUNT)) {
-						if(authmgtCreate(&mgt->authmgt, &mgt->netid, auth_slots, local_nodekey, dhstate)) {
-							if(nodedbCreate(&mgt->relaydb, (peer_slots + 1), peermgt_RELAYDB_NUM_PEERADDRS)) {
-								if(nodedbCreate(&mgt->nodedb, ((peer_slots * 8) + 1), peermgt_NODEDB_NUM_PEERADDRS)) {
-									if(mapCreate(&mgt->map, (peer_slots + 1), nodeid_SIZE, 1)) {
-										mgt->nodekey = local_nodekey;
-										mgt->data = data_mem;
-										mgt->ctx = ctx_mem;
-										mgt->rrmsg.msg = mgt->rrmsgbuf;
-										if(peermgtInit(mgt)) {
-											return 1;
+				bcmember_mem = malloc(sizeof(struct s_peermgt_bcchild) * (slots + 1));
+				if(bcmember_mem != NULL) {
+					seqmask_mem = malloc(sizeof(uint64_t) * 2 * seqMaskWords(seq_REPLAYWINDOW_DEFAULT) * (slots + 1));
+					if(seqmask_mem != NULL) {
+						if(cryptoCreate(ctx_mem, (slots + 1))) {
+							if(dfragCreate(&mgt->dfrag, peermgt_MSGSIZE_MAX, peermgtGetFragbufCount(slots), (slots + 1), peermgt_FRAGBUF_PEER_MAX)) {
+								if(resumeCreate(&mgt->resume, ((slots * 2) + 1))) {
+									if(compressCreate(&mgt->compress)) {
+										if(fecCreate(&mgt->fec, (slots + 1), peermgt_FEC_CACHE_SIZE, peermgt_FEC_ITEMSIZE)) {
+											if(peermgtCreateOutq(mgt, (slots + 1))) {
+												if(txqCreate(&mgt->rrq, peermgt_MSGSIZE_MAX, peermgt_RRQ_SIZE, (slots + 1), peermgt_RRQ_PEER_MAX)) {
+													if(authmgtCreate(&mgt->authmgt, &mgt->netid, auth_slots, local_nodekey, dhstate, &mgt->resume)) {
+														if(nodedbCreate(&mgt->relaydb, (slots + 1), peermgt_RELAYDB_NUM_PEERADDRS)) {
+															if(nodedbCreate(&mgt->nodedb, ((slots * 8) + 1), peermgt_NODEDB_NUM_PEERADDRS)) {
+																if(mapCreate(&mgt->map, (slots + 1), nodeid_SIZE, 1)) {
+																	if(mapCreate(&mgt->peerconf, peermgt_PEERCONF_SIZE, nodeid_SIZE, sizeof(struct s_peermgt_peerconf))) {
+																		if(timerCreate(&mgt->timer, (slots + 1))) {
+																			mgt->nodekey = local_nodekey;
+																			mgt->data = data_mem;
+																			mgt->ctx = ctx_mem;
+																			mgt->bcmember = bcmember_mem;
+																			mgt->seqmask = seqmask_mem;
+																			mgt->replaywindow = seq_REPLAYWINDOW_DEFAULT;
+																			for(i=0; i<(slots + 1); i++) {
+																				peermgtSetSeqWindow(mgt, i);
+																			}
+																			mgt->ctxcount = (slots + 1);
+																			mgt->peermax = peer_slots;
+																			if(peermgtInit(mgt)) {
+																				return 1;
+																			}
+																			mgt->nodekey = NULL;
+																			mgt->data = NULL;
+																			mgt->ctx = NULL;
+																			mgt->bcmember = NULL;
+																			mgt->seqmask = NULL;
+																			timerDestroy(&mgt->timer);
+																		}
+																		mapDestroy(&mgt->peerconf);
+																	}
+																	mapDestroy(&mgt->map);
+																}
+																nodedbDestroy(&mgt->nodedb);
+															}
+															nodedbDestroy(&mgt->relaydb);
+														}
+														authmgtDestroy(&mgt->authmgt);
+													}
+													txqDestroy(&mgt->rrq);
+												}
+												peermgtDestroyOutq(mgt);
+											}
+											fecDestroy(&mgt->fec);
 										}
-										mgt->nodekey = NULL;
-										mgt->data = NULL;
-										mgt->ctx = NULL;
-										mapDestroy(&mgt->map);
+										compressDestroy(&mgt->compress);
 									}
-									nodedbDestroy(&mgt->nodedb);
+									resumeDestroy(&mgt->resume);
 								}
-								nodedbDestroy(&mgt->relaydb);
+								dfragDestroy(&mgt->dfrag);
 							}
-							authmgtDestroy(&mgt->authmgt);
+							cryptoDestroy(ctx_mem, (slots + 1));
 						}
-						dfragDestroy(&mgt->dfrag);
+						free(seqmask_mem);
 					}
-					cryptoDestroy(ctx_mem, (peer_slots + 1));
+					free(bcmember_mem);
 				}
 				free(ctx_mem);
 			}
@@ -1302,13 +3191,21 @@ static int peermgtCreate(struct s_peermgt *mgt, const int peer_slots, const int
 
 // Destroy peer manager object.
 static void peermgtDestroy(struct s_peermgt *mgt) {
-	int size = mapGetMapSize(&mgt->map);
+	timerDestroy(&mgt->timer);
+	mapDestroy(&mgt->peerconf);
 	mapDestroy(&mgt->map);
 	nodedbDestroy(&mgt->nodedb);
 	nodedbDestroy(&mgt->relaydb);
 	authmgtDestroy(&mgt->authmgt);
+	txqDestroy(&mgt->rrq);
+	peermgtDestroyOutq(mgt);
+	fecDestroy(&mgt->fec);
+	compressDestroy(&mgt->compress);
+	resumeDestroy(&mgt->resume);
 	dfragDestroy(&mgt->dfrag);
-	cryptoDestroy(mgt->ctx, size);
+	cryptoDestroy(mgt->ctx, mgt->ctxcount);
+	free(mgt->seqmask);
+	free(mgt->bcmember);
 	free(mgt->ctx);
 	free(mgt->data);
 }
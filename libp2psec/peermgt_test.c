@@ -37,6 +37,11 @@
 #error not enough nodes!
 #endif
 
+#define peermgtResizeTestsuite_PEERS 200
+
+#define peermgtNetTestsuite_NODECOUNT 3
+#define peermgtNetTestsuite_LOGSIZE 64
+
 
 struct s_peermgt_test {
 	struct s_authmgt_test authtest;
@@ -44,6 +49,22 @@ struct s_peermgt_test {
 };
 
 
+// A small network of nodes that exchange packets directly. Received messages are logged by their first byte and length.
+// Node i can also be reached at the address i + NODECOUNT. If down is set to a node, packets to its first address are lost and it sends from its second one.
+struct s_peermgt_nettest {
+	struct s_nodekey nk[peermgtNetTestsuite_NODECOUNT];
+	struct s_dh_state dhstate[peermgtNetTestsuite_NODECOUNT];
+	struct s_peermgt peermgts[peermgtNetTestsuite_NODECOUNT];
+	int rxtag[peermgtNetTestsuite_NODECOUNT][peermgtNetTestsuite_LOGSIZE];
+	int rxlen[peermgtNetTestsuite_NODECOUNT][peermgtNetTestsuite_LOGSIZE];
+	int rxcount[peermgtNetTestsuite_NODECOUNT];
+	int rxmax;
+	int packets;
+	int authpackets[peermgtNetTestsuite_NODECOUNT];
+	int down;
+};
+
+
 static int peermgtTestsuiteGetID(const struct s_peeraddr *addr) {
 	int id;
 	if(addr->addr[0] == 42 && addr->addr[1] == 23 && addr->addr[2] == 66 && addr->addr[3] == 13) {
@@ -160,8 +181,9 @@ static int peermgtTestsuiteRun(struct s_peermgt_test *teststate) {
 				break;
 		}
 		
-		// route the packets
+		// route the packets and regenerate used DH keys like the main loop does
 		for(i=0; i<peermgtTestsuite_NODECOUNT; i++) {
+			dhRefresh(&teststate->authtest.dhstate[i], utilGetClockUS());
 			peermgtTestsuiteGetAddr(&sourceaddr, i);
 			while((len = (peermgtGetNextPacket(&teststate->peermgts[i], pbuf, 4096, &addr))) > 0) {
 				j = peermgtTestsuiteGetID(&addr);
@@ -245,4 +267,714 @@ static int peermgtTestsuite() {
 }
 
 
+// Create the NodeID of a test peer.
+static void peermgtResizeTestsuiteNodeID(struct s_nodeid *nodeid, const int n) {
+	memset(nodeid->id, 0x5A, nodeid_SIZE);
+	utilWriteInt32(nodeid->id, n);
+}
+
+
+// Check the state that was stored for a test peer when it was added.
+static int peermgtResizeTestsuiteCheck(struct s_peermgt *mgt, const int n, const int peerid) {
+	struct s_nodeid nodeid;
+	peermgtResizeTestsuiteNodeID(&nodeid, n);
+	if(peermgtGetID(mgt, &nodeid) != peerid) return 0;
+	if(!peermgtIsValidID(mgt, peerid)) return 0;
+	if(peermgtGetOutmsgCount(mgt, peerid) != (((n % 4) == 0) ? 1 : 0)) return 0;
+	if(seqCheck(&mgt->data[peerid].seq, (1000 + peerid))) return 0; // still marked as received
+	if(!seqCheck(&mgt->data[peerid].seq, (1001 + peerid))) return 0;
+	return 1;
+}
+
+
+// Add peers until the peer tables have grown to their maximum size while every peer has queued messages and incomplete fragmented messages.
+// One resize is made to fail and has to be retried with the next new peer.
+static int peermgtResizeTestsuiteRun(struct s_peermgt *mgt) {
+	unsigned char frag[64];
+	struct s_msg msg = { .msg = frag, .len = sizeof(frag) };
+	struct s_nodeid nodeid;
+	struct s_peeraddr addr;
+	int peerid[peermgtResizeTestsuite_PEERS];
+	int tnow = utilGetClock();
+	int fragbufs;
+	int n;
+	int i;
+
+	memset(frag, 0, sizeof(frag));
+	peermgtTestsuiteGetAddr(&addr, 1);
+	if(peermgtGetFragbufCount(100000) != peermgt_FRAGBUF_COUNT_MAX) return 0;
+	for(n=0; n<peermgtResizeTestsuite_PEERS; n++) {
+		peermgtResizeTestsuiteNodeID(&nodeid, n);
+		if(n == (peermgt_PEER_SLOTS_INIT * 2)) {
+			// the fragment buffers refuse to grow, so the resize fails after some tables have grown already
+			fragbufs = mgt->dfrag.msgbuf_count;
+			mgt->dfrag.msgbuf_count = (peermgt_FRAGBUF_COUNT_MAX + 1);
+			if(peermgtNew(mgt, &nodeid, &addr) >= 0) return 0;
+			mgt->dfrag.msgbuf_count = fragbufs;
+			if(peermgtPeerCount(mgt) != n) return 0;
+			if(mapGetMapSize(&mgt->map) != ((peermgt_PEER_SLOTS_INIT * 2) + 1)) return 0;
+			for(i=0; i<n; i++) {
+				if(!peermgtResizeTestsuiteCheck(mgt, i, peerid[i])) return 0;
+			}
+		}
+		peerid[n] = peermgtNew(mgt, &nodeid, &addr);
+		if(!(peerid[n] > 0)) return 0;
+		seqInit(&mgt->data[peerid[n]].seq, 1000);
+		if(!seqVerify(&mgt->data[peerid[n]].seq, (1000 + peerid[n]))) return 0;
+		if(((n % 4) == 0) && (!peermgtAddOutmsg(mgt, &msg, peerid[n]))) return 0;
+		frag[0] = peerid[n];
+		if(dfragAssemble(&mgt->dfrag, mgt->data[peerid[n]].conntime, peerid[n], (5000 + n), frag, sizeof(frag), 0, 2, tnow) >= 0) return 0;
+	}
+	if(mapGetMapSize(&mgt->map) != (peermgtResizeTestsuite_PEERS + 1)) return 0;
+	if(mgt->dfrag.msgbuf_count != peermgtGetFragbufCount(peermgtResizeTestsuite_PEERS)) return 0;
+
+	// all PeerIDs are kept, the maps and hash tables find the old entries
+	for(n=0; n<peermgtResizeTestsuite_PEERS; n++) {
+		if(!peermgtResizeTestsuiteCheck(mgt, n, peerid[n])) return 0;
+		i = dfragAssemble(&mgt->dfrag, mgt->data[peerid[n]].conntime, peerid[n], (5000 + n), frag, 10, 1, 2, tnow);
+		if(!(i >= 0)) return 0;
+		if((dfragLength(&mgt->dfrag, i) != (sizeof(frag) + 10)) || (dfragGet(&mgt->dfrag, i)[0] != (unsigned char)peerid[n])) return 0;
+		dfragClear(&mgt->dfrag, i);
+	}
+
+	// no more peers than the maximum
+	peermgtResizeTestsuiteNodeID(&nodeid, peermgtResizeTestsuite_PEERS);
+	if(peermgtNew(mgt, &nodeid, &addr) >= 0) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int peermgtResizeTestsuite() {
+	int ret = 0;
+	struct s_nodekey nk;
+	struct s_dh_state dhstate;
+	struct s_peermgt mgt;
+	if(nodekeyCreate(&nk)) {
+		if(nodekeyGenerate(&nk, authmgtTestsuite_PUBKEYSIZE)) {
+			if(dhCreate(&dhstate)) {
+				if(peermgtCreate(&mgt, peermgtResizeTestsuite_PEERS, 4, &nk, &dhstate)) {
+					ret = peermgtResizeTestsuiteRun(&mgt);
+					peermgtDestroy(&mgt);
+				}
+				dhDestroy(&dhstate);
+			}
+		}
+		nodekeyDestroy(&nk);
+	}
+	return ret;
+}
+
+
+// Deliver the next packet of a node. Returns 1 if a packet was sent, 0 if there is none and -1 if it was sent to an unknown address.
+static int peermgtNetTestsuiteForward(struct s_peermgt_nettest *nettest, const int i) {
+	unsigned char pbuf[4096];
+	struct s_peeraddr addr;
+	struct s_peeraddr sourceaddr;
+	struct s_msg msgr;
+	int len;
+	int count;
+	int j;
+	len = peermgtGetNextPacket(&nettest->peermgts[i], pbuf, 4096, &addr);
+	if(!(len > 0)) return 0;
+	j = peermgtTestsuiteGetID(&addr);
+	if((j < 0) || (!(j < (peermgtNetTestsuite_NODECOUNT * 2)))) return -1;
+	nettest->packets++;
+	if(packetGetPeerID(pbuf) == 0) nettest->authpackets[i]++;
+	if(j == nettest->down) return 1;
+	j = (j % peermgtNetTestsuite_NODECOUNT);
+	peermgtTestsuiteGetAddr(&sourceaddr, ((i == nettest->down) ? (i + peermgtNetTestsuite_NODECOUNT) : i));
+	if(!peermgtDecodePacket(&nettest->peermgts[j], pbuf, len, &sourceaddr)) return 1;
+	count = 0;
+	while(peermgtRecvUserdata(&nettest->peermgts[j], &msgr, NULL, NULL, NULL)) {
+		if(nettest->rxcount[j] < peermgtNetTestsuite_LOGSIZE) {
+			nettest->rxtag[j][nettest->rxcount[j]] = msgr.msg[0];
+			nettest->rxlen[j][nettest->rxcount[j]] = msgr.len;
+			nettest->rxcount[j]++;
+		}
+		count++;
+	}
+	if(count > nettest->rxmax) nettest->rxmax = count;
+	return 1;
+}
+
+
+// Deliver all pending packets of all nodes once. Returns 0 if a packet was sent to an unknown address.
+static int peermgtNetTestsuiteRoute(struct s_peermgt_nettest *nettest) {
+	int ret;
+	int i;
+	for(i=0; i<peermgtNetTestsuite_NODECOUNT; i++) {
+		dhRefresh(&nettest->dhstate[i], utilGetClockUS());
+		while((ret = peermgtNetTestsuiteForward(nettest, i)) > 0);
+		if(ret < 0) return 0;
+	}
+	return 1;
+}
+
+
+// Deliver packets until no node has anything left to send. Returns 0 if a packet was sent to an unknown address.
+static int peermgtNetTestsuiteRouteAll(struct s_peermgt_nettest *nettest) {
+	int packets;
+	int pending;
+	int r;
+	int i;
+	for(r=0; r<16; r++) {
+		packets = nettest->packets;
+		if(!peermgtNetTestsuiteRoute(nettest)) return 0;
+		pending = 0;
+		for(i=0; i<peermgtNetTestsuite_NODECOUNT; i++) {
+			if(peermgtGetOutputDelay(&nettest->peermgts[i]) == 0) pending = 1;
+		}
+		if((nettest->packets == packets) && (!pending)) return 1;
+	}
+	return 1;
+}
+
+
+// Returns 1 if a node has an active session with another node.
+static int peermgtNetTestsuiteIsConnected(struct s_peermgt_nettest *nettest, const int from, const int to) {
+	struct s_peermgt *mgt = &nettest->peermgts[from];
+	int peerid = peermgtGetID(mgt, &nettest->nk[to].nodeid);
+	return ((peerid > 0) && peermgtIsActiveRemoteID(mgt, peerid));
+}
+
+
+// Connect all nodes to node 0. Returns 1 if all sessions are up on both sides.
+static int peermgtNetTestsuiteConnect(struct s_peermgt_nettest *nettest) {
+	struct s_peeraddr addr;
+	int count;
+	int r;
+	int i;
+	peermgtTestsuiteGetAddr(&addr, 0);
+	for(i=1; i<peermgtNetTestsuite_NODECOUNT; i++) {
+		if(!peermgtConnect(&nettest->peermgts[i], &addr)) return 0;
+	}
+	for(r=0; r<100; r++) {
+		if(!peermgtNetTestsuiteRoute(nettest)) return 0;
+		count = 0;
+		for(i=1; i<peermgtNetTestsuite_NODECOUNT; i++) {
+			if(peermgtNetTestsuiteIsConnected(nettest, 0, i) && peermgtNetTestsuiteIsConnected(nettest, i, 0)) count++;
+		}
+		if(count == (peermgtNetTestsuite_NODECOUNT - 1)) return 1;
+	}
+	return 0;
+}
+
+
+// Send a message of len bytes that starts with tag from one node to another.
+static int peermgtNetTestsuiteSend(struct s_peermgt_nettest *nettest, const int from, const int to, const int tag, const int len) {
+	unsigned char buf[4096];
+	struct s_msg msg = { .msg = buf, .len = len };
+	struct s_peermgt *mgt = &nettest->peermgts[from];
+	int peerid = peermgtGetID(mgt, &nettest->nk[to].nodeid);
+	if(!(peerid > 0)) return 0;
+	memset(buf, tag, len);
+	return peermgtSendUserdata(mgt, &msg, NULL, peerid, mgt->data[peerid].conntime);
+}
+
+
+// Create the nodes. The flags of each node are taken from the flags array.
+static int peermgtNetTestsuiteCreate(struct s_peermgt_nettest *nettest, const int *flags) {
+	int count = 0;
+	memset(nettest->rxcount, 0, sizeof(nettest->rxcount));
+	memset(nettest->authpackets, 0, sizeof(nettest->authpackets));
+	nettest->rxmax = 0;
+	nettest->packets = 0;
+	nettest->down = -1;
+	while(count < peermgtNetTestsuite_NODECOUNT) {
+		if(!nodekeyCreate(&nettest->nk[count])) break;
+		if(nodekeyGenerate(&nettest->nk[count], authmgtTestsuite_PUBKEYSIZE)) {
+			if(dhCreate(&nettest->dhstate[count])) {
+				if(peermgtCreate(&nettest->peermgts[count], 8, 16, &nettest->nk[count], &nettest->dhstate[count])) {
+					peermgtSetFastauth(&nettest->peermgts[count], 1);
+					peermgtSetLoopback(&nettest->peermgts[count], 0);
+					peermgtSetFragmentation(&nettest->peermgts[count], 1);
+					peermgtSetNetID(&nettest->peermgts[count], "testnet", 7);
+					peermgtSetFlags(&nettest->peermgts[count], flags[count]);
+					count++;
+					continue;
+				}
+				dhDestroy(&nettest->dhstate[count]);
+			}
+		}
+		nodekeyDestroy(&nettest->nk[count]);
+		break;
+	}
+	if(!(count < peermgtNetTestsuite_NODECOUNT)) return 1;
+	while(count > 0) {
+		count--;
+		peermgtDestroy(&nettest->peermgts[count]);
+		dhDestroy(&nettest->dhstate[count]);
+		nodekeyDestroy(&nettest->nk[count]);
+	}
+	return 0;
+}
+
+
+// Destroy the nodes.
+static void peermgtNetTestsuiteDestroy(struct s_peermgt_nettest *nettest) {
+	int i;
+	for(i=0; i<peermgtNetTestsuite_NODECOUNT; i++) {
+		peermgtDestroy(&nettest->peermgts[i]);
+		dhDestroy(&nettest->dhstate[i]);
+		nodekeyDestroy(&nettest->nk[i]);
+	}
+}
+
+
+// Node 1 sends small frames to node 0, node 2 does not support aggregation.
+static int peermgtAggTestsuiteRun(struct s_peermgt_nettest *nettest) {
+	const int aggdelay = 50000;
+	struct s_peermgt *mgt = &nettest->peermgts[1];
+	int rx;
+	int i;
+
+	if(!peermgtNetTestsuiteConnect(nettest)) return 0;
+	for(i=0; i<peermgtNetTestsuite_NODECOUNT; i++) {
+		peermgtSetAggregation(&nettest->peermgts[i], aggdelay);
+	}
+
+	// small frames are held back and sent in one packet after the delay
+	rx = nettest->rxcount[0];
+	nettest->rxmax = 0;
+	for(i=0; i<5; i++) {
+		if(!peermgtNetTestsuiteSend(nettest, 1, 0, (0x10 + i), (40 + i))) return 0;
+		if(!peermgtNetTestsuiteRoute(nettest)) return 0;
+	}
+	if(nettest->rxcount[0] != rx) return 0;
+	if(!(peermgtGetAggregateDelay(mgt) > 0)) return 0;
+	usleep(aggdelay + 10000);
+	if(peermgtGetAggregateDelay(mgt) != 0) return 0;
+	if(!peermgtNetTestsuiteRoute(nettest)) return 0;
+	if((nettest->rxcount[0] != (rx + 5)) || (nettest->rxmax != 5)) return 0;
+	for(i=0; i<5; i++) {
+		if((nettest->rxtag[0][(rx + i)] != (0x10 + i)) || (nettest->rxlen[0][(rx + i)] != (40 + i))) return 0;
+	}
+	if(peermgtGetAggregateDelay(mgt) != -1) return 0;
+
+	// a large frame sends the pending aggregate first
+	rx = nettest->rxcount[0];
+	if(!peermgtNetTestsuiteSend(nettest, 1, 0, 0x20, 100)) return 0;
+	if(!peermgtNetTestsuiteSend(nettest, 1, 0, 0x21, 3000)) return 0;
+	if(!peermgtNetTestsuiteRoute(nettest)) return 0;
+	if((nettest->rxcount[0] != (rx + 2)) || (nettest->rxtag[0][rx] != 0x20) || (nettest->rxtag[0][(rx + 1)] != 0x21) || (nettest->rxlen[0][(rx + 1)] != 3000)) return 0;
+
+	// an expired aggregate does not interrupt the fragments of a large frame
+	rx = nettest->rxcount[0];
+	if(!peermgtNetTestsuiteSend(nettest, 1, 0, 0x30, 3000)) return 0;
+	if(peermgtNetTestsuiteForward(nettest, 1) != 1) return 0;
+	if(!(mgt->fragoutsize > 0)) return 0;
+	if(!peermgtNetTestsuiteSend(nettest, 1, 0, 0x31, 60)) return 0;
+	if(!(peermgtGetAggregateDelay(mgt) > 0)) return 0;
+	usleep(aggdelay + 10000);
+	if(!peermgtNetTestsuiteRoute(nettest)) return 0;
+	if((nettest->rxcount[0] != (rx + 2)) || (nettest->rxtag[0][rx] != 0x30) || (nettest->rxlen[0][rx] != 3000) || (nettest->rxtag[0][(rx + 1)] != 0x31)) return 0;
+
+	// frames to a peer without aggregation support are sent at once
+	rx = nettest->rxcount[2];
+	if(!peermgtNetTestsuiteSend(nettest, 0, 2, 0x40, 60)) return 0;
+	if(peermgtGetAggregateDelay(&nettest->peermgts[0]) != -1) return 0;
+	if(!peermgtNetTestsuiteRoute(nettest)) return 0;
+	if((nettest->rxcount[2] != (rx + 1)) || (nettest->rxtag[2][rx] != 0x40)) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int peermgtAggTestsuite() {
+	const int flags[peermgtNetTestsuite_NODECOUNT] = { (peermgt_FLAG_USERDATA | peermgt_FLAG_AGGREGATE), (peermgt_FLAG_USERDATA | peermgt_FLAG_AGGREGATE), peermgt_FLAG_USERDATA };
+	int ret = 0;
+	struct s_peermgt_nettest *nettest;
+	nettest = malloc(sizeof(struct s_peermgt_nettest));
+	if(nettest != NULL) {
+		if(peermgtNetTestsuiteCreate(nettest, flags)) {
+			ret = peermgtAggTestsuiteRun(nettest);
+			peermgtNetTestsuiteDestroy(nettest);
+		}
+		free(nettest);
+	}
+	return ret;
+}
+
+
+// Feed a loss report to the rate learning of a PeerID as if txbytes bytes had been sent during the last second. Returns the learned rate.
+static int peermgtRateTestsuiteReport(struct s_peermgt *mgt, const int peerid, const int64_t txbytes, const int lost) {
+	mgt->data[peerid].txbytes = txbytes;
+	mgt->data[peerid].txstart = (utilGetClockUS() - 1000000);
+	peermgtLearnRate(mgt, peerid, lost);
+	return mgt->data[peerid].learnedrate;
+}
+
+
+static int peermgtRateTestsuiteRun(struct s_peermgt *mgt) {
+	struct s_nodeid nodeid;
+	struct s_peeraddr addr;
+	int peerid;
+	int rate;
+
+	memset(nodeid.id, 0x42, nodeid_SIZE);
+	peermgtTestsuiteGetAddr(&addr, 1);
+	peerid = peermgtNew(mgt, &nodeid, &addr);
+	if(!(peerid > 0)) return 0;
+	if(tbfIsEnabled(&mgt->data[peerid].tbf)) return 0;
+
+	// loss without a learned rate, the rate is set below the measured rate
+	rate = peermgtRateTestsuiteReport(mgt, peerid, 1000000, 8);
+	if((rate < 742500) || (rate > 750000)) return 0;
+	if(mgt->data[peerid].tbf.rate != rate) return 0;
+
+	// no loss, the rate is increased
+	if(peermgtRateTestsuiteReport(mgt, peerid, 750000, 0) != (rate + (rate / 8))) return 0;
+	rate = (rate + (rate / 8));
+
+	// loss below the threshold, the rate is kept
+	if(peermgtRateTestsuiteReport(mgt, peerid, 750000, (peermgt_RATELIMIT_LOSS_THRESHOLD - 1)) != rate) return 0;
+
+	// loss above the measured rate, the current rate is decreased
+	if(peermgtRateTestsuiteReport(mgt, peerid, 2000000, peermgt_RATELIMIT_LOSS_THRESHOLD) != ((rate * 3) / 4)) return 0;
+
+	// the rate is not decreased below the minimum
+	if(peermgtRateTestsuiteReport(mgt, peerid, 1000, 64) != peermgt_RATELIMIT_MIN) return 0;
+
+	// no loss far below the limit, the learned rate is dropped
+	if(peermgtRateTestsuiteReport(mgt, peerid, 1000, 0) != 0) return 0;
+	if(tbfIsEnabled(&mgt->data[peerid].tbf)) return 0;
+	if(peermgtRateTestsuiteReport(mgt, peerid, 1000, 0) != 0) return 0;
+
+	// the lower one of the configured and the learned rate is used
+	mgt->data[peerid].ratelimit = 100000;
+	rate = peermgtRateTestsuiteReport(mgt, peerid, 1000000, 8);
+	if(!(rate > 100000)) return 0;
+	if(mgt->data[peerid].tbf.rate != 100000) return 0;
+	rate = peermgtRateTestsuiteReport(mgt, peerid, 100000, 8);
+	if(!(rate < 100000)) return 0;
+	if(mgt->data[peerid].tbf.rate != rate) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int peermgtRateTestsuite() {
+	int ret = 0;
+	struct s_nodekey nk;
+	struct s_dh_state dhstate;
+	struct s_peermgt mgt;
+	if(nodekeyCreate(&nk)) {
+		if(nodekeyGenerate(&nk, authmgtTestsuite_PUBKEYSIZE)) {
+			if(dhCreate(&dhstate)) {
+				if(peermgtCreate(&mgt, 4, 4, &nk, &dhstate)) {
+					ret = peermgtRateTestsuiteRun(&mgt);
+					peermgtDestroy(&mgt);
+				}
+				dhDestroy(&dhstate);
+			}
+		}
+		nodekeyDestroy(&nk);
+	}
+	return ret;
+}
+
+
+// Node 1 measures its link to node 0, then fails over to and bonds with a second path. Both nodes have bonding enabled.
+static int peermgtLinkTestsuiteRun(struct s_peermgt_nettest *nettest) {
+	const int reportsize = 1024;
+	char report[reportsize + 1];
+	struct s_peermgt *mgt = &nettest->peermgts[1];
+	struct s_peeraddr addr;
+	struct s_peeraddr altaddr;
+	const struct s_peeraddr *sel;
+	int tnow;
+	int peerid;
+	int loss;
+	int lines;
+	int count[2];
+	int path[2];
+	int rx;
+	int r;
+	int i;
+
+	if(!peermgtNetTestsuiteConnect(nettest)) return 0;
+	if(!peermgtNetTestsuiteRouteAll(nettest)) return 0;
+	peerid = peermgtGetID(mgt, &nettest->nk[0].nodeid);
+	peermgtTestsuiteGetAddr(&addr, 0);
+	peermgtTestsuiteGetAddr(&altaddr, peermgtNetTestsuite_NODECOUNT);
+	tnow = utilGetClock();
+
+	// the first probe is sent when the session starts
+	if((peermgtGetRTT(mgt, peerid) < 0) || (peermgtGetRTT(mgt, peerid) > 1000000)) return 0;
+	if(peermgtGetJitter(mgt, peerid) < 0) return 0;
+	if(peermgtGetLoss(mgt, peerid) != 0) return 0;
+	if(!(mgt->data[peerid].lastrttprobe > (tnow - peermgt_RTT_INTERVAL))) return 0;
+
+	// a probe without a pong counts as lost when the next one is sent
+	loss = peermgtGetLoss(mgt, peerid);
+	loss = ((((loss * 7) + peermgt_RTT_PPM) / 8) * 7) / 8;
+	for(r=0; r<2; r++) {
+		nettest->down = ((r == 0) ? 0 : -1);
+		mgt->data[peerid].lastrttprobe = (tnow - peermgt_RTT_INTERVAL);
+		timerSetEarlier(&mgt->timer, peerid, tnow);
+		if(!peermgtNetTestsuiteRouteAll(nettest)) return 0;
+	}
+	if(peermgtGetLoss(mgt, peerid) != loss) return 0;
+	if(mgt->data[peerid].rttprobe != 0) return 0;
+
+	// the round trip time is smoothed, the jitter is the mean deviation
+	mgt->data[peerid].rtt = -1;
+	peermgtAddRTTSample(mgt, peerid, 1000);
+	if((peermgtGetRTT(mgt, peerid) != 1000) || (peermgtGetJitter(mgt, peerid) != 500)) return 0;
+	peermgtAddRTTSample(mgt, peerid, 2000);
+	if((peermgtGetRTT(mgt, peerid) != 1125) || (peermgtGetJitter(mgt, peerid) != 625)) return 0;
+	peermgtAddLossSample(mgt, peerid, 0);
+	if(peermgtGetLoss(mgt, peerid) != ((loss * 7) / 8)) return 0;
+
+	// the status report only contains whole rows and is never written past its end
+	for(r=0; r<reportsize; r++) {
+		memset(report, 'x', (reportsize + 1));
+		peermgtStatus(mgt, report, r);
+		for(i=r; i<(reportsize + 1); i++) {
+			if(report[i] != 'x') return 0;
+		}
+		if(r > 0) {
+			if(memchr(report, '\0', r) == NULL) return 0;
+			i = strlen(report);
+			if((i > 0) && (report[(i - 1)] != '\n')) return 0;
+		}
+	}
+	lines = 0;
+	for(i=0; report[i] != '\0'; i++) {
+		if(report[i] == '\n') lines++;
+	}
+	if(lines < 3) return 0;
+
+	// a second address is probed and kept as backup
+	if(peermgtAddPath(mgt, peerid, &altaddr, tnow) < 0) return 0;
+	if(!peermgtNetTestsuiteRouteAll(nettest)) return 0;
+	path[0] = peermgtFindPath(mgt, peerid, &addr);
+	path[1] = peermgtFindPath(mgt, peerid, &altaddr);
+	if((path[0] < 0) || (path[1] < 0)) return 0;
+	for(i=0; i<2; i++) {
+		if((mgt->data[peerid].path[path[i]].rtt < 0) || (mgt->data[peerid].path[path[i]].lost != 0)) return 0;
+	}
+	if(memcmp(mgt->data[peerid].remoteaddr.addr, addr.addr, peeraddr_SIZE) != 0) return 0;
+
+	// the peer is moved to the backup path after PATH_LOST_MAX lost probes
+	nettest->down = 0;
+	for(r=0; r<=peermgt_PATH_LOST_MAX; r++) {
+		if(memcmp(mgt->data[peerid].remoteaddr.addr, addr.addr, peeraddr_SIZE) != 0) return 0;
+		mgt->data[peerid].lastpathprobe = (tnow - peermgt_PATH_PROBE_INTERVAL);
+		timerSetEarlier(&mgt->timer, peerid, tnow);
+		if(!peermgtNetTestsuiteRouteAll(nettest)) return 0;
+	}
+	if(memcmp(mgt->data[peerid].remoteaddr.addr, altaddr.addr, peeraddr_SIZE) != 0) return 0;
+	rx = nettest->rxcount[0];
+	if(!peermgtNetTestsuiteSend(nettest, 1, 0, 0x50, 100)) return 0;
+	if(!peermgtNetTestsuiteRouteAll(nettest)) return 0;
+	if((nettest->rxcount[0] != (rx + 1)) || (nettest->rxtag[0][rx] != 0x50)) return 0;
+	nettest->down = -1;
+
+	// user data is striped across both paths by their round trip times
+	for(r=0; r<3; r++) {
+		for(i=0; i<2; i++) {
+			mgt->data[peerid].path[path[i]].rtt = ((i == 0) ? 1000 : ((r == 0) ? 1000 : ((r == 1) ? 4000 : 10000)));
+			mgt->data[peerid].path[path[i]].lost = 0;
+			mgt->data[peerid].pathcredit[path[i]] = 0;
+			count[i] = 0;
+		}
+		for(i=0; i<24; i++) {
+			sel = peermgtGetDataAddr(mgt, peerid);
+			if(sel == &mgt->data[peerid].path[path[0]].addr) count[0]++;
+			if(sel == &mgt->data[peerid].path[path[1]].addr) count[1]++;
+		}
+		if((r == 0) && ((count[0] != 12) || (count[1] != 12))) return 0;
+		if((r == 1) && ((count[0] != 16) || (count[1] != 8))) return 0;
+		if((r == 2) && ((count[0] != 24) || (count[1] != 0))) return 0;
+	}
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int peermgtLinkTestsuite() {
+	const int flags[peermgtNetTestsuite_NODECOUNT] = { (peermgt_FLAG_USERDATA | peermgt_FLAG_BONDING), (peermgt_FLAG_USERDATA | peermgt_FLAG_BONDING), peermgt_FLAG_USERDATA };
+	int ret = 0;
+	struct s_peermgt_nettest *nettest;
+	nettest = malloc(sizeof(struct s_peermgt_nettest));
+	if(nettest != NULL) {
+		if(peermgtNetTestsuiteCreate(nettest, flags)) {
+			ret = peermgtLinkTestsuiteRun(nettest);
+			peermgtNetTestsuiteDestroy(nettest);
+		}
+		free(nettest);
+	}
+	return ret;
+}
+
+
+// Drive the auth sessions between node 1 and node 0. Returns the number of auth packets node 1 has sent since start until its session was up, or 0 if the session did not come up on both sides.
+// Afterwards all remaining packets are delivered, so that the next count starts from an idle network.
+static int peermgtResumeTestsuiteWait(struct s_peermgt_nettest *nettest, const int start) {
+	int count = 0;
+	int sent;
+	int ret;
+	int r;
+	int i;
+	for(r=0; r<5000; r++) {
+		sent = 0;
+		for(i=0; i<2; i++) {
+			dhRefresh(&nettest->dhstate[i], utilGetClockUS());
+			ret = peermgtNetTestsuiteForward(nettest, i);
+			if(ret < 0) return 0;
+			if(ret > 0) sent = 1;
+			if((count == 0) && peermgtNetTestsuiteIsConnected(nettest, 1, 0)) count = (nettest->authpackets[1] - start);
+		}
+		if((count > 0) && peermgtNetTestsuiteIsConnected(nettest, 0, 1)) {
+			if(!peermgtNetTestsuiteRouteAll(nettest)) return 0; // deliver the remaining auth messages
+			return count;
+		}
+		if(!sent) usleep(1000);
+	}
+	return 0;
+}
+
+
+// Drop the session between node 1 and node 0 on both sides.
+static void peermgtResumeTestsuiteDisconnect(struct s_peermgt_nettest *nettest) {
+	peermgtDelete(&nettest->peermgts[0], &nettest->nk[1].nodeid);
+	peermgtDelete(&nettest->peermgts[1], &nettest->nk[0].nodeid);
+}
+
+
+// Check that a session resumption attempt of node 1 was rejected by node 0, then let node 1 resend, which falls back to the full handshake.
+static int peermgtResumeTestsuiteFallback(struct s_peermgt_nettest *nettest) {
+	struct s_authmgt *authmgt = &nettest->peermgts[1].authmgt;
+	struct s_peeraddr addr;
+	int authstateid;
+	if(!peermgtNetTestsuiteRouteAll(nettest)) return 0;
+	if(peermgtGetID(&nettest->peermgts[0], &nettest->nk[1].nodeid) >= 0) return 0;
+	if(peermgtGetID(&nettest->peermgts[1], &nettest->nk[0].nodeid) >= 0) return 0;
+	peermgtTestsuiteGetAddr(&addr, 0);
+	authstateid = authmgtFindAddr(authmgt, &addr);
+	if(authstateid < 0) return 0;
+	if(authmgt->authstate[authstateid].state != auth_R0a) return 0;
+	authmgt->lastsend[authstateid] = (utilGetClock() - authmgt_RESEND_TIMEOUT - 1);
+	authmgtSchedule(authmgt, authstateid);
+	return (peermgtResumeTestsuiteWait(nettest, nettest->authpackets[1]) > 0);
+}
+
+
+// Node 1 reconnects to node 0 with full handshakes, resumed sessions and fast handshakes. The number of auth packets node 1 needs is checked.
+static int peermgtResumeTestsuiteRun(struct s_peermgt_nettest *nettest) {
+	struct s_peermgt *mgt = nettest->peermgts;
+	struct s_resume_ticket ticket;
+	struct s_resume_ticket oldticket;
+	struct s_resume_ticket *stored;
+	struct s_nodeid nodeid;
+	struct s_peeraddr addr;
+	int full;
+	int rx;
+	int i;
+
+	for(i=0; i<peermgtNetTestsuite_NODECOUNT; i++) {
+		peermgtSetResumeTimeout(&mgt[i], 600);
+	}
+	peermgtTestsuiteGetAddr(&addr, 0);
+
+	// the full handshake stores a ticket on both sides
+	if(!peermgtConnect(&mgt[1], &addr)) return 0;
+	full = peermgtResumeTestsuiteWait(nettest, nettest->authpackets[1]);
+	if(!(full > 2)) return 0;
+	if(!resumeGet(&mgt[1].resume, &nettest->nk[0].nodeid, &oldticket)) return 0;
+	if(!resumeFind(&mgt[0].resume, oldticket.id, &nodeid, &ticket)) return 0;
+	if(memcmp(nodeid.id, nettest->nk[1].nodeid.id, nodeid_SIZE) != 0) return 0;
+
+	// a reconnect resumes the session after one round trip, the ticket is replaced
+	peermgtResumeTestsuiteDisconnect(nettest);
+	if(!peermgtConnectNode(&mgt[1], &nettest->nk[0].nodeid, &addr)) return 0;
+	if(peermgtResumeTestsuiteWait(nettest, nettest->authpackets[1]) != 1) return 0;
+	for(i=0; i<2; i++) {
+		rx = nettest->rxcount[i];
+		if(!peermgtNetTestsuiteSend(nettest, (1 - i), i, (0x60 + i), 100)) return 0;
+		if(!peermgtNetTestsuiteRouteAll(nettest)) return 0;
+		if((nettest->rxcount[i] != (rx + 1)) || (nettest->rxtag[i][rx] != (0x60 + i))) return 0;
+	}
+	if(resumeFind(&mgt[0].resume, oldticket.id, &nodeid, &ticket)) return 0;
+	if(!resumeGet(&mgt[1].resume, &nettest->nk[0].nodeid, &ticket)) return 0;
+	if(memcmp(ticket.id, oldticket.id, resume_IDSIZE) == 0) return 0;
+
+	// a used ticket is rejected, node 1 falls back to the full handshake
+	peermgtResumeTestsuiteDisconnect(nettest);
+	if(!authmgtStartResume(&mgt[1].authmgt, &addr, &nettest->nk[0].nodeid, &oldticket)) return 0;
+	if(!peermgtResumeTestsuiteFallback(nettest)) return 0;
+
+	// a forged ticket is rejected and does not invalidate the real one
+	peermgtResumeTestsuiteDisconnect(nettest);
+	if(!resumeGet(&mgt[1].resume, &nettest->nk[0].nodeid, &ticket)) return 0;
+	oldticket = ticket;
+	oldticket.secret[0] ^= 0x01;
+	if(!authmgtStartResume(&mgt[1].authmgt, &addr, &nettest->nk[0].nodeid, &oldticket)) return 0;
+	if(!peermgtNetTestsuiteRouteAll(nettest)) return 0;
+	if(peermgtNetTestsuiteIsConnected(nettest, 1, 0) || (peermgtGetID(&mgt[0], &nettest->nk[1].nodeid) >= 0)) return 0;
+	if(!resumeFind(&mgt[0].resume, ticket.id, &nodeid, &oldticket)) return 0;
+	authmgtDelete(&mgt[1].authmgt, authmgtFindAddr(&mgt[1].authmgt, &addr));
+	if(!peermgtConnectNode(&mgt[1], &nettest->nk[0].nodeid, &addr)) return 0;
+	if(peermgtResumeTestsuiteWait(nettest, nettest->authpackets[1]) != 1) return 0;
+
+	// a ticket outside of the resumption window is rejected and deleted
+	peermgtResumeTestsuiteDisconnect(nettest);
+	stored = mapGet(&mgt[0].resume.nodemap, nettest->nk[1].nodeid.id);
+	if(stored == NULL) return 0;
+	stored->lastused = (utilGetClock() - 601);
+	if(!peermgtConnectNode(&mgt[1], &nettest->nk[0].nodeid, &addr)) return 0;
+	if(!peermgtResumeTestsuiteFallback(nettest)) return 0;
+	if(resumeFind(&mgt[0].resume, ticket.id, &nodeid, &oldticket)) return 0;
+
+	// the fast handshake needs two round trips
+	peermgtResumeTestsuiteDisconnect(nettest);
+	for(i=0; i<2; i++) {
+		peermgtSetFastHandshake(&mgt[i], 1);
+	}
+	if(!peermgtConnect(&mgt[1], &addr)) return 0;
+	if(peermgtResumeTestsuiteWait(nettest, nettest->authpackets[1]) != 2) return 0;
+
+	// the fast handshake also stores a ticket
+	peermgtResumeTestsuiteDisconnect(nettest);
+	if(!peermgtConnectNode(&mgt[1], &nettest->nk[0].nodeid, &addr)) return 0;
+	if(peermgtResumeTestsuiteWait(nettest, nettest->authpackets[1]) != 1) return 0;
+
+	// a responder without the fast handshake makes the initiator continue with the full handshake, no extra round trip is needed
+	peermgtResumeTestsuiteDisconnect(nettest);
+	peermgtSetFastHandshake(&mgt[0], 0);
+	if(!peermgtConnect(&mgt[1], &addr)) return 0;
+	if(peermgtResumeTestsuiteWait(nettest, nettest->authpackets[1]) != full) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int peermgtResumeTestsuite() {
+	const int flags[peermgtNetTestsuite_NODECOUNT] = { (peermgt_FLAG_USERDATA | peermgt_FLAG_RESUME), (peermgt_FLAG_USERDATA | peermgt_FLAG_RESUME), peermgt_FLAG_USERDATA };
+	int ret = 0;
+	struct s_peermgt_nettest *nettest;
+	nettest = malloc(sizeof(struct s_peermgt_nettest));
+	if(nettest != NULL) {
+		if(peermgtNetTestsuiteCreate(nettest, flags)) {
+			ret = peermgtResumeTestsuiteRun(nettest);
+			peermgtNetTestsuiteDestroy(nettest);
+		}
+		free(nettest);
+	}
+	return ret;
+}
+
+
 #endif // F_PEERMGT_TEST_C
@@ -0,0 +1,177 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_RESUME_C
+#define F_RESUME_C
+
+
+#include "map.c"
+#include "nodeid.c"
+#include "util.c"
+
+
+// Size of resumption ticket ID and secret in bytes.
+#define resume_IDSIZE 16
+#define resume_SECRETSIZE 32
+
+
+// The resumption ticket structure.
+struct s_resume_ticket {
+	unsigned char id[resume_IDSIZE];
+	unsigned char secret[resume_SECRETSIZE];
+	int lastused;
+};
+
+
+// The resumption ticket cache structure.
+struct s_resume {
+	struct s_map nodemap; // NodeID -> ticket
+	struct s_map idmap; // ticket ID -> NodeID
+	int timeout;
+};
+
+
+// Clear all tickets.
+static void resumeInit(struct s_resume *resume) {
+	mapInit(&resume->nodemap);
+	mapInit(&resume->idmap);
+	mapEnableReplaceOld(&resume->nodemap);
+	mapEnableReplaceOld(&resume->idmap);
+}
+
+
+// Set the resumption window in seconds. A timeout of 0 disables session resumption.
+static void resumeSetTimeout(struct s_resume *resume, const int timeout) {
+	if(timeout > 0) {
+		resume->timeout = timeout;
+	}
+	else {
+		resume->timeout = 0;
+	}
+}
+
+
+// Returns 1 if ticket is still inside the resumption window.
+static int resumeIsValid(struct s_resume *resume, const struct s_resume_ticket *ticket) {
+	return ((resume->timeout > 0) && ((utilGetClock() - ticket->lastused) < resume->timeout));
+}
+
+
+// Delete the ticket of a NodeID.
+static void resumeDelete(struct s_resume *resume, const struct s_nodeid *nodeid) {
+	struct s_resume_ticket *ticket = mapGet(&resume->nodemap, nodeid->id);
+	if(ticket != NULL) {
+		mapRemove(&resume->idmap, ticket->id);
+		mapRemove(&resume->nodemap, nodeid->id);
+	}
+}
+
+
+// Store a ticket for a NodeID. An existing ticket of the NodeID is replaced.
+static void resumeSet(struct s_resume *resume, const struct s_nodeid *nodeid, const unsigned char *ticketid, const unsigned char *secret) {
+	struct s_resume_ticket ticket;
+	if(resume->timeout > 0) {
+		resumeDelete(resume, nodeid);
+		memcpy(ticket.id, ticketid, resume_IDSIZE);
+		memcpy(ticket.secret, secret, resume_SECRETSIZE);
+		ticket.lastused = utilGetClock();
+		if(mapSet(&resume->nodemap, nodeid->id, &ticket)) {
+			mapSet(&resume->idmap, ticket.id, nodeid->id);
+		}
+	}
+}
+
+
+// Restart the resumption window of a NodeID's ticket, e.g. when its session ends.
+static void resumeTouch(struct s_resume *resume, const struct s_nodeid *nodeid) {
+	struct s_resume_ticket *ticket = mapGet(&resume->nodemap, nodeid->id);
+	if(ticket != NULL) {
+		ticket->lastused = utilGetClock();
+	}
+}
+
+
+// Get the ticket of a NodeID. Returns 1 if a valid ticket is found.
+static int resumeGet(struct s_resume *resume, const struct s_nodeid *nodeid, struct s_resume_ticket *ticket) {
+	struct s_resume_ticket *stored = mapGet(&resume->nodemap, nodeid->id);
+	if(stored != NULL) {
+		if(resumeIsValid(resume, stored)) {
+			*ticket = *stored;
+			return 1;
+		}
+		resumeDelete(resume, nodeid);
+	}
+	return 0;
+}
+
+
+// Look up a ticket by its ID. Returns 1 if a valid ticket is found.
+static int resumeFind(struct s_resume *resume, const unsigned char *ticketid, struct s_nodeid *nodeid, struct s_resume_ticket *ticket) {
+	unsigned char *stored_nodeid = mapGet(&resume->idmap, ticketid);
+	struct s_resume_ticket *stored;
+	if(stored_nodeid != NULL) {
+		memcpy(nodeid->id, stored_nodeid, nodeid_SIZE);
+		stored = mapGet(&resume->nodemap, nodeid->id);
+		if((stored != NULL) && (memcmp(stored->id, ticketid, resume_IDSIZE) == 0)) {
+			if(resumeIsValid(resume, stored)) {
+				*ticket = *stored;
+				return 1;
+			}
+			resumeDelete(resume, nodeid);
+		}
+		else {
+			// stale entry, the NodeID has a newer ticket or none at all
+			mapRemove(&resume->idmap, ticketid);
+		}
+	}
+	return 0;
+}
+
+
+// Create ticket cache.
+static int resumeCreate(struct s_resume *resume, const int size) {
+	if(size > 0) {
+		if(mapCreate(&resume->nodemap, size, nodeid_SIZE, sizeof(struct s_resume_ticket))) {
+			if(mapCreate(&resume->idmap, size, resume_IDSIZE, nodeid_SIZE)) {
+				resume->timeout = 0;
+				resumeInit(resume);
+				return 1;
+			}
+			mapDestroy(&resume->nodemap);
+		}
+	}
+	return 0;
+}
+
+
+// Increase the size of the ticket cache.
+static int resumeResize(struct s_resume *resume, const int size) {
+	return (mapResize(&resume->nodemap, size) && mapResize(&resume->idmap, size));
+}
+
+
+// Destroy ticket cache.
+static void resumeDestroy(struct s_resume *resume) {
+	resumeInit(resume);
+	mapDestroy(&resume->idmap);
+	mapDestroy(&resume->nodemap);
+}
+
+
+#endif // F_RESUME_C
@@ -222,6 +222,33 @@ static int rsaLoadPrivatePEM(struct s_rsa *rsa, unsigned char *privkey, const in
 }
 
 
+// Get PEM encoded private key. Returns length if successful.
+static int rsaGetPrivatePEM(unsigned char *buf, const int buf_size, const struct s_rsa *rsa) {
+	BIO *biopriv;
+	char *pem;
+	long len;
+	int ret;
+	if((rsa->isvalid) && (rsa->isprivate)) {
+		ret = 0;
+		biopriv = BIO_new(BIO_s_mem());
+		if(biopriv != NULL) {
+			if(PEM_write_bio_PrivateKey(biopriv, rsa->key, NULL, NULL, 0, NULL, NULL)) {
+				len = BIO_get_mem_data(biopriv, &pem);
+				if((len > 0) && (len < buf_size)) {
+					memcpy(buf, pem, len);
+					ret = len;
+				}
+			}
+			BIO_free(biopriv);
+		}
+		return ret;
+	}
+	else {
+		return 0;
+	}
+}
+
+
 // Return maximum size of a signature.
 static int rsaSignSize(const struct s_rsa *rsa) {
 	return EVP_PKEY_size(rsa->key);
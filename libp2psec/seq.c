@@ -22,64 +22,146 @@
 
 
 #include <stdint.h>
+#include <string.h>
 
 
 // Size of sequence number in bytes.
 #define seq_SIZE 8
 
 
-// Window size.
+// Maximum distance to the highest received sequence number that is accepted.
 #define seq_WINDOWSIZE 16384
 
 
+// Replay window size in bits. Sequence numbers that arrive out of order are accepted as long as they are within the replay window.
+#define seq_REPLAYWINDOW_MIN 64
+#define seq_REPLAYWINDOW_MAX 8192
+#define seq_REPLAYWINDOW_DEFAULT 1024
+
+
 // The sequence number state structure.
+// The replay window is a ring of bits, sequence number s is stored at bit (s mod window). It covers the sequence numbers from start+1 to start+window.
+// The memory of the ring is provided by the owner of the state, see seqMaskWords.
 struct s_seq_state {
 	int64_t start;
-	uint64_t mask;
+	int window;
+	uint64_t *mask;
 };
 
 
 // Get sequence number state.
 static int64_t seqGet(struct s_seq_state *state) {
-	return state->start;
+	return (state->start + state->window);
+}
+
+
+// Return a valid replay window size in bits. The size is rounded up to a power of 2.
+static int seqWindowSize(const int window) {
+	int w = seq_REPLAYWINDOW_MIN;
+	while((w < window) && (w < seq_REPLAYWINDOW_MAX)) w = (w * 2);
+	return w;
+}
+
+
+// Return the number of 64 bit words that are needed to store a replay window.
+static int seqMaskWords(const int window) {
+	return (seqWindowSize(window) / 64);
+}
+
+
+// Set the replay window size in bits and the memory that stores it. The mask has to hold seqMaskWords(window) words.
+static void seqSetWindow(struct s_seq_state *state, uint64_t *mask, const int window) {
+	state->window = seqWindowSize(window);
+	state->mask = mask;
 }
 
 
-// Initialize sequence number state.
+// Initialize sequence number state. Sequence numbers up to seq are marked as received.
 static void seqInit(struct s_seq_state *state, const int64_t seq) {
-	state->start = seq;
-	state->mask = 0;
+	state->start = (seq - state->window);
+	memset(state->mask, 0xFF, (state->window / 8));
 }
 
 
-// Verify sequence number. Returns 1 if accepted, else 0.
-static int seqVerify(struct s_seq_state *state, const int64_t seq) {
+// Return bit position of a sequence number in the replay window.
+static int seqPos(const struct s_seq_state *state, const int64_t seq) {
+	return (int)((uint64_t)seq & (uint64_t)(state->window - 1));
+}
+
+
+// Check if a sequence number is marked as received.
+static int seqIsSet(const struct s_seq_state *state, const int64_t seq) {
 	const uint_least64_t one = 1;
-	int64_t start = state->start;
-	int64_t seqdiff = (seq - start);
-	uint64_t mask = state->mask;
-	uint64_t vmask;
-	if((seqdiff > 0) && (seqdiff < seq_WINDOWSIZE)) {
-		// move the window
-		if(seqdiff > 64) {
-			seqdiff = (seqdiff - 64);
-			start = (start + seqdiff);
-			if(seqdiff > 64) {
-				mask = 0;
+	int pos = seqPos(state, seq);
+	return ((state->mask[(pos / 64)] & (one << (pos % 64))) != 0);
+}
+
+
+// Move the replay window forward by count sequence numbers. The bits of the sequence numbers that leave the window are cleared word by word.
+static void seqMove(struct s_seq_state *state, const int64_t count) {
+	const uint_least64_t one = 1;
+	int64_t seq = (state->start + 1);
+	int64_t n = count;
+	int pos;
+	int bits;
+	if(n < state->window) {
+		while(n > 0) {
+			pos = seqPos(state, seq);
+			bits = (64 - (pos % 64));
+			if(bits > n) bits = n;
+			if(bits < 64) {
+				state->mask[(pos / 64)] &= (~(((one << bits) - 1) << (pos % 64)));
 			}
 			else {
-				mask = (mask << seqdiff);
+				state->mask[(pos / 64)] = 0;
 			}
-			seqdiff = 64;
+			seq = (seq + bits);
+			n = (n - bits);
+		}
+	}
+	else {
+		memset(state->mask, 0, (state->window / 8));
+	}
+	state->start = (state->start + count);
+}
+
+
+// Check sequence number without updating the state. Returns 1 if seqVerify would accept it, else 0.
+static int seqCheck(const struct s_seq_state *state, const int64_t seq) {
+	int64_t seqdiff = (seq - state->start);
+	if((seqdiff > 0) && (seqdiff < (state->window + seq_WINDOWSIZE))) {
+		if(seqdiff > state->window) {
+			// window would be moved
+			return 1;
+		}
+		else {
+			// check for duplicates
+			return (!seqIsSet(state, seq));
+		}
+	}
+	else {
+		// out of window
+		return 0;
+	}
+}
+
+
+// Verify sequence number. Returns 1 if accepted, else 0.
+static int seqVerify(struct s_seq_state *state, const int64_t seq) {
+	const uint_least64_t one = 1;
+	int64_t seqdiff = (seq - state->start);
+	int pos;
+	if((seqdiff > 0) && (seqdiff < (state->window + seq_WINDOWSIZE))) {
+		// move the window
+		if(seqdiff > state->window) {
+			seqMove(state, (seqdiff - state->window));
 		}
 
 		// check for duplicates
-		vmask = (one << (64 - seqdiff));
-		if((vmask & mask) == 0) {
+		if(!seqIsSet(state, seq)) {
 			// sequence number is accepted
-			mask = (mask | vmask);
-			state->start = start;
-			state->mask = mask;
+			pos = seqPos(state, seq);
+			state->mask[(pos / 64)] |= (one << (pos % 64));
 			return 1;
 		}
 		else {
@@ -114,9 +196,14 @@ static int seqRQ(struct s_seq_state *state) {
 		3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 
 		4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8
 	};
-	const unsigned char *bytes = (unsigned char *)&state->mask;
+	int pos = seqPos(state, (seqGet(state) - 63));
+	int word = (pos / 64);
+	int bit = (pos % 64);
+	uint64_t last = (state->mask[word] >> bit);
+	const unsigned char *bytes = (unsigned char *)&last;
 	int c = 0;
 	int i;
+	if(bit > 0) last = (last | (state->mask[((word + 1) % (state->window / 64))] << (64 - bit)));
 	for(i=0; i<(sizeof(uint64_t)); i++) {
 		c = c + bitc[bytes[i]];
 	}
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_SEQ_TEST_C
+#define F_SEQ_TEST_C
+
+
+#include "seq.c"
+#include <stdio.h>
+
+
+#define seqTestsuite_GUARD 4
+
+
+// Check a replay window of the specified size. The words after the mask must not be touched.
+static int seqTestsuiteWindow(const int window) {
+	const int words = seqMaskWords(window);
+	uint64_t mask[((seq_REPLAYWINDOW_MAX / 64) + seqTestsuite_GUARD)];
+	struct s_seq_state state;
+	int64_t highest;
+	int64_t seq;
+	int i;
+
+	memset(mask, 0xA5, sizeof(mask));
+	seqSetWindow(&state, mask, window);
+	if(state.window != (words * 64)) return 0;
+	seqInit(&state, 1000);
+	if(seqGet(&state) != 1000) return 0;
+
+	// old sequence numbers are rejected
+	if(seqVerify(&state, 1000)) return 0;
+	if(seqVerify(&state, (1000 - state.window))) return 0;
+
+	// every sequence number is accepted once while the ring wraps around several times
+	for(seq=1001; seq<=(1000 + (3 * state.window)); seq++) {
+		if(!seqCheck(&state, seq)) return 0;
+		if(!seqVerify(&state, seq)) return 0;
+		if(seqVerify(&state, seq)) return 0;
+	}
+	highest = seqGet(&state);
+	if(highest != (1000 + (3 * state.window))) return 0;
+	if(seqRQ(&state) != 64) return 0;
+
+	// out of order sequence numbers are accepted up to the edge of the window
+	seq = (highest + state.window);
+	if(!seqVerify(&state, seq)) return 0;
+	highest = seq;
+	if(seqGet(&state) != highest) return 0;
+	if(seqCheck(&state, (highest - state.window))) return 0;
+	if(seqVerify(&state, (highest - state.window))) return 0;
+	if(!seqCheck(&state, (highest - state.window + 1))) return 0;
+	if(!seqVerify(&state, (highest - state.window + 1))) return 0;
+	if(seqVerify(&state, (highest - state.window + 1))) return 0;
+	for(i=1; i<state.window; i++) {
+		if(seqCheck(&state, (highest - i)) != (i != (state.window - 1))) return 0;
+	}
+	if(seqRQ(&state) != ((state.window > 64) ? 1 : 2)) return 0;
+
+	// sequence numbers too far ahead are rejected
+	if(seqCheck(&state, (highest + seq_WINDOWSIZE))) return 0;
+	if(seqVerify(&state, (highest + seq_WINDOWSIZE))) return 0;
+	if(!seqVerify(&state, (highest + seq_WINDOWSIZE - 1))) return 0;
+	highest = (highest + seq_WINDOWSIZE - 1);
+	if(seqGet(&state) != highest) return 0;
+	for(i=1; i<state.window; i++) {
+		if(!seqCheck(&state, (highest - i))) return 0;
+	}
+
+	// the memory after the mask is untouched
+	for(i=words; i<((seq_REPLAYWINDOW_MAX / 64) + seqTestsuite_GUARD); i++) {
+		if(mask[i] != 0xA5A5A5A5A5A5A5A5ULL) return 0;
+	}
+
+	return 1;
+}
+
+
+static int seqTestsuite() {
+	if(seqWindowSize(1) != seq_REPLAYWINDOW_MIN) return 0;
+	if(seqWindowSize(1000) != 1024) return 0;
+	if(seqWindowSize(1000000) != seq_REPLAYWINDOW_MAX) return 0;
+	if(!seqTestsuiteWindow(seq_REPLAYWINDOW_MIN)) return 0;
+	if(!seqTestsuiteWindow(seq_REPLAYWINDOW_DEFAULT)) return 0;
+	if(!seqTestsuiteWindow(seq_REPLAYWINDOW_MAX)) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+#endif // F_SEQ_TEST_C
@@ -0,0 +1,101 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_TBF_C
+#define F_TBF_C
+
+
+#include <stdint.h>
+
+
+// Token bucket settings. Tokens are counted in millionths of a byte, so that a rate in bytes per second adds rate tokens per microsecond.
+#define tbf_SCALE 1000000
+#define tbf_MAX_ELAPSED 1000000
+
+
+// The token bucket structure. A bucket with a rate of 0 is disabled.
+// Sending is allowed as long as the bucket is not empty, the last packet may take the bucket below zero.
+struct s_tbf {
+	int64_t rate;
+	int64_t burst;
+	int64_t tokens;
+	int64_t last;
+};
+
+
+// Add the tokens of the time elapsed since the last update.
+static void tbfUpdate(struct s_tbf *tbf, const int64_t now) {
+	int64_t elapsed = (now - tbf->last);
+	if(elapsed > tbf_MAX_ELAPSED) elapsed = tbf_MAX_ELAPSED;
+	if(elapsed > 0) {
+		tbf->tokens = (tbf->tokens + (elapsed * tbf->rate));
+		if(tbf->tokens > tbf->burst) tbf->tokens = tbf->burst;
+	}
+	tbf->last = now;
+}
+
+
+// Return 1 if the bucket is enabled.
+static int tbfIsEnabled(struct s_tbf *tbf) {
+	return (tbf->rate > 0);
+}
+
+
+// Set rate in bytes per second and bucket size in bytes. A rate of 0 disables the bucket.
+static void tbfSetRate(struct s_tbf *tbf, const int64_t rate, const int64_t burst, const int64_t now) {
+	if(tbf->rate > 0) {
+		tbfUpdate(tbf, now);
+	}
+	else {
+		tbf->tokens = (burst * tbf_SCALE);
+		tbf->last = now;
+	}
+	tbf->rate = ((rate > 0) ? rate : 0);
+	tbf->burst = (burst * tbf_SCALE);
+	if(tbf->tokens > tbf->burst) tbf->tokens = tbf->burst;
+}
+
+
+// Take len bytes from the bucket.
+static void tbfConsume(struct s_tbf *tbf, const int len, const int64_t now) {
+	if(!(tbf->rate > 0)) return;
+	tbfUpdate(tbf, now);
+	tbf->tokens = (tbf->tokens - ((int64_t)len * tbf_SCALE));
+}
+
+
+// Return the amount of microseconds until the bucket is not empty anymore.
+static int tbfGetDelay(struct s_tbf *tbf, const int64_t now) {
+	if(!(tbf->rate > 0)) return 0;
+	tbfUpdate(tbf, now);
+	if(!(tbf->tokens < 0)) return 0;
+	return (int)(((-tbf->tokens) + tbf->rate - 1) / tbf->rate);
+}
+
+
+// Disable the bucket.
+static void tbfReset(struct s_tbf *tbf) {
+	tbf->rate = 0;
+	tbf->burst = 0;
+	tbf->tokens = 0;
+	tbf->last = 0;
+}
+
+
+#endif // F_TBF_C
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_TBF_TEST_C
+#define F_TBF_TEST_C
+
+
+#include "tbf.c"
+#include <stdio.h>
+
+
+#define tbfTestsuite_RATE 1000
+#define tbfTestsuite_BURST 500
+#define tbfTestsuite_PKTSIZE 100
+#define tbfTestsuite_DURATION 10000000
+
+
+// Check the delay after the bucket has been emptied. One byte at tbfTestsuite_RATE bytes per second takes 1000 microseconds.
+static int tbfTestsuiteDelay(struct s_tbf *tbf, const int64_t start) {
+	tbfConsume(tbf, tbfTestsuite_BURST, start);
+	if(tbfGetDelay(tbf, start) != 0) return 0; // an empty bucket still allows sending
+	tbfConsume(tbf, 1, start);
+	if(tbfGetDelay(tbf, start) != 1000) return 0;
+	if(tbfGetDelay(tbf, (start + 400)) != 600) return 0;
+	if(tbfGetDelay(tbf, (start + 1000)) != 0) return 0;
+	return 1;
+}
+
+
+// Send packets as fast as the bucket allows and count the bytes.
+static int64_t tbfTestsuiteSend(struct s_tbf *tbf, const int64_t start, const int64_t duration) {
+	int64_t bytes = 0;
+	int64_t now;
+	for(now=start; now<(start + duration); now+=100) {
+		while(tbfGetDelay(tbf, now) == 0) {
+			tbfConsume(tbf, tbfTestsuite_PKTSIZE, now);
+			bytes = (bytes + tbfTestsuite_PKTSIZE);
+		}
+	}
+	return bytes;
+}
+
+
+static int tbfTestsuite() {
+	struct s_tbf tbf;
+	int64_t bytes;
+
+	// disabled bucket
+	tbfReset(&tbf);
+	if(tbfIsEnabled(&tbf)) return 0;
+	tbfConsume(&tbf, 100000, 0);
+	if(tbfGetDelay(&tbf, 0) != 0) return 0;
+
+	// delay
+	tbfSetRate(&tbf, tbfTestsuite_RATE, tbfTestsuite_BURST, 0);
+	if(!tbfIsEnabled(&tbf)) return 0;
+	if(!tbfTestsuiteDelay(&tbf, 0)) return 0;
+
+	// burst, the bucket is not filled beyond its size after a long idle time
+	if(!tbfTestsuiteDelay(&tbf, 60000000)) return 0;
+
+	// rate, the burst plus the rate over the duration plus one packet that takes the bucket below zero
+	bytes = tbfTestsuiteSend(&tbf, 120000000, tbfTestsuite_DURATION);
+	if((bytes < ((tbfTestsuite_RATE * 10) + tbfTestsuite_BURST)) || (bytes > ((tbfTestsuite_RATE * 10) + tbfTestsuite_BURST + (2 * tbfTestsuite_PKTSIZE)))) return 0;
+
+	// changing the rate keeps the current tokens
+	tbfSetRate(&tbf, (tbfTestsuite_RATE * 2), tbfTestsuite_BURST, 130000000);
+	if(tbfGetDelay(&tbf, 130000000) > ((tbfTestsuite_PKTSIZE * 1000000) / (tbfTestsuite_RATE * 2))) return 0;
+	bytes = tbfTestsuiteSend(&tbf, 131000000, tbfTestsuite_DURATION);
+	if((bytes < (tbfTestsuite_RATE * 20)) || (bytes > ((tbfTestsuite_RATE * 20) + tbfTestsuite_BURST + (2 * tbfTestsuite_PKTSIZE)))) return 0;
+
+	// a rate of 0 disables the bucket
+	tbfSetRate(&tbf, 0, 0, 150000000);
+	if(tbfIsEnabled(&tbf)) return 0;
+	tbfConsume(&tbf, 100000, 150000000);
+	if(tbfGetDelay(&tbf, 150000000) != 0) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+#endif // F_TBF_TEST_C
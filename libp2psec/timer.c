@@ -0,0 +1,216 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_TIMER_C
+#define F_TIMER_C
+
+
+#include <stdlib.h>
+
+
+// Timer wheel settings. Time is counted in seconds. The first level has one slot per second, each slot of the second level covers a whole rotation of the first level.
+// Timers that are due later than timer_RANGE seconds are moved forward, they expire early and have to be set again.
+#define timer_L0_SIZE 256
+#define timer_L0_BITS 8
+#define timer_L1_SIZE 64
+#define timer_RANGE (timer_L0_SIZE * timer_L1_SIZE)
+#define timer_SLOT_EXPIRED (timer_L0_SIZE + timer_L1_SIZE)
+#define timer_SLOT_COUNT (timer_SLOT_EXPIRED + 1)
+
+
+// The timer entry structure.
+struct s_timer_entry {
+	int due;
+	int slot;
+	int next;
+	int prev;
+};
+
+
+// The timer wheel structure. Every ID can have one timer.
+struct s_timer {
+	struct s_timer_entry *entry;
+	int head[timer_SLOT_COUNT];
+	int count;
+	int now;
+};
+
+
+// Remove an ID from its slot.
+static void timerUnlink(struct s_timer *timer, const int id) {
+	struct s_timer_entry *entry = &timer->entry[id];
+	if(entry->slot < 0) return;
+	if(entry->prev < 0) {
+		timer->head[entry->slot] = entry->next;
+	}
+	else {
+		timer->entry[entry->prev].next = entry->next;
+	}
+	if(!(entry->next < 0)) timer->entry[entry->next].prev = entry->prev;
+	entry->slot = -1;
+}
+
+
+// Add an ID to a slot.
+static void timerLink(struct s_timer *timer, const int id, const int slot) {
+	struct s_timer_entry *entry = &timer->entry[id];
+	entry->slot = slot;
+	entry->prev = -1;
+	entry->next = timer->head[slot];
+	if(!(entry->next < 0)) timer->entry[entry->next].prev = id;
+	timer->head[slot] = id;
+}
+
+
+// Add an ID to the slot that matches its due time.
+static void timerPlace(struct s_timer *timer, const int id) {
+	struct s_timer_entry *entry = &timer->entry[id];
+	unsigned int now = timer->now;
+	unsigned int due;
+	if((entry->due - timer->now) <= 0) {
+		timerLink(timer, id, timer_SLOT_EXPIRED);
+	}
+	else if((entry->due - timer->now) < timer_L0_SIZE) {
+		due = entry->due;
+		timerLink(timer, id, (due % timer_L0_SIZE));
+	}
+	else {
+		due = entry->due;
+		if(((due >> timer_L0_BITS) - (now >> timer_L0_BITS)) >= timer_L1_SIZE) { // out of range
+			due = (((now >> timer_L0_BITS) + (timer_L1_SIZE - 1)) << timer_L0_BITS);
+			entry->due = due;
+		}
+		timerLink(timer, id, (timer_L0_SIZE + ((due >> timer_L0_BITS) % timer_L1_SIZE)));
+	}
+}
+
+
+// Move all IDs of a slot to the expired slot.
+static void timerExpireSlot(struct s_timer *timer, const int slot) {
+	int id;
+	while(!((id = timer->head[slot]) < 0)) {
+		timerUnlink(timer, id);
+		timerLink(timer, id, timer_SLOT_EXPIRED);
+	}
+}
+
+
+// Advance the timer wheel to the current time. All slots are expired if the clock jumps back or too far ahead.
+static void timerUpdate(struct s_timer *timer, const int now) {
+	unsigned int tick;
+	int id;
+	int i;
+	if(((now - timer->now) < 0) || ((now - timer->now) > timer_RANGE)) {
+		for(i=0; i<timer_SLOT_EXPIRED; i++) timerExpireSlot(timer, i);
+		timer->now = now;
+		return;
+	}
+	while(timer->now != now) {
+		timer->now++;
+		tick = timer->now;
+		if((tick % timer_L0_SIZE) == 0) { // cascade the next second level slot down to the first level
+			i = (timer_L0_SIZE + ((tick >> timer_L0_BITS) % timer_L1_SIZE));
+			while(!((id = timer->head[i]) < 0)) {
+				timerUnlink(timer, id);
+				timerPlace(timer, id);
+			}
+		}
+		timerExpireSlot(timer, (tick % timer_L0_SIZE));
+	}
+}
+
+
+// Set the due time of an ID.
+static void timerSet(struct s_timer *timer, const int id, const int due) {
+	timerUnlink(timer, id);
+	timer->entry[id].due = due;
+	timerPlace(timer, id);
+}
+
+
+// Set the due time of an ID if it is earlier than the current one.
+static void timerSetEarlier(struct s_timer *timer, const int id, const int due) {
+	if((timer->entry[id].slot < 0) || ((due - timer->entry[id].due) < 0)) timerSet(timer, id, due);
+}
+
+
+// Remove the timer of an ID.
+static void timerCancel(struct s_timer *timer, const int id) {
+	timerUnlink(timer, id);
+}
+
+
+// Returns an ID whose timer has expired and removes its timer, or -1 if there is none.
+static int timerGetNext(struct s_timer *timer, const int now) {
+	int id;
+	timerUpdate(timer, now);
+	id = timer->head[timer_SLOT_EXPIRED];
+	if(!(id < 0)) timerUnlink(timer, id);
+	return id;
+}
+
+
+// Remove all timers.
+static void timerReset(struct s_timer *timer, const int now) {
+	int i;
+	for(i=0; i<timer_SLOT_COUNT; i++) timer->head[i] = -1;
+	for(i=0; i<timer->count; i++) timer->entry[i].slot = -1;
+	timer->now = now;
+}
+
+
+// Create timer wheel for count IDs.
+static int timerCreate(struct s_timer *timer, const int count) {
+	struct s_timer_entry *entry_mem;
+	if(count > 0) {
+		entry_mem = malloc(sizeof(struct s_timer_entry) * count);
+		if(entry_mem != NULL) {
+			timer->entry = entry_mem;
+			timer->count = count;
+			timerReset(timer, 0);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+// Increase the number of IDs. New IDs have no timer.
+static int timerResize(struct s_timer *timer, const int count) {
+	struct s_timer_entry *entry_mem;
+	int i;
+	if(count < timer->count) return 0;
+	entry_mem = realloc(timer->entry, (sizeof(struct s_timer_entry) * count));
+	if(entry_mem == NULL) return 0;
+	for(i=timer->count; i<count; i++) {
+		entry_mem[i].slot = -1;
+	}
+	timer->entry = entry_mem;
+	timer->count = count;
+	return 1;
+}
+
+
+// Destroy timer wheel.
+static void timerDestroy(struct s_timer *timer) {
+	free(timer->entry);
+}
+
+
+#endif // F_TIMER_C
@@ -0,0 +1,156 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_TIMER_TEST_C
+#define F_TIMER_TEST_C
+
+
+#include "timer.c"
+#include <stdio.h>
+
+
+#define timerTestsuite_COUNT 16
+#define timerTestsuite_START 1000
+
+
+// Collect all IDs that expire at now. Every ID has to expire exactly once at its due time. Returns the number of expired IDs or -1 on error.
+static int timerTestsuiteCollect(struct s_timer *timer, const int now, const int *due, int *done) {
+	int count = 0;
+	int id;
+	while(!((id = timerGetNext(timer, now)) < 0)) {
+		if(!(id < timerTestsuite_COUNT)) return -1;
+		if(done[id]) return -1;
+		if(due[id] != now) return -1;
+		done[id] = 1;
+		count++;
+	}
+	return count;
+}
+
+
+// Step the clock one second at a time and check the expiry of all IDs.
+static int timerTestsuiteStep(struct s_timer *timer, const int start, const int end, const int *due, int *done) {
+	int count = 0;
+	int ret;
+	int now;
+	for(now=start; now<=end; now++) {
+		ret = timerTestsuiteCollect(timer, now, due, done);
+		if(ret < 0) return -1;
+		count = (count + ret);
+	}
+	return count;
+}
+
+
+static int timerTestsuiteRun(struct s_timer *timer) {
+	// offsets around the first level boundaries, timerTestsuite_START is 24 seconds before the next rotation of the first level
+	const int offset[timerTestsuite_COUNT] = { 0, 1, 23, 24, 25, 255, 256, 257, 279, 280, 300, 511, 512, 1000, 5000, 16000 };
+	int due[timerTestsuite_COUNT];
+	int done[timerTestsuite_COUNT];
+	int count;
+	int now;
+	int i;
+
+	// expiry at the exact second across the first and the second level
+	timerReset(timer, timerTestsuite_START);
+	for(i=0; i<timerTestsuite_COUNT; i++) {
+		due[i] = (timerTestsuite_START + offset[i]);
+		done[i] = 0;
+		timerSet(timer, i, due[i]);
+	}
+	if(timerTestsuiteStep(timer, timerTestsuite_START, (timerTestsuite_START + timer_RANGE), due, done) != timerTestsuite_COUNT) return 0;
+
+	// cancelled timers don't expire, an earlier due time replaces a later one but not the other way around
+	now = (timerTestsuite_START + timer_RANGE);
+	for(i=0; i<timerTestsuite_COUNT; i++) {
+		due[i] = (now + 10 + i);
+		done[i] = 0;
+		timerSet(timer, i, (now + 1000));
+		timerSetEarlier(timer, i, due[i]);
+		timerSetEarlier(timer, i, (now + 2000));
+	}
+	timerCancel(timer, 3);
+	timerCancel(timer, 7);
+	if(timerTestsuiteStep(timer, now, (now + 3000), due, done) != (timerTestsuite_COUNT - 2)) return 0;
+	if(done[3] || done[7]) return 0;
+
+	// a due time beyond the range of the wheel is clamped and expires early
+	now = (now + 3000);
+	due[0] = ((((now >> timer_L0_BITS) + (timer_L1_SIZE - 1))) << timer_L0_BITS);
+	done[0] = 0;
+	timerSet(timer, 0, (now + (4 * timer_RANGE)));
+	if(timer->entry[0].due != due[0]) return 0;
+	if(!(due[0] > (now + timer_RANGE - (2 * timer_L0_SIZE)))) return 0;
+	if(timerTestsuiteStep(timer, now, (now + timer_RANGE), due, done) != 1) return 0;
+
+	// a forward clock jump within the range expires the timers that are due, the other timers still expire on time
+	now = (now + timer_RANGE);
+	count = 0;
+	for(i=0; i<timerTestsuite_COUNT; i++) {
+		timerSet(timer, i, (now + offset[i] + 1));
+		if((offset[i] + 1) > timer_L0_SIZE) {
+			due[i] = (now + offset[i] + 1);
+		}
+		else {
+			due[i] = (now + timer_L0_SIZE);
+			count++;
+		}
+		done[i] = 0;
+	}
+	if(timerTestsuiteCollect(timer, (now + timer_L0_SIZE), due, done) != count) return 0;
+	if(timerTestsuiteStep(timer, (now + timer_L0_SIZE + 1), (now + timer_L0_SIZE + timer_RANGE), due, done) != (timerTestsuite_COUNT - count)) return 0;
+	now = (now + timer_L0_SIZE + timer_RANGE);
+
+	// a forward clock jump beyond the range expires all timers
+	for(i=0; i<timerTestsuite_COUNT; i++) {
+		timerSet(timer, i, (now + offset[i] + 1));
+		due[i] = (now + (2 * timer_RANGE));
+		done[i] = 0;
+	}
+	now = (now + (2 * timer_RANGE));
+	if(timerTestsuiteCollect(timer, now, due, done) != timerTestsuite_COUNT) return 0;
+
+	// a backward clock jump expires all timers
+	for(i=0; i<timerTestsuite_COUNT; i++) {
+		timerSet(timer, i, (now + offset[i] + 1));
+		due[i] = (now - 5000);
+		done[i] = 0;
+	}
+	now = (now - 5000);
+	if(timerTestsuiteCollect(timer, now, due, done) != timerTestsuite_COUNT) return 0;
+	if(timerGetNext(timer, (now + timer_RANGE)) != -1) return 0;
+
+	printf("success!\n");
+
+	return 1;
+}
+
+
+static int timerTestsuite() {
+	int ret = 0;
+	struct s_timer timer;
+	if(timerCreate(&timer, timerTestsuite_COUNT)) {
+		ret = timerTestsuiteRun(&timer);
+		timerDestroy(&timer);
+	}
+	return ret;
+}
+
+
+#endif // F_TIMER_TEST_C
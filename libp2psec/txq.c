@@ -0,0 +1,366 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_TXQ_C
+#define F_TXQ_C
+
+
+#include "idsp.c"
+#include <stdlib.h>
+
+
+// Deficit round robin settings. A queue of weight 1 may send QUANTUM bytes per round.
+#define txq_QUANTUM 1536
+#define txq_WEIGHT_MAX 64
+
+
+// The transmit queue entry structure.
+struct s_txq_entry {
+	int next;
+	int queue;
+	int peerct;
+	int type;
+	int options;
+	int len;
+};
+
+
+// The queue structure. Non-empty queues are linked into the active list, unless they are blocked.
+struct s_txq_queue {
+	int head;
+	int tail;
+	int count;
+	int nextactive;
+	int deficit;
+	int quantum;
+	int blocked;
+};
+
+
+// The transmit queue structure. Messages are stored in a shared pool of slots and kept in one FIFO queue per ID.
+// The queues are served by deficit round robin, so each queue gets a share of the bytes sent that follows its weight.
+struct s_txq {
+	struct s_idsp idsp;
+	struct s_txq_entry *entry;
+	struct s_txq_queue *queue;
+	unsigned char *slotbuf;
+	int slot_size;
+	int slot_count;
+	int queue_count;
+	int queue_max;
+	int activehead;
+	int activetail;
+	int pending;
+};
+
+
+// Append a queue to the active list.
+static void txqActivate(struct s_txq *txq, const int queue) {
+	txq->queue[queue].nextactive = -1;
+	if(txq->activetail < 0) {
+		txq->activehead = queue;
+	}
+	else {
+		txq->queue[txq->activetail].nextactive = queue;
+	}
+	txq->activetail = queue;
+}
+
+
+// Remove the first queue from the active list.
+static void txqDeactivate(struct s_txq *txq) {
+	const int queue = txq->activehead;
+	txq->activehead = txq->queue[queue].nextactive;
+	if(txq->activehead < 0) txq->activetail = -1;
+	txq->queue[queue].nextactive = -1;
+}
+
+
+// Remove a queue from the active list.
+static void txqRemoveActive(struct s_txq *txq, const int queue) {
+	int prev;
+	int i;
+	prev = -1;
+	i = txq->activehead;
+	while(!(i < 0)) {
+		if(i == queue) {
+			if(prev < 0) {
+				txq->activehead = txq->queue[i].nextactive;
+			}
+			else {
+				txq->queue[prev].nextactive = txq->queue[i].nextactive;
+			}
+			if(txq->activetail == i) txq->activetail = prev;
+			txq->queue[i].nextactive = -1;
+			break;
+		}
+		prev = i;
+		i = txq->queue[i].nextactive;
+	}
+}
+
+
+// Reset transmit queue.
+static void txqReset(struct s_txq *txq) {
+	int i;
+	idspReset(&txq->idsp);
+	for(i=0; i<txq->queue_count; i++) {
+		txq->queue[i].head = -1;
+		txq->queue[i].tail = -1;
+		txq->queue[i].count = 0;
+		txq->queue[i].nextactive = -1;
+		txq->queue[i].deficit = 0;
+		txq->queue[i].quantum = txq_QUANTUM;
+		txq->queue[i].blocked = 0;
+	}
+	txq->activehead = -1;
+	txq->activetail = -1;
+	txq->pending = 0;
+}
+
+
+// Add a message of len bytes to a queue. Returns a pointer to the message buffer that has to be filled by the caller, or NULL if the queue is full.
+static unsigned char *txqAdd(struct s_txq *txq, const int queue, const int peerct, const int type, const int options, const int len) {
+	struct s_txq_queue *q;
+	struct s_txq_entry *e;
+	int id;
+	if(!((queue >= 0) && (queue < txq->queue_count) && (len > 0) && (len <= txq->slot_size))) return NULL;
+	q = &txq->queue[queue];
+	if(!(q->count < txq->queue_max)) return NULL;
+	id = idspNew(&txq->idsp);
+	if(id < 0) return NULL;
+	e = &txq->entry[id];
+	e->next = -1;
+	e->queue = queue;
+	e->peerct = peerct;
+	e->type = type;
+	e->options = options;
+	e->len = len;
+	if(q->tail < 0) {
+		q->head = id;
+		if(!q->blocked) txqActivate(txq, queue);
+	}
+	else {
+		txq->entry[q->tail].next = id;
+	}
+	q->tail = id;
+	q->count++;
+	txq->pending++;
+	return &txq->slotbuf[(id * txq->slot_size)];
+}
+
+
+// Set the weight of a queue.
+static void txqSetWeight(struct s_txq *txq, const int queue, const int weight) {
+	int w = weight;
+	if(w < 1) w = 1;
+	if(w > txq_WEIGHT_MAX) w = txq_WEIGHT_MAX;
+	txq->queue[queue].quantum = (w * txq_QUANTUM);
+}
+
+
+// Remove the next message from the queues. The first active queue sends messages as long as its deficit covers them,
+// then it receives its quantum and moves to the end of the active list. Returns the entry ID, or -1 if all queues are empty.
+// The entry stays valid until it is released by txqRelease.
+static int txqGet(struct s_txq *txq) {
+	struct s_txq_queue *q;
+	int queue;
+	int id;
+	while(!((queue = txq->activehead) < 0)) {
+		q = &txq->queue[queue];
+		id = q->head;
+		if(q->deficit >= txq->entry[id].len) {
+			q->deficit = (q->deficit - txq->entry[id].len);
+			q->head = txq->entry[id].next;
+			q->count--;
+			txq->pending--;
+			if(q->head < 0) {
+				q->tail = -1;
+				q->deficit = 0;
+				txqDeactivate(txq);
+			}
+			return id;
+		}
+		q->deficit = (q->deficit + q->quantum);
+		txqDeactivate(txq);
+		txqActivate(txq, queue);
+	}
+	return -1;
+}
+
+
+// Release an entry returned by txqGet.
+static void txqRelease(struct s_txq *txq, const int id) {
+	idspDelete(&txq->idsp, id);
+}
+
+
+// Stop sending messages of a queue until it is unblocked.
+static void txqBlock(struct s_txq *txq, const int queue) {
+	if(txq->queue[queue].blocked) return;
+	txq->queue[queue].blocked = 1;
+	if(txq->queue[queue].count > 0) txqRemoveActive(txq, queue);
+}
+
+
+// Continue sending messages of a blocked queue.
+static void txqUnblock(struct s_txq *txq, const int queue) {
+	if(!txq->queue[queue].blocked) return;
+	txq->queue[queue].blocked = 0;
+	if(txq->queue[queue].count > 0) txqActivate(txq, queue);
+}
+
+
+// Drop all messages of a queue.
+static void txqFlush(struct s_txq *txq, const int queue) {
+	int i;
+	if(!((queue >= 0) && (queue < txq->queue_count) && (txq->queue[queue].count > 0))) return;
+	while(!(txq->queue[queue].head < 0)) {
+		i = txq->queue[queue].head;
+		txq->queue[queue].head = txq->entry[i].next;
+		idspDelete(&txq->idsp, i);
+		txq->pending--;
+	}
+	txq->queue[queue].tail = -1;
+	txq->queue[queue].count = 0;
+	txq->queue[queue].deficit = 0;
+	if(!txq->queue[queue].blocked) txqRemoveActive(txq, queue);
+}
+
+
+// Return number of messages in a queue.
+static int txqCount(struct s_txq *txq, const int queue) {
+	return txq->queue[queue].count;
+}
+
+
+// Return number of messages in all queues.
+static int txqPending(struct s_txq *txq) {
+	return txq->pending;
+}
+
+
+// Return 1 if a message can be sent, that is if a queue that is not blocked holds messages.
+static int txqIsReady(struct s_txq *txq) {
+	return (!(txq->activehead < 0));
+}
+
+
+// Return message buffer of an entry.
+static unsigned char *txqGetBuf(struct s_txq *txq, const int id) {
+	return &txq->slotbuf[(id * txq->slot_size)];
+}
+
+
+// Return message length of an entry.
+static int txqGetLen(struct s_txq *txq, const int id) {
+	return txq->entry[id].len;
+}
+
+
+// Return queue of an entry.
+static int txqGetQueue(struct s_txq *txq, const int id) {
+	return txq->entry[id].queue;
+}
+
+
+// Return PeerCT of an entry.
+static int txqGetPeerCT(struct s_txq *txq, const int id) {
+	return txq->entry[id].peerct;
+}
+
+
+// Return type of an entry.
+static int txqGetType(struct s_txq *txq, const int id) {
+	return txq->entry[id].type;
+}
+
+
+// Return options of an entry.
+static int txqGetOptions(struct s_txq *txq, const int id) {
+	return txq->entry[id].options;
+}
+
+
+// Create transmit queue with slot_count slots of slot_size bytes, shared by queue_count queues of up to queue_max messages.
+static int txqCreate(struct s_txq *txq, const int slot_size, const int slot_count, const int queue_count, const int queue_max) {
+	struct s_txq_entry *entry_mem;
+	struct s_txq_queue *queue_mem;
+	unsigned char *slotbuf_mem;
+	if((slot_size > 0) && (slot_count > 0) && (queue_count > 0) && (queue_max > 0)) {
+		entry_mem = malloc(sizeof(struct s_txq_entry) * slot_count);
+		if(entry_mem != NULL) {
+			queue_mem = malloc(sizeof(struct s_txq_queue) * queue_count);
+			if(queue_mem != NULL) {
+				slotbuf_mem = malloc(slot_size * slot_count);
+				if(slotbuf_mem != NULL) {
+					if(idspCreate(&txq->idsp, slot_count)) {
+						txq->entry = entry_mem;
+						txq->queue = queue_mem;
+						txq->slotbuf = slotbuf_mem;
+						txq->slot_size = slot_size;
+						txq->slot_count = slot_count;
+						txq->queue_count = queue_count;
+						txq->queue_max = queue_max;
+						txqReset(txq);
+						return 1;
+					}
+					free(slotbuf_mem);
+				}
+				free(queue_mem);
+			}
+			free(entry_mem);
+		}
+	}
+	return 0;
+}
+
+
+// Increase the number of queues. New queues are empty and have the default weight.
+static int txqResize(struct s_txq *txq, const int queue_count) {
+	struct s_txq_queue *queue_mem;
+	int i;
+	if(queue_count < txq->queue_count) return 0;
+	queue_mem = realloc(txq->queue, (sizeof(struct s_txq_queue) * queue_count));
+	if(queue_mem == NULL) return 0;
+	for(i=txq->queue_count; i<queue_count; i++) {
+		queue_mem[i].head = -1;
+		queue_mem[i].tail = -1;
+		queue_mem[i].count = 0;
+		queue_mem[i].nextactive = -1;
+		queue_mem[i].deficit = 0;
+		queue_mem[i].quantum = txq_QUANTUM;
+		queue_mem[i].blocked = 0;
+	}
+	txq->queue = queue_mem;
+	txq->queue_count = queue_count;
+	return 1;
+}
+
+
+// Destroy transmit queue.
+static void txqDestroy(struct s_txq *txq) {
+	idspDestroy(&txq->idsp);
+	free(txq->slotbuf);
+	free(txq->queue);
+	free(txq->entry);
+}
+
+
+#endif // F_TXQ_C
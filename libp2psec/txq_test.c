@@ -0,0 +1,205 @@
+/***************************************************************************
+ *   Copyright (C) 2016 by Tobias Volk                                     *
+ *   mail@tobiasvolk.de                                                    *
+ *                                                                         *
+ *   This program is free software: you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation, either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ ***************************************************************************/
+
+
+#ifndef F_TXQ_TEST_C
+#define F_TXQ_TEST_C
+
+
+#include "txq.c"
+#include <stdio.h>
+#include <string.h>
+
+
+#define txqTestsuite_SLOTSIZE 512
+#define txqTestsuite_SLOTCOUNT 256
+#define txqTestsuite_QUEUECOUNT 4
+#define txqTestsuite_QUEUEMAX 64
+
+
+// Check that the active list holds exactly the queues that have messages and are not blocked, each one once.
+static int txqTestsuiteCheckActive(struct s_txq *txq) {
+	int seen[txqTestsuite_QUEUECOUNT];
+	int queue;
+	int last = -1;
+	int n = 0;
+	int i;
+	memset(seen, 0, sizeof(seen));
+	queue = txq->activehead;
+	while(!(queue < 0)) {
+		if(!(n < txq->queue_count)) return 0; // loop in the list
+		if(seen[queue] || txq->queue[queue].blocked || (!(txq->queue[queue].count > 0))) return 0;
+		seen[queue] = 1;
+		last = queue;
+		queue = txq->queue[queue].nextactive;
+		n++;
+	}
+	if(txq->activetail != last) return 0;
+	for(i=0; i<txq->queue_count; i++) {
+		if((!seen[i]) && (!txq->queue[i].blocked) && (txq->queue[i].count > 0)) return 0;
+	}
+	return 1;
+}
+
+
+// Add a message to a queue. The first byte holds a message number.
+static int txqTestsuiteAdd(struct s_txq *txq, const int queue, const int num, const int len) {
+	unsigned char *buf = txqAdd(txq, queue, 0, 0, 0, len);
+	if(buf == NULL) return 0;
+	memset(buf, 0, len);
+	buf[0] = num;
+	return 1;
+}
+
+
+// Messages of a queue leave in the order they were added.
+static int txqTestsuiteFIFO(struct s_txq *txq) {
+	int next[txqTestsuite_QUEUECOUNT];
+	int i, id, queue;
+	memset(next, 0, sizeof(next));
+	for(i=0; i<20; i++) {
+		if(!txqTestsuiteAdd(txq, ((i % 2) + 1), (i / 2), (64 + i))) return 0;
+	}
+	if(txqPending(txq) != 20) return 0;
+	while(!((id = txqGet(txq)) < 0)) {
+		queue = txqGetQueue(txq, id);
+		if(txqGetBuf(txq, id)[0] != next[queue]) return 0;
+		if(txqGetLen(txq, id) != (64 + (next[queue] * 2) + (queue - 1))) return 0;
+		next[queue]++;
+		txqRelease(txq, id);
+	}
+	if((next[1] != 10) || (next[2] != 10) || (txqPending(txq) != 0) || txqIsReady(txq)) return 0;
+	return txqTestsuiteCheckActive(txq);
+}
+
+
+// The queues get shares of the sent bytes that follow their weights.
+static int txqTestsuiteDRR(struct s_txq *txq) {
+	int sent[txqTestsuite_QUEUECOUNT];
+	int i, id;
+	memset(sent, 0, sizeof(sent));
+	txqSetWeight(txq, 1, 1);
+	txqSetWeight(txq, 2, 3);
+	for(i=0; i<60; i++) {
+		if(!txqTestsuiteAdd(txq, 1, i, txqTestsuite_SLOTSIZE)) return 0;
+		if(!txqTestsuiteAdd(txq, 2, i, txqTestsuite_SLOTSIZE)) return 0;
+	}
+	for(i=0; i<48; i++) {
+		if((id = txqGet(txq)) < 0) return 0;
+		sent[txqGetQueue(txq, id)]++;
+		txqRelease(txq, id);
+	}
+	if((sent[1] != 12) || (sent[2] != 36)) return 0;
+	txqFlush(txq, 1);
+	txqFlush(txq, 2);
+	txqSetWeight(txq, 1, 1);
+	txqSetWeight(txq, 2, 1);
+	if((txqPending(txq) != 0) || txqIsReady(txq)) return 0;
+	return txqTestsuiteCheckActive(txq);
+}
+
+
+// Flushing queues at the head, in the middle and at the tail of the active list keeps the list consistent.
+static int txqTestsuiteFlush(struct s_txq *txq) {
+	int next[txqTestsuite_QUEUECOUNT];
+	int i, id, queue;
+	for(i=0; i<txqTestsuite_QUEUECOUNT; i++) {
+		if(!txqTestsuiteAdd(txq, i, 0, 64)) return 0;
+		if(!txqTestsuiteAdd(txq, i, 1, 64)) return 0;
+	}
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqFlush(txq, 2); // middle of the list
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqFlush(txq, 0); // head of the list
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqFlush(txq, 3); // tail of the list
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqFlush(txq, 2); // empty queue
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	if(!txqTestsuiteAdd(txq, 3, 2, 64)) return 0; // a flushed queue becomes active again
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	next[1] = 0;
+	next[3] = 2;
+	for(i=0; i<3; i++) {
+		if((id = txqGet(txq)) < 0) return 0;
+		queue = txqGetQueue(txq, id);
+		if(!((queue == 1) || (queue == 3))) return 0;
+		if(txqGetBuf(txq, id)[0] != next[queue]) return 0;
+		next[queue]++;
+		txqRelease(txq, id);
+		if(!txqTestsuiteCheckActive(txq)) return 0;
+	}
+	if((txqPending(txq) != 0) || (txqGet(txq) >= 0) || (idspUsedCount(&txq->idsp) != 0)) return 0;
+	return 1;
+}
+
+
+// Blocking, unblocking and flushing queues keeps the active list consistent.
+static int txqTestsuiteBlock(struct s_txq *txq) {
+	int i, id;
+	for(i=0; i<txqTestsuite_QUEUECOUNT; i++) {
+		if(!txqTestsuiteAdd(txq, i, 0, 64)) return 0;
+		if(!txqTestsuiteAdd(txq, i, 1, 64)) return 0;
+	}
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqBlock(txq, 2); // middle of the list
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqFlush(txq, 1); // active queue
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqFlush(txq, 2); // blocked queue
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqUnblock(txq, 2); // empty queue must not become active
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqBlock(txq, 3); // tail of the list
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	if(!txqTestsuiteAdd(txq, 3, 2, 64)) return 0; // add to blocked queue
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqBlock(txq, 0); // head of the list, no queue is active anymore
+	if(!txqTestsuiteCheckActive(txq) || txqIsReady(txq)) return 0;
+	if(txqGet(txq) >= 0) return 0;
+	txqUnblock(txq, 3);
+	txqUnblock(txq, 0);
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	txqFlush(txq, 3);
+	if(!txqTestsuiteCheckActive(txq)) return 0;
+	for(i=0; i<2; i++) {
+		if((id = txqGet(txq)) < 0) return 0;
+		if((txqGetQueue(txq, id) != 0) || (txqGetBuf(txq, id)[0] != i)) return 0;
+		txqRelease(txq, id);
+		if(!txqTestsuiteCheckActive(txq)) return 0;
+	}
+	if((txqPending(txq) != 0) || txqIsReady(txq) || (idspUsedCount(&txq->idsp) != 0)) return 0;
+	return 1;
+}
+
+
+static int txqTestsuite() {
+	int ret = 0;
+	struct s_txq txq;
+	if(txqCreate(&txq, txqTestsuite_SLOTSIZE, txqTestsuite_SLOTCOUNT, txqTestsuite_QUEUECOUNT, txqTestsuite_QUEUEMAX)) {
+		if(txqTestsuiteFIFO(&txq) && txqTestsuiteDRR(&txq) && txqTestsuiteFlush(&txq) && txqTestsuiteBlock(&txq)) {
+			printf("success!\n");
+			ret = 1;
+		}
+		txqDestroy(&txq);
+	}
+	return ret;
+}
+
+
+#endif // F_TXQ_TEST_C
@@ -34,6 +34,29 @@ static char util4BitToHexchar(const int n) {
 }
 
 
+// Convert a hexchar to a 4 bit number. Returns -1 if the character is not a hexchar.
+static int utilHexcharTo4Bit(const char c) {
+	if((c >= '0') && (c <= '9')) return (c - '0');
+	if((c >= 'A') && (c <= 'F')) return (c - 'A' + 10);
+	if((c >= 'a') && (c <= 'f')) return (c - 'a' + 10);
+	return -1;
+}
+
+
+// Convert a hexstring of exactly arrlen*2 hexchars to a byte array.
+static int utilHexstringToByteArray(unsigned char *arr, const int arrlen, const char *str, const int strlen) {
+	int l, r, i;
+	if(strlen != (arrlen * 2)) return 0;
+	for(i=0; i<arrlen; i++) {
+		l = utilHexcharTo4Bit(str[(i * 2)]);
+		r = utilHexcharTo4Bit(str[((i * 2) + 1)]);
+		if((l < 0) || (r < 0)) return 0;
+		arr[i] = ((l << 4) | r);
+	}
+	return 1;
+}
+
+
 // Convert a byte array to a hexstring.
 static int utilByteArrayToHexstring(char *str, const int strlen, const unsigned char *arr, const int arrlen) {
 	int l, r, p, i;
@@ -185,4 +208,12 @@ static int utilGetClock() {
 }
 
 
+// Get monotonic clock value in microseconds
+static int64_t utilGetClockUS() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000));
+}
+
+
 #endif // F_UTIL_C
@@ -17,6 +17,7 @@
  ***************************************************************************/
 
 
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <openssl/engine.h>
@@ -57,12 +58,24 @@ int main(int argc, char **argv) {
 	strcpy(config.chrootstr,"");
 	strcpy(config.networkname,"PEERVPN");
 	strcpy(config.initpeers,"");
+	strcpy(config.peerweights,"");
+	strcpy(config.peerratelimits,"");
 	strcpy(config.engines,"");
+	strcpy(config.keyfile,"");
 	config.password_len = 0;
 	config.enableeth = 1;
 	config.enablendpcache = 0;
 	config.enablevirtserv = 0;
 	config.enablerelay = 0;
+	config.enablefasthandshake = 0;
+	config.enableintegrityonly = 0;
+	config.enablecompression = 0;
+	config.enablefec = 0;
+	config.enablebroadcasttree = 0;
+	config.enableadaptiveratelimit = 0;
+	config.enablefastfailover = 0;
+	config.enablebonding = 0;
+	config.enablepmtudiscovery = 0;
 	config.enableindirect = 0;
 	config.enableconsole = 0;
 	config.enableseccomp = 0;
@@ -72,6 +85,11 @@ int main(int argc, char **argv) {
 	config.enableipv6 = 1;
 	config.enablenat64clat = 0;
 	config.sockmark = 0;
+	config.resumewindow = 600;
+	config.aggregationdelay = 0;
+	config.ratelimit = 0;
+	config.replaywindow = 1024;
+	config.maxpeers = 256;
 
 	setbuf(stdout,NULL);
 	printf("PeerVPN v%d.%03d\n", PEERVPN_VERSION_MAJOR, PEERVPN_VERSION_MINOR);
@@ -118,7 +118,9 @@ struct s_io_state {
 	int max;
 	int count;
 	int timeout;
+	int nexttimeout_us;
 	int sockmark;
+	int pmtudisc;
 	int nat64clat;
 	unsigned char nat64_prefix[12];
 	int debug;
@@ -318,11 +320,35 @@ static int ioOpenSocket(struct s_io_state *iostate, const int iotype, const char
 #endif
 	}
 
+	if(iostate->pmtudisc > 0) {
+		// set the don't fragment bit and ignore the kernel's path MTU cache, path MTU discovery is done by the application
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+		so = IP_PMTUDISC_PROBE;
+		if(domain == AF_INET) setsockopt(fd, IPPROTO_IP, IP_MTU_DISCOVER, (void *)&so, sizeof(int));
+#elif defined(IP_DONTFRAG)
+		so = 1;
+		if(domain == AF_INET) setsockopt(fd, IPPROTO_IP, IP_DONTFRAG, (void *)&so, sizeof(int));
+#endif
+#if defined(AF_INET6) && defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_PROBE)
+		so = IPV6_PMTUDISC_PROBE;
+		if(domain == AF_INET6) setsockopt(fd, IPPROTO_IPV6, IPV6_MTU_DISCOVER, (void *)&so, sizeof(int));
+#elif defined(AF_INET6) && defined(IPV6_DONTFRAG)
+		so = 1;
+		if(domain == AF_INET6) setsockopt(fd, IPPROTO_IPV6, IPV6_DONTFRAG, (void *)&so, sizeof(int));
+#endif
+	}
+
 #elif defined(IO_WINDOWS)
 
 	if((fd = WSASocket(domain, type, 0, 0, 0, WSA_FLAG_OVERLAPPED)) < 0) {
 		return -1;
 	}
+#if defined(IP_DONTFRAGMENT)
+	if(iostate->pmtudisc > 0) {
+		so = 1;
+		if(domain == AF_INET) setsockopt(fd, IPPROTO_IP, IP_DONTFRAGMENT, (void *)&so, sizeof(int));
+	}
+#endif
 
 #else
 
@@ -1086,8 +1112,15 @@ static int ioReadAll(struct s_io_state *iostate) {
 	struct timeval seltimeout;
 	int fd, fdh;
 
-	seltimeout.tv_sec = iostate->timeout;
-	seltimeout.tv_usec = 0;
+	if(iostate->nexttimeout_us < 0) {
+		seltimeout.tv_sec = iostate->timeout;
+		seltimeout.tv_usec = 0;
+	}
+	else {
+		seltimeout.tv_sec = (iostate->nexttimeout_us / 1000000);
+		seltimeout.tv_usec = (iostate->nexttimeout_us % 1000000);
+		iostate->nexttimeout_us = -1;
+	}
 
 	fdh = 0;
 	FD_ZERO(&fdset);
@@ -1121,6 +1154,15 @@ static int ioReadAll(struct s_io_state *iostate) {
 
 	HANDLE events[iostate->max];
 	int fdc;
+	int timeout_ms;
+
+	if(iostate->nexttimeout_us < 0) {
+		timeout_ms = (iostate->timeout * 1000);
+	}
+	else {
+		timeout_ms = ((iostate->nexttimeout_us + 999) / 1000);
+		iostate->nexttimeout_us = -1;
+	}
 
 	fdc = 0;
 	for(i=0; i<iostate->max; i++) {
@@ -1135,7 +1177,7 @@ static int ioReadAll(struct s_io_state *iostate) {
 
 	ret = 0;
 	if(fdc > 0) {
-		WaitForMultipleObjects(fdc, events, FALSE, (iostate->timeout * 1000));
+		WaitForMultipleObjects(fdc, events, FALSE, timeout_ms);
 		for(i=0; i<iostate->max; i++) {
 			if(ioRead(iostate, i) > 0) {
 				ret++;
@@ -1143,7 +1185,7 @@ static int ioReadAll(struct s_io_state *iostate) {
 		}
 	}
 	else {
-		Sleep(iostate->timeout * 1000);
+		Sleep(timeout_ms);
 	}
 
 #else
@@ -1328,6 +1370,17 @@ static void ioSetSockmark(struct s_io_state *iostate, const int io_sockmark) {
 }
 
 
+// Enable/Disable the don't fragment bit for new sockets.
+static void ioSetPMTUDiscovery(struct s_io_state *iostate, const int enable) {
+	if(enable > 0) {
+		iostate->pmtudisc = 1;
+	}
+	else {
+		iostate->pmtudisc = 0;
+	}
+}
+
+
 // Enable/Disable NAT64 CLAT support.
 static void ioSetNat64Clat(struct s_io_state *iostate, const int enable) {
 	if(enable > 0) {
@@ -1350,6 +1403,17 @@ static void ioSetTimeout(struct s_io_state *iostate, const int io_timeout) {
 }
 
 
+// Set IO read timeout for the next read only (in microseconds).
+static void ioSetNextTimeoutUS(struct s_io_state *iostate, const int io_timeout_us) {
+	if(io_timeout_us > 0) {
+		iostate->nexttimeout_us = io_timeout_us;
+	}
+	else {
+		iostate->nexttimeout_us = 0;
+	}
+}
+
+
 // Closes all handles and resets defaults.
 static void ioReset(struct s_io_state *iostate) {
 	int i;
@@ -1358,7 +1422,9 @@ static void ioReset(struct s_io_state *iostate) {
 		ioResetID(iostate, i);
 	}
 	iostate->timeout = 1;
+	iostate->nexttimeout_us = -1;
 	iostate->sockmark = 0;
+	iostate->pmtudisc = 0;
 	iostate->nat64clat = 0;
 	memcpy(iostate->nat64_prefix, "\x00\x64\xff\x9b\x00\x00\x00\x00\x00\x00\x00\x00", 12);
 	iostate->debug = 0;